@@ -14,6 +14,7 @@
 #include "apps.h"
 #include "string.h"
 #include "util.h"
+#include "perf.h"
 
 // BigBuf is the large multi-purpose buffer, typically used to hold A/D samples or traces.
 // Also used to hold various smaller buffers and the Mifare Emulator Memory.
@@ -88,6 +89,7 @@ uint8_t *BigBuf_malloc(uint16_t chunksize)
 	} else {
 		chunksize = (chunksize + 3) & 0xfffc;	// round to next multiple of 4
 		BigBuf_hi -= chunksize; 		  		// aligned to 4 Byte boundary 
+		PERF_HIGH_WATER(PERF_HW_BIGBUF_ALLOC, BIGBUF_SIZE - BigBuf_hi);
 		return (uint8_t *)BigBuf + BigBuf_hi;
 	}
 }
@@ -160,6 +162,7 @@ bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_
 {
 	if (!tracing) return false;
 
+	PERF_START(perf_start);
 	uint8_t *trace = BigBuf_get_addr();
 
 	uint16_t num_paritybytes = (iLen-1)/8 + 1;	// number of valid paritybytes in *parity
@@ -170,6 +173,7 @@ bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_
 
 	if (traceLen + sizeof(iLen) + sizeof(timestamp_start) + sizeof(duration) + num_paritybytes + iLen >= max_traceLen) {
 		tracing = false;	// don't trace any more
+		PERF_COUNT(PERF_TRACE_FULL);
 		return false;
 	}
 	// Traceformat:
@@ -214,6 +218,12 @@ bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_
 	}
 	traceLen += num_paritybytes;
 
+#ifdef WITH_PERF
+	perf_stats.trace_size = max_traceLen;
+#endif
+	PERF_HIGH_WATER(PERF_HW_TRACE_LEN, traceLen);
+	PERF_COUNT(PERF_FRAMES_LOGGED);
+	PERF_STOP(PERF_SEC_LOG_TRACE, perf_start);
 	return true;
 }
 
@@ -29,6 +29,7 @@
 #include "mifareutil.h"
 #include "pcf7931.h"
 #include "i2c.h"
+#include "perf.h"
 #ifdef WITH_LCD
  #include "LCD.h"
 #endif
@@ -972,8 +973,11 @@ void UsbPacketReceived(uint8_t *packet, int len)
 	UsbCommand *c = (UsbCommand *)packet;
 
 //  Dbprintf("received %d bytes, with command: 0x%04x and args: %d %d %d",len,c->cmd,c->arg[0],c->arg[1],c->arg[2]);
-  
-	switch(c->cmd) {
+
+	// answer with the tag of the request
+	cmd_set_tag(c->cmd >> USB_CMD_TAG_SHIFT);
+
+	switch(c->cmd & USB_CMD_CMD_MASK) {
 #ifdef WITH_LF
 		case CMD_SET_LF_SAMPLING_CONFIG:
 			setSamplingConfig((sample_config *) c->d.asBytes);
@@ -1206,6 +1210,12 @@ void UsbPacketReceived(uint8_t *packet, int len)
 		case CMD_MIFARE_WRITEBL:
 			MifareWriteBlock(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
 			break;
+		case CMD_MIFARE_READSC_BLOCKS:
+			MifareReadSectorBlocks(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
+			break;
+		case CMD_MIFARE_WRITESC_BLOCKS:
+			MifareWriteSectorBlocks(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
+			break;
 		//case CMD_MIFAREU_WRITEBL_COMPAT:
 			//MifareUWriteBlockCompat(c->arg[0], c->d.asBytes);
 			//break;
@@ -1221,6 +1231,12 @@ void UsbPacketReceived(uint8_t *packet, int len)
 		case CMD_MIFARE_CHKKEYS:
 			MifareChkKeys(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
 			break;
+		case CMD_MIFARE_CHKKEYS_DICT:
+			MifareChkKeysDict(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
+			break;
+		case CMD_MIFARE_CHKKEYS_FAST:
+			MifareChkKeysFast(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
+			break;
 		case CMD_SIMULATE_MIFARE_CARD:
 			Mifare1ksim(c->arg[0], c->arg[1], c->arg[2], c->d.asBytes);
 			break;
@@ -1405,7 +1421,10 @@ void UsbPacketReceived(uint8_t *packet, int len)
 			SendStatus();
 			break;
 		case CMD_PING:
-			cmd_send(CMD_ACK,0,0,0,0,0);
+			cmd_send(CMD_ACK,USB_CMD_CAP_TAG | USB_CMD_CAP_MF_SECTOR,0,0,0,0);
+			break;
+		case CMD_PERF_STATS:
+			PerfSendStats(c->arg[0] & 1);
 			break;
 #ifdef WITH_LCD
 		case CMD_LCD_RESET:
@@ -1443,9 +1462,11 @@ void UsbPacketReceived(uint8_t *packet, int len)
 			break;
 		}
 		default:
-			Dbprintf("%s: 0x%04x","unknown command:",c->cmd);
+			Dbprintf("%s: 0x%04x","unknown command:",(uint32_t)c->cmd);
 			break;
 	}
+
+	cmd_set_tag(0);
 }
 
 void  __attribute__((noreturn)) AppMain(void)
@@ -1487,6 +1508,9 @@ void  __attribute__((noreturn)) AppMain(void)
 	FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
 
 	StartTickCount();
+#ifdef WITH_PERF
+	PerfInit();
+#endif
   	
 #ifdef WITH_LCD
 	LCDInit();
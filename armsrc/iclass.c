@@ -51,6 +51,7 @@
 #include "protocols.h"
 #include "optimized_cipher.h"
 #include "usb_cdc.h" // for usb_poll_validate_length
+#include "perf.h"
 
 static int timeout = 4096;
 
@@ -151,6 +152,7 @@ static RAMFUNC int OutOfNDecoding(int bit)
 					// When not part of SOF or EOF, it is an error
 					Uart.state = STATE_UNSYNCD;
 					Uart.highCnt = 0;
+					PERF_COUNT(PERF_ICLASS_READER_DECODE_ERRORS);
 					//error = 4;
 				}
 			}
@@ -169,6 +171,7 @@ static RAMFUNC int OutOfNDecoding(int bit)
 						//error = 7;
 					}
 					// It is an error if we already have seen a drop in current frame
+					PERF_COUNT(PERF_ICLASS_READER_DECODE_ERRORS);
 					Uart.state = STATE_UNSYNCD;
 					Uart.highCnt = 0;
 				}
@@ -206,6 +209,7 @@ static RAMFUNC int OutOfNDecoding(int bit)
 					if(!Uart.dropPosition) {
 						Uart.state = STATE_UNSYNCD;
 						Uart.highCnt = 0;
+						PERF_COUNT(PERF_ICLASS_READER_DECODE_ERRORS);
 						//error = 9;
 					}
 					else {
@@ -235,6 +239,7 @@ static RAMFUNC int OutOfNDecoding(int bit)
 				if(!Uart.dropPosition) {
 					Uart.state = STATE_UNSYNCD;
 					Uart.highCnt = 0;
+					PERF_COUNT(PERF_ICLASS_READER_DECODE_ERRORS);
 					//error = 3;
 				}
 				else {
@@ -595,6 +600,7 @@ static RAMFUNC int ManchesterDecoding(int v)
 			}
 
 			if(error) {
+				PERF_COUNT(PERF_ICLASS_TAG_DECODE_ERRORS);
 				Demod.output[Demod.len] = 0xBB;
 				Demod.len++;
 				Demod.output[Demod.len] = error & 0xFF;
@@ -702,6 +708,8 @@ void RAMFUNC SnoopIClass(void)
     int decbyte = 0;
     int decbyter = 0;
 
+    PERF_START(perf_sniff);
+
     // And now we loop, receiving samples.
     for(;;) {
         LED_A_ON();
@@ -710,8 +718,10 @@ void RAMFUNC SnoopIClass(void)
                                 (DMA_BUFFER_SIZE-1);
         if(behindBy > maxBehindBy) {
             maxBehindBy = behindBy;
+            PERF_HIGH_WATER(PERF_HW_DMA_BACKLOG, behindBy);
             if(behindBy > (9 * DMA_BUFFER_SIZE / 10)) {
                 Dbprintf("blew circular buffer! behindBy=0x%x", behindBy);
+                PERF_COUNT(PERF_DMA_ABORTS);
                 goto done;
             }
         }
@@ -744,7 +754,10 @@ void RAMFUNC SnoopIClass(void)
 	
 	if((div + 1) % 2 == 0) {
 		smpl = decbyter;	
-		if(OutOfNDecoding((smpl & 0xF0) >> 4)) {
+		PERF_START(perf_reader);
+		int reader_frame = OutOfNDecoding((smpl & 0xF0) >> 4);
+		PERF_STOP(PERF_SEC_ICLASS_READER_DECODE, perf_reader);
+		if(reader_frame) {
 		    rsamples = samples - Uart.samples;
 			time_stop = (GetCountSspClk()-time_0) << 4;
 		    LED_C_ON();
@@ -773,7 +786,10 @@ void RAMFUNC SnoopIClass(void)
 
 	if(div > 3) {
 		smpl = decbyte;
-		if(ManchesterDecoding(smpl & 0x0F)) {
+		PERF_START(perf_tag);
+		int tag_frame = ManchesterDecoding(smpl & 0x0F);
+		PERF_STOP(PERF_SEC_ICLASS_TAG_DECODE, perf_tag);
+		if(tag_frame) {
 			time_stop = (GetCountSspClk()-time_0) << 4;
 
 			rsamples = samples - Demod.samples;
@@ -811,6 +827,7 @@ void RAMFUNC SnoopIClass(void)
 	Dbprintf("%x %x %x", Uart.byteCntMax, BigBuf_get_traceLen(), (int)Uart.output[0]);
 
 done:
+    PERF_STOP(PERF_SEC_ICLASS_SNIFF, perf_sniff);
     AT91C_BASE_PDC_SSC->PDC_PTCR = AT91C_PDC_RXTDIS;
     Dbprintf("%x %x %x", maxBehindBy, Uart.state, Uart.byteCnt);
 	Dbprintf("%x %x %x", Uart.byteCntMax, BigBuf_get_traceLen(), (int)Uart.output[0]);
@@ -25,6 +25,7 @@
 #include "BigBuf.h"
 #include "protocols.h"
 #include "parity.h"
+#include "perf.h"
 
 typedef struct {
 	enum {
@@ -262,12 +263,46 @@ static tUart Uart;
 // 0011  -   a 2 tick wide pause, or a three tick wide pause shifted left
 // 0111  -   a 2 tick wide pause shifted left
 // 1001  -   a 2 tick wide pause shifted right
-const bool Mod_Miller_LUT[] = {
-	false,  true, false, true,  false, false, false, true,
-	false,  true, false, false, false, false, false, false
+// The table is indexed with 8 raw bits (one Miller sequence) and returns the
+// Modulation_t of both halves at once.
+static const uint8_t Mod_Miller_LUT[256] = {
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	2, 3, 2, 3, 2, 2, 2, 3, 2, 3, 2, 2, 2, 2, 2, 2,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	2, 3, 2, 3, 2, 2, 2, 3, 2, 3, 2, 2, 2, 2, 2, 2,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	2, 3, 2, 3, 2, 2, 2, 3, 2, 3, 2, 2, 2, 2, 2, 2,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	2, 3, 2, 3, 2, 2, 2, 3, 2, 3, 2, 2, 2, 2, 2, 2,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0
+};
+
+// Number of leading "1"s of a byte, used to locate the start bit
+static const uint8_t Miller_LeadingOnes_LUT[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 7, 8
 };
-#define IsMillerModulationNibble1(b) (Mod_Miller_LUT[(b & 0x000000F0) >> 4])
-#define IsMillerModulationNibble2(b) (Mod_Miller_LUT[(b & 0x0000000F)])
 
 static void UartReset()
 {
@@ -304,14 +339,14 @@ static RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time)
 		// (12 '1's followed by 2 '0's, eventually followed by another '0', followed by 5 '1's)
 		#define ISO14443A_STARTBIT_MASK		0x07FFEF80							// mask is    00000111 11111111 11101111 10000000
 		#define ISO14443A_STARTBIT_PATTERN	0x07FF8F80							// pattern is 00000111 11111111 10001111 10000000
-		if		((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 0)) == ISO14443A_STARTBIT_PATTERN >> 0) Uart.syncBit = 7;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 1)) == ISO14443A_STARTBIT_PATTERN >> 1) Uart.syncBit = 6;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 2)) == ISO14443A_STARTBIT_PATTERN >> 2) Uart.syncBit = 5;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 3)) == ISO14443A_STARTBIT_PATTERN >> 3) Uart.syncBit = 4;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 4)) == ISO14443A_STARTBIT_PATTERN >> 4) Uart.syncBit = 3;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 5)) == ISO14443A_STARTBIT_PATTERN >> 5) Uart.syncBit = 2;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 6)) == ISO14443A_STARTBIT_PATTERN >> 6) Uart.syncBit = 1;
-		else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 7)) == ISO14443A_STARTBIT_PATTERN >> 7) Uart.syncBit = 0;
+		// Bits 19..15 are "1" at all 8 possible positions of the pattern. The pattern can match at one
+		// position only: the one where the run of "1"s starting at bit 15 ends.
+		if ((Uart.fourBits & 0x000F8000) == 0x000F8000) {
+			uint8_t ones = Miller_LeadingOnes_LUT[(Uart.fourBits >> 8) & 0xff];
+			if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> (ones - 1))) == ISO14443A_STARTBIT_PATTERN >> (ones - 1)) {
+				Uart.syncBit = 8 - ones;
+			}
+		}
 
 		if (Uart.syncBit != 9999) {												// found a sync bit
 			Uart.startTime = non_real_time?non_real_time:(GetCountSspClk() & 0xfffffff8);
@@ -322,48 +357,29 @@ static RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time)
 
 	} else {
 
-		if (IsMillerModulationNibble1(Uart.fourBits >> Uart.syncBit)) {			
-			if (IsMillerModulationNibble2(Uart.fourBits >> Uart.syncBit)) {		// Modulation in both halves - error
+		switch (Mod_Miller_LUT[(Uart.fourBits >> Uart.syncBit) & 0xff]) {
+			case MOD_BOTH_HALVES:												// Modulation in both halves - error
+				PERF_COUNT(PERF_14A_READER_DECODE_ERRORS);
 				UartReset();
-			} else {															// Modulation in first half = Sequence Z = logic "0"
+				return false;
+			case MOD_FIRST_HALF:												// Modulation in first half = Sequence Z = logic "0"
 				if (Uart.state == STATE_MILLER_X) {								// error - must not follow after X
+					PERF_COUNT(PERF_14A_READER_DECODE_ERRORS);
 					UartReset();
-				} else {
-					Uart.bitCount++;
-					Uart.shiftReg = (Uart.shiftReg >> 1);						// add a 0 to the shiftreg
-					Uart.state = STATE_MILLER_Z;
-					Uart.endTime = Uart.startTime + 8*(9*Uart.len + Uart.bitCount + 1) - 6;
-					if(Uart.bitCount >= 9) {									// if we decoded a full byte (including parity)
-						Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
-						Uart.parityBits <<= 1;									// make room for the parity bit
-						Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01);		// store parity bit
-						Uart.bitCount = 0;
-						Uart.shiftReg = 0;
-						if((Uart.len&0x0007) == 0) {							// every 8 data bytes
-							Uart.parity[Uart.parityLen++] = Uart.parityBits;	// store 8 parity bits
-							Uart.parityBits = 0;
-						}
-					}
+					return false;
 				}
-			}
-		} else {
-			if (IsMillerModulationNibble2(Uart.fourBits >> Uart.syncBit)) {		// Modulation second half = Sequence X = logic "1"
+				Uart.bitCount++;
+				Uart.shiftReg = (Uart.shiftReg >> 1);							// add a 0 to the shiftreg
+				Uart.state = STATE_MILLER_Z;
+				Uart.endTime = Uart.startTime + 8*(9*Uart.len + Uart.bitCount + 1) - 6;
+				break;
+			case MOD_SECOND_HALF:												// Modulation second half = Sequence X = logic "1"
 				Uart.bitCount++;
 				Uart.shiftReg = (Uart.shiftReg >> 1) | 0x100;					// add a 1 to the shiftreg
 				Uart.state = STATE_MILLER_X;
 				Uart.endTime = Uart.startTime + 8*(9*Uart.len + Uart.bitCount + 1) - 2;
-				if(Uart.bitCount >= 9) {										// if we decoded a full byte (including parity)
-					Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
-					Uart.parityBits <<= 1;										// make room for the new parity bit
-					Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01); 			// store parity bit
-					Uart.bitCount = 0;
-					Uart.shiftReg = 0;
-					if ((Uart.len&0x0007) == 0) {								// every 8 data bytes
-						Uart.parity[Uart.parityLen++] = Uart.parityBits;		// store 8 parity bits
-						Uart.parityBits = 0;
-					}
-				}
-			} else {															// no modulation in both halves - Sequence Y
+				break;
+			default:															// no modulation in both halves - Sequence Y
 				if (Uart.state == STATE_MILLER_Z || Uart.state == STATE_MILLER_Y) {	// Y after logic "0" - End of Communication
 					Uart.state = STATE_UNSYNCD;
 					Uart.bitCount--;											// last "0" was part of EOC sequence
@@ -386,27 +402,28 @@ static RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time)
 					}
 				}
 				if (Uart.state == STATE_START_OF_COMMUNICATION) {				// error - must not follow directly after SOC
+					PERF_COUNT(PERF_14A_READER_DECODE_ERRORS);
 					UartReset();
-				} else {														// a logic "0"
-					Uart.bitCount++;
-					Uart.shiftReg = (Uart.shiftReg >> 1);						// add a 0 to the shiftreg
-					Uart.state = STATE_MILLER_Y;
-					if(Uart.bitCount >= 9) {									// if we decoded a full byte (including parity)
-						Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
-						Uart.parityBits <<= 1;									// make room for the parity bit
-						Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01); 		// store parity bit
-						Uart.bitCount = 0;
-						Uart.shiftReg = 0;
-						if ((Uart.len&0x0007) == 0) {							// every 8 data bytes
-							Uart.parity[Uart.parityLen++] = Uart.parityBits;	// store 8 parity bits
-							Uart.parityBits = 0;
-						}
-					}
+					return false;
 				}
+				Uart.bitCount++;												// a logic "0"
+				Uart.shiftReg = (Uart.shiftReg >> 1);							// add a 0 to the shiftreg
+				Uart.state = STATE_MILLER_Y;
+				break;
+		}
+
+		if(Uart.bitCount >= 9) {												// if we decoded a full byte (including parity)
+			Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
+			Uart.parityBits <<= 1;												// make room for the parity bit
+			Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01);					// store parity bit
+			Uart.bitCount = 0;
+			Uart.shiftReg = 0;
+			if((Uart.len&0x0007) == 0) {										// every 8 data bytes
+				Uart.parity[Uart.parityLen++] = Uart.parityBits;				// store 8 parity bits
+				Uart.parityBits = 0;
 			}
 		}
-			
-	} 
+	}
 
     return false;	// not finished yet, need more data
 }
@@ -432,13 +449,85 @@ static tDemod Demod;
 
 // Lookup-Table to decide if 4 raw bits are a modulation.
 // We accept three or four "1" in any position
-const bool Mod_Manchester_LUT[] = {
-	false, false, false, false, false, false, false, true,
-	false, false, false, true,  false, true,  true,  true
+// The table is indexed with 8 raw bits (one Manchester sequence) and returns the
+// Modulation_t of both halves at once.
+static const uint8_t Mod_Manchester_LUT[256] = {
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 3, 2, 3, 3, 3,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 3, 2, 3, 3, 3,
+	0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 3, 2, 3, 3, 3,
+	2, 2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 3, 2, 3, 3, 3,
+	2, 2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 3, 2, 3, 3, 3
+};
+
+// Start bit search: bit (7-n) of Manchester_Sync_Hi_LUT[twoBits >> 8] & Manchester_Sync_Lo_LUT[twoBits & 0xff]
+// is set if (twoBits & (0x7700 >> n)) == (0x7000 >> n). The highest set bit is the sync bit.
+static const uint8_t Manchester_Sync_Hi_LUT[256] = {
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x21, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x41, 0x03, 0x01, 0x07, 0x61, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x21, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x81, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0xc1, 0x03, 0x01, 0x07, 0x61, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x21, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x41, 0x03, 0x01, 0x07, 0x61, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x21, 0x03, 0x31, 0x1f,
+	0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0x01, 0x03, 0x01, 0x07, 0x01, 0x03, 0x11, 0x1f,
+	0x81, 0x03, 0x01, 0x07, 0x01, 0x03, 0x01, 0x0f, 0xc1, 0x03, 0x01, 0x07, 0x61, 0x03, 0x31, 0x1f
+};
+
+static const uint8_t Manchester_Sync_Lo_LUT[256] = {
+	0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8,
+	0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0,
+	0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0,
+	0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0, 0xe0,
+	0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0,
+	0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0,
+	0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0,
+	0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0,
+	0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x86, 0x86, 0x86, 0x86, 0x84, 0x84, 0x84, 0x84, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x83, 0x83, 0x82, 0x82, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x81, 0x81, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
 };
 
-#define IsManchesterModulationNibble1(b) (Mod_Manchester_LUT[(b & 0x00F0) >> 4])
-#define IsManchesterModulationNibble2(b) (Mod_Manchester_LUT[(b & 0x000F)])
+static const uint8_t Highest_Bit_LUT[256] = {
+	0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
+};
 
 
 static void DemodReset()
@@ -478,14 +567,10 @@ static RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non
 			}
 		} else {
 			Demod.syncBit = 0xFFFF;			// not set
-			if 		((Demod.twoBits & 0x7700) == 0x7000) Demod.syncBit = 7; 
-			else if ((Demod.twoBits & 0x3B80) == 0x3800) Demod.syncBit = 6;
-			else if ((Demod.twoBits & 0x1DC0) == 0x1C00) Demod.syncBit = 5;
-			else if ((Demod.twoBits & 0x0EE0) == 0x0E00) Demod.syncBit = 4;
-			else if ((Demod.twoBits & 0x0770) == 0x0700) Demod.syncBit = 3;
-			else if ((Demod.twoBits & 0x03B8) == 0x0380) Demod.syncBit = 2;
-			else if ((Demod.twoBits & 0x01DC) == 0x01C0) Demod.syncBit = 1;
-			else if ((Demod.twoBits & 0x00EE) == 0x00E0) Demod.syncBit = 0;
+			uint8_t sync = Manchester_Sync_Hi_LUT[Demod.twoBits >> 8] & Manchester_Sync_Lo_LUT[Demod.twoBits & 0xff];
+			if (sync) {
+				Demod.syncBit = Highest_Bit_LUT[sync];
+			}
 			if (Demod.syncBit != 0xFFFF) {
 				Demod.startTime = non_real_time?non_real_time:(GetCountSspClk() & 0xfffffff8);
 				Demod.startTime -= Demod.syncBit;
@@ -496,43 +581,23 @@ static RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non
 
 	} else {
 
-		if (IsManchesterModulationNibble1(Demod.twoBits >> Demod.syncBit)) {		// modulation in first half
-			if (IsManchesterModulationNibble2(Demod.twoBits >> Demod.syncBit)) {	// ... and in second half = collision
+		uint8_t modulation = Mod_Manchester_LUT[(Demod.twoBits >> Demod.syncBit) & 0xff];
+		switch (modulation) {
+			case MOD_BOTH_HALVES:										// modulation in both halves = collision
 				if (!Demod.collisionPos) {
 					Demod.collisionPos = (Demod.len << 3) + Demod.bitCount;
+					PERF_COUNT(PERF_14A_TAG_COLLISIONS);
 				}
-			}															// modulation in first half only - Sequence D = 1
-			Demod.bitCount++;
-			Demod.shiftReg = (Demod.shiftReg >> 1) | 0x100;				// in both cases, add a 1 to the shiftreg
-			if(Demod.bitCount == 9) {									// if we decoded a full byte (including parity)
-				Demod.output[Demod.len++] = (Demod.shiftReg & 0xff);
-				Demod.parityBits <<= 1;									// make room for the parity bit
-				Demod.parityBits |= ((Demod.shiftReg >> 8) & 0x01); 	// store parity bit
-				Demod.bitCount = 0;
-				Demod.shiftReg = 0;
-				if((Demod.len&0x0007) == 0) {							// every 8 data bytes
-					Demod.parity[Demod.parityLen++] = Demod.parityBits;	// store 8 parity bits
-					Demod.parityBits = 0;
-				}
-			}
-			Demod.endTime = Demod.startTime + 8*(9*Demod.len + Demod.bitCount + 1) - 4;
-		} else {														// no modulation in first half
-			if (IsManchesterModulationNibble2(Demod.twoBits >> Demod.syncBit)) {	// and modulation in second half = Sequence E = 0
+				// fall through, treat as Sequence D
+			case MOD_FIRST_HALF:										// modulation in first half only - Sequence D = 1
+				Demod.bitCount++;
+				Demod.shiftReg = (Demod.shiftReg >> 1) | 0x100;			// add a 1 to the shiftreg
+				break;
+			case MOD_SECOND_HALF:										// modulation in second half only - Sequence E = 0
 				Demod.bitCount++;
 				Demod.shiftReg = (Demod.shiftReg >> 1);					// add a 0 to the shiftreg
-				if(Demod.bitCount >= 9) {								// if we decoded a full byte (including parity)
-					Demod.output[Demod.len++] = (Demod.shiftReg & 0xff);
-					Demod.parityBits <<= 1;								// make room for the new parity bit
-					Demod.parityBits |= ((Demod.shiftReg >> 8) & 0x01); // store parity bit
-					Demod.bitCount = 0;
-					Demod.shiftReg = 0;
-					if ((Demod.len&0x0007) == 0) {						// every 8 data bytes
-						Demod.parity[Demod.parityLen++] = Demod.parityBits;	// store 8 parity bits1
-						Demod.parityBits = 0;
-					}
-				}
-				Demod.endTime = Demod.startTime + 8*(9*Demod.len + Demod.bitCount + 1);
-			} else {													// no modulation in both halves - End of communication
+				break;
+			default:													// no modulation in both halves - End of communication
 				if(Demod.bitCount > 0) {								// there are some remaining data bits
 					Demod.shiftReg >>= (9 - Demod.bitCount);			// right align the decoded bits
 					Demod.output[Demod.len++] = Demod.shiftReg & 0xff;	// and add them to the output
@@ -549,10 +614,25 @@ static RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non
 				} else { 												// nothing received. Start over
 					DemodReset();
 				}
+				return false;
+		}
+
+		if(Demod.bitCount >= 9) {										// if we decoded a full byte (including parity)
+			Demod.output[Demod.len++] = (Demod.shiftReg & 0xff);
+			Demod.parityBits <<= 1;										// make room for the parity bit
+			Demod.parityBits |= ((Demod.shiftReg >> 8) & 0x01); 		// store parity bit
+			Demod.bitCount = 0;
+			Demod.shiftReg = 0;
+			if((Demod.len&0x0007) == 0) {								// every 8 data bytes
+				Demod.parity[Demod.parityLen++] = Demod.parityBits;		// store 8 parity bits
+				Demod.parityBits = 0;
 			}
 		}
-			
-	} 
+		Demod.endTime = Demod.startTime + 8*(9*Demod.len + Demod.bitCount + 1);
+		if (modulation != MOD_SECOND_HALF) {							// Sequence D ends 4 ticks earlier
+			Demod.endTime -= 4;
+		}
+	}
 
     return false;	// not finished yet, need more data
 }
@@ -617,6 +697,8 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 	// triggered == false -- to wait first for card
 	bool triggered = !(param & 0x03); 
 	
+	PERF_START(perf_sniff);
+
 	// And now we loop, receiving samples.
 	for(uint32_t rsamples = 0; true; ) {
 
@@ -638,8 +720,10 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 		// test for length of buffer
 		if(dataLen > maxDataLen) {
 			maxDataLen = dataLen;
+			PERF_HIGH_WATER(PERF_HW_DMA_BACKLOG, dataLen);
 			if(dataLen > (9 * DMA_BUFFER_SIZE / 10)) {
 				Dbprintf("blew circular buffer! dataLen=%d", dataLen);
+				PERF_COUNT(PERF_DMA_ABORTS);
 				break;
 			}
 		}
@@ -650,6 +734,7 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 			AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) dmaBuf;
 			AT91C_BASE_PDC_SSC->PDC_RCR = DMA_BUFFER_SIZE;
 			Dbprintf("RxEmpty ERROR!!! data length:%d", dataLen); // temporary
+			PERF_COUNT(PERF_DMA_OVERRUNS);
 		}
 		// secondary buffer sets as primary, secondary buffer was stopped
 		if (!AT91C_BASE_PDC_SSC->PDC_RNCR) {
@@ -663,7 +748,10 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 
 			if(!TagIsActive) {		// no need to try decoding reader data if the tag is sending
 				uint8_t readerdata = (previous_data & 0xF0) | (*data >> 4);
-				if (MillerDecoding(readerdata, (rsamples-1)*4)) {
+				PERF_START(perf_reader);
+				bool reader_frame = MillerDecoding(readerdata, (rsamples-1)*4);
+				PERF_STOP(PERF_SEC_14A_READER_DECODE, perf_reader);
+				if (reader_frame) {
 					LED_C_ON();
 
 					// check - if there is a short 7bit request from reader
@@ -689,7 +777,10 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 
 			if(!ReaderIsActive) {		// no need to try decoding tag data if the reader is sending - and we cannot afford the time
 				uint8_t tagdata = (previous_data << 4) | (*data & 0x0F);
-				if(ManchesterDecoding(tagdata, 0, (rsamples-1)*4)) {
+				PERF_START(perf_tag);
+				bool tag_frame = ManchesterDecoding(tagdata, 0, (rsamples-1)*4);
+				PERF_STOP(PERF_SEC_14A_TAG_DECODE, perf_tag);
+				if(tag_frame) {
 					LED_B_ON();
 
 					if (!LogTrace(receivedResponse, 
@@ -720,6 +811,7 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 		}
 	} // main cycle
 
+	PERF_STOP(PERF_SEC_14A_SNIFF, perf_sniff);
 	DbpString("COMMAND FINISHED");
 
 	FpgaDisableSscDma();
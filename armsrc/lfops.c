@@ -1202,6 +1202,7 @@ void CmdIOdemodFSK(int findone, int *high, int *low, int ledcontrol)
 #define WRITE_0   18*8 // was 144 // SPEC: 16*8 to 32*8 - typ 24*8 (or 24fc)
 #define WRITE_1   50*8 // was 400 // SPEC: 48*8 to 64*8 - typ 56*8 (or 56fc)  432 for T55x7; 448 for E5550
 #define READ_GAP  15*8 
+#define T55XX_SETTLE_SAMPLES 1000 // skipped by the answer measurement
 
 void TurnReadLFOn(int delay) {
 	FpgaWriteConfWord(FPGA_MAJOR_MODE_LF_ADC | FPGA_LF_ADC_READER_FIELD);
@@ -1327,11 +1328,27 @@ void T55xxWriteBlock(uint32_t Data, uint32_t Block, uint32_t Pwd, uint8_t arg) {
 	cmd_send(CMD_ACK,0,0,0,0,0);
 }
 
+// Peak to peak amplitude of the samples, the first ones are the tag settling.
+// DoPartialAcquisition() samples undecimated with 8 bits, one sample per byte.
+static uint8_t T55xxSignalRange(uint32_t samples) {
+	uint8_t *dest = BigBuf_get_addr();
+	uint8_t min = 255, max = 0;
+	for (uint32_t i = T55XX_SETTLE_SAMPLES; i < samples; i++) {
+		if (dest[i] < min) min = dest[i];
+		if (dest[i] > max) max = dest[i];
+	}
+	return max > min ? max - min : 0;
+}
+
 // Read one card block in page [page]
+// arg0: bit0 = password mode, bit1 = page, bit2 = measure the answer.
+// With bit2 the ACK carries the signal range in arg0 and 1 in arg1, so the
+// client can skip the download of a capture without a tag answer.
 void T55xxReadBlock(uint16_t arg0, uint8_t Block, uint32_t Pwd) {
 	LED_A_ON();
 	bool PwdMode = arg0 & 0x1;
 	uint8_t Page = (arg0 & 0x2) >> 1;
+	bool Measure = arg0 & 0x4;
 	uint32_t i = 0;
 	bool RegReadMode = (Block == 0xFF);//regular read mode
 
@@ -1374,11 +1391,14 @@ void T55xxReadBlock(uint16_t arg0, uint8_t Block, uint32_t Pwd) {
 
 	// Acquisition
 	// Now do the acquisition
-	DoPartialAcquisition(0, true, 12000, 0);
+	uint32_t samples = DoPartialAcquisition(0, true, 12000, 0) / 8;
 
 	// Turn the field off
 	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF); // field off
-	cmd_send(CMD_ACK,0,0,0,0,0);    
+	if (Measure)
+		cmd_send(CMD_ACK,T55xxSignalRange(samples),1,0,0,0);
+	else
+		cmd_send(CMD_ACK,0,0,0,0,0);    
 	LED_A_OFF();
 }
 
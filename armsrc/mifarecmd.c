@@ -19,6 +19,7 @@
 #include "util.h"
 #include "parity.h"
 #include "crc.h"
+#include "crc16.h"
 
 #define HARDNESTED_AUTHENTICATION_TIMEOUT 848			// card times out 1ms after wrong authentication (according to NXP documentation)
 #define HARDNESTED_PRE_AUTHENTICATION_LEADTIME 400		// some (non standard) cards need a pause after select before they are ready for first authentication 
@@ -421,6 +422,153 @@ void MifareWriteBlock(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 	LEDsoff();
 }
 
+//-----------------------------------------------------------------------------
+// Read/write several blocks of a sector with one selection. The card is
+// selected again only after an error, a change of the key type is done with
+// a nested authentication.
+//-----------------------------------------------------------------------------
+// 0 = authenticated, 1 = can't select, 2 = auth error
+static int MifareSectorAuth(struct Crypto1State *pcs, uint32_t *cuid, int8_t *authKeyType, uint8_t blockNo, uint8_t keyType, uint64_t ui64Key)
+{
+	if (*authKeyType == keyType) return 0;
+
+	if (*authKeyType < 0) {
+		if(!iso14443a_select_card(NULL, NULL, cuid, true, 0, true)) {
+			if (MF_DBGLEVEL >= 1)	Dbprintf("Can't select card");
+			return 1;
+		}
+		crypto1_destroy(pcs);
+		if(mifare_classic_auth(pcs, *cuid, blockNo, keyType, ui64Key, AUTH_FIRST)) {
+			if (MF_DBGLEVEL >= 1)	Dbprintf("Auth error");
+			return 2;
+		}
+	} else {
+		if(mifare_classic_auth(pcs, *cuid, blockNo, keyType, ui64Key, AUTH_NESTED)) {
+			if (MF_DBGLEVEL >= 1)	Dbprintf("Nested auth error");
+			*authKeyType = -1;
+			return 2;
+		}
+	}
+
+	*authKeyType = keyType;
+	return 0;
+}
+
+// arg0 = sector, arg1 = blocks to read (bit mask), arg2 = blocks to read with key B (bit mask)
+// datain = key A, key B. Answers the blocks read as bit mask in arg1.
+void MifareReadSectorBlocks(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
+{
+	uint8_t sectorNo = arg0;
+	uint16_t blocks = arg1;
+	uint16_t keyBblocks = arg2;
+	uint64_t keys[2] = {bytes_to_num(datain, 6), bytes_to_num(datain + 6, 6)};
+
+	byte_t dataoutbuf[16 * 16];
+	uint16_t blocksOK = 0;
+	uint32_t cuid = 0;
+	int8_t authKeyType = -1;
+	struct Crypto1State mpcs = {0, 0};
+	struct Crypto1State *pcs;
+	pcs = &mpcs;
+
+	memset(dataoutbuf, 0, sizeof(dataoutbuf));
+
+	iso14443a_setup(FPGA_HF_ISO14443A_READER_LISTEN);
+
+	clear_trace();
+
+	LED_A_ON();
+	LED_B_OFF();
+	LED_C_OFF();
+
+	for (uint8_t blockNo = 0; sectorNo < 40 && blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+		if (!(blocks & (1 << blockNo))) continue;
+
+		uint8_t keyType = (keyBblocks >> blockNo) & 0x01;
+		int res = MifareSectorAuth(pcs, &cuid, &authKeyType, FirstBlockOfSector(sectorNo) + blockNo, keyType, keys[keyType]);
+		if (res == 1) break;
+		if (res) continue;
+
+		if(mifare_classic_readblock(pcs, cuid, FirstBlockOfSector(sectorNo) + blockNo, dataoutbuf + 16 * blockNo)) {
+			if (MF_DBGLEVEL >= 1)	Dbprintf("Read sector %2d block %2d error", sectorNo, blockNo);
+			authKeyType = -1;
+			continue;
+		}
+		blocksOK |= 1 << blockNo;
+	}
+
+	if (authKeyType >= 0 && mifare_classic_halt(pcs, cuid)) {
+		if (MF_DBGLEVEL >= 1)	Dbprintf("Halt error");
+	}
+
+	crypto1_destroy(pcs);
+
+	if (MF_DBGLEVEL >= 2) DbpString("READ SECTOR BLOCKS FINISHED");
+
+	LED_B_ON();
+	cmd_send(CMD_ACK, blocksOK == blocks, blocksOK, 0, dataoutbuf, 16 * NumBlocksPerSector(sectorNo));
+	LED_B_OFF();
+
+	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+	LEDsoff();
+}
+
+// arg0 = sector, arg1 = blocks to write (bit mask), arg2 = key type
+// datain = key, 4 bytes unused, 16 bytes per block of the sector. Answers the blocks written as bit mask in arg1.
+void MifareWriteSectorBlocks(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
+{
+	uint8_t sectorNo = arg0;
+	uint16_t blocks = arg1;
+	uint8_t keyType = arg2 & 0x01;
+	uint64_t ui64Key = bytes_to_num(datain, 6);
+
+	uint16_t blocksOK = 0;
+	uint32_t cuid = 0;
+	int8_t authKeyType = -1;
+	struct Crypto1State mpcs = {0, 0};
+	struct Crypto1State *pcs;
+	pcs = &mpcs;
+
+	iso14443a_setup(FPGA_HF_ISO14443A_READER_LISTEN);
+
+	clear_trace();
+
+	LED_A_ON();
+	LED_B_OFF();
+	LED_C_OFF();
+
+	// the sector trailer is the last block, new keys don't matter for the other blocks
+	for (uint8_t blockNo = 0; sectorNo < 40 && blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+		if (!(blocks & (1 << blockNo))) continue;
+
+		int res = MifareSectorAuth(pcs, &cuid, &authKeyType, FirstBlockOfSector(sectorNo) + blockNo, keyType, ui64Key);
+		if (res == 1) break;
+		if (res) continue;
+
+		if(mifare_classic_writeblock(pcs, cuid, FirstBlockOfSector(sectorNo) + blockNo, datain + 10 + 16 * blockNo)) {
+			if (MF_DBGLEVEL >= 1)	Dbprintf("Write sector %2d block %2d error", sectorNo, blockNo);
+			authKeyType = -1;
+			continue;
+		}
+		blocksOK |= 1 << blockNo;
+	}
+
+	if (authKeyType >= 0 && mifare_classic_halt(pcs, cuid)) {
+		if (MF_DBGLEVEL >= 1)	Dbprintf("Halt error");
+	}
+
+	crypto1_destroy(pcs);
+
+	if (MF_DBGLEVEL >= 2) DbpString("WRITE SECTOR BLOCKS FINISHED");
+
+	LED_B_ON();
+	cmd_send(CMD_ACK, blocksOK == blocks, blocksOK, 0, 0, 0);
+	LED_B_OFF();
+
+	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+	LEDsoff();
+}
+
 /* // Command not needed but left for future testing
 void MifareUWriteBlockCompat(uint8_t arg0, uint8_t *datain)
 {
@@ -1017,6 +1165,183 @@ void MifareChkKeys(uint16_t arg0, uint16_t arg1, uint8_t arg2, uint8_t *datain)
 	MF_DBGLEVEL = OLD_MF_DBGLEVEL;
 }
 
+//-----------------------------------------------------------------------------
+// MIFARE check keys with a dictionary kept in BigBuf between the commands.
+// The dictionary is lost when another command frees BigBuf, the check command
+// verifies it with the key count and the CRC the client sends along.
+//-----------------------------------------------------------------------------
+static uint8_t *chk_dict = NULL;
+static uint16_t chk_dict_size = 0;		// allocated, in keys
+static uint16_t chk_dict_count = 0;
+
+static bool ChkDictAllocated(void)
+{
+	return chk_dict != NULL && chk_dict >= BigBuf_get_addr() + BigBuf_max_traceLen();
+}
+
+// arg0 = index of the first key in datain, arg1 = size of the dictionary, arg2 = keys in datain
+void MifareChkKeysDict(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
+{
+	uint16_t first = arg0;
+	uint16_t total = arg1;
+	uint16_t count = arg2;
+	bool isOK = false;
+
+	// download the HF bitstream now, it would clear BigBuf later
+	FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
+
+	if (first == 0) {
+		if (!ChkDictAllocated() || chk_dict_size < total) {
+			chk_dict = NULL;
+			chk_dict_size = 0;
+			if (total <= MF_CHKKEYS_DICT_MAX) {
+				chk_dict = BigBuf_malloc(total * 6);
+				if (chk_dict != NULL) chk_dict_size = total;
+			}
+		}
+		chk_dict_count = 0;
+	}
+
+	if (ChkDictAllocated() && first == chk_dict_count && first + count <= chk_dict_size && count <= USB_CMD_DATA_SIZE / 6) {
+		memcpy(chk_dict + first * 6, datain, count * 6);
+		chk_dict_count += count;
+		isOK = true;
+	}
+
+	cmd_send(CMD_ACK, isOK, chk_dict_count, 0, NULL, 0);
+}
+
+static void ChkKeysFastReply(uint8_t sector, uint8_t keyType, uint16_t keyIndex)
+{
+	LED_B_ON();
+	cmd_send(CMD_ACK, MF_CHKKEYS_SECTOR, sector | (keyType << 8) | ((keyIndex != 0) << 16),
+			keyIndex, keyIndex ? chk_dict + (keyIndex - 1) * 6 : NULL, keyIndex ? 6 : 0);
+	LED_B_OFF();
+}
+
+// try one key, retry if the card doesn't answer. 0 = ok, 2 = wrong key, <0 = abort
+static int ChkKeysFastKey(TChkSession *session, uint16_t keyIndex, uint8_t sector, uint8_t keyType, uint8_t debugLevel)
+{
+	uint64_t ui64Key = bytes_to_num(chk_dict + keyIndex * 6, 6);
+
+	for (int retryCount = 0; retryCount < 5; retryCount++) {
+		int res = MifareChkBlockKeySession(session, ui64Key, FirstBlockOfSector(sector), keyType, debugLevel);
+		if (res != 1) return res;
+		SpinDelay(20);
+	}
+	Dbprintf("ChkKeys: sector=%d key=%d. Can't select. Exit...", sector, keyType);
+	return -1;
+}
+
+// Check all sectors against the dictionary. A key that is found is tried on all
+// remaining sectors first, cards often use a few keys only. While the keys are
+// valid they are checked with nested authentications without a reselect.
+// The result of every sector/key type is sent when it is known.
+// arg0 = sectorCnt | keyType << 8 (2 = A and B), arg1 = clearTrace | timeout << 8,
+// arg2 = key count | CRC16 of the dictionary << 16
+void MifareChkKeysFast(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
+{
+	uint8_t sectorCnt = MIN(arg0 & 0xff, 40);
+	uint8_t keyType = (arg0 >> 8) & 0xff;
+	bool clearTrace = arg1 & 0x01;
+	uint8_t set14aTimeout = (arg1 >> 8) & 0xff;
+	uint16_t keyCount = arg2 & 0xffff;
+	uint16_t dictCrc = arg2 >> 16;
+
+	LED_A_ON();
+	LED_B_OFF();
+	LED_C_OFF();
+	iso14443a_setup(FPGA_HF_ISO14443A_READER_LISTEN);
+
+	// loading the FPGA may have cleared BigBuf
+	if (!ChkDictAllocated() || keyCount != chk_dict_count || keyCount == 0
+		|| crc16_ccitt(chk_dict, keyCount * 6) != dictCrc) {
+		cmd_send(CMD_ACK, MF_CHKKEYS_NO_DICT, 0, 0, NULL, 0);
+		FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+		LEDsoff();
+		return;
+	}
+
+	// clear debug level
+	int OLD_MF_DBGLEVEL = MF_DBGLEVEL;
+	MF_DBGLEVEL = MF_DBG_NONE;
+
+	if (clearTrace) clear_trace();
+	set_tracing(true);
+
+	if (set14aTimeout){
+		iso14a_set_timeout(set14aTimeout * 10); // timeout: ms = x/106  35-minimum, 50-OK 106-recommended 500-safe
+	}
+
+	TChkSession session;
+	memset(&session, 0, sizeof(session));
+	uint16_t keyIndex[2][40] = {{0}};		// found key + 1
+	uint8_t keyABfirst = keyType == 1 ? 1 : 0;
+	uint8_t keyABlast = keyType == 0 ? 0 : 1;
+	int found = 0;
+	int res = 0;
+
+	for (int sc = 0; sc < sectorCnt && res >= 0; sc++) {
+		for (int keyAB = keyABfirst; keyAB <= keyABlast && res >= 0; keyAB++) {
+			if (keyIndex[keyAB][sc]) continue;
+
+			for (uint16_t i = 0; i < keyCount; i++) {
+				WDT_HIT();
+				if (BUTTON_PRESS() && !usb_poll_validate_length()) {
+					Dbprintf("ChkKeys: Cancel operation. Exit...");
+					res = -2;
+					break;
+				}
+
+				res = ChkKeysFastKey(&session, i, sc, keyAB, OLD_MF_DBGLEVEL);
+				if (res < 0) break;
+				if (res) continue;
+
+				keyIndex[keyAB][sc] = i + 1;
+				found++;
+				ChkKeysFastReply(sc, keyAB, i + 1);
+
+				// key reuse on the sectors still to do
+				for (int sc2 = sc; sc2 < sectorCnt && res >= 0; sc2++) {
+					for (int keyAB2 = keyABfirst; keyAB2 <= keyABlast; keyAB2++) {
+						if (keyIndex[keyAB2][sc2]) continue;
+						WDT_HIT();
+						res = ChkKeysFastKey(&session, i, sc2, keyAB2, OLD_MF_DBGLEVEL);
+						if (res < 0) break;
+						if (res) continue;
+						keyIndex[keyAB2][sc2] = i + 1;
+						found++;
+						ChkKeysFastReply(sc2, keyAB2, i + 1);
+					}
+				}
+				break;
+			}
+
+			if (res >= 0 && !keyIndex[keyAB][sc]) {
+				ChkKeysFastReply(sc, keyAB, 0);
+			}
+		}
+	}
+
+	if (session.authenticated) {
+		mifare_classic_halt(&session.cs, session.cuid);
+	}
+
+	LED_B_ON();
+	if (res >= 0) {
+		cmd_send(CMD_ACK, MF_CHKKEYS_DONE, found, 0, NULL, 0);
+	} else {
+		cmd_send(CMD_ACK, MF_CHKKEYS_FAILED, found, 0, NULL, 0);
+	}
+	LED_B_OFF();
+
+	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+	LEDsoff();
+
+	// restore debug level
+	MF_DBGLEVEL = OLD_MF_DBGLEVEL;
+}
+
 //-----------------------------------------------------------------------------
 // MIFARE commands set debug level
 //
@@ -850,6 +850,47 @@ int MifareChkBlockKey(uint8_t *uid, uint32_t *cuid, uint8_t *cascade_levels, uin
 	return 0;
 }
 
+// one key check in a session. Returns 0 = ok, 1 = can't select, 2 = wrong key
+int MifareChkBlockKeySession(TChkSession *session, uint64_t ui64Key, uint8_t blockNo, uint8_t keyType, uint8_t debugLevel) {
+
+	if (session->authenticated) {
+		// the card is still in the state of the last valid key
+		if (!mifare_classic_auth(&session->cs, session->cuid, blockNo, keyType, ui64Key, AUTH_NESTED)) {
+			return 0;
+		}
+		// a failed authentication ends the session, the card needs a reselect
+		session->authenticated = false;
+		return 2;
+	}
+
+	if (session->cascade_levels == 0) {
+		iso14a_card_select_t card_info;
+		if(!iso14443a_select_card(session->uid, &card_info, &session->cuid, true, 0, true)) {
+			if (debugLevel >= 1) 	Dbprintf("ChkKeys: Can't select card");
+			return  1;
+		}
+		switch (card_info.uidlen) {
+			case 4 : session->cascade_levels = 1; break;
+			case 7 : session->cascade_levels = 2; break;
+			case 10: session->cascade_levels = 3; break;
+			default: break;
+		}
+	} else {
+		if(!iso14443a_select_card(session->uid, NULL, NULL, false, session->cascade_levels, true)) {
+			if (debugLevel >= 1)	Dbprintf("ChkKeys: Can't select card (UID) lvl=%d", session->cascade_levels);
+			return  1;
+		}
+	}
+
+	crypto1_destroy(&session->cs);
+	if(mifare_classic_auth(&session->cs, session->cuid, blockNo, keyType, ui64Key, AUTH_FIRST)) {
+		return 2;
+	}
+
+	session->authenticated = true;
+	return 0;
+}
+
 // multi key check
 int MifareChkBlockKeys(uint8_t *keys, uint8_t keyCount, uint8_t blockNo, uint8_t keyType, uint8_t debugLevel) {
 	uint8_t uid[10];
@@ -95,4 +95,15 @@ int MifareChkBlockKey(uint8_t *uid, uint32_t *cuid, uint8_t *cascade_levels, uin
 int MifareChkBlockKeys(uint8_t *keys, uint8_t keyCount, uint8_t blockNo, uint8_t keyType, uint8_t debugLevel);
 int MifareMultisectorChk(uint8_t *keys, uint8_t keyCount, uint8_t SectorCount, uint8_t keyType, uint8_t debugLevel, TKeyIndex *keyIndex);
 
+// key check session. The card stays selected and authenticated after a valid key,
+// the next key is then tried with a nested authentication instead of a reselect.
+typedef struct {
+	uint8_t uid[10];
+	uint32_t cuid;
+	uint8_t cascade_levels;
+	bool authenticated;
+	struct Crypto1State cs;
+} TChkSession;
+int MifareChkBlockKeySession(TChkSession *session, uint64_t ui64Key, uint8_t blockNo, uint8_t keyType, uint8_t debugLevel);
+
 #endif
@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hot path instrumentation, see perf.h
+//-----------------------------------------------------------------------------
+
+#include "perf.h"
+
+#include "proxmark3.h"
+#include "cmd.h"
+#include "string.h"
+#include "BigBuf.h"
+
+#ifdef WITH_PERF
+
+perf_stats_t perf_stats;
+static uint32_t perf_reset_ticks;
+
+static void PerfReset(void)
+{
+	memset(&perf_stats, 0, sizeof(perf_stats));
+	perf_stats.version = PERF_STATS_VERSION;
+	perf_stats.tick_hz = PERF_TICK_HZ;
+	perf_stats.dma_buffer_size = DMA_BUFFER_SIZE;
+	perf_stats.trace_size = BigBuf_max_traceLen();
+	perf_stats.bigbuf_size = BIGBUF_SIZE;
+	perf_reset_ticks = PerfTicks();
+}
+
+void PerfInit(void)
+{
+	// the longest period, PICNT:CPIV counts through all 32 bits
+	AT91C_BASE_PITC->PITC_PIMR = AT91C_PITC_PITEN | AT91C_PITC_PIV;
+	PerfReset();
+}
+
+void PerfSendStats(bool reset)
+{
+	perf_stats.elapsed_ticks = PerfTicks() - perf_reset_ticks;
+	cmd_send(CMD_ACK, 1, sizeof(perf_stats), 0, &perf_stats, sizeof(perf_stats));
+	if (reset)
+		PerfReset();
+}
+
+#else
+
+void PerfSendStats(bool reset)
+{
+	cmd_send(CMD_ACK, 0, 0, 0, 0, 0);
+}
+
+#endif
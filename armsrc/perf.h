@@ -0,0 +1,58 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hot path instrumentation, compiled in with WITH_PERF (see perf_stats.h).
+// Without it all PERF_ macros are empty.
+//-----------------------------------------------------------------------------
+
+#ifndef __PERF_H
+#define __PERF_H
+
+#include <stdbool.h>
+#include "perf_stats.h"
+
+#ifdef WITH_PERF
+
+#include "proxmark3.h"
+
+extern perf_stats_t perf_stats;
+
+extern void PerfInit(void);
+
+// PICNT:CPIV of the free running PIT is a 32 bit count of PERF_TICK_HZ.
+// Reading PIIR doesn't clear PICNT.
+static inline uint32_t PerfTicks(void)
+{
+	return AT91C_BASE_PITC->PITC_PIIR;
+}
+
+static inline void PerfStop(int sec, uint32_t start)
+{
+	uint32_t ticks = PerfTicks() - start;
+	perf_section_t *s = &perf_stats.section[sec];
+	s->calls++;
+	s->ticks += ticks;
+	if (ticks > s->max_ticks)
+		s->max_ticks = ticks;
+}
+
+#define PERF_START(t)			uint32_t t = PerfTicks()
+#define PERF_STOP(sec, t)		PerfStop(sec, t)
+#define PERF_COUNT(ctr)			do { perf_stats.counter[ctr]++; } while (0)
+#define PERF_HIGH_WATER(hw, v)	do { if ((uint32_t)(v) > perf_stats.high_water[hw]) perf_stats.high_water[hw] = (v); } while (0)
+
+#else
+
+#define PERF_START(t)			do { } while (0)
+#define PERF_STOP(sec, t)		do { } while (0)
+#define PERF_COUNT(ctr)			do { } while (0)
+#define PERF_HIGH_WATER(hw, v)	do { } while (0)
+
+#endif
+
+// CMD_PERF_STATS, answers with arg0 = 0 if built without WITH_PERF
+extern void PerfSendStats(bool reset);
+
+#endif
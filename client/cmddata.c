@@ -24,6 +24,11 @@
 #include "lfdemod.h"  // for demod code
 #include "loclass/cipherutils.h" // for decimating samples in getsamples
 #include "cmdlfem4x.h"// for em410x demod
+#include "crctest.h"
+#include "graphlodtest.h"
+#include "crcsearch.h"
+#include "util_posix.h"
+#include "cliparser/cliparser.h"
 
 uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
 uint8_t g_debugMode=0;
@@ -1386,6 +1391,7 @@ int CmdMtrim(const char *Cmd) {
 	for (int i = 0; i < GraphTraceLen; i++) {
 		GraphBuffer[i] = GraphBuffer[start+i];
 	}
+	RepaintGraphWindow();
 	return 0;
 }
 
@@ -1755,6 +1761,154 @@ int FSKToNRZ(int *data, int *dataLen, int clk, int LowToneFC, int HighToneFC) {
 	return 0;
 }
 
+int usage_data_crctest() {
+	PrintAndLog("Usage: data crctest [v] [b]");
+	PrintAndLog("       Compares the table driven CRCs with the bitwise references and known check values.");
+	PrintAndLog("Options:        ");
+	PrintAndLog("       h            This help");
+	PrintAndLog("       v            show the result of each test");
+	PrintAndLog("       b            measure the throughput afterwards");
+	return 0;
+}
+
+int CmdCrcTest(const char *Cmd) {
+	bool verbose = false, bench = false;
+	char cmdp = 0;
+	while (param_getchar(Cmd, cmdp) != 0x00) {
+		switch (param_getchar(Cmd, cmdp)) {
+		case 'v':
+		case 'V':
+			verbose = true;
+			break;
+		case 'b':
+		case 'B':
+			bench = true;
+			break;
+		default:
+			return usage_data_crctest();
+		}
+		cmdp++;
+	}
+
+	bool res = crc_selftest(verbose);
+	if (res && bench)
+		crc_bench();
+	return res ? 0 : 1;
+}
+
+int usage_data_lodtest() {
+	PrintAndLog("Usage: data lodtest [v]");
+	PrintAndLog("       Compares the level of detail data of the plot with brute force min/max/sum.");
+	PrintAndLog("Options:        ");
+	PrintAndLog("       h            This help");
+	PrintAndLog("       v            show the result of each test");
+	return 0;
+}
+
+int CmdLodTest(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (cmdp != 0x00 && cmdp != 'v' && cmdp != 'V')
+		return usage_data_lodtest();
+
+	return graphlod_selftest(cmdp != 0x00) ? 0 : 1;
+}
+
+int CmdCrcSearch(const char *Cmd) {
+	CLIParserInit("data crcsearch",
+		"Searches the CRC models matching all frames. The CRC is expected at the end of the frames, in both byte orders. "
+		"Give frames of the same length to pin down the polynomial and frames of different lengths to tell init and xorout apart. "
+		"8 and 16 bit polynomials are searched exhaustively. 32 bit polynomials are only found if the frames of the same length "
+		"pin them down, otherwise only the polynomials of the catalogue (CRC-32, CRC-32C, ...) are tried.",
+		"Usage:\n\tdata crcsearch 300002a8 300426ee 60074a0f -> search 8, 16 and 32 bit CRCs\n"
+			"\tdata crcsearch -w 16 -o 1 -t 1 ... -> 16 bit CRC, skip up to one leading byte and one byte after the CRC\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_int0("wW",  "width",    "<8|16|32>", "CRC width, default: all"),
+		arg_int0("oO",  "offset",   "<n>",       "try data starting at up to n bytes into the frames"),
+		arg_int0("tT",  "trailing", "<n>",       "try up to n bytes following the CRC"),
+		arg_lit0("vV",  "verbose",               "show the layouts and candidate counts"),
+		arg_strx1(NULL, NULL,       "<frame (HEX)>", NULL),
+		arg_param_end
+	};
+	CLIExecWithReturn(Cmd, argtable, false);
+
+	int width = arg_get_int_def(1, 0);
+	int max_offset = arg_get_int_def(2, 0);
+	int max_trailing = arg_get_int_def(3, 0);
+	bool verbose = arg_get_lit(4);
+	struct arg_str *framestr = arg_get_str(5);
+
+	crc_frame_t frames[CRCSEARCH_MAX_FRAMES];
+	size_t count = framestr->count;
+	if (count > CRCSEARCH_MAX_FRAMES) {
+		PrintAndLog("At most %d frames", CRCSEARCH_MAX_FRAMES);
+		CLIParserFree();
+		return 1;
+	}
+	for (size_t i = 0; i < count; i++) {
+		int len = 0;
+		if (param_gethex_to_eol(framestr->sval[i], 0, frames[i].data, CRCSEARCH_MAX_FRAMELEN, &len) || len == 0) {
+			PrintAndLog("Invalid frame '%s', at most %d bytes hex", framestr->sval[i], CRCSEARCH_MAX_FRAMELEN);
+			CLIParserFree();
+			return 1;
+		}
+		frames[i].len = len;
+	}
+	CLIParserFree();
+
+	if (width != 0 && width != 8 && width != 16 && width != 32) {
+		PrintAndLog("Width must be 8, 16 or 32");
+		return 1;
+	}
+	if (max_offset < 0 || max_offset > 8 || max_trailing < 0 || max_trailing > 8) {
+		PrintAndLog("Offset and trailing bytes must be 0..8");
+		return 1;
+	}
+	if (count < 2) {
+		PrintAndLog("Give at least 2 frames, every CRC matches a single frame");
+		return 1;
+	}
+
+	crc_model_t models[CRCSEARCH_MAX_MODELS];
+	uint64_t t1 = msclock();
+	int n = crcsearch(frames, count, width, max_offset, max_trailing, models, CRCSEARCH_MAX_MODELS, verbose);
+	t1 = msclock() - t1;
+
+	if (n < 0) {
+		PrintAndLog("More than %d models match, give more frames.", CRCSEARCH_MAX_MODELS);
+		return 1;
+	}
+	if (n == 0) {
+		PrintAndLog("No model found (%.1f s).", t1 / 1000.0);
+		return 0;
+	}
+
+	PrintAndLog("width |       poly |       init | refin | refout |     xorout | data      | CRC | check      | name");
+	PrintAndLog("------|------------|------------|-------|--------|------------|-----------|-----|------------|-----");
+	bool ambiguous = false;
+	for (int i = 0; i < n; i++) {
+		crc_model_t *m = &models[i];
+		const char *name = crc_model_name(m);
+		char range[16], poly[12], init[12], xorout[12], check[12];
+		snprintf(range, sizeof(range), "%d..-%d", m->offset, m->width / 8 + m->trailing + 1);
+		snprintf(poly, sizeof(poly), "0x%0*X", m->width / 4, m->poly);
+		snprintf(init, sizeof(init), "0x%0*X", m->width / 4, m->init);
+		snprintf(xorout, sizeof(xorout), "0x%0*X", m->width / 4, m->xorout);
+		snprintf(check, sizeof(check), "0x%0*X", m->width / 4, crc_model_calc(m, (const uint8_t *)"123456789", 9));
+		PrintAndLog("   %2d | %10s | %10s |   %d   |   %d    | %10s | %-9s | %s  | %10s | %s%s",
+			m->width, poly, init, m->refin, m->refout, xorout,
+			range, m->width == 8 ? "  " : (m->crc_le ? "LE" : "BE"),
+			check, name ? name : "", m->ambiguous ? " *" : "");
+		ambiguous |= m->ambiguous;
+	}
+	if (ambiguous)
+		PrintAndLog("* other init/xorout pairs give the same CRCs, the ones with xorout 0 and all ones are shown.\n"
+			"  Frames of more lengths help, unless the polynomial is divisible by x+1.");
+	PrintAndLog("%d model(s) found in %.1f s.", n, t1 / 1000.0);
+	return 0;
+}
+
 int usage_data_fsktonrz() {
 		PrintAndLog("Usage: data fsktonrz c <clock> l <fc_low> f <fc_high>");
 		PrintAndLog("Options:        ");
@@ -1822,6 +1976,8 @@ static command_t CommandTable[] =
 	{"bin2hex",         Cmdbin2hex,         1, "bin2hex <digits>     -- Converts binary to hexadecimal"},
 	{"bitsamples",      CmdBitsamples,      0, "Get raw samples as bitstring"},
 	{"buffclear",       CmdBuffClear,       1, "Clear sample buffer and graph window"},
+	{"crctest",         CmdCrcTest,         1, "[v] [b] -- Test (and benchmark) the table driven CRCs"},
+	{"crcsearch",       CmdCrcSearch,       1, "<frames> -- Search the CRC parameters matching captured frames"},
 	{"dec",             CmdDec,             1, "Decimate samples"},
 	{"detectclock",     CmdDetectClockRate, 1, "[modulation] Detect clock rate of wave in GraphBuffer (options: 'a','f','n','p' for ask, fsk, nrz, psk respectively)"},
 	{"fsktonrz",        CmdFSKToNRZ,        1, "Convert fsk2 to nrz wave for alternate fsk demodulating (for weak fsk)"},
@@ -1832,6 +1988,7 @@ static command_t CommandTable[] =
 	{"hide",            CmdHide,            1, "Hide graph window"},
 	{"hpf",             CmdHpf,             1, "Remove DC offset from trace"},
 	{"load",            CmdLoad,            1, "<filename> -- Load trace (to graph window"},
+	{"lodtest",         CmdLodTest,         1, "[v] -- Test the level of detail data of the graph window"},
 	{"ltrim",           CmdLtrim,           1, "<samples> -- Trim samples from left of trace"},
 	{"rtrim",           CmdRtrim,           1, "<location to end trace> -- Trim samples from right of trace"},
 	{"mtrim",           CmdMtrim,           1, "<start> <stop> -- Trim out samples from the specified start to the specified stop"},
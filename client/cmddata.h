@@ -32,6 +32,9 @@ int CmdAutoCorr(const char *Cmd);
 int CmdBiphaseDecodeRaw(const char *Cmd);
 int CmdBitsamples(const char *Cmd);
 int CmdBuffClear(const char *Cmd);
+int CmdCrcSearch(const char *Cmd);
+int CmdCrcTest(const char *Cmd);
+int CmdLodTest(const char *Cmd);
 int CmdDec(const char *Cmd);
 int CmdDetectClockRate(const char *Cmd);
 int CmdFSKrawdemod(const char *Cmd);
@@ -35,6 +35,7 @@
 #include "emv/cmdemv.h"
 #include "cmdhflist.h"
 #include "cmdhffido.h"
+#include "tracefile.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -131,13 +132,13 @@ uint8_t iclass_CRC_check(bool isResponse, uint8_t* data, uint8_t len)
 }
 
 
-bool is_last_record(uint16_t tracepos, uint8_t *trace, uint16_t traceLen)
+bool is_last_record(size_t tracepos, uint8_t *trace, size_t traceLen)
 {
 	return(tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) >= traceLen);
 }
 
 
-bool next_record_is_response(uint16_t tracepos, uint8_t *trace)
+bool next_record_is_response(size_t tracepos, uint8_t *trace)
 {
 	uint16_t next_records_datalen = *((uint16_t *)(trace + tracepos + sizeof(uint32_t) + sizeof(uint16_t)));
 	
@@ -145,7 +146,7 @@ bool next_record_is_response(uint16_t tracepos, uint8_t *trace)
 }
 
 
-bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen, uint8_t *trace, uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len)
+bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, size_t *tracepos, size_t traceLen, uint8_t *trace, uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len)
 {
 
 #define MAX_TOPAZ_READER_CMD_LEN	16
@@ -184,7 +185,7 @@ bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t
 }
 
 
-uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes)
+size_t printTraceLine(size_t tracepos, size_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes)
 {
 	bool isResponse;
 	uint16_t data_len, parity_len;
@@ -365,43 +366,83 @@ int CmdHFList(const char *Cmd)
 	bool markCRCBytes = false;
 	bool loadFromFile = false;
 	bool saveToFile = false;
-	char param1 = '\0';
-	char param2 = '\0';
-	char param3 = '\0';
 	char type[40] = {0};
 	char filename[FILE_PATH_SIZE] = {0};
 	uint8_t protocol = 0;
-	
+	tracefilter_t filter;
+	TraceFilterInit(&filter);
+
+	ClearTraceKeys();
+
 	// parse command line
 	int tlen = param_getstr(Cmd, 0, type, sizeof(type));
-	if (param_getlength(Cmd, 1) == 1) {
-		param1 = param_getchar(Cmd, 1);
-	} else {
-		param_getstr(Cmd, 1, filename, sizeof(filename));
-	}
-	if (param_getlength(Cmd, 2) == 1) {
-		param2 = param_getchar(Cmd, 2);
-	} else if (strlen(filename) == 0) {
-		param_getstr(Cmd, 2, filename, sizeof(filename));
-	}
-	if (param_getlength(Cmd, 3) == 1) {
-		param3 = param_getchar(Cmd, 3);
-	} else if (strlen(filename) == 0) {
-		param_getstr(Cmd, 3, filename, sizeof(filename));
-	}
 
-	// Validate param1
 	bool errors = false;
 
 	if(tlen == 0) {
 		errors = true;
 	}
 
-	if(param1 == 'h'
-			|| (param1 != 0 && param1 != 'f' && param1 != 'c' && param1 != 'l')
-			|| (param2 != 0 && param2 != 'f' && param2 != 'c' && param2 != 'l')
-			|| (param3 != 0 && param3 != 'f' && param3 != 'c' && param3 != 'l')) {
-		errors = true;
+	int cmdp = 1;
+	while (!errors && param_getchar(Cmd, cmdp) != 0x00) {
+		if (param_getlength(Cmd, cmdp) != 1) {
+			if (strlen(filename) == 0) {
+				param_getstr(Cmd, cmdp, filename, sizeof(filename));
+			} else {
+				errors = true;
+			}
+			cmdp++;
+			continue;
+		}
+		switch (param_getchar(Cmd, cmdp)) {
+			case 'f':
+				showWaitCycles = true;
+				cmdp++;
+				break;
+			case 'c':
+				markCRCBytes = true;
+				cmdp++;
+				break;
+			case 'l':
+				loadFromFile = true;
+				cmdp++;
+				break;
+			case 't':
+				filter.by_time = true;
+				filter.time_from = param_get32ex(Cmd, cmdp + 1, 0, 10);
+				filter.time_to = param_get32ex(Cmd, cmdp + 2, UINT32_MAX, 10);
+				if (param_getlength(Cmd, cmdp + 1) == 0 || param_getlength(Cmd, cmdp + 2) == 0 || filter.time_to < filter.time_from) {
+					errors = true;
+				}
+				cmdp += 3;
+				break;
+			case 'd':
+				switch (param_getchar(Cmd, cmdp + 1)) {
+					case 'r': filter.direction = 0; break;
+					case 't': filter.direction = 1; break;
+					default:  errors = true; break;
+				}
+				cmdp += 2;
+				break;
+			case 'k': {
+				char dicname[FILE_PATH_SIZE] = {0};
+				if (param_getstr(Cmd, cmdp + 1, dicname, sizeof(dicname)) == 0 || AddTraceKeysFile(dicname)) {
+					errors = true;
+				}
+				cmdp += 2;
+				break;
+			}
+			case 'x':
+				filter.by_cmd = true;
+				if (param_gethex(Cmd, cmdp + 1, &filter.cmd, 2)) {
+					errors = true;
+				}
+				cmdp += 2;
+				break;
+			default:
+				errors = true;
+				break;
+		}
 	}
 
 	if(!errors) {
@@ -423,18 +464,6 @@ int CmdHFList(const char *Cmd)
 			errors = true;
 		}
 	}
-	
-	if (param1 == 'f' || param2 == 'f' || param3 == 'f') {
-		showWaitCycles = true;
-	}
-
-	if (param1 == 'c' || param2 == 'c' || param3 == 'c') {
-		markCRCBytes = true;
-	}
-
-	if (param1 == 'l' || param2 == 'l' || param3 == 'l') {
-		loadFromFile = true;
-	}
 
 	if ((loadFromFile || saveToFile) && strlen(filename) == 0) {
 		errors = true;
@@ -446,10 +475,14 @@ int CmdHFList(const char *Cmd)
 	
 	if (errors) {
 		PrintAndLog("List or save protocol data.");
-		PrintAndLog("Usage:  hf list <protocol> [f] [c] [l <filename>]");
+		PrintAndLog("Usage:  hf list <protocol> [f] [c] [t <start> <end>] [d r|t] [x <cmd>] [k <dic>] [l <filename>]");
 		PrintAndLog("        hf list save <filename>");
 		PrintAndLog("    f      - show frame delay times as well");
 		PrintAndLog("    c      - mark CRC bytes");
+		PrintAndLog("    t      - only show frames starting between <start> and <end> (carrier periods from trace start)");
+		PrintAndLog("    d      - only show reader (r) or tag (t) frames");
+		PrintAndLog("    x      - only show frames starting with byte <cmd> (hex)");
+		PrintAndLog("    k      - mf: additional key dictionary for nested authentications (default_keys.dic is always used)");
 		PrintAndLog("    l      - load data from file instead of trace buffer");
 		PrintAndLog("    save   - save data to file");
 		PrintAndLog("Supported <protocol> values:");
@@ -464,45 +497,22 @@ int CmdHFList(const char *Cmd)
 		PrintAndLog("example: hf list iclass");
 		PrintAndLog("example: hf list save myCardTrace.trc");
 		PrintAndLog("example: hf list 14a l myCardTrace.trc");
+		PrintAndLog("example: hf list mf k mykeys.dic l myCardTrace.trc");
+		PrintAndLog("example: hf list 14a t 1000000 2000000 d r x 60 l myCardTrace.trc");
 		return 0;
 	}
 
 
-	uint8_t *trace;
-	uint32_t tracepos = 0;
-	uint32_t traceLen = 0;
+	tracebuf_t tb;
 	
 	if (loadFromFile) {
-		#define TRACE_CHUNK_SIZE (1<<16)		// 64K to start with. Will be enough for BigBuf and some room for future extensions
-		FILE *tracefile = NULL;
-		size_t bytes_read;
-		trace = malloc(TRACE_CHUNK_SIZE);
-		if (trace == NULL) {
-			PrintAndLog("Cannot allocate memory for trace");
-			return 2;
-		}
-		if ((tracefile = fopen(filename,"rb")) == NULL) { 
-			PrintAndLog("Could not open file %s", filename);
-			free(trace);
-			return 0;
-		}
-		while (!feof(tracefile)) {
-			bytes_read = fread(trace+traceLen, 1, TRACE_CHUNK_SIZE, tracefile);
-			traceLen += bytes_read;
-			if (!feof(tracefile)) {
-				uint8_t *p = realloc(trace, traceLen + TRACE_CHUNK_SIZE);
-				if (p == NULL) {
-					PrintAndLog("Cannot allocate memory for trace");
-					free(trace);
-					fclose(tracefile);
-					return 2;
-				}
-				trace = p;
-			}
+		int res = TraceLoadFile(filename, &tb);
+		if (res) {
+			return res == 1 ? 0 : res;
 		}
-		fclose(tracefile);
 	} else {
-		trace = malloc(USB_CMD_DATA_SIZE);
+		uint8_t *trace = malloc(USB_CMD_DATA_SIZE);
+		uint32_t traceLen = 0;
 		// Query for the size of the trace
 		UsbCommand response;
 		GetFromBigBuf(trace, USB_CMD_DATA_SIZE, 0, &response, -1, false);
@@ -517,19 +527,23 @@ int CmdHFList(const char *Cmd)
 			trace = p;
 			GetFromBigBuf(trace, traceLen, 0, NULL, -1, false);
 		}
+		if (TraceLoadBuffer(trace, traceLen, &tb)) {
+			return 2;
+		}
 	}
 
 	if (saveToFile) {
 		FILE *tracefile = NULL;
 		if ((tracefile = fopen(filename,"wb")) == NULL) { 
 			PrintAndLog("Could not create file %s", filename);
+			TraceFree(&tb);
 			return 1;
 		}
-		fwrite(trace, 1, traceLen, tracefile);
-		PrintAndLog("Recorded Activity (TraceLen = %d bytes) written to file %s", traceLen, filename);
+		fwrite(tb.data, 1, tb.len, tracefile);
+		PrintAndLog("Recorded Activity (TraceLen = %zu bytes) written to file %s", tb.len, filename);
 		fclose(tracefile);
 	} else {
-		PrintAndLog("Recorded Activity (TraceLen = %d bytes)", traceLen);
+		PrintAndLog("Recorded Activity (TraceLen = %zu bytes, %zu records)", tb.len, tb.num_records);
 		PrintAndLog("");
 		PrintAndLog("Start = Start of Start Bit, End = End of last modulation. Src = Source of Transfer");
 		PrintAndLog("iso14443a - All times are in carrier periods (1/13.56Mhz)");
@@ -539,13 +553,23 @@ int CmdHFList(const char *Cmd)
 		PrintAndLog("------------|------------|-----|-----------------------------------------------------------------|-----|--------------------|");
 
 		ClearAuthData();
-		while(tracepos < traceLen)
-		{
-			tracepos = printTraceLine(tracepos, traceLen, trace, protocol, showWaitCycles, markCRCBytes);
+		bool filtered = TraceFilterActive(&filter);
+		size_t i = filtered && filter.by_time ? TraceFindTime(&tb, filter.time_from) : 0;
+		while (i < tb.num_records) {
+			if (filtered && !TraceRecordMatches(&tb, i, &filter)) {
+				if (filter.by_time && TraceRecordTimestamp(&tb, i) - TraceRecordTimestamp(&tb, 0) > filter.time_to)
+					break;
+				i++;
+				continue;
+			}
+			// a record may consume its successors (merged topaz reader frames)
+			size_t tracepos = printTraceLine(tb.offsets[i], tb.len, tb.data, protocol, showWaitCycles, markCRCBytes);
+			while (i < tb.num_records && tb.offsets[i] < tracepos)
+				i++;
 		}
 	}
 
-	free(trace);
+	TraceFree(&tb);
 	return 0;
 }
 
@@ -37,6 +37,7 @@
 #include "iso15693tools.h"
 #include "protocols.h"
 #include "cmdmain.h"
+#include "tracefile.h"
 
 #define FrameSOF              Iso15693FrameSOF
 #define Logic0						Iso15693Logic0
@@ -279,87 +280,177 @@ static char* TagErrorStr(uint8_t error) {
 
 
 // Mode 3
-int CmdHF15Demod(const char *Cmd)
+// The sampling rate is 106.353 ksps/s, for T = 18.8 us. The templates have 2 values per sample.
+#define DEMOD_SKIP			2
+#define DEMOD_SAMPLE_TICKS	128			// carrier periods per sample, for the trace timestamps
+
+typedef struct {
+	graph_kernel_t sof;
+	graph_kernel_t eof;
+	graph_kernel_t logic0;
+	graph_kernel_t logic1;
+} demod_kernels_t;
+
+// Decodes the bits following a SOF at pos. Returns the number of bits, *end is the sample
+// following the EOF or -1 if the capture ends first.
+static int DemodFrame(const demod_kernels_t *k, const int64_t *prefix, int len, int pos, uint8_t *out, int maxbits, int *end)
 {
-	// The sampling rate is 106.353 ksps/s, for T = 18.8 us
-	
-	int i, j;
-	int max = 0, maxPos = 0;
+	int bits = 0;
+
+	*end = -1;
+	while (pos + k->eof.len <= len && bits < maxbits) {
+		int64_t corr0 = GraphCorrelate(&k->logic0, prefix, pos);
+		int64_t corr1 = GraphCorrelate(&k->logic1, prefix, pos);
+		int64_t corrEOF = GraphCorrelate(&k->eof, prefix, pos);
+		// two bit lookahead, 0 followed by 0 or 1
+		int64_t corr00 = corr0 + GraphCorrelate(&k->logic0, prefix, pos + k->logic0.len);
+		int64_t corr01 = corr0 + GraphCorrelate(&k->logic1, prefix, pos + k->logic0.len);
+		// Even things out by the length of the target waveform.
+		corr00 *= 2;
+		corr01 *= 2;
+		corr0 *= 4;
+		corr1 *= 4;
+
+		if (corrEOF > corr1 && corrEOF > corr00 && corrEOF > corr01) {
+			*end = pos + k->eof.len;
+			break;
+		} else if (corr1 > corr0) {
+			out[bits / 8] |= 1 << (bits % 8);
+			pos += k->logic1.len;
+		} else {
+			out[bits / 8] &= ~(1 << (bits % 8));
+			pos += k->logic0.len;
+		}
+		bits++;
+	}
+	return bits;
+}
 
-	int skip = 2;
+static int usage_hf_15_demod(void)
+{
+	PrintAndLog("Decodes all tag frames in the graph buffer ('hf 15 record' and 'data samples').");
+	PrintAndLog("Usage:  hf 15 demod [t <threshold>] [s <filename>]");
+	PrintAndLog("    t      - minimal SOF correlation (per sample), default: half of the strongest SOF");
+	PrintAndLog("    s      - save the frames to a trace file, show with 'hf list raw l <filename>'");
+	PrintAndLog("             (the trace format limits durations to 65535 carrier periods, frames longer");
+	PrintAndLog("             than 512 samples end at start + 65535 in the listing)");
+	return 0;
+}
+
+int CmdHF15Demod(const char *Cmd)
+{
+	int threshold = 0;
+	char filename[FILE_PATH_SIZE] = {0};
+	FILE *tracefile = NULL;
+	int cmdp = 0;
+
+	while (param_getchar(Cmd, cmdp) != 0x00) {
+		switch (param_getchar(Cmd, cmdp)) {
+			case 't':
+				threshold = param_get32ex(Cmd, cmdp + 1, 0, 10);
+				cmdp += 2;
+				break;
+			case 's':
+				if (param_getstr(Cmd, cmdp + 1, filename, sizeof(filename)) == 0)
+					return usage_hf_15_demod();
+				cmdp += 2;
+				break;
+			default:
+				return usage_hf_15_demod();
+		}
+	}
 
 	if (GraphTraceLen < 2000) return 0;
 
-	// First, correlate for SOF
-	for (i = 0; i < 200; i++) {
-		int corr = 0;
-		for (j = 0; j < arraylen(FrameSOF); j += skip) {
-			corr += FrameSOF[j] * GraphBuffer[i + (j / skip)];
-		}
-		if (corr > max) {
-			max = corr;
-			maxPos = i;
+	demod_kernels_t k;
+	GraphKernelInit(&k.sof, FrameSOF, arraylen(FrameSOF), DEMOD_SKIP);
+	GraphKernelInit(&k.eof, FrameEOF, arraylen(FrameEOF), DEMOD_SKIP);
+	GraphKernelInit(&k.logic0, Logic0, arraylen(Logic0), DEMOD_SKIP);
+	GraphKernelInit(&k.logic1, Logic1, arraylen(Logic1), DEMOD_SKIP);
+
+	// SOF correlation for all offsets in one go
+	int count = GraphTraceLen - k.sof.len + 1;
+	int maxbits = GraphTraceLen / k.logic0.len;
+	int64_t *prefix = GraphPrefixSums(GraphBuffer, GraphTraceLen);
+	int64_t *corr = malloc(count * sizeof(int64_t));
+	uint8_t *frame = calloc(maxbits / 8 + 1, 1);
+	if (prefix == NULL || corr == NULL || frame == NULL) {
+		PrintAndLog("Cannot allocate memory");
+		free(prefix);
+		free(corr);
+		free(frame);
+		return 2;
+	}
+	GraphCorrelateAll(&k.sof, prefix, count, corr);
+
+	int64_t max = 0;
+	for (int i = 0; i < count; i++) {
+		if (corr[i] > max)
+			max = corr[i];
+	}
+	int64_t min_corr = threshold > 0 ? (int64_t)threshold * k.sof.len : max / 2;
+	if (max <= 0 || max < min_corr) {
+		PrintAndLog("No SOF found.");
+		goto out;
+	}
+
+	if (filename[0]) {
+		if ((tracefile = fopen(filename, "wb")) == NULL) {
+			PrintAndLog("Could not create file %s", filename);
+			goto out;
 		}
 	}
-	PrintAndLog("SOF at %d, correlation %d", maxPos,
-		max / (arraylen(FrameSOF) / skip));
-	
-	i = maxPos + arraylen(FrameSOF) / skip;
-	int k = 0;
-	uint8_t outBuf[20];
-	memset(outBuf, 0, sizeof(outBuf));
-	uint8_t mask = 0x01;
-	for (;;) {
-			int corr0 = 0, corr00 = 0, corr01 = 0, corr1 = 0, corrEOF = 0;
-			for(j = 0; j < arraylen(Logic0); j += skip) {
-				corr0 += Logic0[j]*GraphBuffer[i+(j/skip)];
-			}
-			corr01 = corr00 = corr0;
-			for(j = 0; j < arraylen(Logic0); j += skip) {
-				corr00 += Logic0[j]*GraphBuffer[i+arraylen(Logic0)/skip+(j/skip)];
-				corr01 += Logic1[j]*GraphBuffer[i+arraylen(Logic0)/skip+(j/skip)];
-			}
-			for(j = 0; j < arraylen(Logic1); j += skip) {
-				corr1 += Logic1[j]*GraphBuffer[i+(j/skip)];
-			}
-			for(j = 0; j < arraylen(FrameEOF); j += skip) {
-				corrEOF += FrameEOF[j]*GraphBuffer[i+(j/skip)];
-			}
-			// Even things out by the length of the target waveform.
-			corr00 *= 2;
-			corr01 *= 2;
-			corr0 *= 4;
-			corr1 *= 4;
-	
-			if(corrEOF > corr1 && corrEOF > corr00 && corrEOF > corr01) {
-				PrintAndLog("EOF at %d", i);
-				break;
-		} else if (corr1 > corr0) {
-			i += arraylen(Logic1) / skip;
-			outBuf[k] |= mask;
-		} else {
-			i += arraylen(Logic0) / skip;
+
+	PrintAndLog("    SOF |     EOF | corr | bits | data");
+	PrintAndLog("--------|---------|------|------|-----------------------------------------");
+	int frames = 0;
+	for (int i = 0; i < count; ) {
+		if (corr[i] < min_corr || corr[i] <= 0) {
+			i++;
+			continue;
+		}
+		// strongest match overlapping this one
+		int sof = i;
+		for (int j = i + 1; j < i + k.sof.len && j < count; j++) {
+			if (corr[j] > corr[sof])
+				sof = j;
 		}
-		mask <<= 1;
-		if (mask == 0) {
-			k++;
-			mask = 0x01;
+
+		int end;
+		int bits = DemodFrame(&k, prefix, GraphTraceLen, sof + k.sof.len, frame, maxbits, &end);
+		int bytes = bits / 8;
+		char eof[12];
+		if (end < 0)
+			strcpy(eof, "-");
+		else
+			sprintf(eof, "%d", end);
+		PrintAndLog("%7d | %7s | %4d | %4d | %s%s%s", sof, eof, (int)(corr[sof] / k.sof.len), bits,
+			sprint_hex(frame, bytes),
+			bytes >= 3 ? (Crc(frame, bytes) == ISO15693_CRC_CHECK ? " (CRC ok)" : " (CRC error)") : "",
+			bits % 8 ? " (uneven octet)" : "");
+		frames++;
+
+		if (tracefile != NULL && bytes > 0) {
+			int last = end < 0 ? GraphTraceLen : end;
+			TraceWriteRecord(tracefile, sof * DEMOD_SAMPLE_TICKS, (last - sof) * DEMOD_SAMPLE_TICKS, frame, bytes, true);
 		}
-		if ((i + (int)arraylen(FrameEOF)) >= GraphTraceLen) {
+		if (end < 0) {
 			PrintAndLog("ran off end!");
 			break;
 		}
+		i = end;
 	}
-	if (mask != 0x01) {
-		PrintAndLog("error, uneven octet! (discard extra bits!)");
-		PrintAndLog("   mask=%02x", mask);
-	}
-	PrintAndLog("%d octets", k);
-	
-	for (i = 0; i < k; i++) {
-		PrintAndLog("# %2d: %02x ", i, outBuf[i]);
+	PrintAndLog("%d frames", frames);
+
+	if (tracefile != NULL) {
+		fclose(tracefile);
+		PrintAndLog("Frames written to %s", filename);
 	}
-	PrintAndLog("CRC=%04x", Iso15693Crc(outBuf, k - 2));
+
+out:
+	free(prefix);
+	free(corr);
+	free(frame);
 	return 0;
 }
 
@@ -512,7 +603,7 @@ int CmdHF15DumpMem(const char*Cmd) {
 static command_t CommandTable15[] = 
 {
 	{"help",    CmdHF15Help,    1, "This help"},
-	{"demod",   CmdHF15Demod,   1, "Demodulate ISO15693 from tag"},
+	{"demod",   CmdHF15Demod,   1, "[t <threshold>] [s <file>] Demodulate all ISO15693 tag frames in the graph buffer"},
 	{"read",    CmdHF15Read,    0, "Read HF tag (ISO 15693)"},
 	{"record",  CmdHF15Record,  0, "Record Samples (ISO 15693)"}, // atrox
 	{"reader",  CmdHF15Reader,  0, "Act like an ISO15693 reader"},
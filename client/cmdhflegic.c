@@ -18,6 +18,9 @@
 #include "cmdparser.h"
 #include "cmdmain.h"
 #include "util.h"
+#include "crc.h"
+#include "cliparser/cliparser.h"
+#include "legicdecode.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -25,6 +28,7 @@ static command_t CommandTable[] =
 {
   {"help",        CmdHelp,        1, "This help"},
   {"decode",      CmdLegicDecode, 0, "Display deobfuscated and decoded LEGIC RF tag data (use after hf legic reader)"},
+  {"batch",       CmdLegicBatch,  1, "<dump files/directories> -- Decode and check saved dumps, output as JSON"},
   {"reader",      CmdLegicRFRead, 0, "[offset [length]] -- read bytes from a LEGIC card"},
   {"save",        CmdLegicSave,   0, "<filename> [<length>] -- Store samples"},
   {"load",        CmdLegicLoad,   0, "<filename> -- Restore samples"},
@@ -71,12 +75,13 @@ int CmdLegicDecode(const char *Cmd)
   
   PrintAndLog("\nCDF: System Area");
   
-  PrintAndLog("MCD: %02x, MSN: %02x %02x %02x, MCC: %02x",
+  PrintAndLog("MCD: %02x, MSN: %02x %02x %02x, MCC: %02x (%s)",
     data_buf[0],
     data_buf[1],
     data_buf[2],
     data_buf[3],
-    data_buf[4]
+    data_buf[4],
+    CRC8Legic(data_buf, 4) == data_buf[4] ? "ok" : "CRC error"
   );
   
   crc = data_buf[4];
@@ -141,8 +146,12 @@ int CmdLegicDecode(const char *Cmd)
     
     wrp = (data_buf[i+2]^crc);
     wrc = ((data_buf[i+3]^crc)&0x70)>>4;
+
+    // header CRC over UID and header
+    uint8_t crc_data[8] = {data_buf[0], data_buf[1], data_buf[2], data_buf[3],
+      data_buf[i]^crc, data_buf[i+1]^crc, data_buf[i+2]^crc, data_buf[i+3]^crc};
     
-     PrintAndLog("Segment %02u: raw header=%02x %02x %02x %02x, flag=%01x (valid=%01u, last=%01u), len=%04u, WRP=%02u, WRC=%02u, RD=%01u, CRC=%02x",
+     PrintAndLog("Segment %02u: raw header=%02x %02x %02x %02x, flag=%01x (valid=%01u, last=%01u), len=%04u, WRP=%02u, WRC=%02u, RD=%01u, CRC=%02x (%s)",
       n,
       data_buf[i]^crc,
       data_buf[i+1]^crc,
@@ -155,7 +164,8 @@ int CmdLegicDecode(const char *Cmd)
       wrp,
       wrc,
       ((data_buf[i+3]^crc)&0x80)>>7,
-      (data_buf[i+4]^crc)
+      (data_buf[i+4]^crc),
+      CRC8Legic(crc_data, 8) == (data_buf[i+4]^crc) ? "ok" : "error"
     );
     
     i+=5;
@@ -206,6 +216,40 @@ int CmdLegicDecode(const char *Cmd)
   return 0;
 }
 
+int CmdLegicBatch(const char *Cmd)
+{
+  CLIParserInit("hf legic batch",
+    "Decodes saved LEGIC Prime dumps (hf legic save text files or binary) offline on all CPUs and checks the MCC and all segment header CRCs.\n"
+    "Directories are searched for dump files. Files with errors are listed, all cards can be written as a JSON array.",
+    "Usage:\n\thf legic batch dumps/ -> check all dumps in directory dumps\n"
+      "\thf legic batch -j cards.json dumps/ a.txt -> write the decoded cards to cards.json\n");
+
+  void* argtable[] = {
+    arg_param_begin,
+    arg_str0("jJ",  "json",    "<file>", "write the decoded cards as JSON"),
+    arg_int0("tT",  "threads", "<n>", "number of threads (default: all CPUs)"),
+    arg_lit0("vV",  "verbose", "list all files"),
+    arg_strx1(NULL, NULL,      "<dump file or directory>", NULL),
+    arg_param_end
+  };
+  CLIExecWithReturn(Cmd, argtable, false);
+
+  char jsonname[FILE_PATH_SIZE] = {0};
+  int jsonnamelen = 0;
+  CLIParamStrToBuf(arg_get_str(1), (uint8_t *)jsonname, sizeof(jsonname) - 1, &jsonnamelen);
+  int threads = arg_get_int_def(2, 0);
+  bool verbose = arg_get_lit(3);
+
+  struct arg_str *dumps = arg_get_str(4);
+  char *names[dumps->count];
+  for (int i = 0; i < dumps->count; i++)
+    names[i] = (char *)dumps->sval[i];
+
+  int res = LegicBatchDecode(names, dumps->count, threads, jsonnamelen ? jsonname : NULL, verbose);
+  CLIParserFree();
+  return res;
+}
+
 int CmdLegicRFRead(const char *Cmd)
 {
   int byte_count=0,offset=0;
@@ -15,6 +15,7 @@ int CmdHFLegic(const char *Cmd);
 
 int CmdLegicRFRead(const char *Cmd);
 int CmdLegicDecode(const char *Cmd);
+int CmdLegicBatch(const char *Cmd);
 int CmdLegicLoad(const char *Cmd);
 int CmdLegicSave(const char *Cmd);
 int CmdLegicRfSim(const char *Cmd);
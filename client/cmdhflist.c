@@ -15,6 +15,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include "util.h"
 #include "ui.h"
 #include "iso14443crc.h"
@@ -22,7 +23,30 @@
 #include "protocols.h"
 #include "crapto1/crapto1.h"
 #include "mifarehost.h"
-#include "mifaredefault.h"
+#include "mfkeysearch.h"
+
+// keys found while decoding a trace, reused for later authentications to the same sector
+#define MAX_TRACE_KEYS		256
+typedef struct {
+	uint32_t uid;
+	uint8_t sector;
+	uint8_t keytype;
+	uint64_t key;
+} TTraceKey;
+static TTraceKey TraceKeys[MAX_TRACE_KEYS];
+static int TraceKeysCnt;
+
+// dictionary for nested authentications. Compiled in + default_keys.dic + user files
+static mfkeydic_t TraceKeyDic;
+static bool TraceKeyDicLoaded;
+
+typedef struct {
+	TAuthData *ad;
+	uint8_t *cmd;
+	uint8_t cmdsize;
+	uint8_t *parity;
+} TNestedKeyCheck;
+static bool NestedKeyCheck(uint64_t key, void *data);
 
 
 enum MifareAuthSeq {
@@ -38,12 +62,75 @@ enum MifareAuthSeq {
 static enum MifareAuthSeq MifareAuthState;
 static TAuthData AuthData;
 
+static uint8_t BlockToSector(uint8_t block) {
+	if (block < 128)
+		return block / 4;
+	return 32 + (block - 128) / 16;
+}
+
+void ClearTraceKeys(void) {
+	TraceKeysCnt = 0;
+	mfKeyDicFree(&TraceKeyDic);
+	TraceKeyDicLoaded = false;
+}
+
+int AddTraceKeysFile(const char *filename) {
+	if (!TraceKeyDicLoaded) {
+		if (mfKeyDicAddDefaults(&TraceKeyDic))
+			return 2;
+		TraceKeyDicLoaded = true;
+	}
+
+	int cnt = mfKeyDicLoadFile(&TraceKeyDic, filename);
+	if (cnt < 0)
+		return 1;
+
+	PrintAndLog("Loaded %d keys from %s, %zu keys in dictionary", cnt, filename, TraceKeyDic.count);
+	return 0;
+}
+
+static void StoreTraceKey(TAuthData *ad, uint64_t key) {
+	uint8_t sector = BlockToSector(ad->block);
+
+	for (int i = 0; i < TraceKeysCnt; i++) {
+		if (TraceKeys[i].uid == ad->uid && TraceKeys[i].sector == sector && TraceKeys[i].keytype == ad->keytype) {
+			TraceKeys[i].key = key;
+			return;
+		}
+	}
+
+	if (TraceKeysCnt == MAX_TRACE_KEYS) {
+		// full: drop the oldest one
+		memmove(&TraceKeys[0], &TraceKeys[1], (MAX_TRACE_KEYS - 1) * sizeof(TTraceKey));
+		TraceKeysCnt--;
+	}
+	TraceKeys[TraceKeysCnt].uid = ad->uid;
+	TraceKeys[TraceKeysCnt].sector = sector;
+	TraceKeys[TraceKeysCnt].keytype = ad->keytype;
+	TraceKeys[TraceKeysCnt].key = key;
+	TraceKeysCnt++;
+}
+
+static bool FindTraceKey(TAuthData *ad, uint64_t *key) {
+	uint8_t sector = BlockToSector(ad->block);
+
+	for (int i = 0; i < TraceKeysCnt; i++) {
+		if (TraceKeys[i].uid == ad->uid && TraceKeys[i].sector == sector && TraceKeys[i].keytype == ad->keytype) {
+			*key = TraceKeys[i].key;
+			return true;
+		}
+	}
+	return false;
+}
+
 void ClearAuthData() {
 	AuthData.uid = 0;
 	AuthData.nt = 0;
 	AuthData.first_auth = true;
 	AuthData.ks2 = 0;
 	AuthData.ks3 = 0;
+	AuthData.block = 0;
+	AuthData.keytype = 0;
 }
 
 /**
@@ -239,6 +326,8 @@ void annotateIso14443a(char *exp, size_t size, uint8_t* cmd, uint8_t cmdsize)
 		if ( cmdsize > 3) {
 			snprintf(exp,size,"AUTH-A(%d)",cmd[1]); 
 			MifareAuthState = masNt;
+			AuthData.block = cmd[1];
+			AuthData.keytype = 0;
 		} else {
 			//	case MIFARE_ULEV1_VERSION :  both 0x60.
 			snprintf(exp,size,"EV1 VERSION");
@@ -246,6 +335,8 @@ void annotateIso14443a(char *exp, size_t size, uint8_t* cmd, uint8_t cmdsize)
 		break;
 	case MIFARE_AUTH_KEYB:
 		MifareAuthState = masNt;
+		AuthData.block = cmd[1];
+		AuthData.keytype = 1;
 		snprintf(exp,size,"AUTH-B(%d)",cmd[1]); 
 		break;
 	case MIFARE_MAGICWUPC1:			snprintf(exp,size,"MAGIC WUPC1"); break;
@@ -399,6 +490,7 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
 				AuthData.ks3);
 			
 			AuthData.first_auth = false;
+			StoreTraceKey(&AuthData, mfLastKey);
 
 			traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
 		} else {
@@ -407,31 +499,57 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
 				traceCrypto1 = NULL;
 			}
 
+			// check key already found for this sector
+			uint64_t key;
+			if (FindTraceKey(&AuthData, &key) && NestedCheckKey(key, &AuthData, cmd, cmdsize, parity)) {
+				PrintAndLog("            |          * | key | known key:%012"PRIx64"                ks2:%08x ks3:%08x |     |", 
+					key,
+					AuthData.ks2,
+					AuthData.ks3);
+
+				mfLastKey = key;
+				traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
+			}
+
 			// check last used key
-			if (mfLastKey) {
+			if (!traceCrypto1 && mfLastKey) {
 				if (NestedCheckKey(mfLastKey, &AuthData, cmd, cmdsize, parity)) {
 					PrintAndLog("            |          * | key | last used key:%012"PRIx64"            ks2:%08x ks3:%08x |     |", 
 						mfLastKey,
 						AuthData.ks2,
 						AuthData.ks3);
 
+				StoreTraceKey(&AuthData, mfLastKey);
 				traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
 				};
 			}
 			
-			// check default keys
+			// check dictionary keys
 			if (!traceCrypto1) {
-				for (int defaultKeyCounter = 0; defaultKeyCounter < MifareDefaultKeysSize; defaultKeyCounter++){
-					if (NestedCheckKey(MifareDefaultKeys[defaultKeyCounter], &AuthData, cmd, cmdsize, parity)) {
-						PrintAndLog("            |          * | key | default key:%012"PRIx64"              ks2:%08x ks3:%08x |     |", 
-							MifareDefaultKeys[defaultKeyCounter],
-							AuthData.ks2,
-							AuthData.ks3);
-
-						mfLastKey = MifareDefaultKeys[defaultKeyCounter];
-						traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
-						break;
-					};
+				if (!TraceKeyDicLoaded) {
+					if (mfKeyDicAddDefaults(&TraceKeyDic))
+						mfKeyDicFree(&TraceKeyDic);		// out of memory, try again with the next authentication
+					else
+						TraceKeyDicLoaded = true;
+				}
+				// bitsliced pre-check of ar/at, full check of the remaining candidates
+				mfkeydic_t candidates;
+				mfKeyDicInit(&candidates);
+				mfkeydic_t *dic = &TraceKeyDic;
+				if (mfKeyDicFilterAuth(&TraceKeyDic, AuthData.uid, AuthData.nt_enc, AuthData.nr_enc, AuthData.ar_enc, AuthData.at_enc, &candidates) >= 0)
+					dic = &candidates;
+				TNestedKeyCheck keycheck = {&AuthData, cmd, cmdsize, parity};
+				bool found = mfKeySearch(dic, NestedKeyCheck, &keycheck, &key);
+				mfKeyDicFree(&candidates);
+				if (found && NestedCheckKey(key, &AuthData, cmd, cmdsize, parity)) {
+					PrintAndLog("            |          * | key | dictionary key:%012"PRIx64"           ks2:%08x ks3:%08x |     |", 
+						key,
+						AuthData.ks2,
+						AuthData.ks3);
+
+					mfLastKey = key;
+					StoreTraceKey(&AuthData, mfLastKey);
+					traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
 				}
 			}
 			
@@ -459,6 +577,7 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
 								mfLastKey,
 								AuthData.ks2,
 								AuthData.ks3);
+							StoreTraceKey(&AuthData, mfLastKey);
 
 							traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
 							break;
@@ -542,42 +661,57 @@ bool NTParityChk(TAuthData *ad, uint32_t ntx) {
 	return true;
 }
 
-bool NestedCheckKey(uint64_t key, TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity) {
+// checks a key against a nested authentication and the first encrypted frame after it.
+// Doesn't modify any state, safe to call from several threads.
+static bool CheckNestedKey(uint64_t key, TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, uint32_t *nt) {
 	uint8_t buf[32] = {0};
-	struct Crypto1State *pcs;
-	
-	AuthData.ks2 = 0;
-	AuthData.ks3 = 0;
+	struct Crypto1State cs;
 
-	pcs = crypto1_create(key);
-	uint32_t nt1 = crypto1_word(pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
+	crypto1_init(&cs, key);
+	uint32_t nt1 = crypto1_word(&cs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
 	uint32_t ar = prng_successor(nt1, 64);
 	uint32_t at = prng_successor(nt1, 96);
 
-	crypto1_word(pcs, ad->nr_enc, 1);
-//	uint32_t nr1 = crypto1_word(pcs, ad->nr_enc, 1) ^ ad->nr_enc;  // if needs deciphered nr
-	uint32_t ar1 = crypto1_word(pcs, 0, 0) ^ ad->ar_enc;
-	uint32_t at1 = crypto1_word(pcs, 0, 0) ^ ad->at_enc;
+	crypto1_word(&cs, ad->nr_enc, 1);
+//	uint32_t nr1 = crypto1_word(&cs, ad->nr_enc, 1) ^ ad->nr_enc;  // if needs deciphered nr
+	uint32_t ar1 = crypto1_word(&cs, 0, 0) ^ ad->ar_enc;
+	uint32_t at1 = crypto1_word(&cs, 0, 0) ^ ad->at_enc;
 
-	if (!(ar == ar1 && at == at1 && NTParityChk(ad, nt1))) {
-		crypto1_destroy(pcs);
+	if (!(ar == ar1 && at == at1 && NTParityChk(ad, nt1)))
 		return false;
-	}
 
 	memcpy(buf, cmd, cmdsize);
-	mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
-	
-	crypto1_destroy(pcs);
-	
+	mf_crypto1_decrypt(&cs, buf, cmdsize, 0);
+
 	if (!CheckCrypto1Parity(cmd, cmdsize, buf, parity))
 		return false;
 
 	if(!CheckCrc14443(CRC_14443_A, buf, cmdsize)) 
 		return false;
-	
-	AuthData.nt = nt1;
-	AuthData.ks2 = AuthData.ar_enc ^ ar;
-	AuthData.ks3 = AuthData.at_enc ^ at;
+
+	*nt = nt1;
+	return true;
+}
+
+static bool NestedKeyCheck(uint64_t key, void *data) {
+	TNestedKeyCheck *kc = data;
+	uint32_t nt;
+
+	return CheckNestedKey(key, kc->ad, kc->cmd, kc->cmdsize, kc->parity, &nt);
+}
+
+bool NestedCheckKey(uint64_t key, TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity) {
+	uint32_t nt;
+
+	ad->ks2 = 0;
+	ad->ks3 = 0;
+
+	if (!CheckNestedKey(key, ad, cmd, cmdsize, parity, &nt))
+		return false;
+
+	ad->nt = nt;
+	ad->ks2 = ad->ar_enc ^ prng_successor(nt, 64);
+	ad->ks3 = ad->at_enc ^ prng_successor(nt, 96);
 
 	return true;
 }
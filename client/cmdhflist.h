@@ -27,8 +27,12 @@ typedef struct {
 	bool first_auth;    // is first authentication
 	uint32_t ks2;		// ar ^ ar_enc
 	uint32_t ks3;       // at ^ at_enc
+	uint8_t block;      // authenticated block
+	uint8_t keytype;    // 0 = key A, 1 = key B
 } TAuthData;
 extern void ClearAuthData();
+extern void ClearTraceKeys(void);
+extern int AddTraceKeysFile(const char *filename);
 
 extern uint8_t iso14443A_CRC_check(bool isResponse, uint8_t* data, uint8_t len);
 extern uint8_t mifare_CRC_check(bool isResponse, uint8_t* data, uint8_t len);
@@ -30,6 +30,8 @@
 #include "cliparser/cliparser.h"
 #include "cmdhf14a.h"
 #include "mifare4.h"
+#include "mftracekeys.h"
+#include "crypto1_bs.h"
 
 #define NESTED_SECTOR_RETRY     10			// how often we try mfested() until we give up
 
@@ -272,60 +274,35 @@ static int ParamCardSizeBlocks(const char c) {
 	return numBlocks;
 }
 
-int CmdHF14AMfDump(const char *Cmd)
+// C1C2C3 of the data areas 0..2 and the sector trailer
+static void mfAccessRights(uint8_t *trailer, uint8_t *rights)
 {
-	uint8_t sectorNo, blockNo;
+	uint8_t *data = trailer + 6;
+	rights[0] = ((data[1] & 0x10)>>2) | ((data[2] & 0x1)<<1) | ((data[2] & 0x10)>>4); // C1C2C3 for data area 0
+	rights[1] = ((data[1] & 0x20)>>3) | ((data[2] & 0x2)<<0) | ((data[2] & 0x20)>>5); // C1C2C3 for data area 1
+	rights[2] = ((data[1] & 0x40)>>4) | ((data[2] & 0x4)>>1) | ((data[2] & 0x40)>>6); // C1C2C3 for data area 2
+	rights[3] = ((data[1] & 0x80)>>5) | ((data[2] & 0x8)>>2) | ((data[2] & 0x80)>>7); // C1C2C3 for sector trailer
+}
 
-	uint8_t keyA[40][6];
-	uint8_t keyB[40][6];
-	uint8_t rights[40][4];
-	uint8_t carddata[256][16];
-	uint8_t numSectors = 16;
+static void mfDefaultAccessRights(uint8_t *rights)
+{
+	rights[0] = rights[1] = rights[2] = 0x00;
+	rights[3] = 0x01;
+}
 
-	FILE *fin;
-	FILE *fout;
+static void mfFillTrailerKeys(uint8_t *trailer, uint8_t *keyA, uint8_t *keyB)
+{
+	memcpy(trailer, keyA, 6);
+	memcpy(trailer + 10, keyB, 6);
+}
 
+// one block per command
+static bool mfDumpBlocks(uint8_t numSectors, uint8_t keyA[][6], uint8_t keyB[][6], uint8_t carddata[][16])
+{
+	uint8_t sectorNo, blockNo;
+	uint8_t rights[40][4];
 	UsbCommand resp;
 
-	char cmdp = param_getchar(Cmd, 0);
-	numSectors = ParamCardSizeSectors(cmdp);
-
-	if (strlen(Cmd) > 1 || cmdp == 'h' || cmdp == 'H') {
-		PrintAndLog("Usage:   hf mf dump [card memory]");
-		PrintAndLog("  [card memory]: 0 = 320 bytes (Mifare Mini), 1 = 1K (default), 2 = 2K, 4 = 4K");
-		PrintAndLog("");
-		PrintAndLog("Samples: hf mf dump");
-		PrintAndLog("         hf mf dump 4");
-		return 0;
-	}
-
-	if ((fin = fopen("dumpkeys.bin","rb")) == NULL) {
-		PrintAndLog("Could not find file dumpkeys.bin");
-		return 1;
-	}
-
-	// Read keys A from file
-	for (sectorNo=0; sectorNo<numSectors; sectorNo++) {
-		size_t bytes_read = fread(keyA[sectorNo], 1, 6, fin);
-		if (bytes_read != 6) {
-			PrintAndLog("File reading error.");
-			fclose(fin);
-			return 2;
-		}
-	}
-
-	// Read keys B from file
-	for (sectorNo=0; sectorNo<numSectors; sectorNo++) {
-		size_t bytes_read = fread(keyB[sectorNo], 1, 6, fin);
-		if (bytes_read != 6) {
-			PrintAndLog("File reading error.");
-			fclose(fin);
-			return 2;
-		}
-	}
-
-	fclose(fin);
-
 	PrintAndLog("|-----------------------------------------|");
 	PrintAndLog("|------ Reading sector access bits...-----|");
 	PrintAndLog("|-----------------------------------------|");
@@ -340,20 +317,15 @@ int CmdHF14AMfDump(const char *Cmd)
 				uint8_t isOK  = resp.arg[0] & 0xff;
 				uint8_t *data  = resp.d.asBytes;
 				if (isOK){
-					rights[sectorNo][0] = ((data[7] & 0x10)>>2) | ((data[8] & 0x1)<<1) | ((data[8] & 0x10)>>4); // C1C2C3 for data area 0
-					rights[sectorNo][1] = ((data[7] & 0x20)>>3) | ((data[8] & 0x2)<<0) | ((data[8] & 0x20)>>5); // C1C2C3 for data area 1
-					rights[sectorNo][2] = ((data[7] & 0x40)>>4) | ((data[8] & 0x4)>>1) | ((data[8] & 0x40)>>6); // C1C2C3 for data area 2
-					rights[sectorNo][3] = ((data[7] & 0x80)>>5) | ((data[8] & 0x8)>>2) | ((data[8] & 0x80)>>7); // C1C2C3 for sector trailer
+					mfAccessRights(data, rights[sectorNo]);
 					break;
 				} else if (tries == 2) { // on last try set defaults
 					PrintAndLog("Could not get access rights for sector %2d. Trying with defaults...", sectorNo);
-					rights[sectorNo][0] = rights[sectorNo][1] = rights[sectorNo][2] = 0x00;
-					rights[sectorNo][3] = 0x01;
+					mfDefaultAccessRights(rights[sectorNo]);
 				}
 			} else {
 				PrintAndLog("Command execute timeout when trying to read access rights for sector %2d. Trying with defaults...", sectorNo);
-				rights[sectorNo][0] = rights[sectorNo][1] = rights[sectorNo][2] = 0x00;
-				rights[sectorNo][3] = 0x01;
+				mfDefaultAccessRights(rights[sectorNo]);
 			}
 		}
 	}
@@ -400,18 +372,7 @@ int CmdHF14AMfDump(const char *Cmd)
 				isOK  = resp.arg[0] & 0xff;
 				uint8_t *data  = resp.d.asBytes;
 				if (blockNo == NumBlocksPerSector(sectorNo) - 1) {		// sector trailer. Fill in the keys.
-					data[0]  = (keyA[sectorNo][0]);
-					data[1]  = (keyA[sectorNo][1]);
-					data[2]  = (keyA[sectorNo][2]);
-					data[3]  = (keyA[sectorNo][3]);
-					data[4]  = (keyA[sectorNo][4]);
-					data[5]  = (keyA[sectorNo][5]);
-					data[10] = (keyB[sectorNo][0]);
-					data[11] = (keyB[sectorNo][1]);
-					data[12] = (keyB[sectorNo][2]);
-					data[13] = (keyB[sectorNo][3]);
-					data[14] = (keyB[sectorNo][4]);
-					data[15] = (keyB[sectorNo][5]);
+					mfFillTrailerKeys(data, keyA[sectorNo], keyB[sectorNo]);
 				}
 				if (isOK) {
 					memcpy(carddata[FirstBlockOfSector(sectorNo) + blockNo], data, 16);
@@ -429,6 +390,148 @@ int CmdHF14AMfDump(const char *Cmd)
 		}
 	}
 
+	return isOK;
+}
+
+// one command per sector and pass, the commands of the following sectors are queued
+static bool mfDumpSectors(uint8_t numSectors, uint8_t keyA[][6], uint8_t keyB[][6], uint8_t carddata[][16])
+{
+	uint8_t sectorNo, blockNo;
+	uint8_t rights[40][4];
+	uint16_t blocks[40];
+	uint16_t keyBblocks[40] = {0};
+	uint8_t tries;
+	int res = 0;
+
+	PrintAndLog("|-----------------------------------------|");
+	PrintAndLog("|------ Reading sector access bits...-----|");
+	PrintAndLog("|-----------------------------------------|");
+	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+		blocks[sectorNo] = 1 << (NumBlocksPerSector(sectorNo) - 1);
+	}
+	for (tries = 0; tries < 3; tries++) {
+		res = mfReadSectorBlocks(numSectors, keyA, keyB, blocks, keyBblocks, &carddata[0][0]);
+		if (res != 2) break;
+	}
+	if (res == 1) {
+		PrintAndLog("Command execute timeout when trying to read access rights.");
+		return false;
+	}
+	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+		if (blocks[sectorNo]) {
+			PrintAndLog("Could not get access rights for sector %2d. Trying with defaults...", sectorNo);
+			mfDefaultAccessRights(rights[sectorNo]);
+		} else {
+			mfAccessRights(carddata[FirstBlockOfSector(sectorNo) + NumBlocksPerSector(sectorNo) - 1], rights[sectorNo]);
+		}
+	}
+
+	PrintAndLog("|-----------------------------------------|");
+	PrintAndLog("|----- Dumping all blocks to file... -----|");
+	PrintAndLog("|-----------------------------------------|");
+
+	bool isOK = true;
+	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+		// the sector trailer is read again if the first pass failed
+		blocks[sectorNo] |= (1 << (NumBlocksPerSector(sectorNo) - 1)) - 1;
+		uint8_t area_blocks = (NumBlocksPerSector(sectorNo) == 4) ? 1 : 5;
+		for (uint8_t data_area = 0; data_area < 3; data_area++) {
+			if ((rights[sectorNo][data_area] == 0x03) || (rights[sectorNo][data_area] == 0x05)) {	// only key B would work
+				keyBblocks[sectorNo] |= ((1 << area_blocks) - 1) << (data_area * area_blocks);
+			} else if (rights[sectorNo][data_area] == 0x07) {										// no key would work
+				PrintAndLog("Access rights do not allow reading of sector %2d block %3d", sectorNo, data_area * area_blocks);
+				isOK = false;
+			}
+		}
+	}
+	if (!isOK) {
+		return false;
+	}
+
+	for (tries = 0; tries < 3; tries++) {
+		res = mfReadSectorBlocks(numSectors, keyA, keyB, blocks, keyBblocks, &carddata[0][0]);
+		if (res != 2) break;
+	}
+	if (res == 1) {
+		PrintAndLog("Command execute timeout when trying to read the sectors.");
+		return false;
+	}
+
+	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+		for (blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+			if (blocks[sectorNo] & (1 << blockNo)) {
+				PrintAndLog("Could not read block %2d of sector %2d", blockNo, sectorNo);
+				isOK = false;
+			} else {
+				PrintAndLog("Successfully read block %2d of sector %2d.", blockNo, sectorNo);
+			}
+		}
+		// sector trailer. Fill in the keys.
+		mfFillTrailerKeys(carddata[FirstBlockOfSector(sectorNo) + NumBlocksPerSector(sectorNo) - 1], keyA[sectorNo], keyB[sectorNo]);
+	}
+
+	return isOK;
+}
+
+int CmdHF14AMfDump(const char *Cmd)
+{
+	uint8_t sectorNo;
+
+	uint8_t keyA[40][6];
+	uint8_t keyB[40][6];
+	uint8_t carddata[256][16];
+	uint8_t numSectors = 16;
+
+	FILE *fin;
+	FILE *fout;
+
+	char cmdp = param_getchar(Cmd, 0);
+	numSectors = ParamCardSizeSectors(cmdp);
+
+	if (strlen(Cmd) > 1 || cmdp == 'h' || cmdp == 'H') {
+		PrintAndLog("Usage:   hf mf dump [card memory]");
+		PrintAndLog("  [card memory]: 0 = 320 bytes (Mifare Mini), 1 = 1K (default), 2 = 2K, 4 = 4K");
+		PrintAndLog("");
+		PrintAndLog("Samples: hf mf dump");
+		PrintAndLog("         hf mf dump 4");
+		return 0;
+	}
+
+	if ((fin = fopen("dumpkeys.bin","rb")) == NULL) {
+		PrintAndLog("Could not find file dumpkeys.bin");
+		return 1;
+	}
+
+	// Read keys A from file
+	for (sectorNo=0; sectorNo<numSectors; sectorNo++) {
+		size_t bytes_read = fread(keyA[sectorNo], 1, 6, fin);
+		if (bytes_read != 6) {
+			PrintAndLog("File reading error.");
+			fclose(fin);
+			return 2;
+		}
+	}
+
+	// Read keys B from file
+	for (sectorNo=0; sectorNo<numSectors; sectorNo++) {
+		size_t bytes_read = fread(keyB[sectorNo], 1, 6, fin);
+		if (bytes_read != 6) {
+			PrintAndLog("File reading error.");
+			fclose(fin);
+			return 2;
+		}
+	}
+
+	fclose(fin);
+
+	memset(carddata, 0, sizeof(carddata));
+	bool isOK;
+	if (mfSectorCommandsSupported()) {
+		isOK = mfDumpSectors(numSectors, keyA, keyB, carddata);
+	} else {
+		isOK = mfDumpBlocks(numSectors, keyA, keyB, carddata);
+	}
+
 	if (isOK) {
 		if ((fout = fopen("dumpdata.bin","wb")) == NULL) {
 			PrintAndLog("Could not create file name dumpdata.bin");
@@ -447,8 +550,8 @@ int CmdHF14AMfRestore(const char *Cmd)
 {
 	uint8_t sectorNo,blockNo;
 	uint8_t keyType = 0;
-	uint8_t key[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-	uint8_t bldata[16] = {0x00};
+	uint8_t key[40][6];
+	uint8_t carddata[256][16];
 	uint8_t keyA[40][6];
 	uint8_t keyB[40][6];
 	uint8_t numSectors;
@@ -504,51 +607,59 @@ int CmdHF14AMfRestore(const char *Cmd)
 		PrintAndLog("Could not find file dumpdata.bin");
 		return 1;
 	}
+
+	uint16_t numblocks = FirstBlockOfSector(numSectors - 1) + NumBlocksPerSector(numSectors - 1);
+	size_t bytes_read = fread(carddata, 1, 16 * numblocks, fdump);
+	fclose(fdump);
+	if (bytes_read != 16 * numblocks) {
+		PrintAndLog("File reading error (dumpdata.bin).");
+		return 2;
+	}
+
 	PrintAndLog("Restoring dumpdata.bin to card");
 
+	uint16_t blocks[40];
 	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
-		for(blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
-			UsbCommand c = {CMD_MIFARE_WRITEBL, {FirstBlockOfSector(sectorNo) + blockNo, keyType, 0}};
-			memcpy(c.d.asBytes, key, 6);
-
-			size_t bytes_read = fread(bldata, 1, 16, fdump);
-			if (bytes_read != 16) {
-				PrintAndLog("File reading error (dumpdata.bin).");
-				fclose(fdump);
-				return 2;
-			}
+		memset(key[sectorNo], 0xFF, 6);
+		blocks[sectorNo] = (1 << NumBlocksPerSector(sectorNo)) - 1;
+		mfFillTrailerKeys(carddata[FirstBlockOfSector(sectorNo) + NumBlocksPerSector(sectorNo) - 1], keyA[sectorNo], keyB[sectorNo]);
+		for (blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+			PrintAndLog("Writing to block %3d: %s", FirstBlockOfSector(sectorNo) + blockNo, sprint_hex(carddata[FirstBlockOfSector(sectorNo) + blockNo], 16));
+		}
+	}
 
-			if (blockNo == NumBlocksPerSector(sectorNo) - 1) {	// sector trailer
-				bldata[0]  = (keyA[sectorNo][0]);
-				bldata[1]  = (keyA[sectorNo][1]);
-				bldata[2]  = (keyA[sectorNo][2]);
-				bldata[3]  = (keyA[sectorNo][3]);
-				bldata[4]  = (keyA[sectorNo][4]);
-				bldata[5]  = (keyA[sectorNo][5]);
-				bldata[10] = (keyB[sectorNo][0]);
-				bldata[11] = (keyB[sectorNo][1]);
-				bldata[12] = (keyB[sectorNo][2]);
-				bldata[13] = (keyB[sectorNo][3]);
-				bldata[14] = (keyB[sectorNo][4]);
-				bldata[15] = (keyB[sectorNo][5]);
+	if (mfSectorCommandsSupported()) {
+		if (mfWriteSectorBlocks(numSectors, key, keyType, blocks, &carddata[0][0]) == 1) {
+			PrintAndLog("Command execute timeout");
+			return 1;
+		}
+		for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+			for (blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+				if (blocks[sectorNo] & (1 << blockNo)) {
+					PrintAndLog("Could not write block %3d", FirstBlockOfSector(sectorNo) + blockNo);
+				}
 			}
+		}
+		return 0;
+	}
 
-			PrintAndLog("Writing to block %3d: %s", FirstBlockOfSector(sectorNo) + blockNo, sprint_hex(bldata, 16));
-
-			memcpy(c.d.asBytes + 10, bldata, 16);
+	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+		for(blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+			UsbCommand c = {CMD_MIFARE_WRITEBL, {FirstBlockOfSector(sectorNo) + blockNo, keyType, 0}};
+			memcpy(c.d.asBytes, key[sectorNo], 6);
+			memcpy(c.d.asBytes + 10, carddata[FirstBlockOfSector(sectorNo) + blockNo], 16);
 			SendCommand(&c);
 
 			UsbCommand resp;
 			if (WaitForResponseTimeout(CMD_ACK,&resp,1500)) {
 				uint8_t isOK  = resp.arg[0] & 0xff;
-				PrintAndLog("isOk:%02x", isOK);
+				PrintAndLog("block %3d isOk:%02x", FirstBlockOfSector(sectorNo) + blockNo, isOK);
 			} else {
 				PrintAndLog("Command execute timeout");
 			}
 		}
 	}
 
-	fclose(fdump);
 	return 0;
 }
 
@@ -1210,7 +1321,19 @@ int CmdHF14AMfChk(const char *Cmd)
 	if (SectorsCnt) {
 		PrintAndLog("To cancel this operation press the button on the proxmark...");
 		printf("--");
-		for (uint32_t c = 0; c < keycnt; c += max_keys) {
+		// whole dictionary in one go, falls back to chunks for big dictionaries or old firmware
+		res = mfCheckKeysFast(SectorsCnt, keyType, btimeout14a, true, keycnt, keyBlock, e_sector);
+		if (res == 0) {
+			foundAKey = true;
+		} else if (res == 2) {
+			printf("\n");
+			PrintAndLog("Can't select card or operation cancelled");
+		} else if (res == 5) {
+			printf("\n");
+			PrintAndLog("Command execute timeout");
+		}
+		bool chunked = (res == 1 || res == 4);
+		for (uint32_t c = 0; chunked && c < keycnt; c += max_keys) {
 
 			uint32_t size = keycnt-c > max_keys ? max_keys : keycnt-c;
 			res = mfCheckKeysSec(SectorsCnt, keyType, btimeout14a, true, size, &keyBlock[6 * c], e_sector); // timeout is (ms * 106)/10 or us*0.0106
@@ -2703,6 +2826,93 @@ int CmdHF14AMfAuth4(const char *cmd) {
 	return MifareAuth4(NULL, keyn, key, true, false, true);
 }
 
+int CmdHF14AMfTraceKeys(const char *cmd) {
+	CLIParserInit("hf mf tracekeys", 
+		"Recovers the keys of all authentications in saved traces (hf list save / hf mf sniff) and writes decrypted transcripts.\n"
+		"First authentications are solved directly, nested ones with the keys already found, the dictionaries and the weak PRNG nonce distance.", 
+		"Usage:\n\thf mf tracekeys traces/ -> all *.trc files in directory traces\n"
+			"\thf mf tracekeys -d mykeys.dic -o out traces/ a.trc -> add dictionary, write mfkeys.txt and transcripts to directory out\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_strx0("dD",  "dic",    "<file>", "additional key dictionary for nested authentications"),
+		arg_str0("oO",  "out",     "<dir>", "output directory for mfkeys.txt and <trace>.txt transcripts"),
+		arg_strx1(NULL,  NULL,     "<trace file or directory>", NULL),
+		arg_param_end
+	};
+	CLIExecWithReturn(cmd, argtable, false);
+
+	mfkeydic_t dic;
+	mfKeyDicInit(&dic);
+	if (mfKeyDicAddDefaults(&dic)) {
+		PrintAndLog("Cannot allocate memory for the dictionary");
+		CLIParserFree();
+		mfKeyDicFree(&dic);
+		return 2;
+	}
+	struct arg_str *dics = arg_get_str(1);
+	for (int i = 0; i < dics->count; i++) {
+		if (mfKeyDicLoadFile(&dic, dics->sval[i]) < 0) {
+			CLIParserFree();
+			mfKeyDicFree(&dic);
+			return 1;
+		}
+	}
+
+	char outdir[FILE_PATH_SIZE] = {0};
+	int outdirlen = 0;
+	CLIParamStrToBuf(arg_get_str(2), (uint8_t *)outdir, sizeof(outdir) - 1, &outdirlen);
+
+	struct arg_str *traces = arg_get_str(3);
+	char *tracenames[traces->count];
+	for (int i = 0; i < traces->count; i++)
+		tracenames[i] = (char *)traces->sval[i];
+
+	mftracekeys_t keys;
+	int res = mfTraceKeysRecover(tracenames, traces->count, &dic, outdirlen ? outdir : NULL, &keys);
+	CLIParserFree();
+	mfKeyDicFree(&dic);
+	if (res)
+		return res;
+
+	PrintAndLog("|---------|-----|----------------|---|");
+	PrintAndLog("|   uid   | sec | key            |A/B|");
+	PrintAndLog("|---------|-----|----------------|---|");
+	for (size_t i = 0; i < keys.count; i++) {
+		PrintAndLog("|%08x | %03d | %012" PRIx64 "   | %c |", keys.keys[i].uid, keys.keys[i].sector, keys.keys[i].key, keys.keys[i].keytype ? 'B' : 'A');
+	}
+	PrintAndLog("|---------|-----|----------------|---|");
+
+	mfTraceKeysFree(&keys);
+	return 0;
+}
+
+int CmdHF14AMfSelfTest(const char *cmd) {
+	CLIParserInit("hf mf selftest",
+		"Tests the bitsliced Crypto1 implementation against the reference for all SIMD instruction sets of this CPU.",
+		"Usage:\n\thf mf selftest -v -> test with verbose output\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_lit0("vV",  "verbose", "show the result of each test"),
+		arg_param_end
+	};
+	CLIExecWithReturn(cmd, argtable, true);
+
+	bool verbose = arg_get_lit(1);
+	CLIParserFree();
+
+	bool res = crypto1_bs_selftest(verbose);
+
+	PrintAndLog("\n--------------------------");
+	if (res)
+		PrintAndLog("Tests [OK].");
+	else
+		PrintAndLog("Test(s) [ERROR].");
+
+	return res ? 0 : 1;
+}
+
 static command_t CommandTable[] =
 {
   {"help",             CmdHelp,                 1, "This help"},
@@ -2734,6 +2944,8 @@ static command_t CommandTable[] =
   {"cload",            CmdHF14AMfCLoad,         0, "Load dump into magic Chinese card"},
   {"csave",            CmdHF14AMfCSave,         0, "Save dump from magic Chinese card into file or emulator"},
   {"decrypt",          CmdDecryptTraceCmds,     1, "[nt] [ar_enc] [at_enc] [data] - to decrypt snoop or trace"},
+  {"tracekeys",        CmdHF14AMfTraceKeys,     1, "Recover keys from saved trace files and decrypt them"},
+  {"selftest",         CmdHF14AMfSelfTest,      1, "Test bitsliced Crypto1 against the reference implementation"},
   {NULL,               NULL,                    0, NULL}
 };
 
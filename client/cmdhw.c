@@ -14,11 +14,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <inttypes.h>
 #include "ui.h"
 #include "comms.h"
 #include "cmdparser.h"
 #include "cmdmain.h"
 #include "cmddata.h"
+#include "util.h"
+#include "util_posix.h"
+#include "cliparser/cliparser.h"
+#include "perf_stats.h"
+#include "profiler.h"
+#include <jansson.h>
 
 /* low-level hardware control */
 
@@ -416,6 +423,8 @@ int CmdVersion(const char *Cmd)
 		PrintAndLog((char*)resp.d.asBytes);
 		lookupChipID(resp.arg[0], resp.arg[1]);
 	}
+	// this is run at the connect, the tagged requests depend on it
+	ProbeDeviceCapabilities();
 	return 0;
 }
 
@@ -431,13 +440,49 @@ int CmdStatus(const char *Cmd)
 }
 
 
+// pings with up to PING_PIPELINE_DEPTH requests on the way
+#define PING_PIPELINE_DEPTH		(CMD_BUFFER_SIZE / 2)
+
+static int CmdPingPipelined(uint32_t count)
+{
+	uint32_t tags[PING_PIPELINE_DEPTH];
+	uint32_t sent = 0, received = 0;
+	UsbCommand c = {CMD_PING};
+
+	clearCommandBuffer();
+	bool tagged = TaggedRequestsSupported();
+	uint64_t start_time = msclock();
+	while (received < count) {
+		while (sent < count && sent - received < PING_PIPELINE_DEPTH) {
+			tags[sent % PING_PIPELINE_DEPTH] = SendCommandTagged(&c);
+			sent++;
+		}
+		if (!WaitForTaggedResponseTimeout(tags[received % PING_PIPELINE_DEPTH], CMD_ACK, NULL, 1000)) {
+			PrintAndLog("Ping %u failed", received);
+			return 1;
+		}
+		received++;
+	}
+	uint64_t duration = msclock() - start_time;
+
+	PrintAndLog("%u pings successful in %" PRIu64 " ms (%s), %.2f ms per ping", count, duration,
+		tagged ? "tagged, pipelined" : "untagged, old firmware", (double)duration / count);
+	return 0;
+}
+
 int CmdPing(const char *Cmd)
 {
+	uint32_t count = param_get32ex(Cmd, 0, 1, 10);
+	if (count > 1) {
+		return CmdPingPipelined(count);
+	}
+
 	clearCommandBuffer();
 	UsbCommand resp;
 	UsbCommand c = {CMD_PING};
 	SendCommand(&c);
 	if (WaitForResponseTimeout(CMD_ACK,&resp,1000)) {
+		SetDeviceCapabilities(resp.arg[0]);
 		PrintAndLog("Ping successful");
 	}else{
 		PrintAndLog("Ping failed");
@@ -445,6 +490,199 @@ int CmdPing(const char *Cmd)
 	return 0;
 }
 
+static const char *PerfSectionNames[PERF_SECTIONS] = {
+	"14a sniff", "14a reader decode", "14a tag decode",
+	"iclass sniff", "iclass reader decode", "iclass tag decode",
+	"LogTrace"
+};
+
+static const char *PerfCounterNames[PERF_COUNTERS] = {
+	"DMA overruns", "DMA aborts", "trace full", "frames logged",
+	"14a reader decode errors", "14a tag collisions",
+	"iclass reader decode errors", "iclass tag decode errors"
+};
+
+static const char *PerfHighWaterNames[PERF_HIGH_WATER_MARKS] = {
+	"DMA backlog", "trace length", "BigBuf allocated"
+};
+
+static uint32_t PerfHighWaterLimit(const perf_stats_t *ps, int hw)
+{
+	switch (hw) {
+		case PERF_HW_DMA_BACKLOG:  return ps->dma_buffer_size;
+		case PERF_HW_TRACE_LEN:    return ps->trace_size;
+		case PERF_HW_BIGBUF_ALLOC: return ps->bigbuf_size;
+	}
+	return 0;
+}
+
+static double PerfTicksToUs(const perf_stats_t *ps, uint64_t ticks)
+{
+	return ticks * 1e6 / ps->tick_hz;
+}
+
+static void PerfPrint(const perf_stats_t *ps)
+{
+	double elapsed_us = PerfTicksToUs(ps, ps->elapsed_ticks);
+	PrintAndLog("Elapsed %.3f s since the last reset", elapsed_us / 1e6);
+	PrintAndLog("");
+	PrintAndLog("section              |    calls |   total ms |   avg us |   max us | elapsed");
+	PrintAndLog("---------------------+----------+------------+----------+----------+--------");
+	for (int i = 0; i < PERF_SECTIONS; i++) {
+		const perf_section_t *sec = &ps->section[i];
+		if (!sec->calls)
+			continue;
+		double total_us = PerfTicksToUs(ps, sec->ticks);
+		PrintAndLog("%-20s | %8u | %10.3f | %8.2f | %8.2f | %5.1f %%", PerfSectionNames[i], sec->calls,
+			total_us / 1000, total_us / sec->calls, PerfTicksToUs(ps, sec->max_ticks),
+			elapsed_us > 0 ? 100 * total_us / elapsed_us : 0);
+	}
+	PrintAndLog("");
+	for (int i = 0; i < PERF_COUNTERS; i++)
+		PrintAndLog("%-28s %u", PerfCounterNames[i], ps->counter[i]);
+	PrintAndLog("");
+	for (int i = 0; i < PERF_HIGH_WATER_MARKS; i++)
+		PrintAndLog("%-28s %u of %u bytes", PerfHighWaterNames[i], ps->high_water[i], PerfHighWaterLimit(ps, i));
+}
+
+static int PerfSaveJson(const perf_stats_t *ps, const char *name)
+{
+	json_t *root = json_object();
+	json_object_set_new(root, "tick_hz", json_integer(ps->tick_hz));
+	json_object_set_new(root, "elapsed_ticks", json_integer(ps->elapsed_ticks));
+
+	json_t *sections = json_object();
+	for (int i = 0; i < PERF_SECTIONS; i++) {
+		const perf_section_t *sec = &ps->section[i];
+		json_object_set_new(sections, PerfSectionNames[i], json_pack("{s:I, s:I, s:I}",
+			"calls", (json_int_t)sec->calls, "ticks", (json_int_t)sec->ticks, "max_ticks", (json_int_t)sec->max_ticks));
+	}
+	json_object_set_new(root, "sections", sections);
+
+	json_t *counters = json_object();
+	for (int i = 0; i < PERF_COUNTERS; i++)
+		json_object_set_new(counters, PerfCounterNames[i], json_integer(ps->counter[i]));
+	json_object_set_new(root, "counters", counters);
+
+	json_t *high_water = json_object();
+	for (int i = 0; i < PERF_HIGH_WATER_MARKS; i++)
+		json_object_set_new(high_water, PerfHighWaterNames[i], json_pack("{s:I, s:I}",
+			"value", (json_int_t)ps->high_water[i], "limit", (json_int_t)PerfHighWaterLimit(ps, i)));
+	json_object_set_new(root, "high_water", high_water);
+
+	int res = json_dump_file(root, name, JSON_INDENT(2) | JSON_PRESERVE_ORDER);
+	json_decref(root);
+	if (res) {
+		PrintAndLog("Can't write %s", name);
+		return 1;
+	}
+	PrintAndLog("Saved to %s", name);
+	return 0;
+}
+
+int CmdPerf(const char *Cmd)
+{
+	CLIParserInit("hw perf",
+		"Shows the hot path counters of firmware built with -DWITH_PERF (see common/Makefile_Enabled_Options.common):\n"
+		"time spent in the sniffing loops, decoders and LogTrace, DMA and trace buffer high-water marks and error counts.",
+		"Usage:\n\thw perf -> show the counters since power up or the last reset\n"
+			"\thw perf -r -j perf.json -> save the counters to perf.json and reset them\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_lit0("rR",  "reset", "reset the counters after reading them"),
+		arg_str0("jJ",  "json",  "<file>", "save the counters as JSON"),
+		arg_param_end
+	};
+	CLIExecWithReturn(Cmd, argtable, true);
+	bool reset = arg_get_lit(1);
+	char jsonname[FILE_PATH_SIZE] = {0};
+	int jsonnamelen = 0;
+	CLIParamStrToBuf(arg_get_str(2), (uint8_t *)jsonname, sizeof(jsonname) - 1, &jsonnamelen);
+	CLIParserFree();
+
+	clearCommandBuffer();
+	UsbCommand c = {CMD_PERF_STATS, {reset, 0, 0}};
+	UsbCommand resp;
+	SendCommand(&c);
+	if (!WaitForResponseTimeout(CMD_ACK, &resp, 1000)) {
+		PrintAndLog("Command execute timeout");
+		return 1;
+	}
+	if (!resp.arg[0]) {
+		PrintAndLog("The firmware is built without WITH_PERF");
+		return 1;
+	}
+
+	// the structs may differ in their tail padding between the ARM and the host
+	perf_stats_t ps = {0};
+	memcpy(&ps, resp.d.asBytes, MIN(resp.arg[1], sizeof(ps)));
+	if (ps.version != PERF_STATS_VERSION || !ps.tick_hz) {
+		PrintAndLog("Unsupported counters version %u, update the client", ps.version);
+		return 1;
+	}
+
+	PerfPrint(&ps);
+	if (reset)
+		PrintAndLog("\nCounters reset");
+	if (jsonnamelen)
+		return PerfSaveJson(&ps, jsonname);
+	return 0;
+}
+
+int CmdProfile(const char *Cmd)
+{
+	CLIParserInit("hw profile",
+		"Client latency profiler. While it is on, the round trip of each request to the Proxmark until its first answer, "
+		"the time spent waiting for answers and the delay until the command takes the answer are recorded by command ID "
+		"(see include/usb_cmd.h), and wall and CPU time by CLI command. Without options shows the percentiles of all histograms.",
+		"Usage:\n\thw profile --on -> start recording\n"
+			"\thw profile -d -> show the full percentile distributions\n"
+			"\thw profile --off -t trace.json -> stop and save a trace for chrome://tracing or ui.perfetto.dev\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_lit0(NULL,  "on",           "start recording"),
+		arg_lit0(NULL,  "off",          "stop recording and show the results"),
+		arg_lit0("rR",  "reset",        "clear the recorded data"),
+		arg_lit0("dD",  "distribution", "show the full percentile distributions"),
+		arg_str0("tT",  "trace",        "<file>", "save the recorded events in Chrome trace event format"),
+		arg_lit0(NULL,  "selftest",     "check the histograms"),
+		arg_param_end
+	};
+	CLIExecWithReturn(Cmd, argtable, true);
+	bool on = arg_get_lit(1);
+	bool off = arg_get_lit(2);
+	bool reset = arg_get_lit(3);
+	bool distribution = arg_get_lit(4);
+	char tracename[FILE_PATH_SIZE] = {0};
+	int tracenamelen = 0;
+	CLIParamStrToBuf(arg_get_str(5), (uint8_t *)tracename, sizeof(tracename) - 1, &tracenamelen);
+	bool selftest = arg_get_lit(6);
+	CLIParserFree();
+
+	if (selftest)
+		return ProfilerSelftest();
+	if (on && off) {
+		PrintAndLog("Choose --on or --off");
+		return 1;
+	}
+
+	if (reset)
+		ProfilerReset();
+	if (off)
+		ProfilerEnable(false);
+	if (distribution || off || !(on || reset || tracenamelen))
+		ProfilerPrint(distribution);
+	if (tracenamelen && ProfilerSaveChromeTrace(tracename))
+		return 1;
+	if (on) {
+		ProfilerEnable(true);
+		PrintAndLog("Profiling on, show the results with hw profile");
+	}
+	return 0;
+}
+
 static command_t CommandTable[] = 
 {
 	{"help",          CmdHelp,        1, "This help"},
@@ -459,7 +697,9 @@ static command_t CommandTable[] =
 	{"tune",          CmdTune,        0, "['l'|'h'] -- Measure antenna tuning (option 'l' or 'h' to limit to LF or HF)"},
 	{"version",       CmdVersion,     0, "Show version information about the connected Proxmark"},
 	{"status",        CmdStatus,      0, "Show runtime status information about the connected Proxmark"},
-	{"ping",          CmdPing,        0, "Test if the pm3 is responsive"},
+	{"ping",          CmdPing,        0, "[<count>] -- Test if the pm3 is responsive, more than one ping are pipelined"},
+	{"perf",          CmdPerf,        0, "Show the hot path counters of firmware built with WITH_PERF"},
+	{"profile",       CmdProfile,     1, "Client latency profiler: request round trips by command ID, time by CLI command"},
 	{NULL, NULL, 0, NULL}
 };
 
@@ -23,5 +23,7 @@ int CmdSetDivisor(const char *Cmd);
 int CmdSetMux(const char *Cmd);
 int CmdTune(const char *Cmd);
 int CmdVersion(const char *Cmd);
+int CmdPerf(const char *Cmd);
+int CmdProfile(const char *Cmd);
 
 #endif
@@ -22,6 +22,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include "comms.h"
 #include "ui.h"
 #include "graph.h"
@@ -30,7 +32,9 @@
 #include "lfdemod.h" // for HIDdemodFSK
 #include "hidcardformats.h"
 #include "hidcardformatutils.h"
+#include "hidbulk.h"
 #include "util.h" // for param_get8,32,64
+#include "util_posix.h" // for msclock, msleep
 
 
 /**
@@ -270,6 +274,249 @@ int CmdHIDWrite(const char *Cmd) {
   return 0;
 }
 
+void usage_bulk(){
+  PrintAndLog("Usage:  lf hid bulk <format|all> [<field> <value|first-last>] {...} [w <file>] [s <ms>] [p]");
+  PrintAndLog("   Fields:    c: Card number (default 0-max)");
+  PrintAndLog("              f: Facility code (default 0)");
+  PrintAndLog("              i: Issue Level");
+  PrintAndLog("              o: OEM code");
+  PrintAndLog("   Output:    w <file>: write 'format,fc,cn,il,oem,id' lines to file");
+  PrintAndLog("              s <ms>: simulate each ID for <ms> milliseconds");
+  PrintAndLog("              p: clone each ID to a T55x7, asks for the next tag");
+  PrintAndLog("              without output option the IDs are printed");
+  PrintAndLog("          lf hid bulk test  - compare the bulk encoder with the format definitions");
+  PrintAndLog("          lf hid bulk bench - packing speed per format");
+  PrintAndLog("   example: lf hid bulk H10301 f 123 c 1000-1999 w ids.csv");
+  PrintAndLog("            lf hid bulk all f 10 c 5000 s 500");
+}
+
+// <value> or <first>-<last>, decimal
+static bool param_getrange(const char *Cmd, int paramnum, uint64_t *first, uint64_t *last){
+  char str[48];
+  if (param_getstr(Cmd, paramnum, str, sizeof(str)) == 0) return false;
+  int n = 0;
+  if (sscanf(str, "%" SCNu64 "-%" SCNu64 "%n", first, last, &n) == 2 && n == strlen(str))
+    return *first <= *last;
+  if (sscanf(str, "%" SCNu64 "%n", first, &n) == 1 && n == strlen(str)) {
+    *last = *first;
+    return true;
+  }
+  return false;
+}
+
+static void sprint_proxtagid(char *str, size_t len, hidproxmessage_t *packed){
+  if (packed->top != 0)
+    snprintf(str, len, "%x%08x%08x", packed->top, packed->mid, packed->bot);
+  else
+    snprintf(str, len, "%x%08x", packed->mid, packed->bot);
+}
+
+#define BULK_CHUNK 4096
+
+int CmdHIDBulk(const char *Cmd){
+  char format[16] = {0};
+  char filename[FILE_PATH_SIZE] = {0};
+  uint64_t first[HID_BULK_FIELDS] = {0}, last[HID_BULK_FIELDS] = {0};
+  bool ranged[HID_BULK_FIELDS] = {false};
+  uint32_t sim_ms = 0;
+  bool program = false;
+
+  param_getstr(Cmd, 0, format, sizeof(format));
+  if (format[0] == 0 || !strcmp(format, "h") || !strcmp(format, "help")) {
+    usage_bulk();
+    return 0;
+  }
+  if (!strcmp(format, "test")) {
+    bool ok = HIDBulkSelftest(true);
+    PrintAndLog("Tests %s", ok ? "[OK]" : "[FAILED]");
+    return ok ? 0 : 1;
+  }
+  if (!strcmp(format, "bench")) {
+    HIDBulkBench();
+    return 0;
+  }
+  int formatIndex = -1;
+  if (strcmp(format, "all")) {
+    formatIndex = HIDFindCardFormat(format);
+    if (formatIndex == -1) {
+      PrintAndLog("Unknown format: %s", format);
+      return 1;
+    }
+  }
+
+  uint8_t cmdp = 1;
+  while (param_getchar(Cmd, cmdp) != 0x00) {
+    int field = -1;
+    switch (param_getchar(Cmd, cmdp)) {
+      case 'F': case 'f': field = HID_BULK_FC; break;
+      case 'C': case 'c': field = HID_BULK_CN; break;
+      case 'I': case 'i': field = HID_BULK_IL; break;
+      case 'O': case 'o': field = HID_BULK_OEM; break;
+      case 'W': case 'w':
+        if (param_getstr(Cmd, cmdp+1, filename, sizeof(filename)) == 0) {
+          usage_bulk();
+          return 1;
+        }
+        cmdp += 2;
+        continue;
+      case 'S': case 's':
+        sim_ms = param_get32ex(Cmd, cmdp+1, 0, 10);
+        cmdp += 2;
+        continue;
+      case 'P': case 'p':
+        program = true;
+        cmdp++;
+        continue;
+      default:
+        PrintAndLog("Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+        return 1;
+    }
+    if (!param_getrange(Cmd, cmdp+1, &first[field], &last[field])) {
+      PrintAndLog("Invalid value for '%c', expected <value> or <first>-<last>", param_getchar(Cmd, cmdp));
+      return 1;
+    }
+    ranged[field] = true;
+    cmdp += 2;
+  }
+
+  FILE *f = NULL;
+  if (filename[0]) {
+    f = fopen(filename, "w");
+    if (f == NULL) {
+      PrintAndLog("Could not create file %s", filename);
+      return 1;
+    }
+  }
+
+  hidproxmessage_t *packed = malloc(BULK_CHUNK * sizeof(hidproxmessage_t));
+  if (packed == NULL) {
+    if (f) fclose(f);
+    return 1;
+  }
+
+  uint64_t total = 0, start_time = msclock();
+  bool aborted = false;
+  for (int i = formatIndex < 0 ? 0 : formatIndex; HIDGetCardFormat(i).Name && !aborted; i++) {
+    hidcardformat_t fmt = HIDGetCardFormat(i);
+    // the default card number range is all of them
+    uint64_t cn_last = ranged[HID_BULK_CN] ? last[HID_BULK_CN] : HIDBulkFieldMax(i, HID_BULK_CN);
+    bool fits = cn_last <= HIDBulkFieldMax(i, HID_BULK_CN);
+    for (int field = 0; field < HID_BULK_FIELDS; field++)
+      if (field != HID_BULK_CN) fits &= last[field] <= HIDBulkFieldMax(i, field);
+    if (!fits) {
+      if (formatIndex >= 0) PrintAndLog("The card data could not be encoded in the selected format.");
+      if (formatIndex >= 0) break;
+      continue;
+    }
+
+    hidproxcard_t card;
+    memset(&card, 0, sizeof(card));
+    uint64_t format_count = 0;
+    for (uint64_t oem = first[HID_BULK_OEM]; oem <= last[HID_BULK_OEM] && !aborted; oem++) {
+    for (uint64_t il = first[HID_BULK_IL]; il <= last[HID_BULK_IL] && !aborted; il++) {
+    for (uint64_t fc = first[HID_BULK_FC]; fc <= last[HID_BULK_FC] && !aborted; fc++) {
+      card.OEM = oem;
+      card.IssueLevel = il;
+      card.FacilityCode = fc;
+      uint64_t cn = first[HID_BULK_CN];
+      while (cn <= cn_last && !aborted) {
+        card.CardNumber = cn;
+        size_t n = HIDBulkPack(i, &card, MIN(BULK_CHUNK, cn_last - cn + 1), packed);
+        if (n == 0) break;
+        for (size_t k = 0; k < n && !aborted; k++) {
+          char id[32];
+          if (f == NULL && !sim_ms && !program) {
+            sprint_proxtagid(id, sizeof(id), &packed[k]);
+            PrintAndLog("%-8s FC %-6" PRIu64 " CN %-10" PRIu64 " ID %s", fmt.Name, fc, cn + k, id);
+            continue;
+          }
+          if (f) {
+            sprint_proxtagid(id, sizeof(id), &packed[k]);
+            fprintf(f, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%s\n", fmt.Name, fc, cn + k, il, oem, id);
+          }
+          if (sim_ms || program) {
+            sprint_proxtagid(id, sizeof(id), &packed[k]);
+            PrintAndLog("%s FC %" PRIu64 " CN %" PRIu64 " ID %s", fmt.Name, fc, cn + k, id);
+          }
+          if (sim_ms) {
+            UsbCommand c = {CMD_HID_SIM_TAG, {packed[k].top, packed[k].mid, packed[k].bot}};
+            SendCommand(&c);
+            msleep(sim_ms);
+          }
+          if (program) {
+            printf("Place a T55x7 tag on the antenna and press <Enter> (q <Enter> to quit): ");
+            fflush(stdout);
+            int ch = getchar();
+            while (ch != '\n' && ch != EOF && getchar() != '\n');
+            if (ch == 'q' || ch == EOF) {
+              aborted = true;
+              break;
+            }
+            Write(&packed[k]);
+          }
+          if ((sim_ms || program) && ukbhit() > 0) {
+            int gc = getchar(); (void)gc;
+            aborted = true;
+          }
+        }
+        format_count += n;
+        cn += n;
+        if (n < BULK_CHUNK && cn <= cn_last) break;
+      }
+    }
+    }
+    }
+    total += format_count;
+    if (formatIndex >= 0) break;
+  }
+
+  if (sim_ms) {
+    // stop the simulation
+    UsbCommand c = {CMD_PING};
+    clearCommandBuffer();
+    SendCommand(&c);
+    WaitForResponseTimeout(CMD_ACK, NULL, 1000);
+  }
+  free(packed);
+  if (f) {
+    fclose(f);
+    uint64_t ms = msclock() - start_time;
+    PrintAndLog("Wrote %" PRIu64 " IDs to %s in %" PRIu64 " ms", total, filename, ms);
+  }
+  if (aborted) PrintAndLog("Aborted after %" PRIu64 " IDs", total);
+  return 0;
+}
+
+int CmdHIDLookup(const char *Cmd){
+  if (strlen(Cmd) < 3) {
+    PrintAndLog("Usage:  lf hid lookup <id> {p}");
+    PrintAndLog("        lists all formats and fields which produce the ID");
+    PrintAndLog("        (optional) p: also formats where only parity bits differ");
+    PrintAndLog("        sample: lf hid lookup 2006f623ae");
+    return 0;
+  }
+
+  uint32_t top = 0, mid = 0, bot = 0;
+  hexstring_to_int96(&top, &mid, &bot, Cmd);
+  hidproxmessage_t packed = initialize_proxmessage_object(top, mid, bot);
+  bool ignoreParity = param_getchar(Cmd, 1) == 'p';
+
+  hid_bulk_match_t matches[32];
+  size_t n = MIN(HIDBulkLookup(&packed, ignoreParity, matches, 32), 32);
+  if (n == 0) {
+    PrintAndLog("No format produces this %d bit ID.", packed.Length);
+    return 0;
+  }
+  PrintAndLog("%-8s %8s %12s %4s %5s  %s", "Format", "FC", "CN", "IL", "OEM", "Parity");
+  for (size_t i = 0; i < n; i++) {
+    hidcardformat_t fmt = HIDGetCardFormat(matches[i].format);
+    hidproxcard_t *card = &matches[i].card;
+    PrintAndLog("%-8s %8u %12" PRIu64 " %4u %5u  %s", fmt.Name, card->FacilityCode, card->CardNumber,
+      card->IssueLevel, card->OEM, matches[i].exact ? "ok" : "differs");
+  }
+  return 0;
+}
+
 int CmdHIDFormats(){
   HIDListFormats();
   return 0;
@@ -286,6 +533,8 @@ static command_t CommandTable[] =
   {"encode",    CmdHIDEncode,   1, "<format> <fields> -- Encode an HID ID with the specified format and fields"},
   {"formats",   CmdHIDFormats,  1, "List supported card formats"},
   {"write",     CmdHIDWrite,    0, "<format> <fields> -- Encode and write to a T55x7 tag (tag must be in antenna)"},
+  {"bulk",      CmdHIDBulk,     1, "<format|all> <field ranges> -- Encode ranges of cards, write them to a file, simulate or clone them"},
+  {"lookup",    CmdHIDLookup,   1, "<ID> -- List all formats and fields which produce the ID"},
   {NULL, NULL, 0, NULL}
 };
 
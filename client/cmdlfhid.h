@@ -22,4 +22,6 @@ int CmdHIDClone(const char *Cmd);
 int CmdHIDDecode(const char *Cmd);
 int CmdHIDEncode(const char *Cmd);
 int CmdHIDWrite(const char *Cmd);
+int CmdHIDBulk(const char *Cmd);
+int CmdHIDLookup(const char *Cmd);
 #endif
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include "comms.h"
 #include "ui.h"
 #include "cmdparser.h"
@@ -22,6 +23,8 @@
 #include "hitag2.h"
 #include "hitagS.h"
 #include "cmdmain.h"
+#include "hitag2_crack.h"
+#include "cliparser/cliparser.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -29,24 +32,38 @@ size_t nbytes(size_t nbits) {
 	return (nbits/8)+((nbits%8)>0);
 }
 
-int CmdLFHitagList(const char *Cmd)
+// download the trace from the device, NULL if out of memory
+static uint8_t *GetHitagTrace(uint16_t *traceLen)
 {
  	uint8_t *got = malloc(USB_CMD_DATA_SIZE);
+	if (got == NULL) {
+		PrintAndLog("Cannot allocate memory for trace");
+		return NULL;
+	}
 	// Query for the actual size of the trace
 	UsbCommand response;
 	GetFromBigBuf(got, USB_CMD_DATA_SIZE, 0, &response, -1, false);
-	uint16_t traceLen = response.arg[2];
-	if (traceLen > USB_CMD_DATA_SIZE) {
-		uint8_t *p = realloc(got, traceLen);
+	*traceLen = response.arg[2];
+	if (*traceLen > USB_CMD_DATA_SIZE) {
+		uint8_t *p = realloc(got, *traceLen);
 		if (p == NULL) {
 			PrintAndLog("Cannot allocate memory for trace");
 			free(got);
-			return 2;
+			return NULL;
 		}
 		got = p;
-		GetFromBigBuf(got, traceLen, 0, NULL, -1, false);
+		GetFromBigBuf(got, *traceLen, 0, NULL, -1, false);
 	}
-	
+	return got;
+}
+
+int CmdLFHitagList(const char *Cmd)
+{
+	uint16_t traceLen;
+	uint8_t *got = GetHitagTrace(&traceLen);
+	if (got == NULL)
+		return 2;
+
 	PrintAndLog("recorded activity (TraceLen = %d bytes):");
 	PrintAndLog(" ETU     :nbits: who bytes");
 	PrintAndLog("---------+-----+----+-----------");
@@ -430,10 +447,120 @@ int CmdLFHitagWP(const char *Cmd) {
 }
 
 
+int CmdLFHitagCrack(const char *Cmd) {
+	CLIParserInit("lf hitag crack",
+		"Recovers a Hitag2 key from reader authentications (nR aR) sniffed with 'lf hitag snoop'. "
+		"One authentication gives 32 bits of keystream, give two or more to get a unique key. "
+		"Known leading key bytes shrink the search, the full 48 bit key space takes hours to days.",
+		"Usage:\n\tlf hitag crack -t -> authentications from the trace ('lf hitag list')\n"
+			"\tlf hitag crack -u 024e0220 -a 3b2a08c19c1bfd9f -a ... -> uid and nR aR pairs\n"
+			"\tlf hitag crack -k 4d49 -t -> key starts with 4d 49\n"
+			"\tlf hitag crack -b -> benchmark\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_str0("uU",  "uid",     "<hex>",        "tag UID, 4 bytes"),
+		arg_strx0("aA", "auth",    "<hex>",        "reader nR aR, 8 bytes"),
+		arg_lit0("tT",  "trace",                   "take the authentications from the trace on the device"),
+		arg_str0("kK",  "known",   "<hex>",        "first key bytes, up to 4"),
+		arg_int0("jJ",  "threads", "<n>",          "worker threads, default: all CPUs"),
+		arg_lit0("bB",  "bench",                   "benchmark the key search"),
+		arg_lit0("sS",  "selftest",                "test the cipher and key search"),
+		arg_param_end
+	};
+	CLIExecWithReturn(Cmd, argtable, true);
+
+	hitag2_auth_t auths[HITAG2_CRACK_MAX_AUTHS];
+	size_t count = 0;
+	uint8_t uid[4] = {0};
+	int uidlen = 0;
+	uint8_t known[4];
+	int knownlen = 0;
+	CLIGetHexWithReturn(1, uid, &uidlen);
+	struct arg_str *authstr = arg_get_str(2);
+	bool from_trace = arg_get_lit(3);
+	CLIGetHexWithReturn(4, known, &knownlen);
+	int threads = arg_get_int_def(5, 0);
+	bool bench = arg_get_lit(6);
+	bool selftest = arg_get_lit(7);
+
+	for (int i = 0; i < authstr->count && count < HITAG2_CRACK_MAX_AUTHS; i++, count++) {
+		uint8_t nrar[8];
+		int len = 0;
+		if (param_gethex_to_eol(authstr->sval[i], 0, nrar, sizeof(nrar), &len) || len != 8) {
+			PrintAndLog("Invalid nR aR '%s', must be 8 bytes hex", authstr->sval[i]);
+			CLIParserFree();
+			return 1;
+		}
+		memcpy(auths[count].uid, uid, 4);
+		memcpy(auths[count].nr, nrar, 4);
+		memcpy(auths[count].ar, nrar + 4, 4);
+	}
+	CLIParserFree();
+
+	if (selftest)
+		return hitag2_crack_selftest(true) ? 0 : 1;
+	if (bench) {
+		hitag2_crack_bench(threads);
+		return 0;
+	}
+
+	if (count > 0 && uidlen != 4) {
+		PrintAndLog("Give the 4 byte UID with the nR aR pairs");
+		return 1;
+	}
+	if (from_trace) {
+		if (IsOffline()) {
+			PrintAndLog("No device, can't download the trace");
+			return 1;
+		}
+		uint16_t traceLen;
+		uint8_t *trace = GetHitagTrace(&traceLen);
+		if (trace == NULL)
+			return 2;
+		hitag2_auth_t found[HITAG2_CRACK_MAX_AUTHS];
+		size_t n = hitag2_crack_from_trace(trace, traceLen, found, HITAG2_CRACK_MAX_AUTHS);
+		free(trace);
+		// only those of the given tag, or of the first one in the trace
+		for (size_t i = 0; i < n && count < HITAG2_CRACK_MAX_AUTHS; i++) {
+			if (count > 0 ? memcmp(found[i].uid, auths[0].uid, 4) : (uidlen == 4 && memcmp(found[i].uid, uid, 4)))
+				continue;
+			auths[count++] = found[i];
+		}
+		PrintAndLog("%zu authentications in the trace", n);
+	}
+	if (count == 0) {
+		PrintAndLog("No authentications, give -u and -a or -t");
+		return 1;
+	}
+
+	PrintAndLog("UID %s", sprint_hex(auths[0].uid, 4));
+	for (size_t i = 0; i < count; i++)
+		PrintAndLog("  nR %08" PRIx64 " aR %08" PRIx64, bytes_to_num(auths[i].nr, 4), bytes_to_num(auths[i].ar, 4));
+	if (count == 1 && knownlen < 2)
+		PrintAndLog("Only one authentication, about 2^%d keys will match it.", 16 - 8 * knownlen);
+
+	uint64_t prefix = bytes_to_num(known, knownlen) << (48 - 8 * knownlen);
+	uint64_t keys[16];
+	int n = hitag2_crack(auths, count, prefix, knownlen, threads, keys, 16, true);
+	if (n < 0)
+		return 1;
+	if (n == 0) {
+		PrintAndLog("No key found.");
+		return 0;
+	}
+	for (int i = 0; i < n && i < 16; i++)
+		PrintAndLog("Found key: %012" PRIx64, keys[i]);
+	if (n > 16)
+		PrintAndLog("... %d keys in total", n);
+	return 0;
+}
+
 static command_t CommandTable[] = 
 {
   {"help",    		CmdHelp,           1, "This help"},
   {"list",    		CmdLFHitagList,    1, "<outfile> List Hitag trace history"},
+  {"crack",   		CmdLFHitagCrack,   1, "Recover a Hitag2 key from sniffed authentications"},
   {"reader",  		CmdLFHitagReader,  1, "Act like a Hitag Reader"},
   {"sim",     		CmdLFHitagSim,     1, "<infile> Simulate Hitag transponder"},
   {"snoop",   		CmdLFHitagSnoop,   1, "Eavesdrop Hitag communication"},
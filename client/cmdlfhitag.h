@@ -17,5 +17,6 @@ int CmdLFHitagList(const char *Cmd);
 int CmdLFHitagSnoop(const char *Cmd);
 int CmdLFHitagSim(const char *Cmd);
 int CmdLFHitagReader(const char *Cmd);
+int CmdLFHitagCrack(const char *Cmd);
 
 #endif
@@ -14,6 +14,7 @@
 #include <inttypes.h>
 #include <ctype.h>
 #include <time.h>
+#include <pthread.h>
 #include "comms.h"
 #include "ui.h"
 #include "graph.h"
@@ -31,6 +32,12 @@
 #define T55x7_PAGE1 0x01
 //#define T55x7_PWD	0x00000010
 #define REGULAR_READ_MODE_BLOCK 0xFF
+// Peak to peak signal range (samples 1000..12000, see T55xxReadBlock()) below which a
+// capture holds no tag answer. The weakest answer in traces/ is HID-weak-fob-11647.pm3
+// with 34, the other tag captures there range from 202 (psk1) to 255 (EM4102, fsk2).
+// Without a tag only the ADC noise floor of a few counts is left, 10 keeps a margin
+// of more than three to the weakest answer.
+#define T55XX_SILENT_RANGE 10
 
 // Default configuration
 t55xx_conf_block_t config = { .modulation = DEMOD_ASK, .inverted = false, .offset = 0x00, .block0 = 0x00, .Q5 = false };
@@ -502,165 +509,253 @@ int CmdT55xxDetect(const char *Cmd){
 }
 
 // detect configuration?
+// Modulation detection
+//
+// The samples are copied out of the GraphBuffer once, the clocks of all
+// modulation families are detected once on that copy. Every candidate
+// demodulation then works on its own copy in its own thread, nothing global
+// is touched until the results are ranked.
+typedef enum {
+	DETECT_FSK,
+	DETECT_ASK,
+	DETECT_BI,
+	DETECT_NRZ,
+	DETECT_PSK,
+} t55xx_detect_family_t;
+
+typedef struct {
+	t55xx_detect_family_t family;
+	uint8_t demod;			// mode for test()
+	int invert;
+	int maxErr;
+} t55xx_detect_candidate_t;
+
+static const t55xx_detect_candidate_t detect_candidates[] = {
+	{DETECT_FSK, DEMOD_FSK,  0, 0},
+	{DETECT_FSK, DEMOD_FSK,  1, 0},
+	{DETECT_ASK, DEMOD_ASK,  0, 1},
+	{DETECT_ASK, DEMOD_ASK,  1, 1},
+	{DETECT_BI,  DEMOD_BI,   0, 2},
+	{DETECT_BI,  DEMOD_BIa,  1, 2},
+	{DETECT_NRZ, DEMOD_NRZ,  0, 1},
+	{DETECT_NRZ, DEMOD_NRZ,  1, 1},
+	{DETECT_PSK, DEMOD_PSK1, 0, 6},
+	{DETECT_PSK, DEMOD_PSK1, 1, 6},
+	{DETECT_PSK, DEMOD_PSK2, 0, 6},		// inverse waves does not affect this demod
+	{DETECT_PSK, DEMOD_PSK3, 0, 6},
+};
+#define DETECT_CANDIDATES (sizeof(detect_candidates) / sizeof(detect_candidates[0]))
+#define DETECT_PSK_SKIP 160		// let the antenna settle in (psk gets inverted occasionally otherwise)
+
+// computed once, read only while the candidates run
+typedef struct {
+	uint8_t *samples;
+	size_t size;
+	uint8_t fc1, fc2;
+	int fskClk;				// 0 = no FSK, then the other families are tried
+	int askClk;
+	uint8_t *askSamples;	// sequence terminator removed
+	size_t askSize;
+	bool st;
+	int nrzClk;
+	int pskClk;
+} t55xx_detect_shared_t;
+
+typedef struct {
+	const t55xx_detect_shared_t *shared;
+	const t55xx_detect_candidate_t *candidate;
+	uint8_t *bits;
+	size_t len;
+	int errCnt;
+	bool hit;
+	t55xx_conf_block_t conf;
+} t55xx_detect_job_t;
+
+static bool detectShared(t55xx_detect_shared_t *s) {
+	memset(s, 0, sizeof(*s));
+	s->samples = malloc(MAX_GRAPH_TRACE_LEN);
+	s->askSamples = malloc(MAX_GRAPH_TRACE_LEN);
+	if (s->samples == NULL || s->askSamples == NULL)
+		return false;
+	s->size = getFromGraphBuf(s->samples);
+	if (s->size == 0)
+		return true;
+
+	uint16_t fcs = countFC(s->samples, s->size, 1);
+	if (fcs) {
+		int firstClockEdge = 0;
+		s->fc1 = (fcs >> 8) & 0xFF;
+		s->fc2 = fcs & 0xFF;
+		if ((s->fc1 == 10 && s->fc2 == 8) || (s->fc1 == 8 && s->fc2 == 5))
+			s->fskClk = detectFSKClk(s->samples, s->size, s->fc1, s->fc2, &firstClockEdge);
+	}
+	if (s->fskClk)
+		return true;
+
+	// like GetAskClock(), the ASK demods reuse the samples without the sequence terminator
+	size_t ststart = 0, stend = 0;
+	memcpy(s->askSamples, s->samples, s->size);
+	s->askSize = s->size;
+	s->st = DetectST(s->askSamples, &s->askSize, &s->askClk, &ststart, &stend);
+	if (!s->st)
+		DetectASKClock(s->askSamples, s->askSize, &s->askClk, 20);
+
+	size_t clkStartIdx = 0;
+	s->nrzClk = DetectNRZClock(s->samples, s->size, 0, &clkStartIdx);
+
+	size_t firstPhaseShiftLoc = 0;
+	uint8_t curPhase = 0, fc = 0;
+	s->pskClk = DetectPSKClock(s->samples, s->size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
+	return true;
+}
+
+static int detectClock(const t55xx_detect_shared_t *s, t55xx_detect_family_t family) {
+	switch (family) {
+		case DETECT_FSK: return s->fskClk;
+		case DETECT_ASK:
+		case DETECT_BI:  return s->fskClk ? 0 : s->askClk;
+		case DETECT_NRZ: return s->fskClk || s->nrzClk <= 8 ? 0 : s->nrzClk;	// clock of rf/8 is likely a false positive
+		case DETECT_PSK: return s->fskClk || s->size <= DETECT_PSK_SKIP ? 0 : s->pskClk;
+	}
+	return 0;
+}
+
+// one candidate, the demodulation part of FSKrawDemod(), ASKDemod_ext() etc.
+static void *detectCandidate(void *arg) {
+	t55xx_detect_job_t *job = arg;
+	const t55xx_detect_shared_t *s = job->shared;
+	const t55xx_detect_candidate_t *c = job->candidate;
+	int clk = detectClock(s, c->family);
+	int invert = c->invert;
+	int startIdx = 0;
+	int offset = 0;
+
+	job->errCnt = -1;
+	switch (c->family) {
+		case DETECT_FSK: {
+			memcpy(job->bits, s->samples, s->size);
+			int size = fskdemod(job->bits, s->size, clk, invert, s->fc1, s->fc2, &startIdx);
+			job->len = size > 0 ? size : 0;
+			job->errCnt = size > 0 ? 0 : -1;
+			break;
+		}
+		case DETECT_ASK:
+			if (s->size < 255)
+				break;
+			memcpy(job->bits, s->askSamples, s->askSize);
+			job->len = s->askSize;
+			job->errCnt = askdemod_ext(job->bits, &job->len, &clk, &invert, c->maxErr, 0, 1, &startIdx);
+			break;
+		case DETECT_BI:
+			memcpy(job->bits, s->samples, s->size);
+			job->len = s->size;
+			job->errCnt = askdemod_ext(job->bits, &job->len, &clk, &invert, c->maxErr, 0, 0, &startIdx);
+			if (job->errCnt >= 0 && job->errCnt <= c->maxErr)
+				job->errCnt = BiphaseRawDecode(job->bits, &job->len, &offset, invert);
+			break;
+		case DETECT_NRZ:
+			memcpy(job->bits, s->samples, s->size);
+			job->len = s->size;
+			job->errCnt = nrzRawDemod(job->bits, &job->len, &clk, &invert, &startIdx);
+			break;
+		case DETECT_PSK:
+			memcpy(job->bits, s->samples + DETECT_PSK_SKIP, s->size - DETECT_PSK_SKIP);
+			job->len = s->size - DETECT_PSK_SKIP;
+			job->errCnt = pskRawDemod_ext(job->bits, &job->len, &clk, &invert, &startIdx);
+			if (c->demod != DEMOD_PSK1)
+				psk1TOpsk2(job->bits, job->len);
+			break;
+	}
+	if (job->errCnt < 0 || job->errCnt > c->maxErr || job->len < 16)
+		return NULL;
+
+	t55xx_conf_block_t *conf = &job->conf;
+	int bitRate = 0;
+	if (!test(c->demod, job->bits, job->len, &conf->offset, &bitRate, detectClock(s, c->family), &conf->Q5))
+		return NULL;
+
+	conf->modulation = c->demod;
+	if (c->family == DETECT_FSK) {
+		if (s->fc1 == 8 && s->fc2 == 5)
+			conf->modulation = invert ? DEMOD_FSK1 : DEMOD_FSK1a;
+		else if (s->fc1 == 10 && s->fc2 == 8)
+			conf->modulation = invert ? DEMOD_FSK2a : DEMOD_FSK2;
+	}
+	conf->bitrate = bitRate;
+	conf->inverted = c->invert;
+	conf->block0 = PackBits(conf->offset, 32, job->bits);
+	conf->ST = c->family == DETECT_ASK && s->st;
+	job->hit = true;
+	return NULL;
+}
+
 bool tryDetectModulation(){
+	t55xx_detect_shared_t shared;
+	t55xx_detect_job_t jobs[DETECT_CANDIDATES];
+	pthread_t threads[DETECT_CANDIDATES];
+	bool started[DETECT_CANDIDATES] = {false};
+	int order[DETECT_CANDIDATES];
 	uint8_t hits = 0;
-	t55xx_conf_block_t tests[15];
-	int bitRate=0;
-	uint8_t fc1 = 0, fc2 = 0, ans = 0;
-	int clk = 0, firstClockEdge = 0;
-	ans = fskClocks(&fc1, &fc2, (uint8_t *)&clk, false, &firstClockEdge);
-	if (ans && ((fc1==10 && fc2==8) || (fc1==8 && fc2==5))) {
-		if ( FSKrawDemod("0 0", false) && test(DEMOD_FSK, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-			tests[hits].modulation = DEMOD_FSK;
-			if (fc1==8 && fc2 == 5)
-				tests[hits].modulation = DEMOD_FSK1a;
- 			else if (fc1==10 && fc2 == 8)
-				tests[hits].modulation = DEMOD_FSK2;
-			tests[hits].bitrate = bitRate;
-			tests[hits].inverted = false;
-			tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-			tests[hits].ST = false;
-			++hits;
-		}
-		if ( FSKrawDemod("0 1", false) && test(DEMOD_FSK, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-			tests[hits].modulation = DEMOD_FSK;
-			if (fc1 == 8 && fc2 == 5)
-				tests[hits].modulation = DEMOD_FSK1;
-			else if (fc1 == 10 && fc2 == 8)
-				tests[hits].modulation = DEMOD_FSK2a;
-			tests[hits].bitrate = bitRate;
-			tests[hits].inverted = true;
-			tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-			tests[hits].ST = false;
-			++hits;
-		}
-	} else {
-		clk = GetAskClock("", false, false);
-		if (clk>0) {
-			tests[hits].ST = true;
-			if ( ASKDemod_ext("0 0 1", false, false, 1, &tests[hits].ST) && test(DEMOD_ASK, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-				tests[hits].modulation = DEMOD_ASK;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = false;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				++hits;
-			}
-			tests[hits].ST = true;
-			if ( ASKDemod_ext("0 1 1", false, false, 1, &tests[hits].ST)  && test(DEMOD_ASK, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-				tests[hits].modulation = DEMOD_ASK;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = true;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				++hits;
-			}
-			if ( ASKbiphaseDemod("0 0 0 2", false) && test(DEMOD_BI, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5) ) {
-				tests[hits].modulation = DEMOD_BI;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = false;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				tests[hits].ST = false;
-				++hits;
-			}
-			if ( ASKbiphaseDemod("0 0 1 2", false) && test(DEMOD_BIa, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5) ) {
-				tests[hits].modulation = DEMOD_BIa;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = true;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				tests[hits].ST = false;
-				++hits;
-			}
-		}
-		clk = GetNrzClock("", false, false);
-		if (clk>8) { //clock of rf/8 is likely a false positive, so don't use it.
-			if ( NRZrawDemod("0 0 1", false)  && test(DEMOD_NRZ, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-				tests[hits].modulation = DEMOD_NRZ;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = false;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				tests[hits].ST = false;
-				++hits;
-			}
 
-			if ( NRZrawDemod("0 1 1", false)  && test(DEMOD_NRZ, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-				tests[hits].modulation = DEMOD_NRZ;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = true;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				tests[hits].ST = false;
-				++hits;
-			}
-		}
-		
-		clk = GetPskClock("", false, false);
-		if (clk>0) {
-			// allow undo
-			save_restoreGB(GRAPH_SAVE);
-			// skip first 160 samples to allow antenna to settle in (psk gets inverted occasionally otherwise)
-			CmdLtrim("160");
-			if ( PSKDemod("0 0 6", false) && test(DEMOD_PSK1, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-				tests[hits].modulation = DEMOD_PSK1;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = false;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				tests[hits].ST = false;
-				++hits;
-			}
-			if ( PSKDemod("0 1 6", false) && test(DEMOD_PSK1, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
-				tests[hits].modulation = DEMOD_PSK1;
-				tests[hits].bitrate = bitRate;
-				tests[hits].inverted = true;
-				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-				tests[hits].ST = false;
-				++hits;
-			}
-			// PSK2 - needs a call to psk1TOpsk2.
-			if ( PSKDemod("0 0 6", false)) {
-				psk1TOpsk2(DemodBuffer, DemodBufferLen);
-				if (test(DEMOD_PSK2, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)){
-					tests[hits].modulation = DEMOD_PSK2;
-					tests[hits].bitrate = bitRate;
-					tests[hits].inverted = false;
-					tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-					tests[hits].ST = false;
-					++hits;
-				}
-			} // inverse waves does not affect this demod
-			// PSK3 - needs a call to psk1TOpsk2.
-			if ( PSKDemod("0 0 6", false)) {
-				psk1TOpsk2(DemodBuffer, DemodBufferLen);
-				if (test(DEMOD_PSK3, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)){
-					tests[hits].modulation = DEMOD_PSK3;
-					tests[hits].bitrate = bitRate;
-					tests[hits].inverted = false;
-					tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
-					tests[hits].ST = false;
-					++hits;
-				}
-			} // inverse waves does not affect this demod
-			//undo trim samples
-			save_restoreGB(GRAPH_RESTORE);
+	memset(jobs, 0, sizeof(jobs));
+	if (!detectShared(&shared)) {
+		PrintAndLog("Cannot allocate memory for the modulation detection");
+		free(shared.samples);
+		free(shared.askSamples);
+		return false;
+	}
+
+	for (int i = 0; i < DETECT_CANDIDATES; i++) {
+		jobs[i].shared = &shared;
+		jobs[i].candidate = &detect_candidates[i];
+		if (shared.size == 0 || detectClock(&shared, detect_candidates[i].family) <= 0)
+			continue;
+		jobs[i].bits = malloc(MAX_GRAPH_TRACE_LEN);
+		if (jobs[i].bits == NULL)
+			continue;
+		started[i] = pthread_create(&threads[i], NULL, detectCandidate, &jobs[i]) == 0;
+		if (!started[i])
+			detectCandidate(&jobs[i]);
+	}
+	for (int i = 0; i < DETECT_CANDIDATES; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	// fewest demod errors first, candidates in the order above on a tie
+	for (int i = 0; i < DETECT_CANDIDATES; i++) {
+		if (!jobs[i].hit)
+			continue;
+		int j = hits++;
+		while (j > 0 && jobs[order[j - 1]].errCnt > jobs[i].errCnt) {
+			order[j] = order[j - 1];
+			j--;
 		}
-	}	
+		order[j] = i;
+	}
+
+	// the best candidate's bits go to the DemodBuffer, like a single successful demod
+	if (hits > 0)
+		setDemodBuf(jobs[order[0]].bits, jobs[order[0]].len, 0);
+
 	if ( hits == 1) {
-		config.modulation = tests[0].modulation;
-		config.bitrate = tests[0].bitrate;
-		config.inverted = tests[0].inverted;
-		config.offset = tests[0].offset;
-		config.block0 = tests[0].block0;
-		config.Q5 = tests[0].Q5;
-		config.ST = tests[0].ST;
+		config = jobs[order[0]].conf;
 		printConfiguration( config );
-		return true;
 	}
-	
+
 	if ( hits > 1) {
 		PrintAndLog("Found [%d] possible matches for modulation.",hits);
 		for(int i=0; i<hits; ++i){
 			PrintAndLog("--[%d]---------------", i+1);
-			printConfiguration( tests[i] );
+			printConfiguration( jobs[order[i]].conf );
 		}
 	}
-	return false;
+
+	for (int i = 0; i < DETECT_CANDIDATES; i++)
+		free(jobs[i].bits);
+	free(shared.samples);
+	free(shared.askSamples);
+	return hits == 1;
 }
 
 bool testModulation(uint8_t mode, uint8_t modread){
@@ -733,33 +828,33 @@ int convertQ5bitRate(uint8_t bitRateRead) {
 	return -1;
 }
 
-bool testQ5(uint8_t mode, uint8_t *offset, int *fndBitRate, uint8_t	clk){
+bool testQ5(uint8_t mode, uint8_t *bits, size_t len, uint8_t *offset, int *fndBitRate, uint8_t	clk){
 
-	if ( DemodBufferLen < 64 ) return false;
+	if ( len < 64 ) return false;
 	uint8_t si = 0;
 	for (uint8_t idx = 28; idx < 64; idx++){
 		si = idx;
-		if ( PackBits(si, 28, DemodBuffer) == 0x00 ) continue;
+		if ( PackBits(si, 28, bits) == 0x00 ) continue;
 
-		uint8_t safer     = PackBits(si, 4, DemodBuffer); si += 4;     //master key
-		uint8_t resv      = PackBits(si, 8, DemodBuffer); si += 8;
+		uint8_t safer     = PackBits(si, 4, bits); si += 4;     //master key
+		uint8_t resv      = PackBits(si, 8, bits); si += 8;
 		// 2nibble must be zeroed.
 		if (safer != 0x6 && safer != 0x9) continue;
 		if ( resv > 0x00) continue;
-		//uint8_t	pageSel   = PackBits(si, 1, DemodBuffer); si += 1;
-		//uint8_t fastWrite = PackBits(si, 1, DemodBuffer); si += 1;
+		//uint8_t	pageSel   = PackBits(si, 1, bits); si += 1;
+		//uint8_t fastWrite = PackBits(si, 1, bits); si += 1;
 		si += 1+1;
-		int bitRate       = PackBits(si, 6, DemodBuffer)*2 + 2; si += 6;     //bit rate
+		int bitRate       = PackBits(si, 6, bits)*2 + 2; si += 6;     //bit rate
 		if (bitRate > 128 || bitRate < 8) continue;
 
-		//uint8_t AOR       = PackBits(si, 1, DemodBuffer); si += 1;   
-		//uint8_t PWD       = PackBits(si, 1, DemodBuffer); si += 1; 
-		//uint8_t pskcr     = PackBits(si, 2, DemodBuffer); si += 2;  //could check psk cr
-		//uint8_t inverse   = PackBits(si, 1, DemodBuffer); si += 1;
+		//uint8_t AOR       = PackBits(si, 1, bits); si += 1;   
+		//uint8_t PWD       = PackBits(si, 1, bits); si += 1; 
+		//uint8_t pskcr     = PackBits(si, 2, bits); si += 2;  //could check psk cr
+		//uint8_t inverse   = PackBits(si, 1, bits); si += 1;
 		si += 1+1+2+1;
-		uint8_t modread   = PackBits(si, 3, DemodBuffer); si += 3;
-		uint8_t maxBlk    = PackBits(si, 3, DemodBuffer); si += 3;
-		//uint8_t ST        = PackBits(si, 1, DemodBuffer); si += 1;
+		uint8_t modread   = PackBits(si, 3, bits); si += 3;
+		uint8_t maxBlk    = PackBits(si, 3, bits); si += 3;
+		//uint8_t ST        = PackBits(si, 1, bits); si += 1;
 		if (maxBlk == 0) continue;
 		//test modulation
 		if (!testQ5Modulation(mode, modread)) continue;
@@ -781,26 +876,26 @@ bool testBitRate(uint8_t readRate, uint8_t clk){
 	return false;
 }
 
-bool test(uint8_t mode, uint8_t *offset, int *fndBitRate, uint8_t clk, bool *Q5){
+bool test(uint8_t mode, uint8_t *bits, size_t len, uint8_t *offset, int *fndBitRate, uint8_t clk, bool *Q5){
 
-	if ( DemodBufferLen < 64 ) return false;
+	if ( len < 64 ) return false;
 	uint8_t si = 0;
 	for (uint8_t idx = 28; idx < 64; idx++){
 		si = idx;
-		if ( PackBits(si, 28, DemodBuffer) == 0x00 ) continue;
+		if ( PackBits(si, 28, bits) == 0x00 ) continue;
 
-		uint8_t safer    = PackBits(si, 4, DemodBuffer); si += 4;     //master key
-		uint8_t resv     = PackBits(si, 4, DemodBuffer); si += 4;     //was 7 & +=7+3 //should be only 4 bits if extended mode
+		uint8_t safer    = PackBits(si, 4, bits); si += 4;     //master key
+		uint8_t resv     = PackBits(si, 4, bits); si += 4;     //was 7 & +=7+3 //should be only 4 bits if extended mode
 		// 2nibble must be zeroed.
 		// moved test to here, since this gets most faults first.
 		if ( resv > 0x00) continue;
 
-		int bitRate      = PackBits(si, 6, DemodBuffer); si += 6;     //bit rate (includes extended mode part of rate)
-		uint8_t extend   = PackBits(si, 1, DemodBuffer); si += 1;     //bit 15 extended mode
-		uint8_t modread  = PackBits(si, 5, DemodBuffer); si += 5+2+1; 
-		//uint8_t pskcr   = PackBits(si, 2, DemodBuffer); si += 2+1;  //could check psk cr
-		//uint8_t nml01    = PackBits(si, 1, DemodBuffer); si += 1+5;   //bit 24, 30, 31 could be tested for 0 if not extended mode
-		//uint8_t nml02    = PackBits(si, 2, DemodBuffer); si += 2;
+		int bitRate      = PackBits(si, 6, bits); si += 6;     //bit rate (includes extended mode part of rate)
+		uint8_t extend   = PackBits(si, 1, bits); si += 1;     //bit 15 extended mode
+		uint8_t modread  = PackBits(si, 5, bits); si += 5+2+1; 
+		//uint8_t pskcr   = PackBits(si, 2, bits); si += 2+1;  //could check psk cr
+		//uint8_t nml01    = PackBits(si, 1, bits); si += 1+5;   //bit 24, 30, 31 could be tested for 0 if not extended mode
+		//uint8_t nml02    = PackBits(si, 2, bits); si += 2;
 		
 		//if extended mode
 		bool extMode =( (safer == 0x6 || safer == 0x9) && extend) ? true : false;
@@ -819,7 +914,7 @@ bool test(uint8_t mode, uint8_t *offset, int *fndBitRate, uint8_t clk, bool *Q5)
 		*Q5 = false;
 		return true;
 	}
-	if (testQ5(mode, offset, fndBitRate, clk)) {
+	if (testQ5(mode, bits, len, offset, fndBitRate, clk)) {
 		*Q5 = true;
 		return true;
 	}
@@ -1391,18 +1486,77 @@ int CmdT55xxWipe(const char *Cmd) {
 	return 0;
 }
 
+// The device reads with password N+1 while the capture of password N is
+// demodulated. Captures the firmware found silent are not even downloaded.
+// Passwords are the keys or start + index. Returns 1 = found, 0 = not found,
+// -1 = aborted or error; *pwd is the password found or tried last.
+static int T55xxBruteForcePipelined(uint8_t *keys, uint64_t count, uint32_t start, uint32_t *pwd) {
+	UsbCommand c = {CMD_T55XX_READ_BLOCK, {(T55x7_PAGE0 << 1) | 0x4 | 0x1, T55x7_CONFIGURATION_BLOCK, 0}};
+	UsbCommand resp;
+	uint64_t skipped = 0;
+
+	clearCommandBuffer();
+	c.arg[2] = keys ? bytes_to_num(keys, 4) : start;
+	SendCommand(&c);
+
+	for (uint64_t i = 0; i < count; i++) {
+		*pwd = keys ? bytes_to_num(keys + 4*i, 4) : start + i;
+		if (keys) {
+			PrintAndLog("Testing %08X", *pwd);
+		} else {
+			printf(".");
+			fflush(stdout);
+		}
+
+		if (!WaitForResponseTimeout(CMD_ACK, &resp, 2500)) {
+			PrintAndLog("command execution time out");
+			PrintAndLog("Aquireing data from device failed. Quitting");
+			return -1;
+		}
+
+		// old firmware doesn't measure (arg1 = 0), always check the capture then
+		bool answered = resp.arg[1] == 0 || resp.arg[0] >= T55XX_SILENT_RANGE;
+		if (answered)
+			getSamples(12000, true);
+		else
+			skipped++;
+
+		bool aborted = ukbhit();
+		if (aborted) {
+			int ch = getchar();
+			(void)ch;
+		}
+		bool next = !aborted && i + 1 < count;
+		if (next) {
+			c.arg[2] = keys ? bytes_to_num(keys + 4*(i+1), 4) : start + i + 1;
+			SendCommand(&c);
+		}
+
+		if (answered && tryDetectModulation()) {
+			if (next)
+				WaitForResponseTimeout(CMD_ACK, NULL, 2500);
+			return 1;
+		}
+		if (aborted) {
+			printf("\naborted via keyboard!\n");
+			return -1;
+		}
+	}
+	if (skipped)
+		PrintAndLog("\n%" PRIu64 " of %" PRIu64 " captures without a tag answer were not downloaded", skipped, count);
+	return 0;
+}
+
 int CmdT55xxBruteForce(const char *Cmd) {
 
 	// load a default pwd file.
 	char buf[9];
 	char filename[FILE_PATH_SIZE]={0};
 	int keycnt = 0;
-	int ch;
 	uint8_t stKeyBlock = 20;
 	uint8_t *keyBlock = NULL, *p = NULL;
 	uint32_t start_password = 0x00000000; //start password
 	uint32_t end_password   = 0xFFFFFFFF; //end   password
-	bool found = false;
 
 	char cmdp = param_getchar(Cmd, 0);
 	if (cmdp == 'h' || cmdp == 'H') return usage_t55xx_bruteforce();
@@ -1463,38 +1617,13 @@ int CmdT55xxBruteForce(const char *Cmd) {
 			return 1;
 		}
 		PrintAndLog("Loaded %d keys", keycnt);
-		
-		// loop
-		uint64_t testpwd = 0x00;
-		for (uint16_t c = 0; c < keycnt; ++c ) {
-
-			if (ukbhit()) {
-				ch = getchar();
-				(void)ch;
-				printf("\naborted via keyboard!\n");
-				free(keyBlock);
-				return 0;
-			}
-
-			testpwd = bytes_to_num(keyBlock + 4*c, 4);
-
-			PrintAndLog("Testing %08X", testpwd);
-
-			if ( !AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, testpwd)) {
-				PrintAndLog("Aquireing data from device failed. Quitting");
-				free(keyBlock);
-				return 0;
-			}
 
-			found = tryDetectModulation();
-
-			if ( found ) {
-				PrintAndLog("Found valid password: [%08X]", testpwd);
-				free(keyBlock);
-				return 0;
-			}
-		}
-		PrintAndLog("Password NOT found.");
+		uint32_t testpwd = 0;
+		int res = T55xxBruteForcePipelined(keyBlock, keycnt, 0, &testpwd);
+		if (res > 0)
+			PrintAndLog("Found valid password: [%08X]", testpwd);
+		else if (res == 0)
+			PrintAndLog("Password NOT found.");
 		free(keyBlock);
 		return 0;
 	}
@@ -1512,36 +1641,13 @@ int CmdT55xxBruteForce(const char *Cmd) {
 	PrintAndLog("Search password range [%08X -> %08X]", start_password, end_password);
 
 	uint32_t i = start_password;
-
-	while ((!found) && (i <= end_password)) {
-
-		printf(".");
-		fflush(stdout);
-		if (ukbhit()) {
-			ch = getchar();
-			(void)ch;
-			printf("\naborted via keyboard!\n");
-			free(keyBlock);
-			return 0;
-		}
-
-		if (!AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, i)) {
-			PrintAndLog("Aquireing data from device failed. Quitting");
-			free(keyBlock);
-			return 0;
-		}
-		found = tryDetectModulation();
-
-		if (found) break;
-		i++;
-	}
-
+	int res = T55xxBruteForcePipelined(NULL, (uint64_t)end_password - start_password + 1, start_password, &i);
 	PrintAndLog("");
 
-	if (found)
+	if (res > 0)
 		PrintAndLog("Found valid password: [%08x]", i);
-	else
-		PrintAndLog("Password NOT found. Last tried: [%08x]", --i);
+	else if (res == 0)
+		PrintAndLog("Password NOT found. Last tried: [%08x]", i);
 
 	free(keyBlock);
 	return 0;
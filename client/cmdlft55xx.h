@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct {
 	uint32_t bl1;
@@ -96,7 +97,7 @@ int printConfiguration( t55xx_conf_block_t b);
 bool DecodeT55xxBlock(void);
 bool tryDetectModulation(void);
 extern bool tryDetectP1(bool getData);
-bool test(uint8_t mode, uint8_t *offset, int *fndBitRate, uint8_t clk, bool *Q5);
+bool test(uint8_t mode, uint8_t *bits, size_t len, uint8_t *offset, int *fndBitRate, uint8_t clk, bool *Q5);
 int special(const char *Cmd);
 int AquireData( uint8_t page, uint8_t block, bool pwdmode, uint32_t password );
 
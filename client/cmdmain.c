@@ -26,6 +26,7 @@
 #include "util.h"
 #include "util_posix.h"
 #include "cmdscript.h"
+#include "profiler.h"
 #ifdef WITH_SMARTCARD 
   #include "cmdsmartcard.h"
 #endif
@@ -71,6 +72,15 @@ static int CmdQuit(const char *Cmd)
 // then presses Enter, which the full command line that they typed.
 //-----------------------------------------------------------------------------
 int CommandReceived(char *Cmd) {
-	return CmdsParse(CommandTable, Cmd);
+	// a frame that began with profiling on must end, even if it was turned off meanwhile
+	bool profiled = g_profiling;
+	if (profiled) {
+		ProfileCommandBegin(Cmd);
+	}
+	int ret = CmdsParse(CommandTable, Cmd);
+	if (profiled) {
+		ProfileCommandEnd();
+	}
+	return ret;
 }
 
@@ -16,6 +16,7 @@
 #include "ui.h"
 #include "proxmark3.h"
 #include "comms.h"
+#include "profiler.h"
 
 
 void CmdsHelp(const command_t Commands[])
@@ -69,6 +70,8 @@ int CmdsParse(const command_t Commands[], const char *Cmd)
 	if (Commands[i].Name) {
 		while (Cmd[len] == ' ')
 			++len;
+		if (g_profiling)
+			ProfileCommandName(Commands[i].Name);
 	return Commands[i].Parse(Cmd + len);
 	} else {
 		// show help for selected hierarchy or if command not recognised
@@ -12,6 +12,8 @@
 #include "comms.h"
 
 #include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
 #if defined(__linux__) && !defined(NO_UNLINK)
 #include <unistd.h>		// for unlink()
 #endif
@@ -20,6 +22,7 @@
 #include "common.h"
 #include "util_darwin.h"
 #include "util_posix.h"
+#include "profiler.h"
 
 
 // Serial port that we are communicating with the PM3 on.
@@ -56,6 +59,14 @@ static int cmd_tail = 0;
 // to lock rxBuffer operations from different threads
 static pthread_mutex_t rxBufferMutex = PTHREAD_MUTEX_INITIALIZER;
 
+// number of commands stored so far, signalled on every new command
+static uint32_t rx_count = 0;
+static pthread_cond_t rxBufferSig = PTHREAD_COND_INITIALIZER;
+
+// USB_CMD_CAP_* of the firmware, -1 = not yet known
+static int64_t device_capabilities = -1;
+static uint32_t next_tag = 0;
+
 // These wrappers are required because it is not possible to access a static
 // global variable outside of the context of a single file.
 
@@ -77,6 +88,24 @@ void SendCommand(UsbCommand *c) {
 		return;
     }
 
+	if (g_profiling) {
+		ProfileRequestSent(c->cmd);
+	}
+
+#ifndef _WIN32
+	if (!conn.block_after_ACK) {
+		// Send right away. The communication thread only sends when it stops waiting
+		// for data from the Proxmark, which takes up to the UART timeout when the
+		// Proxmark is idle, and pipelined requests would be sent one by one.
+		pthread_mutex_lock(&txBufferMutex);
+		if (!uart_send(sp, (uint8_t*)c, sizeof(UsbCommand))) {
+			PrintAndLog("Sending bytes to proxmark failed");
+		}
+		pthread_mutex_unlock(&txBufferMutex);
+		return;
+	}
+#endif
+
 	pthread_mutex_lock(&txBufferMutex);
 	/**
 	This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive, 
@@ -115,6 +144,10 @@ void clearCommandBuffer()
  */
 static void storeCommand(UsbCommand *command)
 {
+	if (g_profiling) {
+		ProfileResponseStored(command->cmd);
+	}
+
 	pthread_mutex_lock(&rxBufferMutex);
 	if( (cmd_head+1) % CMD_BUFFER_SIZE == cmd_tail)
 	{
@@ -128,6 +161,8 @@ static void storeCommand(UsbCommand *command)
 	memcpy(destination, command, sizeof(UsbCommand));
 
 	cmd_head = (cmd_head +1) % CMD_BUFFER_SIZE; //increment head and wrap
+	rx_count++;
+	pthread_cond_broadcast(&rxBufferSig);
 	pthread_mutex_unlock(&rxBufferMutex);
 }
 
@@ -149,21 +184,60 @@ static int getCommand(UsbCommand* response)
 	//Pick out the next unread command
 	UsbCommand* last_unread = &rxBuffer[cmd_tail];
 	memcpy(response, last_unread, sizeof(UsbCommand));
+	uint64_t tagged_cmd = response->cmd;
+	response->cmd &= USB_CMD_CMD_MASK;
 	//Increment tail - this is a circular buffer, so modulo buffer size
 	cmd_tail = (cmd_tail + 1) % CMD_BUFFER_SIZE;
 
 	pthread_mutex_unlock(&rxBufferMutex);
+	if (g_profiling) {
+		ProfileResponseTaken(tagged_cmd);
+	}
 	return 1;
 }
 
 
+/**
+ * @brief takeCommand takes the first command with the given tag and command out of the circular
+ * buffer, the other commands stay in place
+ * @param cmd command to look for, or CMD_UNKNOWN to take any command.
+ * @return 1 if response was returned, 0 if there is no such command
+ */
+static int takeCommand(uint32_t tag, uint32_t cmd, UsbCommand* response)
+{
+	pthread_mutex_lock(&rxBufferMutex);
+	for (int i = cmd_tail; i != cmd_head; i = (i + 1) % CMD_BUFFER_SIZE) {
+		if ((rxBuffer[i].cmd >> USB_CMD_TAG_SHIFT) != tag)
+			continue;
+		if (cmd != CMD_UNKNOWN && (rxBuffer[i].cmd & USB_CMD_CMD_MASK) != cmd)
+			continue;
+
+		memcpy(response, &rxBuffer[i], sizeof(UsbCommand));
+		uint64_t tagged_cmd = response->cmd;
+		response->cmd &= USB_CMD_CMD_MASK;
+		// close the gap
+		for (int j = i; (j + 1) % CMD_BUFFER_SIZE != cmd_head; j = (j + 1) % CMD_BUFFER_SIZE) {
+			memcpy(&rxBuffer[j], &rxBuffer[(j + 1) % CMD_BUFFER_SIZE], sizeof(UsbCommand));
+		}
+		cmd_head = (cmd_head + CMD_BUFFER_SIZE - 1) % CMD_BUFFER_SIZE;
+		pthread_mutex_unlock(&rxBufferMutex);
+		if (g_profiling) {
+			ProfileResponseTaken(tagged_cmd);
+		}
+		return 1;
+	}
+	pthread_mutex_unlock(&rxBufferMutex);
+	return 0;
+}
+
+
 //----------------------------------------------------------------------------------
 // Entry point into our code: called whenever we received a packet over USB.
 // Handle debug commands directly, store all other commands in circular buffer.
 //----------------------------------------------------------------------------------
 static void UsbCommandReceived(UsbCommand *UC)
 {
-	switch(UC->cmd) {
+	switch(UC->cmd & USB_CMD_CMD_MASK) {
 		// First check if we are handling a debug message
 		case CMD_DEBUG_PRINT_STRING: {
 			char s[USB_CMD_DATA_SIZE+1];
@@ -268,6 +342,7 @@ bool GetFromBigBuf(uint8_t *dest, int bytes, int start_index, UsbCommand *respon
 	SendCommand(&c);
 
 	uint64_t start_time = msclock();
+	uint64_t profile_start = g_profiling ? nsclock() : 0;
 
 	UsbCommand resp;
   	if (response == NULL) {
@@ -275,6 +350,7 @@ bool GetFromBigBuf(uint8_t *dest, int bytes, int start_index, UsbCommand *respon
 	}
 
 	int bytes_completed = 0;
+	bool received = false;
 	while(true) {
 		if (getCommand(response)) {
 			if (response->cmd == CMD_DOWNLOADED_RAW_ADC_SAMPLES_125K) {
@@ -282,7 +358,8 @@ bool GetFromBigBuf(uint8_t *dest, int bytes, int start_index, UsbCommand *respon
 				memcpy(dest + response->arg[0], response->d.asBytes, copy_bytes);
 				bytes_completed += copy_bytes;
 			} else if (response->cmd == CMD_ACK) {
-				return true;
+				received = true;
+				break;
 			}
 		}
 
@@ -297,7 +374,10 @@ bool GetFromBigBuf(uint8_t *dest, int bytes, int start_index, UsbCommand *respon
 		}
 	}
 
-	return false;
+	if (g_profiling && profile_start) {
+		ProfileWaitDone(0, profile_start);
+	}
+	return received;
 }
 
 	
@@ -332,6 +412,7 @@ bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode)
 	} else {
 		// start the USB communication thread
 		serial_port_name = portname;
+		device_capabilities = -1;
 		conn.run = true;
 		conn.block_after_ACK = flash_mode;
 		pthread_create(&USB_communication_thread, NULL, &uart_communication, &conn);
@@ -402,14 +483,20 @@ bool WaitForResponseTimeoutW(uint32_t cmd, UsbCommand* response, size_t ms_timeo
 	}
 
 	uint64_t start_time = msclock();
+	uint64_t profile_start = g_profiling ? nsclock() : 0;
+	bool received = false;
 
 	// Wait until the command is received
 	while (true) {
 		while(getCommand(response)) {
 			if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
-				return true;
+				received = true;
+				break;
 			}
 		}
+		if (received) {
+			break;
+		}
 
 		if (msclock() - start_time > ms_timeout) {
 			break;
@@ -422,7 +509,11 @@ bool WaitForResponseTimeoutW(uint32_t cmd, UsbCommand* response, size_t ms_timeo
 			show_warning = false;
 		}
 	}
-	return false;
+
+	if (g_profiling && profile_start) {
+		ProfileWaitDone(0, profile_start);
+	}
+	return received;
 }
 
 
@@ -434,3 +525,173 @@ bool WaitForResponse(uint32_t cmd, UsbCommand* response) {
 	return WaitForResponseTimeoutW(cmd, response, -1, true);
 }
 
+
+/**
+ * Stores the USB_CMD_CAP_* flags from the arg0 of an answer to CMD_PING.
+ */
+void SetDeviceCapabilities(uint64_t ping_arg0) {
+	device_capabilities = ping_arg0 & 0xffffffff;
+}
+
+
+/**
+ * Asks the firmware for its capabilities with a CMD_PING. Called once after the
+ * connect (by hw version), it drops the answers waiting in the buffer.
+ */
+void ProbeDeviceCapabilities(void) {
+	device_capabilities = -1;
+	if (offline) {
+		return;
+	}
+
+	UsbCommand c = {CMD_PING};
+	UsbCommand resp;
+	clearCommandBuffer();
+	SendCommand(&c);
+	if (WaitForResponseTimeout(CMD_ACK, &resp, 1000)) {
+		SetDeviceCapabilities(resp.arg[0]);
+	}
+}
+
+
+/**
+ * The USB_CMD_CAP_* flags of the firmware as probed at the connect, none if they
+ * weren't probed (yet) or the firmware is old. Doesn't talk to the device.
+ */
+uint32_t GetDeviceCapabilities(void) {
+	if (offline || device_capabilities < 0) {
+		return 0;
+	}
+	return device_capabilities;
+}
+
+
+/**
+ * Does the firmware echo request tags?
+ */
+bool TaggedRequestsSupported(void) {
+	return GetDeviceCapabilities() & USB_CMD_CAP_TAG;
+}
+
+
+/**
+ * Sends a command with a new tag. Several tagged commands can be sent before
+ * the answers are collected with WaitForTaggedResponseTimeout(), in any order.
+ * Waiting with WaitForResponse() in between takes the answers of all requests.
+ * @return the tag, 0 if the firmware can't echo tags. The command is sent
+ * untagged then and the answers must be collected in the order of the requests.
+ */
+uint32_t SendCommandTagged(UsbCommand *c) {
+	uint32_t tag = 0;
+
+	if (TaggedRequestsSupported()) {
+		if (++next_tag == 0) {
+			next_tag = 1;
+		}
+		tag = next_tag;
+	}
+
+	UsbCommand tagged = *c;
+	tagged.cmd = (c->cmd & USB_CMD_CMD_MASK) | ((uint64_t)tag << USB_CMD_TAG_SHIFT);
+	SendCommand(&tagged);
+	return tag;
+}
+
+
+/**
+ * Waits for an answer to the request with the given tag. Answers to other
+ * tagged requests and answers with this tag but another command stay in the buffer.
+ * @param tag as returned by SendCommandTagged()
+ * @param cmd command to wait for, or CMD_UNKNOWN to take any command.
+ * @return true if command was returned, otherwise false
+ */
+bool WaitForTaggedResponseTimeout(uint32_t tag, uint32_t cmd, UsbCommand* response, size_t ms_timeout) {
+
+	UsbCommand resp;
+
+	if (tag == 0) {
+		return WaitForResponseTimeoutW(cmd, response, ms_timeout, false);
+	}
+
+	if (response == NULL) {
+		response = &resp;
+	}
+
+	uint64_t start_time = msclock();
+	uint64_t profile_start = g_profiling ? nsclock() : 0;
+	bool received = false;
+
+	while (true) {
+		// other answers with this tag stay in the buffer
+		if (takeCommand(tag, cmd, response)) {
+			received = true;
+			break;
+		}
+
+		if (msclock() - start_time > ms_timeout) {
+			break;
+		}
+	}
+
+	if (g_profiling && profile_start) {
+		ProfileWaitDone(tag, profile_start);
+	}
+	return received;
+}
+
+
+/**
+ * Non-blocking: takes the first answer with the given tag (0 for untagged ones) and
+ * command out of the buffer. Unlike the WaitForResponse functions this doesn't drop
+ * other answers, several requests can be polled for in turns.
+ * @param cmd command to look for, or CMD_UNKNOWN to take any command.
+ * @return true if command was returned, otherwise false
+ */
+bool PollTaggedResponse(uint32_t tag, uint32_t cmd, UsbCommand* response) {
+	return takeCommand(tag, cmd, response);
+}
+
+
+/**
+ * @return the number of answers received so far, to be passed to WaitForResponses()
+ */
+uint32_t ResponsesReceived(void) {
+	pthread_mutex_lock(&rxBufferMutex);
+	uint32_t count = rx_count;
+	pthread_mutex_unlock(&rxBufferMutex);
+	return count;
+}
+
+
+/**
+ * Sleeps until an answer arrives after the ResponsesReceived() call which returned
+ * received, at most ms_timeout milliseconds.
+ * @return true if there is a new answer
+ */
+bool WaitForResponses(uint32_t received, size_t ms_timeout) {
+	struct timeval now;
+	struct timespec until;
+
+	if (ms_timeout > 3600 * 1000) {
+		ms_timeout = 3600 * 1000;
+	}
+	uint64_t profile_start = g_profiling ? nsclock() : 0;
+	gettimeofday(&now, NULL);
+	uint64_t ns = (uint64_t)now.tv_usec * 1000 + (uint64_t)(ms_timeout % 1000) * 1000000;
+	until.tv_sec = now.tv_sec + ms_timeout / 1000 + ns / 1000000000;
+	until.tv_nsec = ns % 1000000000;
+
+	pthread_mutex_lock(&rxBufferMutex);
+	while (rx_count == received) {
+		if (pthread_cond_timedwait(&rxBufferSig, &rxBufferMutex, &until) != 0) {
+			break;
+		}
+	}
+	bool new_response = rx_count != received;
+	pthread_mutex_unlock(&rxBufferMutex);
+
+	if (g_profiling && profile_start) {
+		ProfileWaitDone(-1, profile_start);
+	}
+	return new_response;
+}
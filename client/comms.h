@@ -34,6 +34,15 @@ void clearCommandBuffer();
 bool WaitForResponseTimeoutW(uint32_t cmd, UsbCommand* response, size_t ms_timeout, bool show_warning);
 bool WaitForResponseTimeout(uint32_t cmd, UsbCommand* response, size_t ms_timeout);
 bool WaitForResponse(uint32_t cmd, UsbCommand* response);
+void SetDeviceCapabilities(uint64_t ping_arg0);
+void ProbeDeviceCapabilities(void);
+uint32_t GetDeviceCapabilities(void);
+bool TaggedRequestsSupported(void);
+uint32_t SendCommandTagged(UsbCommand *c);
+bool WaitForTaggedResponseTimeout(uint32_t tag, uint32_t cmd, UsbCommand* response, size_t ms_timeout);
+bool PollTaggedResponse(uint32_t tag, uint32_t cmd, UsbCommand* response);
+uint32_t ResponsesReceived(void);
+bool WaitForResponses(uint32_t received, size_t ms_timeout);
 bool GetFromBigBuf(uint8_t *dest, int bytes, int start_index, UsbCommand *response, size_t ms_timeout, bool show_warning);
 
 #endif // COMMS_H_
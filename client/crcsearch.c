@@ -0,0 +1,494 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// CRC parameter search over captured frames
+//
+// For a fixed polynomial the register after a frame is linear in the preset:
+//   reg = init * x^(8*len) + data * x^width  (mod poly)
+// and the transmitted CRC is the (reflected) register XOR xorout.
+//
+// Two frames of the same length cancel init and xorout, the polynomial then
+// divides (data_a ^ data_b) * x^width + (reg_a ^ reg_b). The GCD over all
+// such pairs usually is the polynomial itself. Without such pairs all odd
+// polynomials are tried, spread over all CPUs. For 32 bit CRCs these are too
+// many, the search is limited to the polynomials of the catalogue then. For every candidate init and
+// xorout are solved as a linear system over GF(2).
+//-----------------------------------------------------------------------------
+
+#include "crcsearch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ui.h"
+#include "util.h"
+
+#define GF2_WORDS				((CRCSEARCH_MAX_FRAMELEN * 8 + 32) / 64 + 1)
+#define CRCSEARCH_MIN_THREADED	256		// fewer candidates are tried in the calling thread
+
+typedef struct {
+	const char *name;
+	uint8_t width;
+	uint32_t poly;
+	uint32_t init;
+	bool refin;
+	bool refout;
+	uint32_t xorout;
+} crc_catalogue_t;
+
+// the models used by tags and readers and the most common others
+static const crc_catalogue_t catalogue[] = {
+	{"CRC-8/SMBUS",              8, 0x07,       0x00,       false, false, 0x00},
+	{"CRC-8/MAXIM-DOW",          8, 0x31,       0x00,       true,  true,  0x00},
+	{"CRC-8/CDMA2000",           8, 0x9B,       0xFF,       false, false, 0x00},
+	{"CRC-8/ROHC",               8, 0x07,       0xFF,       true,  true,  0x00},
+	{"CRC-8/SAE-J1850",          8, 0x1D,       0xFF,       false, false, 0xFF},
+	{"CRC-8/MIFARE-MAD",         8, 0x1D,       0xC7,       false, false, 0x00},
+	{"CRC-16/ARC",              16, 0x8005,     0x0000,     true,  true,  0x0000},
+	{"CRC-16/MODBUS",           16, 0x8005,     0xFFFF,     true,  true,  0x0000},
+	{"CRC-16/UMTS",             16, 0x8005,     0x0000,     false, false, 0x0000},
+	{"CRC-16/KERMIT",           16, 0x1021,     0x0000,     true,  true,  0x0000},
+	{"CRC-16/ISO-IEC-14443-3-A",16, 0x1021,     0xC6C6,     true,  true,  0x0000},
+	{"CRC-16/IBM-SDLC",         16, 0x1021,     0xFFFF,     true,  true,  0xFFFF},
+	{"CRC-16/MCRF4XX",          16, 0x1021,     0xFFFF,     true,  true,  0x0000},
+	{"CRC-16/IBM-3740",         16, 0x1021,     0xFFFF,     false, false, 0x0000},
+	{"CRC-16/XMODEM",           16, 0x1021,     0x0000,     false, false, 0x0000},
+	{"CRC-16/GENIBUS",          16, 0x1021,     0xFFFF,     false, false, 0xFFFF},
+	{"CRC-16/DNP",              16, 0x3D65,     0x0000,     true,  true,  0xFFFF},
+	{"CRC-32/ISO-HDLC",         32, 0x04C11DB7, 0xFFFFFFFF, true,  true,  0xFFFFFFFF},
+	{"CRC-32/JAMCRC",           32, 0x04C11DB7, 0xFFFFFFFF, true,  true,  0x00000000},
+	{"CRC-32/BZIP2",            32, 0x04C11DB7, 0xFFFFFFFF, false, false, 0xFFFFFFFF},
+	{"CRC-32/MPEG-2",           32, 0x04C11DB7, 0xFFFFFFFF, false, false, 0x00000000},
+	{"CRC-32/CKSUM",            32, 0x04C11DB7, 0x00000000, false, false, 0xFFFFFFFF},
+	{"CRC-32/ISCSI",            32, 0x1EDC6F41, 0xFFFFFFFF, true,  true,  0xFFFFFFFF},
+	{"CRC-32/BASE91-D",         32, 0xA833982B, 0xFFFFFFFF, true,  true,  0xFFFFFFFF},
+	{"CRC-32/AUTOSAR",          32, 0xF4ACFB13, 0xFFFFFFFF, true,  true,  0xFFFFFFFF},
+	{"CRC-32/AIXM",             32, 0x814141AB, 0x00000000, false, false, 0x00000000},
+	{"CRC-32/XFER",             32, 0x000000AF, 0x00000000, false, false, 0x00000000},
+};
+
+// polynomial over GF(2), bit i is the coefficient of x^i
+typedef struct {
+	uint64_t w[GF2_WORDS];
+	int deg;				// -1 for 0
+} gf2poly_t;
+
+// rows of an equation system in echelon form, pivot is the lowest coefficient
+typedef struct {
+	uint64_t coef[64];
+	uint8_t rhs[64];
+	uint64_t used;
+} gf2basis_t;
+
+// one frame layout and reflection, all candidate polynomials are tried on it
+typedef struct {
+	uint8_t width;
+	uint32_t mask;
+	bool refin;
+	bool refout;
+	bool crc_le;
+	uint8_t offset;
+	uint8_t trailing;
+	size_t count;
+	uint8_t data[CRCSEARCH_MAX_FRAMES][CRCSEARCH_MAX_FRAMELEN];	// reflected if refin
+	size_t len[CRCSEARCH_MAX_FRAMES];
+	uint32_t reg[CRCSEARCH_MAX_FRAMES];		// the CRC as register value, before xorout
+	bool have_gcd;
+	gf2poly_t gcd;
+	const uint32_t *polys;					// candidates, NULL for all odd polynomials
+	size_t npolys;
+	// results, shared by the threads
+	pthread_mutex_t lock;
+	crc_model_t *models;
+	size_t max_models;
+	size_t nmodels;
+	bool overflow;
+} crcsearch_t;
+
+typedef struct {
+	crcsearch_t *s;
+	size_t first;
+	size_t step;
+} crcsearch_thread_t;
+
+static uint32_t width_mask(uint8_t width) {
+	return width == 32 ? 0xffffffff : (1U << width) - 1;
+}
+
+//-----------------------------------------------------------------------------
+// GF(2) polynomials
+//-----------------------------------------------------------------------------
+static void gf2_set_degree(gf2poly_t *p) {
+	for (int i = GF2_WORDS - 1; i >= 0; i--) {
+		if (p->w[i]) {
+			p->deg = i * 64 + 63 - __builtin_clzll(p->w[i]);
+			return;
+		}
+	}
+	p->deg = -1;
+}
+
+// a = a mod b
+static void gf2_mod(gf2poly_t *a, const gf2poly_t *b) {
+	while (a->deg >= b->deg) {
+		int shift = a->deg - b->deg;
+		int ws = shift / 64, bs = shift % 64;
+		for (int i = GF2_WORDS - 1; i >= ws; i--) {
+			uint64_t v = b->w[i - ws] << bs;
+			if (bs && i - ws - 1 >= 0)
+				v |= b->w[i - ws - 1] >> (64 - bs);
+			a->w[i] ^= v;
+		}
+		gf2_set_degree(a);
+	}
+}
+
+// a = gcd(a, b), b is destroyed
+static void gf2_gcd(gf2poly_t *a, gf2poly_t *b) {
+	while (b->deg >= 0) {
+		gf2_mod(a, b);
+		gf2poly_t t = *a;
+		*a = *b;
+		*b = t;
+	}
+}
+
+// (data_a ^ data_b) * x^width + regdiff
+static void gf2_frame_diff(gf2poly_t *p, const uint8_t *a, const uint8_t *b, size_t len, uint32_t regdiff, uint8_t width) {
+	memset(p, 0, sizeof(*p));
+	size_t n = len * 8 + width;
+	for (size_t i = 0; i < len * 8; i++) {
+		if (((a[i / 8] ^ b[i / 8]) >> (7 - i % 8)) & 1) {
+			size_t bit = n - 1 - i;
+			p->w[bit / 64] |= 1ULL << (bit % 64);
+		}
+	}
+	p->w[0] ^= regdiff;
+	gf2_set_degree(p);
+}
+
+static bool gf2_divisible(const gf2poly_t *g, uint8_t width, uint32_t poly) {
+	uint64_t top = 1ULL << width;
+	uint64_t r = 0;
+	for (int i = g->deg; i >= 0; i--) {
+		r = (r << 1) | ((g->w[i / 64] >> (i % 64)) & 1);
+		if (r & top)
+			r ^= top | poly;
+	}
+	return r == 0;
+}
+
+//-----------------------------------------------------------------------------
+// equation systems over GF(2), at most 64 unknowns
+//-----------------------------------------------------------------------------
+// false if the equation contradicts the ones inserted before
+static bool gf2_insert(gf2basis_t *b, uint64_t coef, uint8_t rhs) {
+	while (coef) {
+		int c = __builtin_ctzll(coef);
+		if (!((b->used >> c) & 1)) {
+			b->coef[c] = coef;
+			b->rhs[c] = rhs;
+			b->used |= 1ULL << c;
+			return true;
+		}
+		coef ^= b->coef[c];
+		rhs ^= b->rhs[c];
+	}
+	return rhs == 0;
+}
+
+// a solution, the free unknowns are 0
+static uint64_t gf2_solve(const gf2basis_t *b) {
+	uint64_t x = 0;
+	for (int c = 63; c >= 0; c--) {
+		if ((b->used >> c) & 1) {
+			uint64_t bit = b->rhs[c] ^ __builtin_parityll(b->coef[c] & x);
+			x |= bit << c;
+		}
+	}
+	return x;
+}
+
+//-----------------------------------------------------------------------------
+// CRC register, MSB first, without reflection
+//-----------------------------------------------------------------------------
+static uint32_t crc_reg(uint32_t reg, const uint8_t *data, size_t len, uint8_t width, uint32_t poly, uint32_t mask) {
+	for (size_t i = 0; i < len; i++) {
+		for (int bit = 7; bit >= 0; bit--) {
+			uint32_t top = ((reg >> (width - 1)) ^ (data[i] >> bit)) & 1;
+			reg = (reg << 1) & mask;
+			if (top)
+				reg ^= poly;
+		}
+	}
+	return reg;
+}
+
+static uint32_t crc_clock(uint32_t reg, uint8_t width, uint32_t poly, uint32_t mask) {
+	uint32_t top = (reg >> (width - 1)) & 1;
+	reg = (reg << 1) & mask;
+	return top ? reg ^ poly : reg;
+}
+
+uint32_t crc_model_calc(const crc_model_t *model, const uint8_t *data, size_t len) {
+	uint32_t mask = width_mask(model->width);
+	uint32_t reg = model->init & mask;
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = model->refin ? SwapBits(data[i], 8) : data[i];
+		reg = crc_reg(reg, &b, 1, model->width, model->poly, mask);
+	}
+	if (model->refout)
+		reg = SwapBits(reg, model->width);
+	return (reg ^ model->xorout) & mask;
+}
+
+const char *crc_model_name(const crc_model_t *model) {
+	for (size_t i = 0; i < sizeof(catalogue) / sizeof(catalogue[0]); i++) {
+		const crc_catalogue_t *c = &catalogue[i];
+		if (c->width == model->width && c->poly == model->poly && c->init == model->init
+			&& c->refin == model->refin && c->refout == model->refout && c->xorout == model->xorout)
+			return c->name;
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// search
+//-----------------------------------------------------------------------------
+static void add_model(crcsearch_t *s, uint32_t poly, uint64_t solution, bool ambiguous) {
+	crc_model_t m = {
+		.width = s->width,
+		.poly = poly,
+		.init = solution & s->mask,
+		.refin = s->refin,
+		.refout = s->refout,
+		.offset = s->offset,
+		.trailing = s->trailing,
+		.crc_le = s->crc_le,
+		.ambiguous = ambiguous,
+	};
+	uint32_t xorreg = (solution >> s->width) & s->mask;
+	m.xorout = s->refout ? SwapBits(xorreg, s->width) : xorreg;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->nmodels < s->max_models)
+		s->models[s->nmodels++] = m;
+	else
+		s->overflow = true;
+	pthread_mutex_unlock(&s->lock);
+}
+
+// unknowns: init in bits 0..width-1, xorout (as register value) in bits width..2*width-1
+static void try_poly(crcsearch_t *s, uint32_t poly) {
+	uint8_t w = s->width;
+	gf2basis_t b;
+	b.used = 0;
+
+	if (s->have_gcd && !gf2_divisible(&s->gcd, w, poly))
+		return;
+
+	for (size_t i = 0; i < s->count; i++) {
+		uint32_t r = s->reg[i] ^ crc_reg(0, s->data[i], s->len[i], w, poly, s->mask);
+		// column j: x^j * x^(8*len) mod poly
+		uint32_t col[32];
+		col[0] = 1;
+		for (size_t k = 0; k < s->len[i] * 8; k++)
+			col[0] = crc_clock(col[0], w, poly, s->mask);
+		for (int j = 1; j < w; j++)
+			col[j] = crc_clock(col[j - 1], w, poly, s->mask);
+
+		for (int k = 0; k < w; k++) {
+			uint64_t coef = 1ULL << (w + k);
+			for (int j = 0; j < w; j++)
+				coef |= (uint64_t)((col[j] >> k) & 1) << j;
+			if (!gf2_insert(&b, coef, (r >> k) & 1))
+				return;
+		}
+	}
+
+	if (__builtin_popcountll(b.used) == 2 * w) {
+		add_model(s, poly, gf2_solve(&b), false);
+		return;
+	}
+
+	// frames of a single length: report the usual xorouts
+	bool found = false;
+	uint32_t xorouts[] = {0, s->mask};
+	for (int x = 0; x < 2; x++) {
+		gf2basis_t bx = b;
+		bool ok = true;
+		for (int k = 0; k < w && ok; k++)
+			ok = gf2_insert(&bx, 1ULL << (w + k), (xorouts[x] >> k) & 1);
+		if (ok) {
+			add_model(s, poly, gf2_solve(&bx), true);
+			found = true;
+		}
+	}
+	if (!found)
+		add_model(s, poly, gf2_solve(&b), true);
+}
+
+static uint32_t candidate(const crcsearch_t *s, size_t i) {
+	return s->polys ? s->polys[i] : (uint32_t)(2 * i + 1);
+}
+
+static size_t candidate_count(const crcsearch_t *s) {
+	return s->polys ? s->npolys : (size_t)1 << (s->width - 1);
+}
+
+static void *search_thread(void *arg) {
+	crcsearch_thread_t *t = arg;
+	size_t n = candidate_count(t->s);
+	for (size_t i = t->first; i < n && !t->s->overflow; i += t->step)
+		try_poly(t->s, candidate(t->s, i));
+	return NULL;
+}
+
+static void search_candidates(crcsearch_t *s) {
+	size_t n = candidate_count(s);
+	int threads = num_CPUs();
+
+	if (n < CRCSEARCH_MIN_THREADED || threads <= 1) {
+		crcsearch_thread_t t = {s, 0, 1};
+		search_thread(&t);
+		return;
+	}
+
+	pthread_t thread_ids[threads];
+	crcsearch_thread_t args[threads];
+	for (int i = 0; i < threads; i++) {
+		args[i].s = s;
+		args[i].first = i;
+		args[i].step = threads;
+		pthread_create(&thread_ids[i], NULL, search_thread, &args[i]);
+	}
+	for (int i = 0; i < threads; i++)
+		pthread_join(thread_ids[i], NULL);
+}
+
+// cut the frames to the layout. False if a frame is too short.
+static bool prepare(crcsearch_t *s, const crc_frame_t *frames, size_t count) {
+	uint8_t crclen = s->width / 8;
+	s->count = count;
+	for (size_t i = 0; i < count; i++) {
+		if (frames[i].len < (size_t)s->offset + crclen + s->trailing + 1)
+			return false;
+		s->len[i] = frames[i].len - s->offset - crclen - s->trailing;
+		for (size_t j = 0; j < s->len[i]; j++) {
+			uint8_t b = frames[i].data[s->offset + j];
+			s->data[i][j] = s->refin ? SwapBits(b, 8) : b;
+		}
+		const uint8_t *c = frames[i].data + s->offset + s->len[i];
+		uint32_t crc = 0;
+		for (int j = 0; j < crclen; j++)
+			crc |= (uint32_t)c[j] << (s->crc_le ? 8 * j : 8 * (crclen - 1 - j));
+		s->reg[i] = s->refout ? SwapBits(crc, s->width) : crc;
+	}
+
+	// pairs of the same length
+	s->have_gcd = false;
+	for (size_t i = 0; i < count; i++) {
+		for (size_t j = 0; j < i; j++) {
+			if (s->len[j] != s->len[i])
+				continue;
+			gf2poly_t diff;
+			gf2_frame_diff(&diff, s->data[i], s->data[j], s->len[i], s->reg[i] ^ s->reg[j], s->width);
+			if (diff.deg < 0)
+				break;		// same frame twice
+			if (s->have_gcd) {
+				gf2_gcd(&s->gcd, &diff);
+			} else {
+				s->gcd = diff;
+				s->have_gcd = true;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+static size_t catalogue_polys(uint8_t width, uint32_t *polys) {
+	size_t n = 0;
+	for (size_t i = 0; i < sizeof(catalogue) / sizeof(catalogue[0]); i++) {
+		if (catalogue[i].width != width)
+			continue;
+		size_t j;
+		for (j = 0; j < n && polys[j] != catalogue[i].poly; j++);
+		if (j == n)
+			polys[n++] = catalogue[i].poly;
+	}
+	return n;
+}
+
+int crcsearch(const crc_frame_t *frames, size_t count, uint8_t width, uint8_t max_offset, uint8_t max_trailing,
+	crc_model_t *models, size_t max_models, bool verbose) {
+
+	uint8_t widths[] = {8, 16, 32};
+	uint32_t known_polys[sizeof(catalogue) / sizeof(catalogue[0])];
+	bool notified_32 = false;
+
+	crcsearch_t *s = calloc(1, sizeof(crcsearch_t));
+	if (s == NULL) {
+		PrintAndLog("Cannot allocate memory");
+		return 0;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	s->models = models;
+	s->max_models = max_models;
+
+	for (int wi = 0; wi < 3; wi++) {
+		if (width != 0 && width != widths[wi])
+			continue;
+		s->width = widths[wi];
+		s->mask = width_mask(s->width);
+
+		for (int layout = 0; layout < (max_offset + 1) * (max_trailing + 1) * (s->width == 8 ? 1 : 2); layout++) {
+			s->offset = layout % (max_offset + 1);
+			s->trailing = (layout / (max_offset + 1)) % (max_trailing + 1);
+			s->crc_le = layout / ((max_offset + 1) * (max_trailing + 1));
+
+			for (int refl = 0; refl < 4; refl++) {
+				s->refin = refl & 1;
+				s->refout = refl >> 1;
+				if (!prepare(s, frames, count))
+					continue;
+
+				s->polys = NULL;
+				bool by_gcd = false;
+				if (s->have_gcd && s->gcd.deg < s->width)
+					continue;
+				if (s->have_gcd && s->gcd.deg == s->width) {
+					by_gcd = true;
+					known_polys[0] = s->gcd.w[0] & s->mask;
+					s->polys = known_polys;
+					s->npolys = 1;
+				} else if (s->width == 32) {
+					// 2^31 polynomials are too many, more frames of the same length narrow the GCD down
+					if (verbose && !notified_32) {
+						PrintAndLog("32 bit: the frames don't pin the polynomial down, only catalogue polynomials are tried");
+						notified_32 = true;
+					}
+					s->npolys = catalogue_polys(32, known_polys);
+					s->polys = known_polys;
+				}
+
+				if (verbose)
+					PrintAndLog("width %2d offset %d trailing %d %s refin %d refout %d: %zu candidates%s",
+						s->width, s->offset, s->trailing, s->crc_le ? "LE" : "BE", s->refin, s->refout,
+						candidate_count(s), by_gcd ? " (GCD)" : "");
+				search_candidates(s);
+				if (s->overflow)
+					goto out;
+			}
+		}
+	}
+
+out:
+	pthread_mutex_destroy(&s->lock);
+	int res = s->overflow ? -1 : (int)s->nmodels;
+	free(s);
+	return res;
+}
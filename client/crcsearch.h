@@ -0,0 +1,49 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// CRC parameter search over captured frames
+//-----------------------------------------------------------------------------
+
+#ifndef CRCSEARCH_H__
+#define CRCSEARCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CRCSEARCH_MAX_FRAMES		16
+#define CRCSEARCH_MAX_FRAMELEN		64
+#define CRCSEARCH_MAX_MODELS		64
+
+// Rocksoft model plus where the CRC sits in the frames
+typedef struct {
+	uint8_t width;
+	uint32_t poly;				// normal notation, x^width omitted
+	uint32_t init;
+	bool refin;
+	bool refout;
+	uint32_t xorout;
+	uint8_t offset;				// first byte covered by the CRC
+	uint8_t trailing;			// bytes following the CRC
+	bool crc_le;				// CRC sent least significant byte first
+	bool ambiguous;				// init and xorout can't be told apart with these frames
+} crc_model_t;
+
+typedef struct {
+	uint8_t data[CRCSEARCH_MAX_FRAMELEN];
+	size_t len;
+} crc_frame_t;
+
+// width 0 searches 8, 16 and 32 bit CRCs. 32 bit polynomials which the frames don't
+// pin down are taken from the catalogue only. Returns the number of models found,
+// -1 if there are more than max_models.
+int crcsearch(const crc_frame_t *frames, size_t count, uint8_t width, uint8_t max_offset, uint8_t max_trailing,
+	crc_model_t *models, size_t max_models, bool verbose);
+
+uint32_t crc_model_calc(const crc_model_t *model, const uint8_t *data, size_t len);
+// catalogue name of the model or NULL
+const char *crc_model_name(const crc_model_t *model);
+
+#endif
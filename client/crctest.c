@@ -0,0 +1,224 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Tests and benchmark of the table driven CRCs
+//-----------------------------------------------------------------------------
+
+#include "crctest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ui.h"
+#include "util_posix.h"
+#include "crctable.h"
+#include "crc.h"
+#include "crc16.h"
+#include "crc32.h"
+#include "iso14443crc.h"
+#include "iso15693tools.h"
+
+#define CRCTEST_MAXLEN		256
+#define CRCBENCH_SIZE		(1024*1024)
+#define CRCBENCH_MIN_MS		300
+
+// the bit at a time implementations the tables replaced
+static uint16_t ref_crc16_refl(uint16_t crc, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+	return crc;
+}
+
+static uint16_t ref_crc16_ccitt(uint16_t crc, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i] << 8;
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static uint32_t ref_crc32_refl(uint32_t crc, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+	}
+	return crc;
+}
+
+static uint8_t ref_crc8_legic(uint8_t crc, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xC6 : crc >> 1;
+	}
+	return crc;
+}
+
+static uint32_t xorshift32(uint32_t *x) {
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x;
+}
+
+// every preset with every byte, the table lookup of the byte path
+static bool test_all_bytes(void)
+{
+	for (uint32_t crc = 0; crc < 0x10000; crc++) {
+		for (int b = 0; b < 256; b++) {
+			uint8_t d = b;
+			if (crc16_refl_update(crc, &d, 1) != ref_crc16_refl(crc, &d, 1)
+				|| crc16_ccitt_update(crc, &d, 1) != ref_crc16_ccitt(crc, &d, 1)
+				|| crc32_refl_update(crc * 0x9E3779B1, &d, 1) != ref_crc32_refl(crc * 0x9E3779B1, &d, 1)
+				|| crc8_legic_update(crc, &d, 1) != ref_crc8_legic(crc, &d, 1))
+				return false;
+		}
+	}
+	return true;
+}
+
+// all lengths at all alignments, the 8 byte rounds and the remainders
+static bool test_all_lengths(void)
+{
+	uint8_t buf[CRCTEST_MAXLEN + 8];
+	uint32_t rnd = 0x12345678;
+
+	for (int round = 0; round < 16; round++) {
+		for (size_t i = 0; i < sizeof(buf); i++)
+			buf[i] = xorshift32(&rnd);
+		uint32_t preset = xorshift32(&rnd);
+		for (size_t offset = 0; offset < 8; offset++) {
+			for (size_t len = 0; len <= CRCTEST_MAXLEN; len++) {
+				const uint8_t *d = buf + offset;
+				if (crc16_refl_update(preset, d, len) != ref_crc16_refl(preset, d, len)
+					|| crc16_ccitt_update(preset, d, len) != ref_crc16_ccitt(preset, d, len)
+					|| crc32_refl_update(preset, d, len) != ref_crc32_refl(preset, d, len)
+					|| crc8_legic_update(preset, d, len) != ref_crc8_legic(preset, d, len))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+// check values for "123456789" of the CRC catalogue
+static bool test_check_values(void)
+{
+	uint8_t check[] = "123456789";
+	uint8_t crc[4];
+	bool ok = true;
+
+	ComputeCrc14443(CRC_14443_A, check, 9, &crc[0], &crc[1]);
+	ok &= (crc[0] | (crc[1] << 8)) == 0xBF05;				// CRC-16/ISO-IEC-14443-3-A
+	ComputeCrc14443(CRC_14443_B, check, 9, &crc[0], &crc[1]);
+	ok &= (crc[0] | (crc[1] << 8)) == 0x906E;				// CRC-16/IBM-SDLC
+	ok &= Iso15693Crc(check, 9) == 0x906E;
+	ok &= crc16_ccitt(check, 9) == 0x29B1;					// CRC-16/IBM-3740
+	ok &= crc16_ccitt_kermit(check, 9) == 0xC38C;			// CRC-16/XMODEM bit reversed (FDX-B)
+	ok &= crc16(check, 9, 0x0000, 0x8005) == 0xFEE8;		// CRC-16/UMTS, not table driven
+	uint16_t u = 0;
+	for (int i = 0; i < 9; i++)
+		u = update_crc16(u, check[i]);
+	ok &= u == 0x2189;
+	crc32(check, 9, crc);
+	ok &= (crc[0] | (crc[1] << 8) | (crc[2] << 16) | ((uint32_t)crc[3] << 24)) == 0x340BC6D9;	// CRC-32/JAMCRC
+	ok &= CRC8Legic(check, 9) == 0xC6;
+	return ok;
+}
+
+bool crc_selftest(bool verbose)
+{
+	struct {
+		const char *name;
+		bool (*test)(void);
+	} tests[] = {
+		{"all presets and bytes", test_all_bytes},
+		{"lengths 0..256, all alignments", test_all_lengths},
+		{"catalogue check values", test_check_values},
+	};
+	bool res = true;
+
+	PrintAndLog("Table driven CRCs:");
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		bool ok = tests[i].test();
+		if (verbose || !ok)
+			PrintAndLog("  %-35s [%s]", tests[i].name, ok ? "OK" : "ERROR");
+		res &= ok;
+	}
+	PrintAndLog("  %s", res ? "passed" : "FAILED");
+	return res;
+}
+
+typedef uint32_t (*crc_func_t)(uint32_t crc, const uint8_t *data, size_t len);
+
+static uint32_t tab16_refl(uint32_t crc, const uint8_t *data, size_t len) { return crc16_refl_update(crc, data, len); }
+static uint32_t tab16_ccitt(uint32_t crc, const uint8_t *data, size_t len) { return crc16_ccitt_update(crc, data, len); }
+static uint32_t tab32_refl(uint32_t crc, const uint8_t *data, size_t len) { return crc32_refl_update(crc, data, len); }
+static uint32_t tab8_legic(uint32_t crc, const uint8_t *data, size_t len) { return crc8_legic_update(crc, data, len); }
+static uint32_t bit16_refl(uint32_t crc, const uint8_t *data, size_t len) { return ref_crc16_refl(crc, data, len); }
+static uint32_t bit16_ccitt(uint32_t crc, const uint8_t *data, size_t len) { return ref_crc16_ccitt(crc, data, len); }
+static uint32_t bit32_refl(uint32_t crc, const uint8_t *data, size_t len) { return ref_crc32_refl(crc, data, len); }
+static uint32_t bit8_legic(uint32_t crc, const uint8_t *data, size_t len) { return ref_crc8_legic(crc, data, len); }
+
+// MB/s, blocks of len bytes
+static double bench_one(crc_func_t f, const uint8_t *buf, size_t len)
+{
+	uint64_t bytes = 0;
+	uint64_t start = msclock();
+	uint64_t ms;
+	volatile uint32_t sink = 0;
+
+	do {
+		for (size_t pos = 0; pos + len <= CRCBENCH_SIZE; pos += len)
+			sink ^= f(0xffff, buf + pos, len);
+		bytes += CRCBENCH_SIZE / len * len;
+		ms = msclock() - start;
+	} while (ms < CRCBENCH_MIN_MS);
+	(void)sink;
+
+	return bytes / 1000.0 / ms;
+}
+
+void crc_bench(void)
+{
+	struct {
+		const char *name;
+		crc_func_t table, bitwise;
+	} crcs[] = {
+		{"CRC-16 0x8408 LSB first", tab16_refl, bit16_refl},
+		{"CRC-16 0x1021 MSB first", tab16_ccitt, bit16_ccitt},
+		{"CRC-32 0xEDB88320", tab32_refl, bit32_refl},
+		{"CRC-8 0xC6 (LEGIC)", tab8_legic, bit8_legic},
+	};
+	// a short frame and a big block
+	size_t lens[] = {16, 4096};
+
+	uint8_t *buf = malloc(CRCBENCH_SIZE);
+	if (buf == NULL) {
+		PrintAndLog("Cannot allocate memory");
+		return;
+	}
+	uint32_t rnd = 0x87654321;
+	for (size_t i = 0; i < CRCBENCH_SIZE; i++)
+		buf[i] = xorshift32(&rnd);
+
+	PrintAndLog("%-25s %6s %12s %12s", "CRC", "block", "table MB/s", "bitwise MB/s");
+	for (size_t i = 0; i < sizeof(crcs) / sizeof(crcs[0]); i++) {
+		for (size_t j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+			PrintAndLog("%-25s %6zu %12.1f %12.1f", crcs[i].name, lens[j],
+				bench_one(crcs[i].table, buf, lens[j]), bench_one(crcs[i].bitwise, buf, lens[j]));
+		}
+	}
+	free(buf);
+}
@@ -0,0 +1,19 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Tests and benchmark of the table driven CRCs
+//-----------------------------------------------------------------------------
+
+#ifndef CRCTEST_H__
+#define CRCTEST_H__
+
+#include <stdbool.h>
+
+// compares common/crctable.c with bitwise references and known check values
+bool crc_selftest(bool verbose);
+// MB/s of the table driven CRCs and of the bitwise references
+void crc_bench(void);
+
+#endif
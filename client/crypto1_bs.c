@@ -0,0 +1,236 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Crypto1 for testing many keys (or states) at once on the host
+//-----------------------------------------------------------------------------
+
+#include "crypto1_bs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crypto1_bs_core.h"
+#include "hardnested/hardnested_bf_core.h"
+#include "ui.h"
+
+size_t crypto1_bs_count(crypto1_bs_t *bs) {
+	return bs->count;
+}
+
+size_t crypto1_bs_width(crypto1_bs_t *bs) {
+	return bs->width;
+}
+
+uint64_t *crypto1_bs_alive_create(size_t count) {
+	size_t words = (count + 63) / 64;
+	uint64_t *alive = malloc((words ? words : 1) * sizeof(uint64_t));
+	if (alive == NULL)
+		return NULL;
+
+	memset(alive, 0xff, words * sizeof(uint64_t));
+	if (count % 64)
+		alive[words - 1] = (1ULL << (count % 64)) - 1;
+	return alive;
+}
+
+void crypto1_bs_word(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, int is_encrypted, uint32_t *ks) {
+	crypto1_bs_bits(bs, in, in_shared, 32, 24, is_encrypted, ks, NULL, false, NULL);
+}
+
+size_t crypto1_bs_word_cmp(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, int is_encrypted,
+                           const uint32_t *expect, bool expect_shared, uint64_t *alive) {
+	return crypto1_bs_bits(bs, in, in_shared, 32, 24, is_encrypted, NULL, expect, expect_shared, alive);
+}
+
+static void clock_small(crypto1_bs_t *bs, const uint8_t *in, bool in_shared, uint8_t nbits, int is_encrypted, uint8_t *ks) {
+	size_t count = in_shared ? 1 : bs->count;
+	uint32_t *in32 = NULL;
+	uint32_t *ks32 = NULL;
+
+	if (in != NULL) {
+		in32 = malloc(count * sizeof(uint32_t));
+		if (in32 == NULL)
+			goto out;
+		for (size_t i = 0; i < count; i++)
+			in32[i] = in[i];
+	}
+	if (ks != NULL) {
+		ks32 = malloc(bs->count * sizeof(uint32_t));
+		if (ks32 == NULL)
+			goto out;
+	}
+
+	crypto1_bs_bits(bs, in32, in_shared, nbits, 0, is_encrypted, ks32, NULL, false, NULL);
+
+	if (ks != NULL) {
+		for (size_t i = 0; i < bs->count; i++)
+			ks[i] = ks32[i];
+	}
+out:
+	free(in32);
+	free(ks32);
+}
+
+void crypto1_bs_byte(crypto1_bs_t *bs, const uint8_t *in, bool in_shared, int is_encrypted, uint8_t *ks) {
+	clock_small(bs, in, in_shared, 8, is_encrypted, ks);
+}
+
+void crypto1_bs_bit(crypto1_bs_t *bs, const uint8_t *in, bool in_shared, int is_encrypted, uint8_t *ks) {
+	clock_small(bs, in, in_shared, 1, is_encrypted, ks);
+}
+
+//-----------------------------------------------------------------------------
+// self test against the reference implementation in common/crapto1
+//-----------------------------------------------------------------------------
+
+#define SELFTEST_LANES 1000			// deliberately not a multiple of any block width
+
+static uint64_t xorshift64(uint64_t *x) {
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static bool states_equal(crypto1_bs_t *bs, struct Crypto1State *ref) {
+	for (size_t i = 0; i < bs->count; i++) {
+		struct Crypto1State s;
+		crypto1_bs_get_state(bs, i, &s);
+		// crypto1_bit() doesn't clear the bits above the 24 bit halves
+		if (s.odd != (ref[i].odd & 0xffffff) || s.even != (ref[i].even & 0xffffff))
+			return false;
+	}
+	return true;
+}
+
+static bool selftest_simd(SIMDExecInstr instr, bool verbose) {
+	size_t n = SELFTEST_LANES;
+	uint64_t rnd = 0x0123456789abcdefULL;
+	uint64_t keys[SELFTEST_LANES];
+	uint32_t in[SELFTEST_LANES], ks[SELFTEST_LANES], expect[SELFTEST_LANES];
+	uint8_t in8[SELFTEST_LANES], ks8[SELFTEST_LANES];
+	struct Crypto1State ref[SELFTEST_LANES];
+	bool res = false;
+
+	for (size_t i = 0; i < n; i++) {
+		keys[i] = xorshift64(&rnd) & 0xffffffffffff;
+		crypto1_init(&ref[i], keys[i]);
+	}
+
+	SetSIMDInstr(instr);
+	crypto1_bs_t *bs = crypto1_bs_create(keys, n);
+	uint64_t *alive = crypto1_bs_alive_create(n);
+	if (bs == NULL || alive == NULL) {
+		PrintAndLog("Cannot allocate memory");
+		goto out;
+	}
+
+	if (verbose)
+		PrintAndLog("  %3zu lanes:", crypto1_bs_width(bs));
+
+	#define SELFTEST_CHECK(name, cond) \
+		if (!(cond) || !states_equal(bs, ref)) { PrintAndLog("  %-30s [ERROR]", name); goto out; } \
+		else if (verbose) PrintAndLog("  %-30s [OK]", name);
+
+	SELFTEST_CHECK("init", true);
+
+	// shared plain input (uid ^ nt)
+	uint32_t shared = xorshift64(&rnd);
+	crypto1_bs_word(bs, &shared, true, 0, ks);
+	bool ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= (crypto1_word(&ref[i], shared, 0) == ks[i]);
+	SELFTEST_CHECK("word, shared input", ok);
+
+	// different encrypted inputs (nr_enc)
+	for (size_t i = 0; i < n; i++)
+		in[i] = xorshift64(&rnd);
+	crypto1_bs_word(bs, in, false, 1, ks);
+	ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= (crypto1_word(&ref[i], in[i], 1) == ks[i]);
+	SELFTEST_CHECK("word, encrypted lane inputs", ok);
+
+	for (size_t i = 0; i < n; i++)
+		in8[i] = xorshift64(&rnd);
+	crypto1_bs_byte(bs, in8, false, 1, ks8);
+	ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= (crypto1_byte(&ref[i], in8[i], 1) == ks8[i]);
+	SELFTEST_CHECK("byte, encrypted lane inputs", ok);
+
+	crypto1_bs_filter(bs, ks8);
+	ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= (filter(ref[i].odd) == ks8[i]);
+	SELFTEST_CHECK("filter", ok);
+
+	for (size_t i = 0; i < n; i++)
+		in8[i] = xorshift64(&rnd) & 1;
+	crypto1_bs_bit(bs, in8, false, 0, ks8);
+	ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= (crypto1_bit(&ref[i], in8[i], 0) == ks8[i]);
+	SELFTEST_CHECK("bit, lane inputs", ok);
+
+	// compare: every third lane gets a wrong expected keystream
+	for (size_t i = 0; i < n; i++) {
+		expect[i] = crypto1_word(&ref[i], 0, 0);
+		if (i % 3 == 0)
+			expect[i] ^= 1U << (i % 32);
+	}
+	size_t alive_count = crypto1_bs_word_cmp(bs, NULL, false, 0, expect, false, alive);
+	ok = (alive_count == n - (n + 2) / 3);
+	for (size_t i = 0; i < n; i++) {
+		ok &= (crypto1_bs_alive(alive, i) == (i % 3 != 0));
+		if (i % 3 == 0)			// state of dead lanes is undefined
+			crypto1_bs_get_state(bs, i, &ref[i]);
+	}
+	SELFTEST_CHECK("word compare, lane expects", ok);
+
+	// shared expected value: only lanes with this keystream survive
+	uint32_t expect_shared = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t k = crypto1_word(&ref[i], 0, 0);
+		if (i == 1)
+			expect_shared = k;
+		expect[i] = k;
+	}
+	alive_count = crypto1_bs_word_cmp(bs, NULL, false, 0, &expect_shared, true, alive);
+	ok = (alive_count >= 1 && crypto1_bs_alive(alive, 1));
+	for (size_t i = 0; i < n; i++) {
+		if (crypto1_bs_alive(alive, i))
+			ok &= (expect[i] == expect_shared);
+		else
+			crypto1_bs_get_state(bs, i, &ref[i]);
+	}
+	SELFTEST_CHECK("word compare, shared expect", ok);
+
+	res = true;
+out:
+	#undef SELFTEST_CHECK
+	crypto1_bs_destroy(bs);
+	free(alive);
+	return res;
+}
+
+bool crypto1_bs_selftest(bool verbose) {
+	static const char *names[] = {"auto", "AVX512", "AVX2", "AVX", "SSE2", "MMX", "no SIMD"};
+	bool res = true;
+
+	SetSIMDInstr(SIMD_AUTO);
+	SIMDExecInstr best = GetSIMDInstrAuto();
+
+	// all instruction sets supported by this CPU
+	for (SIMDExecInstr instr = best; instr <= SIMD_NONE; instr++) {
+		PrintAndLog("Bitsliced Crypto1 (%s):", names[instr]);
+		bool ok = selftest_simd(instr, verbose);
+		PrintAndLog("  %s", ok ? "passed" : "FAILED");
+		res &= ok;
+	}
+
+	SetSIMDInstr(SIMD_AUTO);
+	return res;
+}
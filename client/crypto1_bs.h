@@ -0,0 +1,55 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Crypto1 for testing many keys (or states) at once on the host
+//
+// Each lane is an independent Crypto1 instance. Lanes are processed 64, 128,
+// 256 or 512 at a time depending on the SIMD instructions available (same
+// selection as the hardnested brute forcer, see SetSIMDInstr()).
+//-----------------------------------------------------------------------------
+
+#ifndef CRYPTO1_BS_H__
+#define CRYPTO1_BS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "crapto1/crapto1.h"
+
+typedef struct crypto1_bs crypto1_bs_t;
+
+// one lane per key, same as crypto1_init(state, keys[i])
+extern crypto1_bs_t *crypto1_bs_create(const uint64_t *keys, size_t count);
+extern void crypto1_bs_destroy(crypto1_bs_t *bs);
+extern size_t crypto1_bs_count(crypto1_bs_t *bs);
+// lanes processed in parallel by the selected implementation
+extern size_t crypto1_bs_width(crypto1_bs_t *bs);
+
+// Clock all lanes like crypto1_word()/crypto1_byte()/crypto1_bit().
+// in: in[0] is used for all lanes if in_shared, else in[i] for lane i. NULL = all zero.
+// ks: keystream of lane i is returned in ks[i]. May be NULL.
+extern void crypto1_bs_word(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, int is_encrypted, uint32_t *ks);
+extern void crypto1_bs_byte(crypto1_bs_t *bs, const uint8_t *in, bool in_shared, int is_encrypted, uint8_t *ks);
+extern void crypto1_bs_bit(crypto1_bs_t *bs, const uint8_t *in, bool in_shared, int is_encrypted, uint8_t *ks);
+
+// Clock like crypto1_bs_word() and compare the keystream with expect (expect[0] for all lanes
+// if expect_shared). alive is a bitmap of (count+63)/64 words; lanes which don't match are
+// cleared. Lanes already cleared may be skipped, their state is undefined afterwards.
+// Returns the number of lanes still alive.
+extern size_t crypto1_bs_word_cmp(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, int is_encrypted,
+                                  const uint32_t *expect, bool expect_shared, uint64_t *alive);
+
+// filter output of the current state, i.e. the next keystream bit
+extern void crypto1_bs_filter(crypto1_bs_t *bs, uint8_t *ks);
+
+extern void crypto1_bs_get_state(crypto1_bs_t *bs, size_t lane, struct Crypto1State *state);
+
+extern uint64_t *crypto1_bs_alive_create(size_t count);
+#define crypto1_bs_alive(alive, lane) (((alive)[(lane) / 64] >> ((lane) % 64)) & 1)
+
+// compare against crypto1_word() & co for all available SIMD types
+extern bool crypto1_bs_selftest(bool verbose);
+
+#endif
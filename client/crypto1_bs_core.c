@@ -0,0 +1,336 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Crypto1. Compiled once per SIMD instruction set, like
+// hardnested/hardnested_bf_core.c.
+//
+// The LFSR is kept as a sequence of 48 bit vectors s[0..47] (s[47] is the
+// newest bit). New bits are appended behind the current state and the state
+// window moves forward, so no shifting is needed while clocking.
+//-----------------------------------------------------------------------------
+
+#include "crypto1_bs_core.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#ifndef __APPLE__
+#include <malloc.h>
+#endif
+#include <string.h>
+#include "hardnested/hardnested_bf_core.h"
+
+#if defined(__AVX512F__)
+#define MAX_BITSLICES 512
+#elif defined(__AVX2__)
+#define MAX_BITSLICES 256
+#elif defined(__AVX__)
+#define MAX_BITSLICES 128
+#elif defined(__SSE2__)
+#define MAX_BITSLICES 128
+#else // MMX or SSE or NOSIMD
+#define MAX_BITSLICES 64
+#endif
+
+#define VECTOR_SIZE (MAX_BITSLICES/8)
+typedef unsigned int __attribute__((aligned(VECTOR_SIZE))) __attribute__((vector_size(VECTOR_SIZE))) bitslice_value_t;
+typedef union {
+	bitslice_value_t value;
+	uint64_t bytes64[MAX_BITSLICES/64];
+} bitslice_t;
+
+// filter function (f20), see hardnested_bf_core.c
+#define f20a(a,b,c,d) (((a|b)^(a&d))^(c&((a^b)|d)))
+#define f20b(a,b,c,d) (((a&b)|c)^((a^b)&(c|d)))
+#define f20c(a,b,c,d,e) ((a|((b|e)&(d^e)))^((a^(b&d))&((c^d)|(b&e))))
+
+#define bs_filter(s) f20c(f20a(s[ 9], s[11], s[13], s[15]), \
+                          f20b(s[17], s[19], s[21], s[23]), \
+                          f20b(s[25], s[27], s[29], s[31]), \
+                          f20a(s[33], s[35], s[37], s[39]), \
+                          f20b(s[41], s[43], s[45], s[47]))
+
+// LF_POLY_ODD/LF_POLY_EVEN as taps on s[]
+#define bs_feedback(s) (s[ 0] ^ s[ 5] ^ s[ 9] ^ s[10] ^ s[12] ^ s[14] ^ s[15] ^ s[17] ^ s[19] ^ \
+                        s[24] ^ s[25] ^ s[27] ^ s[29] ^ s[35] ^ s[39] ^ s[41] ^ s[42] ^ s[43])
+
+#define STATE_SIZE 48
+#define MAX_CLOCK_BITS 32
+
+#define get_bit(n, word) (((word) >> (n)) & 1)
+#define get_lane(v, lane) get_bit((lane) & 0x3f, (v).bytes64[(lane) >> 6])
+#define set_lane(v, lane) ((v).bytes64[(lane) >> 6] |= 1ULL << ((lane) & 0x3f))
+
+#if defined (__AVX512F__)
+#define CRYPTO1_BS_CREATE crypto1_bs_create_AVX512
+#define CRYPTO1_BS_BITS crypto1_bs_bits_AVX512
+#define CRYPTO1_BS_FILTER crypto1_bs_filter_AVX512
+#define CRYPTO1_BS_GET_STATE crypto1_bs_get_state_AVX512
+#elif defined (__AVX2__)
+#define CRYPTO1_BS_CREATE crypto1_bs_create_AVX2
+#define CRYPTO1_BS_BITS crypto1_bs_bits_AVX2
+#define CRYPTO1_BS_FILTER crypto1_bs_filter_AVX2
+#define CRYPTO1_BS_GET_STATE crypto1_bs_get_state_AVX2
+#elif defined (__AVX__)
+#define CRYPTO1_BS_CREATE crypto1_bs_create_AVX
+#define CRYPTO1_BS_BITS crypto1_bs_bits_AVX
+#define CRYPTO1_BS_FILTER crypto1_bs_filter_AVX
+#define CRYPTO1_BS_GET_STATE crypto1_bs_get_state_AVX
+#elif defined (__SSE2__)
+#define CRYPTO1_BS_CREATE crypto1_bs_create_SSE2
+#define CRYPTO1_BS_BITS crypto1_bs_bits_SSE2
+#define CRYPTO1_BS_FILTER crypto1_bs_filter_SSE2
+#define CRYPTO1_BS_GET_STATE crypto1_bs_get_state_SSE2
+#elif defined (__MMX__)
+#define CRYPTO1_BS_CREATE crypto1_bs_create_MMX
+#define CRYPTO1_BS_BITS crypto1_bs_bits_MMX
+#define CRYPTO1_BS_FILTER crypto1_bs_filter_MMX
+#define CRYPTO1_BS_GET_STATE crypto1_bs_get_state_MMX
+#else
+#define CRYPTO1_BS_CREATE crypto1_bs_create_NOSIMD
+#define CRYPTO1_BS_BITS crypto1_bs_bits_NOSIMD
+#define CRYPTO1_BS_FILTER crypto1_bs_filter_NOSIMD
+#define CRYPTO1_BS_GET_STATE crypto1_bs_get_state_NOSIMD
+#endif
+
+typedef crypto1_bs_t *crypto1_bs_create_t(const uint64_t *keys, size_t count);
+crypto1_bs_create_t crypto1_bs_create_AVX512, crypto1_bs_create_AVX2, crypto1_bs_create_AVX, crypto1_bs_create_SSE2, crypto1_bs_create_MMX, crypto1_bs_create_NOSIMD;
+crypto1_bs_bits_t CRYPTO1_BS_BITS;
+crypto1_bs_filter_t CRYPTO1_BS_FILTER;
+crypto1_bs_get_state_t CRYPTO1_BS_GET_STATE;
+
+#if defined (_WIN32)
+#define malloc_bitslice(x) __builtin_assume_aligned(_aligned_malloc((x), MAX_BITSLICES/8), MAX_BITSLICES/8)
+#define free_bitslice(x) _aligned_free(x)
+#elif defined (__APPLE__)
+static void *malloc_bitslice(size_t x) {
+	char *allocated_memory;
+	if (posix_memalign((void**)&allocated_memory, MAX_BITSLICES/8, x)) {
+		return NULL;
+	} else {
+		return __builtin_assume_aligned(allocated_memory, MAX_BITSLICES/8);
+	}
+}
+#define free_bitslice(x) free(x)
+#else
+#define malloc_bitslice(x) memalign(MAX_BITSLICES/8, (x))
+#define free_bitslice(x) free(x)
+#endif
+
+crypto1_bs_t *CRYPTO1_BS_CREATE(const uint64_t *keys, size_t count) {
+	crypto1_bs_t *bs = calloc(1, sizeof(crypto1_bs_t));
+	if (bs == NULL)
+		return NULL;
+
+	bs->bits = &CRYPTO1_BS_BITS;
+	bs->filter = &CRYPTO1_BS_FILTER;
+	bs->get_state = &CRYPTO1_BS_GET_STATE;
+	bs->count = count;
+	bs->width = MAX_BITSLICES;
+	bs->blocks = (count + MAX_BITSLICES - 1) / MAX_BITSLICES;
+
+	size_t size = (bs->blocks ? bs->blocks : 1) * STATE_SIZE * sizeof(bitslice_t);
+	bitslice_t *state = malloc_bitslice(size);
+	if (state == NULL) {
+		free(bs);
+		return NULL;
+	}
+	memset(state, 0, size);
+	bs->state = state;
+
+	// same bit order as crypto1_init()
+	for (size_t i = 0; i < count; i++) {
+		bitslice_t *s = state + (i / MAX_BITSLICES) * STATE_SIZE;
+		size_t lane = i % MAX_BITSLICES;
+		for (int j = 0; j < STATE_SIZE; j++) {
+			if (get_bit((47 - j) ^ 7, keys[i]))
+				set_lane(s[j], lane);
+		}
+	}
+
+	return bs;
+}
+
+static bool block_alive(uint64_t *alive, size_t first, size_t lanes) {
+	for (size_t j = 0; j < (lanes + 63) / 64; j++) {
+		if (alive[first / 64 + j])
+			return true;
+	}
+	return false;
+}
+
+// bit i of all lanes' input words
+static void transpose_in(bitslice_t *v, const uint32_t *in, size_t lanes, uint8_t nbits, uint8_t swap) {
+	memset(v, 0, nbits * sizeof(bitslice_t));
+	for (size_t lane = 0; lane < lanes; lane++) {
+		uint32_t word = in[lane];
+		for (uint8_t i = 0; i < nbits; i++) {
+			if (get_bit(i ^ swap, word))
+				set_lane(v[i], lane);
+		}
+	}
+}
+
+static void broadcast_in(bitslice_t *v, uint32_t in, uint8_t nbits, uint8_t swap) {
+	const bitslice_value_t zeroes = {0};
+	for (uint8_t i = 0; i < nbits; i++)
+		v[i].value = get_bit(i ^ swap, in) ? ~zeroes : zeroes;
+}
+
+size_t CRYPTO1_BS_BITS(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, uint8_t nbits, uint8_t swap,
+                       int is_encrypted, uint32_t *ks, const uint32_t *expect, bool expect_shared, uint64_t *alive) {
+	bitslice_t *state = bs->state;
+	bitslice_value_t buf[STATE_SIZE + MAX_CLOCK_BITS];
+	bitslice_t in_bits[MAX_CLOCK_BITS];
+	bitslice_t ks_bits[MAX_CLOCK_BITS];
+	bitslice_t expect_bits[MAX_CLOCK_BITS];
+	size_t alive_count = 0;
+
+	if (in == NULL || in_shared)
+		broadcast_in(in_bits, in ? in[0] : 0, nbits, swap);
+	if (alive != NULL && expect_shared)
+		broadcast_in(expect_bits, expect[0], nbits, swap);
+
+	for (size_t block = 0; block < bs->blocks; block++) {
+		size_t first = block * MAX_BITSLICES;
+		size_t lanes = bs->count - first < MAX_BITSLICES ? bs->count - first : MAX_BITSLICES;
+		bitslice_t *s = state + block * STATE_SIZE;
+
+		if (alive != NULL && !block_alive(alive, first, lanes))
+			continue;
+
+		if (in != NULL && !in_shared)
+			transpose_in(in_bits, in + first, lanes, nbits, swap);
+
+		for (int j = 0; j < STATE_SIZE; j++)
+			buf[j] = s[j].value;
+
+		for (uint8_t i = 0; i < nbits; i++) {
+			bitslice_value_t *w = buf + i;
+			bitslice_value_t f = bs_filter(w);
+			bitslice_value_t fb = bs_feedback(w) ^ in_bits[i].value;
+			if (is_encrypted)
+				fb ^= f;
+			ks_bits[i].value = f;
+			w[STATE_SIZE] = fb;
+		}
+
+		for (int j = 0; j < STATE_SIZE; j++)
+			s[j].value = buf[nbits + j];
+
+		if (alive != NULL) {
+			if (!expect_shared)
+				transpose_in(expect_bits, expect + first, lanes, nbits, swap);
+			bitslice_t diff;
+			diff.value = ks_bits[0].value ^ expect_bits[0].value;
+			for (uint8_t i = 1; i < nbits; i++)
+				diff.value |= ks_bits[i].value ^ expect_bits[i].value;
+			for (size_t j = 0; j < (lanes + 63) / 64; j++) {
+				uint64_t *a = &alive[first / 64 + j];
+				*a &= ~diff.bytes64[j];
+				alive_count += __builtin_popcountll(*a);
+			}
+		}
+
+		if (ks != NULL) {
+			for (size_t lane = 0; lane < lanes; lane++) {
+				uint32_t word = 0;
+				for (uint8_t i = 0; i < nbits; i++)
+					word |= (uint32_t)get_lane(ks_bits[i], lane) << (i ^ swap);
+				ks[first + lane] = word;
+			}
+		}
+	}
+
+	return alive_count;
+}
+
+void CRYPTO1_BS_FILTER(crypto1_bs_t *bs, uint8_t *ks) {
+	bitslice_t *state = bs->state;
+
+	for (size_t block = 0; block < bs->blocks; block++) {
+		size_t first = block * MAX_BITSLICES;
+		size_t lanes = bs->count - first < MAX_BITSLICES ? bs->count - first : MAX_BITSLICES;
+		bitslice_value_t buf[STATE_SIZE];
+		bitslice_t f;
+
+		for (int j = 0; j < STATE_SIZE; j++)
+			buf[j] = state[block * STATE_SIZE + j].value;
+		f.value = bs_filter(buf);
+		for (size_t lane = 0; lane < lanes; lane++)
+			ks[first + lane] = get_lane(f, lane);
+	}
+}
+
+void CRYPTO1_BS_GET_STATE(crypto1_bs_t *bs, size_t lane, struct Crypto1State *state) {
+	bitslice_t *s = (bitslice_t *)bs->state + (lane / MAX_BITSLICES) * STATE_SIZE;
+	lane %= MAX_BITSLICES;
+
+	state->odd = state->even = 0;
+	for (int j = 23; j >= 0; j--) {
+		state->odd = state->odd << 1 | get_lane(s[47 - 2 * j], lane);
+		state->even = state->even << 1 | get_lane(s[46 - 2 * j], lane);
+	}
+}
+
+
+#ifndef __MMX__
+
+// determine the available instruction set at runtime and call the correct function.
+// Not cached in a function pointer, SetSIMDInstr() may change the selection between calls.
+crypto1_bs_t *crypto1_bs_create(const uint64_t *keys, size_t count) {
+	crypto1_bs_create_t *create_function_p;
+
+	switch(GetSIMDInstrAuto()) {
+#if defined (__i386__) || defined (__x86_64__)
+#if !defined(__APPLE__) || (defined(__APPLE__) && (__clang_major__ > 8 || __clang_major__ == 8 && __clang_minor__ >= 1))
+#if (__GNUC__ >= 5) && (__GNUC__ > 5 || __GNUC_MINOR__ > 2)
+		case SIMD_AVX512:
+			create_function_p = &crypto1_bs_create_AVX512;
+			break;
+#endif
+		case SIMD_AVX2:
+			create_function_p = &crypto1_bs_create_AVX2;
+			break;
+		case SIMD_AVX:
+			create_function_p = &crypto1_bs_create_AVX;
+			break;
+		case SIMD_SSE2:
+			create_function_p = &crypto1_bs_create_SSE2;
+			break;
+		case SIMD_MMX:
+			create_function_p = &crypto1_bs_create_MMX;
+			break;
+#endif
+#endif
+		default:
+			create_function_p = &crypto1_bs_create_NOSIMD;
+			break;
+	}
+
+	return (*create_function_p)(keys, count);
+}
+
+void crypto1_bs_destroy(crypto1_bs_t *bs) {
+	if (bs == NULL)
+		return;
+	free_bitslice(bs->state);
+	free(bs);
+}
+
+size_t crypto1_bs_bits(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, uint8_t nbits, uint8_t swap,
+                       int is_encrypted, uint32_t *ks, const uint32_t *expect, bool expect_shared, uint64_t *alive) {
+	return (*bs->bits)(bs, in, in_shared, nbits, swap, is_encrypted, ks, expect, expect_shared, alive);
+}
+
+void crypto1_bs_filter(crypto1_bs_t *bs, uint8_t *ks) {
+	(*bs->filter)(bs, ks);
+}
+
+void crypto1_bs_get_state(crypto1_bs_t *bs, size_t lane, struct Crypto1State *state) {
+	(*bs->get_state)(bs, lane, state);
+}
+
+#endif
@@ -0,0 +1,35 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Crypto1, internals shared by the SIMD variants
+//-----------------------------------------------------------------------------
+
+#ifndef CRYPTO1_BS_CORE_H__
+#define CRYPTO1_BS_CORE_H__
+
+#include "crypto1_bs.h"
+
+typedef size_t crypto1_bs_bits_t(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, uint8_t nbits, uint8_t swap,
+                                 int is_encrypted, uint32_t *ks, const uint32_t *expect, bool expect_shared, uint64_t *alive);
+typedef void crypto1_bs_filter_t(crypto1_bs_t *bs, uint8_t *ks);
+typedef void crypto1_bs_get_state_t(crypto1_bs_t *bs, size_t lane, struct Crypto1State *state);
+
+struct crypto1_bs {
+	crypto1_bs_bits_t *bits;
+	crypto1_bs_filter_t *filter;
+	crypto1_bs_get_state_t *get_state;
+	size_t count;
+	size_t width;			// lanes per block
+	size_t blocks;
+	void *state;			// blocks * 48 bitsliced LFSR bits
+};
+
+// Clock nbits (<= 32) times. Input bit i of a lane is taken from bit (i ^ swap) of its in word, keystream
+// bit i is stored to bit (i ^ swap) of ks. swap = 24 gives the bit order of crypto1_word(), 0 the one of
+// crypto1_byte(). If alive is not NULL the keystream is compared with expect and mismatching lanes are cleared.
+extern size_t crypto1_bs_bits(crypto1_bs_t *bs, const uint32_t *in, bool in_shared, uint8_t nbits, uint8_t swap,
+                              int is_encrypted, uint32_t *ks, const uint32_t *expect, bool expect_shared, uint64_t *alive);
+
+#endif
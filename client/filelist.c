@@ -0,0 +1,81 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Lists of input files for the batch commands (hf mf tracekeys, hf legic decode)
+//-----------------------------------------------------------------------------
+
+#include "filelist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "ui.h"
+#include "util.h"
+
+int filelist_add(filelist_t *fl, const char *name) {
+	if (fl->count == fl->allocated) {
+		int allocated = fl->allocated ? fl->allocated * 2 : 64;
+		char **p = realloc(fl->names, allocated * sizeof(char *));
+		if (p == NULL)
+			return 2;
+		fl->names = p;
+		fl->allocated = allocated;
+	}
+	fl->names[fl->count] = strmcopy((char *)name);
+	if (fl->names[fl->count] == NULL)
+		return 2;
+	fl->count++;
+	return 0;
+}
+
+void filelist_free(filelist_t *fl) {
+	for (int i = 0; i < fl->count; i++)
+		free(fl->names[i]);
+	free(fl->names);
+	memset(fl, 0, sizeof(filelist_t));
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+int filelist_collect(char **names, int count, filelist_filter_t filter, filelist_t *fl) {
+	for (int i = 0; i < count; i++) {
+		struct stat st;
+		if (stat(names[i], &st) != 0) {
+			PrintAndLog("File: %s: not found", names[i]);
+			return 1;
+		}
+
+		if (!S_ISDIR(st.st_mode)) {
+			if (filelist_add(fl, names[i]))
+				return 2;
+			continue;
+		}
+
+		DIR *dir = opendir(names[i]);
+		if (dir == NULL) {
+			PrintAndLog("Can't open directory %s", names[i]);
+			return 1;
+		}
+		int first = fl->count;
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			char path[strlen(names[i]) + strlen(entry->d_name) + 2];
+			sprintf(path, "%s/%s", names[i], entry->d_name);
+			if (!filter(path, entry->d_name))
+				continue;
+			if (filelist_add(fl, path)) {
+				closedir(dir);
+				return 2;
+			}
+		}
+		closedir(dir);
+		qsort(fl->names + first, fl->count - first, sizeof(char *), compare_names);
+	}
+	return 0;
+}
@@ -0,0 +1,32 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Lists of input files for the batch commands (hf mf tracekeys, hf legic decode)
+//-----------------------------------------------------------------------------
+
+#ifndef FILELIST_H__
+#define FILELIST_H__
+
+#include <stdbool.h>
+
+typedef struct {
+	char **names;
+	int count;
+	int allocated;
+} filelist_t;
+
+// selects the files of a directory, path is "<dir>/<name>"
+typedef bool (*filelist_filter_t)(const char *path, const char *name);
+
+// 0 = ok, 2 = out of memory
+extern int filelist_add(filelist_t *fl, const char *name);
+extern void filelist_free(filelist_t *fl);
+
+// Files as given, directories with the files selected by filter, sorted by name
+// per directory. 0 = ok, 1 = not found, 2 = out of memory. The list must be freed
+// on errors too.
+extern int filelist_collect(char **names, int count, filelist_filter_t filter, filelist_t *fl);
+
+#endif
@@ -9,12 +9,14 @@
 //-----------------------------------------------------------------------------
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include "ui.h"
 #include "graph.h"
 #include "lfdemod.h"
 #include "cmddata.h" //for g_debugmode
+#include "graphlod.h"
 
 int GraphBuffer[MAX_GRAPH_TRACE_LEN];
 int GraphTraceLen;
@@ -92,11 +94,15 @@ size_t getFromGraphBuf(uint8_t *buff)
 {
 	if (buff == NULL ) return 0;
 	uint32_t i;
+	bool trimmed = false;
 	for (i=0;i<GraphTraceLen;++i){
-		if (GraphBuffer[i]>127) GraphBuffer[i]=127; //trim
-		if (GraphBuffer[i]<-127) GraphBuffer[i]=-127; //trim
+		if (GraphBuffer[i]>127) { GraphBuffer[i]=127; trimmed = true; } //trim
+		if (GraphBuffer[i]<-127) { GraphBuffer[i]=-127; trimmed = true; } //trim
 		buff[i]=(uint8_t)(GraphBuffer[i]+128);
 	}
+	// the samples changed in place, the plot must not use its old level of detail data
+	if (trimmed)
+		GraphLodDataChanged();
 	return i;
 }
 
@@ -296,3 +302,46 @@ bool graphJustNoise(int *BitStream, int size)
 	}
 	return justNoise1;
 }
+
+bool GraphKernelInit(graph_kernel_t *k, const int *tmpl, int tmpllen, int skip)
+{
+	// sum d[m] * x[i+m] = sum (d[m-1] - d[m]) * prefix[i+m], over m = 0..len with d[-1] = d[len] = 0
+	k->len = (tmpllen + skip - 1) / skip;
+	k->edges = 0;
+	int prev = 0;
+	for (int m = 0; m <= k->len; m++) {
+		int d = m < k->len ? tmpl[m * skip] : 0;
+		if (d != prev) {
+			if (k->edges == GRAPH_KERNEL_MAX_EDGES)
+				return false;
+			k->pos[k->edges] = m;
+			k->coef[k->edges] = prev - d;
+			k->edges++;
+		}
+		prev = d;
+	}
+	return true;
+}
+
+int64_t *GraphPrefixSums(const int *signal, int len)
+{
+	int64_t *prefix = malloc((len + 1) * sizeof(int64_t));
+	if (prefix == NULL)
+		return NULL;
+	prefix[0] = 0;
+	for (int i = 0; i < len; i++)
+		prefix[i + 1] = prefix[i] + signal[i];
+	return prefix;
+}
+
+void GraphCorrelateAll(const graph_kernel_t *k, const int64_t *prefix, int count, int64_t *out)
+{
+	// one pass per step in the template, each one a plain vectorizable loop
+	memset(out, 0, count * sizeof(int64_t));
+	for (int e = 0; e < k->edges; e++) {
+		const int64_t *p = prefix + k->pos[e];
+		int64_t c = k->coef[e];
+		for (int i = 0; i < count; i++)
+			out[i] += c * p[i];
+	}
+}
@@ -11,6 +11,7 @@
 #ifndef GRAPH_H__
 #define GRAPH_H__
 #include <stdint.h>
+#include <stdbool.h>
 
 void AppendGraph(int redraw, int clock, int bit);
 int ClearGraph(int redraw);
@@ -30,6 +31,31 @@ void save_restoreGB(uint8_t saveOpt);
 bool HasGraphData();
 void DetectHighLowInGraph(int *high, int *low, bool addFuzz); 
 
+// Matched filter for piecewise constant templates (like the ISO15693 SOF/EOF/bit shapes). With
+// the prefix sums of the signal, the correlation at any offset costs one multiply-add per step
+// in the template instead of one per template sample.
+#define GRAPH_KERNEL_MAX_EDGES 64
+typedef struct {
+	int len;								// template length in samples
+	int edges;
+	int pos[GRAPH_KERNEL_MAX_EDGES];
+	int coef[GRAPH_KERNEL_MAX_EDGES];
+} graph_kernel_t;
+
+// every skip'th template value is correlated with one sample. Returns false if the template has too many steps.
+bool GraphKernelInit(graph_kernel_t *k, const int *tmpl, int tmpllen, int skip);
+// malloc'ed, len + 1 entries
+int64_t *GraphPrefixSums(const int *signal, int len);
+// correlation with the signal at offset 0 .. count-1, count + k->len must not exceed the signal length
+void GraphCorrelateAll(const graph_kernel_t *k, const int64_t *prefix, int count, int64_t *out);
+
+static inline int64_t GraphCorrelate(const graph_kernel_t *k, const int64_t *prefix, int offset) {
+	int64_t corr = 0;
+	for (int e = 0; e < k->edges; e++)
+		corr += k->coef[e] * prefix[offset + k->pos[e]];
+	return corr;
+}
+
 // Max graph trace len: 40000 (bigbuf) * 8 (at 1 bit per sample)
 #define MAX_GRAPH_TRACE_LEN (40000 * 8 )
 #define GRAPH_SAVE 1
@@ -0,0 +1,121 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Level of detail data for plotting long sample buffers
+//-----------------------------------------------------------------------------
+
+#include "graphlod.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+static volatile unsigned GraphLodGeneration = 1;
+
+void GraphLodDataChanged(void) {
+	GraphLodGeneration++;
+}
+
+void GraphLodFree(graph_lod_t *lod) {
+	free(lod->store);
+	free(lod->sum);
+	memset(lod, 0, sizeof(*lod));
+}
+
+static bool GraphLodBuild(graph_lod_t *lod, const int *data, size_t len) {
+	GraphLodFree(lod);
+
+	// level k has len >> k blocks, all levels together less than len entries each for min and max
+	lod->store = malloc(2 * (len + 1) * sizeof(int));
+	lod->sum = malloc((len + 1) * sizeof(int64_t));
+	if (!lod->store || !lod->sum) {
+		GraphLodFree(lod);
+		return false;
+	}
+
+	lod->sum[0] = 0;
+	for (size_t i = 0; i < len; i++)
+		lod->sum[i + 1] = lod->sum[i] + data[i];
+
+	int *p = lod->store;
+	int k;
+	for (k = 1; k <= GRAPH_LOD_MAX_LEVELS && (len >> k) > 0; k++) {
+		size_t n = len >> k;
+		lod->min[k] = p;
+		lod->max[k] = p + n;
+		p += 2 * n;
+		for (size_t b = 0; b < n; b++) {
+			int a0, a1, b0, b1;
+			if (k == 1) {
+				a0 = a1 = data[2 * b];
+				b0 = b1 = data[2 * b + 1];
+			} else {
+				a0 = lod->min[k - 1][2 * b];
+				a1 = lod->max[k - 1][2 * b];
+				b0 = lod->min[k - 1][2 * b + 1];
+				b1 = lod->max[k - 1][2 * b + 1];
+			}
+			lod->min[k][b] = a0 < b0 ? a0 : b0;
+			lod->max[k][b] = a1 > b1 ? a1 : b1;
+		}
+	}
+	lod->levels = k - 1;
+	lod->data = data;
+	lod->len = len;
+	return true;
+}
+
+void GraphLodUpdate(graph_lod_t *lod, const int *data, size_t len) {
+	unsigned generation = GraphLodGeneration;
+	if (lod->sum && lod->data == data && lod->len == len && lod->generation == generation)
+		return;
+	if (GraphLodBuild(lod, data, len))
+		lod->generation = generation;
+}
+
+void GraphLodMinMax(const graph_lod_t *lod, size_t first, size_t last, int *vmin, int *vmax) {
+	if (last > lod->len)
+		last = lod->len;
+	if (first >= last || !lod->sum) {
+		*vmin = *vmax = 0;
+		return;
+	}
+
+	int lo = lod->data[first], hi = lo;
+	#define TAKE(a, b) do { if ((a) < lo) lo = (a); if ((b) > hi) hi = (b); } while (0)
+
+	// take the unaligned ends at each level, the rest moves up one level. The
+	// top level has a single block, so the range is used up there.
+	for (int k = 0; first < last && k <= lod->levels; k++) {
+		if (first & 1) {
+			if (k == 0)
+				TAKE(lod->data[first], lod->data[first]);
+			else
+				TAKE(lod->min[k][first], lod->max[k][first]);
+			first++;
+		}
+		if (last & 1) {
+			last--;
+			if (k == 0)
+				TAKE(lod->data[last], lod->data[last]);
+			else
+				TAKE(lod->min[k][last], lod->max[k][last]);
+		}
+		first >>= 1;
+		last >>= 1;
+	}
+	#undef TAKE
+
+	*vmin = lo;
+	*vmax = hi;
+}
+
+int64_t GraphLodSum(const graph_lod_t *lod, size_t first, size_t last) {
+	if (last > lod->len)
+		last = lod->len;
+	if (first >= last || !lod->sum)
+		return 0;
+	return lod->sum[last] - lod->sum[first];
+}
@@ -0,0 +1,53 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Level of detail data for plotting long sample buffers
+//
+// Level k of the pyramid holds the minimum and maximum of each aligned block
+// of 2^k samples, so min/max of any range is found in O(log n) and the plot
+// can draw one vertical segment per pixel column instead of one vertex per
+// sample. Prefix sums give the mean of a range.
+//-----------------------------------------------------------------------------
+
+#ifndef GRAPHLOD_H__
+#define GRAPHLOD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GRAPH_LOD_MAX_LEVELS	32
+
+typedef struct {
+	const int *data;				// buffer the pyramid was built for
+	size_t len;
+	unsigned generation;			// GraphLodGeneration at build time
+	int levels;						// min[k], max[k] valid for 1 <= k <= levels
+	int *min[GRAPH_LOD_MAX_LEVELS + 1];
+	int *max[GRAPH_LOD_MAX_LEVELS + 1];
+	int *store;
+	int64_t *sum;					// sum[i] = data[0] + ... + data[i-1]
+} graph_lod_t;
+
+// Marks all pyramids as outdated, to be called whenever sample data changes
+// (RepaintGraphWindow() does this).
+extern void GraphLodDataChanged(void);
+
+// Rebuilds the pyramid if data, len or the data generation changed.
+extern void GraphLodUpdate(graph_lod_t *lod, const int *data, size_t len);
+extern void GraphLodFree(graph_lod_t *lod);
+
+// min and max of data[first..last), 0 for an empty range
+extern void GraphLodMinMax(const graph_lod_t *lod, size_t first, size_t last, int *vmin, int *vmax);
+extern int64_t GraphLodSum(const graph_lod_t *lod, size_t first, size_t last);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Tests of the plot level of detail data
+//-----------------------------------------------------------------------------
+
+#include "graphlodtest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ui.h"
+#include "graph.h"
+#include "graphlod.h"
+
+#define LODTEST_BUFFERS		200
+#define LODTEST_MAXLEN		3000
+#define LODTEST_QUERIES		2000
+
+static uint32_t lodtest_rnd_state;
+
+static uint32_t lodtest_rnd(void)
+{
+	uint32_t x = lodtest_rnd_state;
+	x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+	return lodtest_rnd_state = x;
+}
+
+// min, max and sum of data[first..last) the slow way, 0 for an empty range
+static bool check_range(const graph_lod_t *lod, const int *data, size_t len, size_t first, size_t last)
+{
+	size_t end = last > len ? len : last;
+	int rmin = 0, rmax = 0;
+	int64_t rsum = 0;
+	if (first < end) {
+		rmin = rmax = data[first];
+		for (size_t i = first; i < end; i++) {
+			if (data[i] < rmin) rmin = data[i];
+			if (data[i] > rmax) rmax = data[i];
+			rsum += data[i];
+		}
+	}
+	int vmin, vmax;
+	GraphLodMinMax(lod, first, last, &vmin, &vmax);
+	return vmin == rmin && vmax == rmax && GraphLodSum(lod, first, last) == rsum;
+}
+
+// random buffers, random ranges including empty ones and ranges past the end
+static bool test_random_ranges(void)
+{
+	graph_lod_t lod;
+	int *data = malloc(LODTEST_MAXLEN * sizeof(int));
+	bool ok = data != NULL;
+	memset(&lod, 0, sizeof(lod));
+	lodtest_rnd_state = 1;
+	for (int t = 0; ok && t < LODTEST_BUFFERS; t++) {
+		size_t len = lodtest_rnd() % LODTEST_MAXLEN;
+		for (size_t i = 0; i < len; i++)
+			data[i] = (int)(lodtest_rnd() % 2001) - 1000;
+		GraphLodDataChanged();
+		GraphLodUpdate(&lod, data, len);
+		for (int q = 0; ok && q < LODTEST_QUERIES; q++) {
+			size_t first = lodtest_rnd() % (len + 1);
+			size_t last = lodtest_rnd() % (len + 2);
+			ok = check_range(&lod, data, len, first, last);
+		}
+		// all lengths from one start, every level boundary
+		size_t first = len ? lodtest_rnd() % len : 0;
+		for (size_t last = first; ok && last <= len; last++)
+			ok = check_range(&lod, data, len, first, last);
+	}
+	GraphLodFree(&lod);
+	free(data);
+	return ok;
+}
+
+// same buffer and length, the samples changed in place
+static bool test_in_place_change(void)
+{
+	graph_lod_t lod;
+	int data[1000];
+	memset(&lod, 0, sizeof(lod));
+	for (int i = 0; i < 1000; i++)
+		data[i] = i % 100;
+	GraphLodUpdate(&lod, data, 1000);
+	data[777] = 5000;
+	GraphLodDataChanged();
+	GraphLodUpdate(&lod, data, 1000);
+	bool ok = check_range(&lod, data, 1000, 0, 1000) && check_range(&lod, data, 1000, 700, 800);
+	GraphLodFree(&lod);
+	return ok;
+}
+
+// getFromGraphBuf() trims the GraphBuffer to -127..127
+static bool test_graph_trim(void)
+{
+	int *saved = malloc(GraphTraceLen * sizeof(int) + 1);
+	uint8_t *bits = malloc(1000);
+	int savedlen = GraphTraceLen;
+	graph_lod_t lod;
+	bool ok = saved != NULL && bits != NULL;
+	memset(&lod, 0, sizeof(lod));
+	if (ok) {
+		memcpy(saved, GraphBuffer, GraphTraceLen * sizeof(int));
+		GraphTraceLen = 1000;
+		for (int i = 0; i < GraphTraceLen; i++)
+			GraphBuffer[i] = (i & 1) ? 500 : -500;
+		GraphLodDataChanged();
+		GraphLodUpdate(&lod, GraphBuffer, GraphTraceLen);
+		getFromGraphBuf(bits);
+		GraphLodUpdate(&lod, GraphBuffer, GraphTraceLen);
+		ok = check_range(&lod, GraphBuffer, GraphTraceLen, 0, GraphTraceLen);
+
+		memcpy(GraphBuffer, saved, savedlen * sizeof(int));
+		GraphTraceLen = savedlen;
+		GraphLodDataChanged();
+	}
+	GraphLodFree(&lod);
+	free(bits);
+	free(saved);
+	return ok;
+}
+
+bool graphlod_selftest(bool verbose)
+{
+	struct {
+		const char *name;
+		bool (*test)(void);
+	} tests[] = {
+		{"random buffers and ranges", test_random_ranges},
+		{"samples changed in place", test_in_place_change},
+		{"GraphBuffer trimmed by a demod", test_graph_trim},
+	};
+	bool res = true;
+
+	PrintAndLog("Plot level of detail data:");
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		bool ok = tests[i].test();
+		if (verbose || !ok)
+			PrintAndLog("  %-35s [%s]", tests[i].name, ok ? "OK" : "ERROR");
+		res &= ok;
+	}
+	PrintAndLog("  %s", res ? "passed" : "FAILED");
+	return res;
+}
@@ -0,0 +1,18 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Tests of the plot level of detail data
+//-----------------------------------------------------------------------------
+
+#ifndef GRAPHLODTEST_H__
+#define GRAPHLODTEST_H__
+
+#include <stdbool.h>
+
+// compares graphlod.c with brute force min/max/sum and checks that in place
+// changes of the samples are noticed
+bool graphlod_selftest(bool verbose);
+
+#endif
@@ -0,0 +1,386 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bulk packing and reverse lookup of HID Prox card formats
+//-----------------------------------------------------------------------------
+
+#include "hidbulk.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "hidcardformats.h"
+#include "util.h"
+#include "util_posix.h"
+#include "ui.h"
+
+typedef struct {
+	hidcardformat_t fmt;
+	bool linear;					// tables reproduce fmt.Pack
+	uint8_t width[HID_BULK_FIELDS];
+	uint64_t max[HID_BULK_FIELDS];
+	hidproxmessage_t base;			// all fields 0
+	hidproxmessage_t fixed;			// bits no field bit changes
+	hidproxmessage_t *table[HID_BULK_FIELDS];	// [byte * 256 + value], the bits flipped by this byte of the field
+} hid_bulk_format_t;
+
+static hid_bulk_format_t *formats = NULL;
+static int format_count = 0;
+
+static uint64_t get_field(const hidproxcard_t *card, int field)
+{
+	switch (field) {
+		case HID_BULK_FC: return card->FacilityCode;
+		case HID_BULK_CN: return card->CardNumber;
+		case HID_BULK_IL: return card->IssueLevel;
+		default:          return card->OEM;
+	}
+}
+
+static void set_field(hidproxcard_t *card, int field, uint64_t value)
+{
+	switch (field) {
+		case HID_BULK_FC: card->FacilityCode = value; break;
+		case HID_BULK_CN: card->CardNumber = value; break;
+		case HID_BULK_IL: card->IssueLevel = value; break;
+		default:          card->OEM = value; break;
+	}
+}
+
+static bool pack_fields(const hid_bulk_format_t *bf, const uint64_t *fields, hidproxmessage_t *packed)
+{
+	hidproxcard_t card;
+	memset(&card, 0, sizeof(card));
+	for (int f = 0; f < HID_BULK_FIELDS; f++) {
+		// the card struct has 32 bit fields except for the card number
+		if (f != HID_BULK_CN && fields[f] > 0xffffffff)
+			return false;
+		set_field(&card, f, fields[f]);
+	}
+	return bf->fmt.Pack(&card, packed);
+}
+
+static bool pack_single(const hid_bulk_format_t *bf, int field, uint64_t value, hidproxmessage_t *packed)
+{
+	uint64_t fields[HID_BULK_FIELDS] = {0};
+	fields[field] = value;
+	return pack_fields(bf, fields, packed);
+}
+
+static inline void msg_xor(hidproxmessage_t *a, const hidproxmessage_t *b)
+{
+	a->top ^= b->top;
+	a->mid ^= b->mid;
+	a->bot ^= b->bot;
+}
+
+static inline bool msg_equal(const hidproxmessage_t *a, const hidproxmessage_t *b)
+{
+	return a->top == b->top && a->mid == b->mid && a->bot == b->bot;
+}
+
+static void table_pack(const hid_bulk_format_t *bf, const uint64_t *fields, hidproxmessage_t *packed)
+{
+	*packed = bf->base;
+	for (int f = 0; f < HID_BULK_FIELDS; f++)
+		for (int b = 0; b < (bf->width[f] + 7) / 8; b++)
+			msg_xor(packed, &bf->table[f][b * 256 + ((fields[f] >> (8 * b)) & 0xff)]);
+}
+
+static uint64_t rand64(uint64_t *state)
+{
+	// xorshift64*
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void random_fields(const hid_bulk_format_t *bf, uint64_t *state, uint64_t *fields)
+{
+	for (int f = 0; f < HID_BULK_FIELDS; f++)
+		fields[f] = bf->max[f] == UINT64_MAX ? rand64(state) : rand64(state) % (bf->max[f] + 1);
+}
+
+static void init_format(hid_bulk_format_t *bf)
+{
+	hidproxmessage_t packed;
+	uint64_t zero[HID_BULK_FIELDS] = {0};
+
+	if (!pack_fields(bf, zero, &bf->base))
+		return;						// width 0 everywhere, HIDBulkPack() refuses it
+
+	bf->linear = true;
+	hidproxmessage_t any = {0};
+	for (int f = 0; f < HID_BULK_FIELDS; f++) {
+		// the accepted values are 0 .. max
+		int w = 0;
+		while (w < 64 && pack_single(bf, f, 1ULL << w, &packed))
+			w++;
+		bf->width[f] = w;
+		if (w == 0)
+			continue;
+		uint64_t lo = 1ULL << (w - 1), hi = w == 64 ? UINT64_MAX : (1ULL << w) - 1;
+		while (lo < hi) {
+			uint64_t mid = lo + (hi - lo + 1) / 2;
+			if (pack_single(bf, f, mid, &packed))
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		bf->max[f] = lo;
+
+		hidproxmessage_t contrib[64];
+		for (int k = 0; k < w; k++) {
+			pack_single(bf, f, 1ULL << k, &contrib[k]);
+			msg_xor(&contrib[k], &bf->base);
+			any.top |= contrib[k].top;
+			any.mid |= contrib[k].mid;
+			any.bot |= contrib[k].bot;
+		}
+		bf->table[f] = calloc((w + 7) / 8 * 256, sizeof(hidproxmessage_t));
+		if (!bf->table[f]) {
+			bf->linear = false;
+			continue;
+		}
+		for (int b = 0; b < (w + 7) / 8; b++) {
+			for (int v = 0; v < 256; v++) {
+				hidproxmessage_t *t = &bf->table[f][b * 256 + v];
+				for (int k = 0; k < 8 && 8 * b + k < w; k++)
+					if (v & (1 << k))
+						msg_xor(t, &contrib[8 * b + k]);
+			}
+		}
+	}
+	bf->fixed.top = ~any.top;
+	bf->fixed.mid = ~any.mid;
+	bf->fixed.bot = ~any.bot;
+
+	// linear in theory, check it
+	uint64_t state = 0x5DEECE66DULL;
+	for (int i = 0; i < 256 && bf->linear; i++) {
+		uint64_t fields[HID_BULK_FIELDS];
+		hidproxmessage_t expected;
+		random_fields(bf, &state, fields);
+		if (!pack_fields(bf, fields, &expected))
+			continue;
+		table_pack(bf, fields, &packed);
+		if (!msg_equal(&packed, &expected))
+			bf->linear = false;
+	}
+}
+
+static hid_bulk_format_t *get_format(int format)
+{
+	if (!formats) {
+		int count = 0;
+		while (HIDGetCardFormat(count).Name)
+			count++;
+		formats = calloc(count, sizeof(hid_bulk_format_t));
+		if (!formats)
+			return NULL;
+		for (int i = 0; i < count; i++) {
+			formats[i].fmt = HIDGetCardFormat(i);
+			init_format(&formats[i]);
+		}
+		format_count = count;
+	}
+	if (format < 0 || format >= format_count)
+		return NULL;
+	return &formats[format];
+}
+
+uint64_t HIDBulkFieldMax(int format, int field)
+{
+	hid_bulk_format_t *bf = get_format(format);
+	if (!bf || field < 0 || field >= HID_BULK_FIELDS)
+		return 0;
+	return bf->max[field];
+}
+
+size_t HIDBulkPack(int format, const hidproxcard_t *card, size_t count, hidproxmessage_t *out)
+{
+	hid_bulk_format_t *bf = get_format(format);
+	if (!bf || count == 0)
+		return 0;
+
+	uint64_t fields[HID_BULK_FIELDS];
+	for (int f = 0; f < HID_BULK_FIELDS; f++) {
+		fields[f] = get_field(card, f);
+		if (fields[f] > bf->max[f] || (f != HID_BULK_CN && fields[f] && !bf->width[f]))
+			return 0;
+	}
+	if (!bf->width[HID_BULK_CN])
+		return 0;
+	uint64_t cn = fields[HID_BULK_CN];
+	if (count - 1 > bf->max[HID_BULK_CN] - cn)
+		count = bf->max[HID_BULK_CN] - cn + 1;
+
+	if (!bf->linear) {
+		for (size_t i = 0; i < count; i++) {
+			fields[HID_BULK_CN] = cn + i;
+			if (!pack_fields(bf, fields, &out[i]))
+				return i;
+		}
+		return count;
+	}
+
+	// the other fields once, the upper bytes of the card number when they change
+	fields[HID_BULK_CN] = 0;
+	hidproxmessage_t others, upper = {0};
+	table_pack(bf, fields, &others);
+	const hidproxmessage_t *low = bf->table[HID_BULK_CN];
+	int bytes = (bf->width[HID_BULK_CN] + 7) / 8;
+	for (size_t i = 0; i < count; i++, cn++) {
+		if (i == 0 || (cn & 0xff) == 0) {
+			upper = others;
+			for (int b = 1; b < bytes; b++)
+				msg_xor(&upper, &low[b * 256 + ((cn >> (8 * b)) & 0xff)]);
+		}
+		out[i].Length = upper.Length;
+		out[i].top = upper.top ^ low[cn & 0xff].top;
+		out[i].mid = upper.mid ^ low[cn & 0xff].mid;
+		out[i].bot = upper.bot ^ low[cn & 0xff].bot;
+	}
+	return count;
+}
+
+size_t HIDBulkLookup(const hidproxmessage_t *packed, bool ignoreParity, hid_bulk_match_t *matches, size_t max_matches)
+{
+	size_t found = 0;
+
+	if (!get_format(0))
+		return 0;
+
+	for (int i = 0; i < format_count; i++) {
+		hid_bulk_format_t *bf = &formats[i];
+		if (bf->base.Length != packed->Length)
+			continue;
+		// bits which are the same for all cards of the format
+		if (bf->linear && (((packed->top ^ bf->base.top) & bf->fixed.top) ||
+		                   ((packed->mid ^ bf->base.mid) & bf->fixed.mid) ||
+		                   ((packed->bot ^ bf->base.bot) & bf->fixed.bot)))
+			continue;
+
+		hidproxmessage_t copy = *packed;
+		hidproxcard_t card;
+		if (!bf->fmt.Unpack(&copy, &card))
+			continue;
+
+		uint64_t fields[HID_BULK_FIELDS];
+		bool valid = true;
+		for (int f = 0; f < HID_BULK_FIELDS; f++) {
+			fields[f] = get_field(&card, f);
+			valid &= fields[f] <= bf->max[f];
+		}
+		hidproxmessage_t repacked;
+		if (!valid || !pack_fields(bf, fields, &repacked))
+			continue;
+		// same fields, so any difference is in the parity bits
+		bool exact = msg_equal(&repacked, packed);
+		if (!exact && !ignoreParity)
+			continue;
+
+		if (found < max_matches) {
+			matches[found].format = i;
+			matches[found].card = card;
+			matches[found].card.ParityValid = exact;
+			matches[found].exact = exact;
+		}
+		found++;
+	}
+	return found;
+}
+
+#define BENCH_CARDS	(1 << 20)
+
+void HIDBulkBench(void)
+{
+	hidproxmessage_t *out = malloc(BENCH_CARDS * sizeof(hidproxmessage_t));
+	if (!out || !get_format(0)) {
+		free(out);
+		return;
+	}
+
+	PrintAndLog("%-10s %12s %12s", "Format", "Pack_*/s", "bulk/s");
+	for (int i = 0; i < format_count; i++) {
+		hid_bulk_format_t *bf = &formats[i];
+		hidproxcard_t card;
+		memset(&card, 0, sizeof(card));
+		size_t n = MIN(BENCH_CARDS, bf->max[HID_BULK_CN] + 1);
+
+		uint64_t start = msclock();
+		size_t single = 0;
+		while (msclock() - start < 200) {
+			for (int k = 0; k < 1000; k++) {
+				card.CardNumber = single++ % n;
+				bf->fmt.Pack(&card, &out[0]);
+			}
+		}
+		double single_rate = single * 1000.0 / (msclock() - start);
+
+		card.CardNumber = 0;
+		start = msclock();
+		size_t bulk = 0;
+		do {
+			bulk += HIDBulkPack(i, &card, n, out);
+		} while (msclock() - start < 200);
+		double bulk_rate = bulk * 1000.0 / MAX(msclock() - start, 1);
+
+		PrintAndLog("%-10s %12.0f %12.0f%s", bf->fmt.Name, single_rate, bulk_rate, bf->linear ? "" : "  (no tables)");
+	}
+	free(out);
+}
+
+bool HIDBulkSelftest(bool verbose)
+{
+	bool ok = true;
+	uint64_t state = 0x0123456789ABCDEFULL;
+	hidproxmessage_t *run = malloc(300 * sizeof(hidproxmessage_t));
+
+	if (!run || !get_format(0)) {
+		free(run);
+		return false;
+	}
+
+	for (int i = 0; i < format_count; i++) {
+		hid_bulk_format_t *bf = &formats[i];
+		int errors = 0, lookups = 0;
+
+		for (int t = 0; t < 200; t++) {
+			uint64_t fields[HID_BULK_FIELDS];
+			random_fields(bf, &state, fields);
+			hidproxcard_t card;
+			memset(&card, 0, sizeof(card));
+			for (int f = 0; f < HID_BULK_FIELDS; f++)
+				set_field(&card, f, fields[f]);
+
+			// runs of card numbers, crossing byte boundaries
+			size_t n = HIDBulkPack(i, &card, 300, run);
+			for (size_t k = 0; k < n; k++) {
+				hidproxmessage_t expected;
+				hidproxcard_t c = card;
+				c.CardNumber += k;
+				if (!bf->fmt.Pack(&c, &expected) || !msg_equal(&expected, &run[k]))
+					errors++;
+			}
+
+			// the first card must be found again
+			hid_bulk_match_t matches[32];
+			size_t m = MIN(HIDBulkLookup(&run[0], false, matches, 32), 32);
+			bool seen = false;
+			for (size_t k = 0; k < m; k++)
+				seen |= matches[k].format == i && matches[k].exact;
+			if (n && !seen)
+				lookups++;
+		}
+		if (verbose || errors || lookups)
+			PrintAndLog("%-10s %s%s: %d pack errors, %d lookup errors", bf->fmt.Name,
+				bf->linear ? "tables" : "Pack_*", bf->linear ? "" : " ", errors, lookups);
+		ok &= !errors && !lookups;
+	}
+	free(run);
+	return ok;
+}
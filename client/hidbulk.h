@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bulk packing and reverse lookup of HID Prox card formats
+//
+// Apart from the BCD format H10320 all formats are affine over GF(2): every
+// field bit flips a fixed set of message bits (the bit itself and the parity
+// bits covering it). These sets are taken once from the Pack_* functions in
+// hidcardformats.c and merged into byte tables, so packing a card is a few
+// table lookups. Formats for which the tables don't reproduce Pack_* fall back
+// to it.
+//-----------------------------------------------------------------------------
+
+#ifndef HIDBULK_H__
+#define HIDBULK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hidcardformatutils.h"
+
+#define HID_BULK_FC		0
+#define HID_BULK_CN		1
+#define HID_BULK_IL		2
+#define HID_BULK_OEM	3
+#define HID_BULK_FIELDS	4
+
+typedef struct {
+	int format;					// index for HIDGetCardFormat()
+	hidproxcard_t card;
+	bool exact;					// false: matches except for parity bits
+} hid_bulk_match_t;
+
+// largest value of the field the format can encode, 0 if not used
+extern uint64_t HIDBulkFieldMax(int format, int field);
+
+// Packs count cards with the fields of card and the card numbers card->CardNumber,
+// card->CardNumber + 1, ... to out. Returns the number of messages stored, less than
+// count if the card number leaves the range of the format, 0 if the other fields
+// can't be encoded.
+extern size_t HIDBulkPack(int format, const hidproxcard_t *card, size_t count, hidproxmessage_t *out);
+
+// All formats which can produce the message. Returns the number of matches (up to max_matches stored).
+extern size_t HIDBulkLookup(const hidproxmessage_t *packed, bool ignoreParity, hid_bulk_match_t *matches, size_t max_matches);
+
+extern void HIDBulkBench(void);
+extern bool HIDBulkSelftest(bool verbose);
+
+#endif
@@ -210,7 +210,7 @@ bool Unpack_H10306(/*in*/hidproxmessage_t* packed, /*out*/hidproxcard_t* card){
   memset(card, 0, sizeof(hidproxcard_t));
   if (packed->Length != 34) return false; // Wrong length? Stop here.
   card->CardNumber = (packed->bot >> 1) & 0xFFFF;
-  card->FacilityCode = ((packed->mid & 1) << 15) | ((packed->bot >> 17) & 0xFF);
+  card->FacilityCode = ((packed->mid & 1) << 15) | ((packed->bot >> 17) & 0x7FFF);
   card->ParityValid =
     ((evenparity32((packed->mid & 0x00000001) ^ (packed->bot & 0xFFFE0000)) & 1) == ((packed->mid >> 1) & 1)) &&
     ((oddparity32(packed->bot & 0x0001FFFE) & 1) == ((packed->bot & 1)));
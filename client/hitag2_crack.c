@@ -0,0 +1,389 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key recovery from sniffed reader authentications
+//-----------------------------------------------------------------------------
+
+#include "hitag2_crack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "hitag2_crack_core.h"
+#include "hardnested/hardnested_bf_core.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+
+#define WORK_UNIT_BITS		24			// keys per work unit and thread, as a power of 2
+#define MAX_CANDIDATES		64			// per work unit, 2^24 keys give one false positive in 256 units
+#define PROGRESS_INTERVAL	5000		// ms
+#define BENCH_BITS			28
+
+// bit i = i-th bit on air, i.e. MSB of b[0] first
+static uint32_t onair32(const uint8_t *b) {
+	uint32_t x = 0;
+	for (int i = 0; i < 32; i++)
+		x |= (uint32_t)((b[i / 8] >> (7 - i % 8)) & 1) << i;
+	return x;
+}
+
+static void onair32_to_bytes(uint32_t x, uint8_t *b) {
+	for (int i = 0; i < 4; i++) {
+		b[i] = 0;
+		for (int j = 0; j < 8; j++)
+			b[i] |= ht2_bit(x, 8 * i + j) << (7 - j);
+	}
+}
+
+static void make_target(const hitag2_auth_t *auth, hitag2_target_t *t) {
+	t->serial = onair32(auth->uid);
+	t->iv = onair32(auth->nr);
+	t->ks = ~onair32(auth->ar);
+}
+
+// Same as _hitag2_init(rev64(key), rev32(uid), rev32(nR)) and 32 rounds of _hitag2_round() in
+// armsrc/hitag2.c. The first two key bytes are loaded, the other four enter one bit per init round.
+static uint32_t keystream(uint64_t key, const hitag2_target_t *t) {
+	uint64_t x = t->serial;
+	for (int i = 0; i < 16; i++)
+		x |= (uint64_t)ht2_bit(key, 47 - i) << (32 + i);
+	for (int i = 0; i < 32; i++)
+		x = ht2_init_round(x, ht2_bit(t->iv, i) ^ ht2_bit(key, 31 - i));
+
+	uint32_t ks = 0;
+	for (int i = 0; i < 32; i++) {
+		uint64_t fb = x & 0xCE0044C101CDULL;
+		x = x >> 1 | (uint64_t)__builtin_parityll(fb) << 47;
+		ks |= ht2_f20(x) << i;
+	}
+	return ks;
+}
+
+void hitag2_crack_answer(uint64_t key, const uint8_t *uid, const uint8_t *nr, uint8_t *ar) {
+	hitag2_target_t t = {onair32(uid), onair32(nr), 0};
+	onair32_to_bytes(~keystream(key, &t), ar);
+}
+
+bool hitag2_crack_check(uint64_t key, const hitag2_auth_t *auth) {
+	hitag2_target_t t;
+	make_target(auth, &t);
+	return keystream(key, &t) == t.ks;
+}
+
+size_t hitag2_crack_from_trace(const uint8_t *trace, size_t tracelen, hitag2_auth_t *auths, size_t max_auths) {
+	size_t count = 0;
+	int state = 0;			// 0: wait for START_AUTH, 1: wait for the UID, 2: wait for nR aR
+	uint8_t uid[4];
+
+	for (size_t i = 0; i + 9 <= tracelen && count < max_auths; ) {
+		bool is_response = trace[i + 3] & 0x80;
+		uint8_t bits = trace[i + 8];
+		size_t len = (bits + 7) / 8;
+		const uint8_t *frame = trace + i + 9;
+		if (len > 100 || i + 9 + len > tracelen)
+			break;
+		i += 9 + len;
+
+		if (!is_response && bits == 5 && (frame[0] & 0xf8) == 0xc0) {
+			state = 1;
+		} else if (state == 1 && is_response && bits >= 32) {
+			// the UID is the last 32 bits, the sniffer may have kept the start bits
+			uint8_t shift = bits - 32;
+			for (int j = 0; j < 4; j++) {
+				uint16_t w = frame[j + shift / 8] << 8 | (j + shift / 8 + 1 < len ? frame[j + shift / 8 + 1] : 0);
+				uid[j] = w >> (8 - shift % 8);
+			}
+			state = 2;
+		} else if (state == 2 && !is_response && bits == 64) {
+			memcpy(auths[count].uid, uid, 4);
+			memcpy(auths[count].nr, frame, 4);
+			memcpy(auths[count].ar, frame + 4, 4);
+			count++;
+			state = 0;
+		} else {
+			state = 0;
+		}
+	}
+	return count;
+}
+
+
+typedef struct {
+	const hitag2_auth_t *auths;
+	size_t count;
+	hitag2_target_t target;
+	uint64_t base;			// the key with the free bits cleared
+	uint8_t unit_bits;
+	uint64_t units;
+	uint64_t next_unit;
+	uint64_t units_done;
+	volatile bool stop;
+	pthread_mutex_t lock;
+	uint64_t *keys;
+	size_t max_keys;
+	size_t found;
+} crack_job_t;
+
+static void *crack_thread(void *arg) {
+	crack_job_t *job = arg;
+	uint64_t cand[MAX_CANDIDATES];
+
+	while (!job->stop) {
+		uint64_t unit = __sync_fetch_and_add(&job->next_unit, 1);
+		if (unit >= job->units)
+			break;
+
+		uint64_t first = job->base | unit << job->unit_bits;
+		uint64_t *keys = cand;
+		size_t n = hitag2_search(&job->target, first >> 32, first & 0xffffffff, 1ULL << job->unit_bits, cand, MAX_CANDIDATES);
+		if (n > MAX_CANDIDATES) {
+			// the survivors are expected to be rare, scan this unit again with room for all
+			keys = malloc(n * sizeof(uint64_t));
+			if (keys != NULL) {
+				n = hitag2_search(&job->target, first >> 32, first & 0xffffffff, 1ULL << job->unit_bits, keys, n);
+			} else {
+				PrintAndLog("Out of memory, only %d of %zu candidates of work unit %" PRIu64 " checked, the key may be missed",
+					MAX_CANDIDATES, n, unit);
+				keys = cand;
+				n = MAX_CANDIDATES;
+			}
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			bool ok = true;
+			for (size_t j = 1; j < job->count && ok; j++)
+				ok = hitag2_crack_check(keys[i], &job->auths[j]);
+			if (!ok)
+				continue;
+			pthread_mutex_lock(&job->lock);
+			if (job->found < job->max_keys)
+				job->keys[job->found] = keys[i];
+			job->found++;
+			if (job->count > 1)
+				job->stop = true;
+			pthread_mutex_unlock(&job->lock);
+		}
+		if (keys != cand)
+			free(keys);
+		__sync_fetch_and_add(&job->units_done, 1);
+	}
+	return NULL;
+}
+
+static void print_duration(char *buf, size_t size, double seconds) {
+	if (seconds < 120)
+		snprintf(buf, size, "%.0fs", seconds);
+	else if (seconds < 7200)
+		snprintf(buf, size, "%.0fmin", seconds / 60);
+	else if (seconds < 2 * 86400)
+		snprintf(buf, size, "%.1fh", seconds / 3600);
+	else
+		snprintf(buf, size, "%.1fd", seconds / 86400);
+}
+
+int hitag2_crack(const hitag2_auth_t *auths, size_t count, uint64_t prefix, uint8_t known_bytes,
+                 int threads, uint64_t *keys, size_t max_keys, bool verbose) {
+	if (count == 0 || known_bytes > 4)
+		return -1;
+	for (size_t i = 1; i < count; i++) {
+		if (memcmp(auths[i].uid, auths[0].uid, 4)) {
+			PrintAndLog("All authentications must be from the same tag");
+			return -1;
+		}
+	}
+
+	crack_job_t job;
+	memset(&job, 0, sizeof(job));
+	job.auths = auths;
+	job.count = count;
+	make_target(&auths[0], &job.target);
+	uint8_t free_bits = 48 - 8 * known_bytes;
+	job.base = free_bits < 48 ? prefix >> free_bits << free_bits : 0;
+	job.unit_bits = free_bits < WORK_UNIT_BITS ? free_bits : WORK_UNIT_BITS;
+	job.units = 1ULL << (free_bits - job.unit_bits);
+	job.keys = keys;
+	job.max_keys = max_keys;
+	pthread_mutex_init(&job.lock, NULL);
+
+	if (threads <= 0)
+		threads = num_CPUs();
+	if ((uint64_t)threads > job.units)
+		threads = job.units;
+
+	if (verbose)
+		PrintAndLog("Searching 2^%d keys with %d threads...", free_bits, threads);
+
+	pthread_t thread_id[threads];
+	for (int i = 0; i < threads; i++)
+		pthread_create(&thread_id[i], NULL, crack_thread, &job);
+
+	// progress and abort, the workers finish their current unit
+	bool aborted = false;
+	uint64_t start_time = msclock();
+	uint64_t last_print = start_time;
+	while (!job.stop && job.units_done < job.units) {
+		msleep(50);
+		if (ukbhit() > 0) {
+			getchar();
+			aborted = true;
+			job.stop = true;
+			break;
+		}
+		uint64_t now = msclock();
+		uint64_t done = job.units_done;
+		if (verbose && done > 0 && now - last_print >= PROGRESS_INTERVAL) {
+			double rate = (double)(done << job.unit_bits) / (now - start_time) * 1000.0;
+			char eta[16];
+			print_duration(eta, sizeof(eta), (job.units - done) * (double)(1ULL << job.unit_bits) / rate);
+			PrintAndLog("  %5.1f%% searched, %.1f Mkeys/s, ETA %s", 100.0 * done / job.units, rate / 1e6, eta);
+			last_print = now;
+		}
+	}
+	for (int i = 0; i < threads; i++)
+		pthread_join(thread_id[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+
+	if (verbose) {
+		uint64_t elapsed = msclock() - start_time;
+		PrintAndLog("%" PRIu64 " keys tested in %.1fs (%.1f Mkeys/s)%s", job.units_done << job.unit_bits,
+		            elapsed / 1000.0, elapsed ? (double)(job.units_done << job.unit_bits) / elapsed / 1000.0 : 0.0,
+		            aborted ? ", aborted" : "");
+	}
+	return aborted ? -1 : (int)job.found;
+}
+
+
+static uint64_t xorshift64(uint64_t *s) {
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+static void random_auth(uint64_t key, const uint8_t *uid, uint64_t *rnd, hitag2_auth_t *auth) {
+	memcpy(auth->uid, uid, 4);
+	num_to_bytes(xorshift64(rnd), 4, auth->nr);
+	hitag2_crack_answer(key, auth->uid, auth->nr, auth->ar);
+}
+
+void hitag2_crack_bench(int threads) {
+	static const char *names[] = {"auto", "AVX512", "AVX2", "AVX", "SSE2", "MMX", "no SIMD"};
+	uint64_t rnd = 0x0123456789abcdefULL;
+	hitag2_auth_t auth;
+	hitag2_target_t t;
+	uint64_t cand[MAX_CANDIDATES];
+	uint8_t uid[4] = {0x12, 0x34, 0x56, 0x78};
+
+	random_auth(0x4d494b52aa55ULL, uid, &rnd, &auth);
+	make_target(&auth, &t);
+
+	SetSIMDInstr(SIMD_AUTO);
+	SIMDExecInstr best = GetSIMDInstrAuto();
+	PrintAndLog("Single thread, 2^%d keys each:", BENCH_BITS);
+	for (SIMDExecInstr instr = best; instr <= SIMD_NONE; instr++) {
+		SetSIMDInstr(instr);
+		uint64_t start_time = msclock();
+		hitag2_search(&t, 0x1234, 0, 1U << BENCH_BITS, cand, MAX_CANDIDATES);
+		uint64_t elapsed = msclock() - start_time;
+		PrintAndLog("  %-8s %8.1f Mkeys/s", names[instr], elapsed ? (double)(1ULL << BENCH_BITS) / elapsed / 1000.0 : 0.0);
+	}
+	SetSIMDInstr(SIMD_AUTO);
+
+	// 2 known bytes: 2^32 keys
+	if (threads <= 0)
+		threads = num_CPUs();
+	PrintAndLog("%d threads, %s:", threads, names[best]);
+	uint64_t start_time = msclock();
+	hitag2_crack(&auth, 1, 0x1234ULL << 32, 2, threads, cand, 1, false);
+	uint64_t elapsed = msclock() - start_time;
+	double rate = elapsed ? (double)(1ULL << 32) / elapsed * 1000.0 : 0.0;
+	char full[16];
+	print_duration(full, sizeof(full), rate ? (double)(1ULL << 48) / rate : 0.0);
+	PrintAndLog("  %.1f Mkeys/s, full 48 bit key space in %s", rate / 1e6, full);
+}
+
+// run with a key and a nonce from the original code, armsrc/hitag2.c
+static bool selftest_cipher(bool verbose) {
+	static const uint8_t uid[4] = {0x02, 0x4e, 0x02, 0x20};
+	static const uint8_t nr[4] = {0x3b, 0x2a, 0x08, 0xc1};
+	static const uint8_t ar_expected[4] = {0x9c, 0x1b, 0xfd, 0x9f};
+	uint8_t ar[4];
+	hitag2_crack_answer(0x4d494b5220f0ULL, uid, nr, ar);
+	bool ok = !memcmp(ar, ar_expected, 4);
+	if (verbose || !ok)
+		PrintAndLog("  %-30s [%s]", "cipher", ok ? "OK" : "ERROR");
+	return ok;
+}
+
+static bool selftest_trace(bool verbose) {
+	// START_AUTH, UID with the 5 start bits, nR aR
+	static const uint8_t trace[] = {
+		0x10, 0x00, 0x00, 0x00,  0, 0, 0, 0,   5, 0xc0,
+		0x20, 0x00, 0x00, 0x80,  0, 0, 0, 0,  37, 0xf8, 0x12, 0x70, 0x11, 0x00,
+		0x30, 0x00, 0x00, 0x00,  0, 0, 0, 0,  64, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+	};
+	hitag2_auth_t auth;
+	bool ok = (hitag2_crack_from_trace(trace, sizeof(trace), &auth, 1) == 1)
+	       && !memcmp(auth.uid, "\x02\x4e\x02\x20", 4) && !memcmp(auth.nr, "\x01\x02\x03\x04", 4)
+	       && !memcmp(auth.ar, "\x05\x06\x07\x08", 4);
+	if (verbose || !ok)
+		PrintAndLog("  %-30s [%s]", "trace", ok ? "OK" : "ERROR");
+	return ok;
+}
+
+static bool selftest_simd(SIMDExecInstr instr, bool verbose) {
+	uint64_t rnd = 0xfedcba9876543210ULL ^ instr;
+	hitag2_auth_t auths[2];
+	uint64_t keys[4];
+	uint8_t uid[4];
+
+	// away from the ends of the 32 bit range, see the range tests below
+	uint64_t key = (xorshift64(&rnd) & 0xffff7fffff00ULL) | 0x80;
+	num_to_bytes(xorshift64(&rnd), 4, uid);
+	random_auth(key, uid, &rnd, &auths[0]);
+	random_auth(key, uid, &rnd, &auths[1]);
+
+	SetSIMDInstr(instr);
+	// 3 known bytes, 2^24 keys
+	int n = hitag2_crack(auths, 2, key, 3, 0, keys, 4, false);
+	bool ok = (n == 1 && keys[0] == key);
+	// a range not aligned to the lane count
+	hitag2_target_t t;
+	make_target(&auths[0], &t);
+	size_t m = hitag2_search(&t, key >> 32, (key & 0xffffffff) - 7, 13, keys, 4);
+	ok &= (m == 1 && keys[0] == key);
+	m = hitag2_search(&t, key >> 32, (key & 0xffffffff) + 1, 500, keys, 4);
+	for (size_t i = 0; i < m && i < 4; i++)
+		ok &= (keys[i] != key);
+	if (verbose || !ok)
+		PrintAndLog("  %-30s [%s]", "key search", ok ? "OK" : "ERROR");
+	return ok;
+}
+
+bool hitag2_crack_selftest(bool verbose) {
+	static const char *names[] = {"auto", "AVX512", "AVX2", "AVX", "SSE2", "MMX", "no SIMD"};
+	bool res = true;
+
+	PrintAndLog("Hitag2 cipher:");
+	res &= selftest_cipher(verbose);
+	res &= selftest_trace(verbose);
+
+	SetSIMDInstr(SIMD_AUTO);
+	SIMDExecInstr best = GetSIMDInstrAuto();
+
+	// all instruction sets supported by this CPU
+	for (SIMDExecInstr instr = best; instr <= SIMD_NONE; instr++) {
+		PrintAndLog("Bitsliced Hitag2 (%s):", names[instr]);
+		bool ok = selftest_simd(instr, verbose);
+		PrintAndLog("  %s", ok ? "passed" : "FAILED");
+		res &= ok;
+	}
+
+	SetSIMDInstr(SIMD_AUTO);
+	return res;
+}
@@ -0,0 +1,50 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key recovery from sniffed reader authentications
+//
+// The reader proves knowledge of the key by sending nR (random, encrypted) and
+// aR (0xffffffff encrypted with the keystream following nR). One (UID, nR, aR)
+// tuple gives 32 keystream bits, two or more pin the 48 bit key down. The key
+// space is searched with a bitsliced cipher, see hitag2_crack_core.c.
+//
+// Keys are handled as 48 bit numbers with the first key byte (as given to
+// 'lf hitag reader 23') in bits 40..47.
+//-----------------------------------------------------------------------------
+
+#ifndef HITAG2_CRACK_H__
+#define HITAG2_CRACK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HITAG2_CRACK_MAX_AUTHS	16
+
+typedef struct {
+	uint8_t uid[4];
+	uint8_t nr[4];		// as transmitted
+	uint8_t ar[4];
+} hitag2_auth_t;
+
+// scalar reference cipher
+extern void hitag2_crack_answer(uint64_t key, const uint8_t *uid, const uint8_t *nr, uint8_t *ar);
+extern bool hitag2_crack_check(uint64_t key, const hitag2_auth_t *auth);
+
+// Extract the authentications from a 'lf hitag list' trace: a 5 bit START_AUTH, the 32 bit UID
+// answer and the 64 bit nR aR of the reader. Returns the number of tuples stored.
+extern size_t hitag2_crack_from_trace(const uint8_t *trace, size_t tracelen, hitag2_auth_t *auths, size_t max_auths);
+
+// Search all keys starting with the known_bytes (0..4) first bytes of prefix. All auths must be
+// from the same tag. threads = 0 uses all CPUs. Matching keys are stored to keys (up to max_keys).
+// With more than one auth the search stops at the first match. Returns the number of matches,
+// -1 if aborted by a keypress or on error.
+extern int hitag2_crack(const hitag2_auth_t *auths, size_t count, uint64_t prefix, uint8_t known_bytes,
+                        int threads, uint64_t *keys, size_t max_keys, bool verbose);
+
+extern void hitag2_crack_bench(int threads);
+extern bool hitag2_crack_selftest(bool verbose);
+
+#endif
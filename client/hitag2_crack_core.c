@@ -0,0 +1,211 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Hitag2 key search. Compiled once per SIMD instruction set, like
+// hardnested/hardnested_bf_core.c.
+//
+// The key bits enter the register one per init round, the last LANE_BITS of
+// them are taken from the lane number. All lanes of a block therefore share
+// the state up to round 32 - LANE_BITS, which is computed once in scalar code
+// and only updated as far as the upper key bits change from block to block.
+// From there on the register is kept as a sequence of bit vectors, new bits
+// are appended behind the current window (no shifting, see crypto1_bs_core.c).
+// Lanes are dropped as soon as their keystream differs from the expected one,
+// a block is done when no lane is left, usually after LANE_BITS + 2 bits.
+//-----------------------------------------------------------------------------
+
+#include "hitag2_crack_core.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardnested/hardnested_bf_core.h"
+
+#if defined(__AVX512F__)
+#define MAX_BITSLICES 512
+#define LANE_BITS 9
+#elif defined(__AVX2__)
+#define MAX_BITSLICES 256
+#define LANE_BITS 8
+#elif defined(__AVX__)
+#define MAX_BITSLICES 128
+#define LANE_BITS 7
+#elif defined(__SSE2__)
+#define MAX_BITSLICES 128
+#define LANE_BITS 7
+#else // MMX or SSE or NOSIMD
+#define MAX_BITSLICES 64
+#define LANE_BITS 6
+#endif
+
+#define VECTOR_SIZE (MAX_BITSLICES/8)
+typedef unsigned int __attribute__((aligned(VECTOR_SIZE))) __attribute__((vector_size(VECTOR_SIZE))) bitslice_value_t;
+typedef union {
+	bitslice_value_t value;
+	uint64_t bytes64[MAX_BITSLICES/64];
+} bitslice_t;
+
+// the 4 and 5 input tables of _f20() in armsrc/hitag2.c, first argument = lowest index bit
+#define f4a(a,b,c,d) (~((((a)|(b))&(c))^((a)|(d))^(b)))
+#define f4b(a,b,c,d) (~((((d)|(c))&((a)^(b)))^((d)|(a)|(b))))
+#define f5c(a,b,c,d,e) (~(((((((c)^(e))|(d))&(a))^(b))&((c)^(b)))^((((d)^(e))|(a))&(((d)^(b))|(c)))))
+
+#define bs_filter(s) f5c(f4a(s[ 1], s[ 2], s[ 4], s[ 5]), \
+                         f4b(s[ 7], s[11], s[13], s[14]), \
+                         f4b(s[16], s[20], s[22], s[25]), \
+                         f4b(s[27], s[28], s[30], s[32]), \
+                         f4a(s[33], s[42], s[43], s[45]))
+
+// taps of _hitag2_round()
+#define bs_feedback(s) (s[ 0] ^ s[ 2] ^ s[ 3] ^ s[ 6] ^ s[ 7] ^ s[ 8] ^ s[16] ^ s[22] ^ \
+                        s[23] ^ s[26] ^ s[30] ^ s[41] ^ s[42] ^ s[43] ^ s[46] ^ s[47])
+
+#define PREFIX_ROUNDS (32 - LANE_BITS)
+
+#if defined (__AVX512F__)
+#define HITAG2_SEARCH hitag2_search_AVX512
+#elif defined (__AVX2__)
+#define HITAG2_SEARCH hitag2_search_AVX2
+#elif defined (__AVX__)
+#define HITAG2_SEARCH hitag2_search_AVX
+#elif defined (__SSE2__)
+#define HITAG2_SEARCH hitag2_search_SSE2
+#elif defined (__MMX__)
+#define HITAG2_SEARCH hitag2_search_MMX
+#else
+#define HITAG2_SEARCH hitag2_search_NOSIMD
+#endif
+
+hitag2_search_t hitag2_search_AVX512, hitag2_search_AVX2, hitag2_search_AVX, hitag2_search_SSE2, hitag2_search_MMX, hitag2_search_NOSIMD;
+
+static inline uint32_t rev16(uint32_t x) {
+	x = (x & 0x5555) << 1 | (x >> 1 & 0x5555);
+	x = (x & 0x3333) << 2 | (x >> 2 & 0x3333);
+	x = (x & 0x0f0f) << 4 | (x >> 4 & 0x0f0f);
+	return (x & 0x00ff) << 8 | (x >> 8 & 0x00ff);
+}
+
+size_t HITAG2_SEARCH(const hitag2_target_t *t, uint16_t k0, uint32_t r_first, uint32_t r_count,
+                     uint64_t *cand, size_t max_cand) {
+	bitslice_value_t s[48 + LANE_BITS + 32];
+	bitslice_value_t lane_bit[LANE_BITS];
+	bitslice_t ones, alive;
+	uint64_t state[PREFIX_ROUNDS + 1];
+	size_t found = 0;
+
+	if (r_count == 0)
+		return 0;
+
+	// lane_bit[q] has bit q of the lane number in each lane
+	for (size_t w = 0; w < MAX_BITSLICES/64; w++)
+		ones.bytes64[w] = ~0ULL;
+	for (int q = 0; q < LANE_BITS; q++) {
+		static const uint64_t pattern[6] = {
+			0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL, 0xf0f0f0f0f0f0f0f0ULL,
+			0xff00ff00ff00ff00ULL, 0xffff0000ffff0000ULL, 0xffffffff00000000ULL
+		};
+		bitslice_t v;
+		for (size_t w = 0; w < MAX_BITSLICES/64; w++)
+			v.bytes64[w] = q < 6 ? pattern[q] : (w >> (q - 6) & 1) ? ~0ULL : 0;
+		lane_bit[q] = v.value;
+	}
+
+	uint64_t r_end = (uint64_t)r_first + r_count;
+	uint32_t c_first = r_first >> LANE_BITS;
+	uint32_t c_last = (r_end - 1) >> LANE_BITS;
+	int valid = 0;			// state[0..valid] are up to date for c
+
+	state[0] = (uint64_t)rev16(k0) << 32 | t->serial;
+	for (uint64_t c = c_first; c <= c_last; c++) {
+		// init round i takes the key bit PREFIX_ROUNDS - 1 - i of c
+		if (c != c_first) {
+			int h = 31 - __builtin_clz((uint32_t)(c ^ (c - 1)));
+			if (valid > PREFIX_ROUNDS - 1 - h)
+				valid = PREFIX_ROUNDS - 1 - h;
+		}
+		for (int i = valid; i < PREFIX_ROUNDS; i++)
+			state[i + 1] = ht2_init_round(state[i], ht2_bit(t->iv, i) ^ ht2_bit(c, PREFIX_ROUNDS - 1 - i));
+		valid = PREFIX_ROUNDS;
+
+		uint64_t x = state[PREFIX_ROUNDS];
+		for (int j = 0; j < 48; j++)
+			s[j] = ht2_bit(x, j) ? ones.value : ~ones.value;
+
+		// remaining init rounds, the key bits are the lane number
+		for (int m = 0; m < LANE_BITS; m++) {
+			bitslice_value_t in = ht2_bit(t->iv, PREFIX_ROUNDS + m) ? ~lane_bit[LANE_BITS - 1 - m] : lane_bit[LANE_BITS - 1 - m];
+			s[48 + m] = bs_filter((s + m + 1)) ^ in;
+		}
+
+		// keystream, window starts at s[LANE_BITS]
+		alive = ones;
+		bitslice_value_t *w = &s[LANE_BITS];
+		for (int b = 0; b < 32; b++, w++) {
+			w[48] = bs_feedback(w);
+			bitslice_value_t out = bs_filter((w + 1));
+			alive.value &= ht2_bit(t->ks, b) ? out : ~out;
+
+			uint64_t any = 0;
+			for (size_t k = 0; k < MAX_BITSLICES/64; k++)
+				any |= alive.bytes64[k];
+			if (!any)
+				break;
+		}
+
+		for (size_t k = 0; k < MAX_BITSLICES/64; k++) {
+			uint64_t a = alive.bytes64[k];
+			while (a) {
+				uint64_t r = c << LANE_BITS | (k * 64 + __builtin_ctzll(a));
+				a &= a - 1;
+				if (r < r_first || r >= r_end)
+					continue;
+				if (found < max_cand)
+					cand[found] = (uint64_t)k0 << 32 | r;
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+
+#ifndef __MMX__
+
+// determine the available instruction set at runtime and call the correct function.
+// Not cached in a function pointer, SetSIMDInstr() may change the selection between calls.
+size_t hitag2_search(const hitag2_target_t *t, uint16_t k0, uint32_t r_first, uint32_t r_count,
+                     uint64_t *cand, size_t max_cand) {
+	hitag2_search_t *search_function_p;
+
+	switch(GetSIMDInstrAuto()) {
+#if defined (__i386__) || defined (__x86_64__)
+#if !defined(__APPLE__) || (defined(__APPLE__) && (__clang_major__ > 8 || __clang_major__ == 8 && __clang_minor__ >= 1))
+#if (__GNUC__ >= 5) && (__GNUC__ > 5 || __GNUC_MINOR__ > 2)
+		case SIMD_AVX512:
+			search_function_p = &hitag2_search_AVX512;
+			break;
+#endif
+		case SIMD_AVX2:
+			search_function_p = &hitag2_search_AVX2;
+			break;
+		case SIMD_AVX:
+			search_function_p = &hitag2_search_AVX;
+			break;
+		case SIMD_SSE2:
+			search_function_p = &hitag2_search_SSE2;
+			break;
+		case SIMD_MMX:
+			search_function_p = &hitag2_search_MMX;
+			break;
+#endif
+#endif
+		default:
+			search_function_p = &hitag2_search_NOSIMD;
+			break;
+	}
+
+	return (*search_function_p)(t, k0, r_first, r_count, cand, max_cand);
+}
+
+#endif
@@ -0,0 +1,49 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key search, internals shared by the SIMD variants
+//-----------------------------------------------------------------------------
+
+#ifndef HITAG2_CRACK_CORE_H__
+#define HITAG2_CRACK_CORE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The cipher state is a 48 bit shift register, bit 0 leaves first. All words
+// below are in this bit order, i.e. bit i is the i-th bit on air.
+typedef struct {
+	uint32_t serial;		// UID
+	uint32_t iv;			// nR
+	uint32_t ks;			// ~aR, the first 32 keystream bits
+} hitag2_target_t;
+
+#define ht2_bit(x, n)		(((x) >> (n)) & 1)
+
+// filter function, taps as in armsrc/hitag2.c
+static inline uint32_t ht2_f20(uint64_t x) {
+	#define i4(a,b,c,d) (ht2_bit(x,a) | ht2_bit(x,b) << 1 | ht2_bit(x,c) << 2 | ht2_bit(x,d) << 3)
+	uint32_t i5 = ((0x2C79 >> i4( 1, 2, 4, 5)) & 1)
+	            | ((0x6671 >> i4( 7,11,13,14)) & 1) << 1
+	            | ((0x6671 >> i4(16,20,22,25)) & 1) << 2
+	            | ((0x6671 >> i4(27,28,30,32)) & 1) << 3
+	            | ((0x2C79 >> i4(33,42,43,45)) & 1) << 4;
+	#undef i4
+	return (0x7907287B >> i5) & 1;
+}
+
+// one init round, in = IV bit ^ key bit
+static inline uint64_t ht2_init_round(uint64_t x, uint32_t in) {
+	x >>= 1;
+	return x | (uint64_t)(ht2_f20(x) ^ in) << 47;
+}
+
+// Tests the keys k0 << 32 | r for r in [r_first, r_first + r_count) against the target. Keys
+// with a matching keystream are stored to cand (up to max_cand). Returns their number.
+typedef size_t hitag2_search_t(const hitag2_target_t *t, uint16_t k0, uint32_t r_first, uint32_t r_count,
+                               uint64_t *cand, size_t max_cand);
+extern hitag2_search_t hitag2_search;
+
+#endif
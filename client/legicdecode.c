@@ -0,0 +1,418 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Offline decoding of LEGIC Prime dumps
+//
+// The layout follows CmdLegicDecode(): 22 bytes system area (UID, MCC, DCF,
+// WRP/WRC/RD, SSC, header), then the segments of the ADF. The ADF is XORed
+// with the MCC. Each segment starts with a 5 byte header whose last byte is
+// the CRC-8 over the UID and the first four header bytes.
+//
+// Dumps from the reader are already deobfuscated from the RF link, the LEGIC
+// PRNG plays no part here. Files are decoded in chunks on all CPUs, the JSON
+// is written in the order of the files with one card per line.
+//-----------------------------------------------------------------------------
+
+#include "legicdecode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+#include "crc.h"
+#include "emv/emvjson.h"
+#include "filelist.h"
+
+#define LEGIC_DCF_SEGMENTED_MAX	60000
+#define LEGIC_MAX_FILE_LEN		(8 * LEGIC_MAX_DUMP_LEN)
+#define LEGIC_BATCH_CHUNK		4096
+
+const char *LegicTokenType(uint8_t dcf_lo) {
+	switch (dcf_lo & 0x7f) {
+		case 0x00 ... 0x2f:
+			return "IAM";
+		case 0x30 ... 0x6f:
+			return "SAM";
+		default:
+			return "GAM";
+	}
+}
+
+int LegicDecodeDump(const uint8_t *data, size_t len, legic_card_t *card) {
+	memset(card, 0, sizeof(legic_card_t));
+	if (len < LEGIC_SYSTEM_AREA_LEN)
+		return -1;
+
+	memcpy(card->uid, data, 4);
+	card->mcc = data[4];
+	card->calc_mcc = CRC8Legic(data, 4);
+	if (card->mcc != card->calc_mcc)
+		card->errors++;
+	card->dcf = data[5] | data[6] << 8;
+	card->wrp = data[7] & 0x0f;
+	card->wrc = (data[7] & 0x70) >> 4;
+	card->rd = data[7] >> 7;
+	card->ssc = data[8];
+	card->segmented = card->dcf <= LEGIC_DCF_SEGMENTED_MAX;
+	if (!card->segmented)
+		return 0;
+
+	// UID followed by the plain segment header
+	uint8_t crcdata[8];
+	memcpy(crcdata, data, 4);
+
+	size_t i = LEGIC_SYSTEM_AREA_LEN;
+	while (card->segment_count < LEGIC_MAX_SEGMENTS && i + LEGIC_SEGMENT_HDR_LEN <= len) {
+		legic_segment_t *seg = &card->segments[card->segment_count++];
+		uint8_t hdr[LEGIC_SEGMENT_HDR_LEN];
+		for (int k = 0; k < LEGIC_SEGMENT_HDR_LEN; k++)
+			hdr[k] = data[i + k] ^ card->mcc;
+
+		seg->offset = i;
+		seg->len = (hdr[1] & 0x0f) << 8 | hdr[0];
+		seg->flag = hdr[1] >> 4;
+		seg->wrp = hdr[2];
+		seg->wrc = (hdr[3] & 0x70) >> 4;
+		seg->rd = hdr[3] >> 7;
+		seg->crc = hdr[4];
+		memcpy(crcdata + 4, hdr, 4);
+		seg->calc_crc = CRC8Legic(crcdata, 8);
+		if (seg->crc != seg->calc_crc)
+			card->errors++;
+
+		if (seg->len < LEGIC_SEGMENT_HDR_LEN || i + seg->len > len) {
+			seg->truncated = true;
+			card->errors++;
+			break;
+		}
+		i += seg->len;
+		if (seg->flag & 0x8)
+			break;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// JSON
+
+static json_t *json_hex(const uint8_t *data, size_t len) {
+	static const char digits[] = "0123456789abcdef";
+	char s[2 * LEGIC_MAX_DUMP_LEN + 1];
+
+	if (len > LEGIC_MAX_DUMP_LEN)
+		len = LEGIC_MAX_DUMP_LEN;
+	for (size_t i = 0; i < len; i++) {
+		s[2 * i] = digits[data[i] >> 4];
+		s[2 * i + 1] = digits[data[i] & 0x0f];
+	}
+	s[2 * len] = '\0';
+	return json_string(s);
+}
+
+// [from, to) clipped to the dump
+static json_t *json_area(const uint8_t *plain, size_t len, size_t from, size_t to) {
+	if (to > len)
+		to = len;
+	if (from > to)
+		from = to;
+	return json_hex(plain + from, to - from);
+}
+
+static json_t *segment_to_json(const uint8_t *plain, size_t len, const legic_segment_t *seg, int index) {
+	json_t *obj = json_object();
+
+	size_t start = seg->offset + LEGIC_SEGMENT_HDR_LEN;
+	size_t wrc_end = start + seg->wrc;
+	size_t wrp_end = start + (seg->wrp > seg->wrc ? seg->wrp : seg->wrc);
+	size_t end = seg->offset + seg->len;
+	if (wrp_end > end)
+		end = wrp_end;
+
+	JsonSaveInt(obj, "index", index);
+	JsonSaveInt(obj, "offset", seg->offset);
+	JsonSaveInt(obj, "len", seg->len);
+	JsonSaveInt(obj, "flag", seg->flag);
+	JsonSaveJsonObject(obj, "valid", json_boolean(seg->flag & 0x4));
+	JsonSaveJsonObject(obj, "last", json_boolean(seg->flag & 0x8));
+	JsonSaveInt(obj, "wrp", seg->wrp);
+	JsonSaveInt(obj, "wrc", seg->wrc);
+	JsonSaveJsonObject(obj, "rd", json_boolean(seg->rd));
+	JsonSaveJsonObject(obj, "crc", json_hex(&seg->crc, 1));
+	JsonSaveJsonObject(obj, "crc_ok", json_boolean(seg->crc == seg->calc_crc));
+	if (seg->truncated)
+		JsonSaveJsonObject(obj, "truncated", json_true());
+	JsonSaveJsonObject(obj, "wrc_data", json_area(plain, len, start, wrc_end));
+	JsonSaveJsonObject(obj, "wrp_data", json_area(plain, len, wrc_end, wrp_end));
+	if (wrp_end - wrc_end == 8 && wrp_end <= len) {
+		char id[8];
+		sprintf(id, "%02X%02X%02X", plain[wrp_end - 4], plain[wrp_end - 3], plain[wrp_end - 2]);
+		JsonSaveStr(obj, "card_id", id);
+	}
+	JsonSaveJsonObject(obj, "payload", json_area(plain, len, wrp_end, end));
+
+	return obj;
+}
+
+json_t *LegicCardToJson(const uint8_t *data, size_t len, const legic_card_t *card) {
+	json_t *root = json_object();
+	uint8_t plain[LEGIC_MAX_DUMP_LEN];
+
+	if (len > LEGIC_MAX_DUMP_LEN)
+		len = LEGIC_MAX_DUMP_LEN;
+	for (size_t i = 0; i < len; i++)
+		plain[i] = (i < LEGIC_SYSTEM_AREA_LEN) ? data[i] : data[i] ^ card->mcc;
+
+	JsonSaveInt(root, "size", len);
+	JsonSaveJsonObject(root, "uid", json_hex(card->uid, 4));
+	JsonSaveJsonObject(root, "mcc", json_hex(&card->mcc, 1));
+	JsonSaveJsonObject(root, "mcc_ok", json_boolean(card->mcc == card->calc_mcc));
+	JsonSaveInt(root, "dcf", card->dcf);
+	JsonSaveStr(root, "token_type", (char *)LegicTokenType(card->dcf & 0xff));
+	JsonSaveJsonObject(root, "ole", json_boolean(card->dcf & 0x80));
+	JsonSaveInt(root, "stamp_len", 0xfc - (card->dcf >> 8));
+	JsonSaveInt(root, "wrp", card->wrp);
+	JsonSaveInt(root, "wrc", card->wrc);
+	JsonSaveJsonObject(root, "rd", json_boolean(card->rd));
+	JsonSaveJsonObject(root, "ssc", json_hex(&card->ssc, 1));
+	JsonSaveJsonObject(root, "header", json_area(plain, len, 9, LEGIC_SYSTEM_AREA_LEN));
+	JsonSaveJsonObject(root, "segmented", json_boolean(card->segmented));
+	if (card->segmented) {
+		json_t *segments = json_array();
+		for (size_t i = 0; i < card->segment_count; i++)
+			json_array_append_new(segments, segment_to_json(plain, len, &card->segments[i], i));
+		JsonSaveJsonObject(root, "segments", segments);
+	}
+	JsonSaveInt(root, "errors", card->errors);
+
+	return root;
+}
+
+//-----------------------------------------------------------------------------
+// dump files
+
+const char *LegicLoadDumpFile(const char *name, uint8_t *data, size_t *len) {
+	uint8_t buf[LEGIC_MAX_FILE_LEN + 1];
+
+	FILE *f = fopen(name, "rb");
+	if (f == NULL)
+		return "can't open file";
+	size_t n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	if (n > LEGIC_MAX_FILE_LEN)
+		return "file too large";
+
+	// hf legic save writes lines of 8 hex bytes
+	bool text = n > 0;
+	for (size_t i = 0; i < n && text; i++)
+		text = isxdigit(buf[i]) || isspace(buf[i]);
+
+	if (!text) {
+		if (n > LEGIC_MAX_DUMP_LEN)
+			return "file too large";
+		memcpy(data, buf, n);
+		*len = n;
+	} else {
+		size_t digits = 0;
+		*len = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (isspace(buf[i])) {
+				if (digits & 1)
+					return "odd number of hex digits";
+				continue;
+			}
+			if (*len == LEGIC_MAX_DUMP_LEN && !(digits & 1))
+				return "file too large";
+			int v = isdigit(buf[i]) ? buf[i] - '0' : (tolower(buf[i]) - 'a' + 10);
+			if (digits & 1)
+				data[(*len)++] |= v;
+			else
+				data[*len] = v << 4;
+			digits++;
+		}
+		if (digits & 1)
+			return "odd number of hex digits";
+	}
+
+	if (*len < LEGIC_SYSTEM_AREA_LEN)
+		return "shorter than the system area";
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// batch
+
+typedef struct {
+	const char *name;
+	const char *error;
+	uint8_t uid[4];
+	uint16_t dcf;
+	size_t segments;
+	int errors;
+	char *json;
+} legic_job_t;
+
+typedef struct {
+	legic_job_t *jobs;
+	size_t count;
+	size_t next;
+	pthread_mutex_t lock;
+} legic_batch_t;
+
+// directories: all their (not hidden) files
+static bool is_dump_file(const char *path, const char *name) {
+	struct stat st;
+	return name[0] != '.' && stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static void decode_job(legic_job_t *job) {
+	uint8_t data[LEGIC_MAX_DUMP_LEN];
+	size_t len = 0;
+	legic_card_t card;
+	json_t *obj;
+
+	job->error = LegicLoadDumpFile(job->name, data, &len);
+	if (job->error == NULL) {
+		LegicDecodeDump(data, len, &card);
+		memcpy(job->uid, card.uid, 4);
+		job->dcf = card.dcf;
+		job->segments = card.segment_count;
+		job->errors = card.errors;
+		obj = LegicCardToJson(data, len, &card);
+	} else {
+		obj = json_object();
+		JsonSaveStr(obj, "error", (char *)job->error);
+	}
+	// file name first
+	json_t *root = json_object();
+	JsonSaveStr(root, "file", (char *)job->name);
+	json_object_update(root, obj);
+	json_decref(obj);
+	job->json = json_dumps(root, JSON_COMPACT);
+	json_decref(root);
+}
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+decode_thread(void *arg) {
+	legic_batch_t *b = arg;
+
+	while (true) {
+		pthread_mutex_lock(&b->lock);
+		size_t idx = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if (idx >= b->count)
+			break;
+		decode_job(&b->jobs[idx]);
+	}
+	return NULL;
+}
+
+static void decode_parallel(legic_job_t *jobs, size_t count, int threads) {
+	legic_batch_t b = {jobs, count, 0};
+	pthread_mutex_init(&b.lock, NULL);
+
+	int num_threads = MIN(threads, (int)count);
+	if (num_threads < 1)
+		num_threads = 1;
+	pthread_t thread_id[num_threads];
+	for (int i = 0; i < num_threads; i++)
+		pthread_create(&thread_id[i], NULL, decode_thread, &b);
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(thread_id[i], NULL);
+
+	pthread_mutex_destroy(&b.lock);
+}
+
+int LegicBatchDecode(char **names, int count, int threads, const char *jsonname, bool verbose) {
+	filelist_t fl = {0};
+	int res = filelist_collect(names, count, is_dump_file, &fl);
+	if (res) {
+		if (res == 2)
+			PrintAndLog("Cannot allocate memory");
+		filelist_free(&fl);
+		return res;
+	}
+	if (fl.count == 0) {
+		PrintAndLog("No dump files found");
+		filelist_free(&fl);
+		return 1;
+	}
+
+	FILE *f = NULL;
+	if (jsonname) {
+		f = fopen(jsonname, "w");
+		if (f == NULL) {
+			PrintAndLog("Can't create file %s", jsonname);
+			filelist_free(&fl);
+			return 1;
+		}
+		fputs("[\n", f);
+	}
+
+	legic_job_t *jobs = calloc(MIN(fl.count, LEGIC_BATCH_CHUNK), sizeof(legic_job_t));
+	if (jobs == NULL) {
+		PrintAndLog("Cannot allocate memory");
+		if (f)
+			fclose(f);
+		filelist_free(&fl);
+		return 2;
+	}
+	if (threads <= 0)
+		threads = num_CPUs();
+	// the hash seed must be set before threads create objects
+	json_object_seed(0);
+
+	size_t cards = 0, failed = 0, unreadable = 0;
+	uint64_t start = msclock();
+
+	PrintAndLog("%-40s %-8s %-4s %-4s %s", "file", "uid", "type", "segs", "result");
+	for (int base = 0; base < fl.count; base += LEGIC_BATCH_CHUNK) {
+		size_t n = MIN(fl.count - base, LEGIC_BATCH_CHUNK);
+		memset(jobs, 0, n * sizeof(legic_job_t));
+		for (size_t i = 0; i < n; i++)
+			jobs[i].name = fl.names[base + i];
+
+		decode_parallel(jobs, n, threads);
+
+		for (size_t i = 0; i < n; i++) {
+			legic_job_t *job = &jobs[i];
+			if (job->error) {
+				unreadable++;
+				PrintAndLog("%-40s %s", job->name, job->error);
+			} else {
+				cards++;
+				if (job->errors)
+					failed++;
+				if (verbose || job->errors)
+					PrintAndLog("%-40s %02x%02x%02x%02x %-4s %4zu %s", job->name, job->uid[0], job->uid[1], job->uid[2], job->uid[3],
+						LegicTokenType(job->dcf & 0xff), job->segments, job->errors ? "CRC/length errors" : "ok");
+			}
+			if (f && job->json)
+				fprintf(f, "%s%s", (base + i) ? ",\n" : "", job->json);
+			free(job->json);
+		}
+	}
+	if (f) {
+		fputs("\n]\n", f);
+		fclose(f);
+	}
+	free(jobs);
+	filelist_free(&fl);
+
+	PrintAndLog("\n%zu dumps decoded in %" PRIu64 " ms, %zu with errors, %zu unreadable", cards, msclock() - start, failed, unreadable);
+	if (jsonname)
+		PrintAndLog("JSON written to %s", jsonname);
+	return 0;
+}
@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Offline decoding of LEGIC Prime dumps
+//-----------------------------------------------------------------------------
+
+#ifndef LEGICDECODE_H__
+#define LEGICDECODE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <jansson.h>
+
+#define LEGIC_MAX_DUMP_LEN		1024
+#define LEGIC_SYSTEM_AREA_LEN	22
+#define LEGIC_SEGMENT_HDR_LEN	5
+#define LEGIC_MAX_SEGMENTS		64
+
+typedef struct {
+	uint16_t offset;			// of the segment header in the dump
+	uint16_t len;				// including the header
+	uint8_t flag;				// bit 2: valid, bit 3: last segment
+	uint8_t wrp;				// write protected bytes behind the header
+	uint8_t wrc;				// of which are stamp bytes
+	bool rd;
+	uint8_t crc;				// header CRC as stored
+	uint8_t calc_crc;			// over UID and header
+	bool truncated;				// continues behind the end of the dump
+} legic_segment_t;
+
+typedef struct {
+	uint8_t uid[4];				// MCD, MSN0..2
+	uint8_t mcc;				// CRC of the UID, the ADF is XORed with it
+	uint8_t calc_mcc;
+	uint16_t dcf;
+	uint8_t wrp;
+	uint8_t wrc;
+	bool rd;
+	uint8_t ssc;
+	bool segmented;				// DCF up to 60000, else unsegmented media
+	size_t segment_count;
+	legic_segment_t segments[LEGIC_MAX_SEGMENTS];
+	int errors;					// CRC mismatches and truncated/invalid segments
+} legic_card_t;
+
+extern const char *LegicTokenType(uint8_t dcf_lo);
+
+// 0 or -1 if the dump is shorter than the system area
+extern int LegicDecodeDump(const uint8_t *data, size_t len, legic_card_t *card);
+extern json_t *LegicCardToJson(const uint8_t *data, size_t len, const legic_card_t *card);
+
+// Text (hf legic save) or binary dump. Returns NULL or an error message.
+extern const char *LegicLoadDumpFile(const char *name, uint8_t *data, size_t *len);
+
+// Decodes all dump files and all files in directories on all CPUs (threads = 0)
+// and writes them as a JSON array to jsonname (may be NULL). Lists the files
+// with errors, with verbose all files.
+extern int LegicBatchDecode(char **names, int count, int threads, const char *jsonname, bool verbose);
+
+#endif
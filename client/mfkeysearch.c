@@ -0,0 +1,287 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Mifare Classic key dictionaries and multithreaded host side key search
+//-----------------------------------------------------------------------------
+
+#include "mfkeysearch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "util.h"
+#include "ui.h"
+#include "proxmark3.h"
+#include "mifaredefault.h"
+#include "crypto1_bs.h"
+
+#define KEYSEARCH_BLOCK_SIZE	64			// keys handed to a thread at a time
+#define KEYSEARCH_MIN_KEYS		256			// don't start threads for less keys than this
+#define NUM_KEYSEARCH_THREADS	(num_CPUs())
+
+void mfKeyDicInit(mfkeydic_t *dic) {
+	memset(dic, 0, sizeof(mfkeydic_t));
+}
+
+void mfKeyDicFree(mfkeydic_t *dic) {
+	free(dic->keys);
+	memset(dic, 0, sizeof(mfkeydic_t));
+}
+
+int mfKeyDicAdd(mfkeydic_t *dic, uint64_t key) {
+	if (dic->count == dic->allocated) {
+		size_t allocated = dic->allocated ? dic->allocated * 2 : 128;
+		uint64_t *p = realloc(dic->keys, allocated * sizeof(uint64_t));
+		if (p == NULL) {
+			PrintAndLog("Cannot allocate memory for keys");
+			return 2;
+		}
+		dic->keys = p;
+		dic->allocated = allocated;
+	}
+	dic->keys[dic->count++] = key & 0xffffffffffff;
+	return 0;
+}
+
+// compiled in keys + default_keys.dic from the client directory
+int mfKeyDicAddDefaults(mfkeydic_t *dic) {
+	for (int i = 0; i < MifareDefaultKeysSize; i++) {
+		if (mfKeyDicAdd(dic, MifareDefaultKeys[i]))
+			return 2;
+	}
+
+	const char *exec_path = get_my_executable_directory();
+	if (exec_path == NULL)
+		return 0;
+
+	char filename[strlen(exec_path) + strlen(MF_DEFAULT_KEYS_DIC) + 1];
+	strcpy(filename, exec_path);
+	strcat(filename, MF_DEFAULT_KEYS_DIC);
+	FILE *f = fopen(filename, "r");
+	if (f == NULL)
+		return 0;
+	fclose(f);
+
+	return mfKeyDicLoadFile(dic, filename) < 0 ? 2 : 0;
+}
+
+// returns number of keys loaded or -1 on error
+int mfKeyDicLoadFile(mfkeydic_t *dic, const char *filename) {
+	char buf[64];
+	int cnt = 0;
+
+	FILE *f = fopen(filename, "r");
+	if (f == NULL) {
+		PrintAndLog("File: %s: not found or locked.", filename);
+		return -1;
+	}
+
+	while (fgets(buf, sizeof(buf), f)) {
+		// long lines: skip the rest
+		if (strchr(buf, '\n') == NULL)
+			while (fgetc(f) != '\n' && !feof(f)) ;
+
+		if (buf[0] == '#')
+			continue;
+
+		int i;
+		for (i = 0; i < 12; i++) {
+			if (!isxdigit((unsigned char)buf[i]))
+				break;
+		}
+		if (i != 12)
+			continue;
+
+		buf[12] = 0;
+		if (mfKeyDicAdd(dic, strtoull(buf, NULL, 16))) {
+			fclose(f);
+			return -1;
+		}
+		cnt++;
+	}
+	fclose(f);
+
+	mfKeyDicUnique(dic);
+	return cnt;
+}
+
+typedef struct {
+	uint64_t key;
+	size_t idx;
+} keyidx_t;
+
+static int compare_keyidx(const void *a, const void *b) {
+	const keyidx_t *ka = a;
+	const keyidx_t *kb = b;
+
+	if (ka->key != kb->key)
+		return ka->key < kb->key ? -1 : 1;
+	return ka->idx < kb->idx ? -1 : (ka->idx > kb->idx);
+}
+
+static int compare_idx(const void *a, const void *b) {
+	const keyidx_t *ka = a;
+	const keyidx_t *kb = b;
+
+	return ka->idx < kb->idx ? -1 : (ka->idx > kb->idx);
+}
+
+// remove duplicate keys, keeps the order of first occurrence
+void mfKeyDicUnique(mfkeydic_t *dic) {
+	if (dic->count < 2)
+		return;
+
+	keyidx_t *ki = malloc(dic->count * sizeof(keyidx_t));
+	if (ki == NULL)
+		return;
+
+	for (size_t i = 0; i < dic->count; i++) {
+		ki[i].key = dic->keys[i];
+		ki[i].idx = i;
+	}
+	qsort(ki, dic->count, sizeof(keyidx_t), compare_keyidx);
+
+	size_t n = 1;
+	for (size_t i = 1; i < dic->count; i++) {
+		if (ki[i].key != ki[n - 1].key)
+			ki[n++] = ki[i];
+	}
+	qsort(ki, n, sizeof(keyidx_t), compare_idx);
+
+	for (size_t i = 0; i < n; i++)
+		dic->keys[i] = ki[i].key;
+	dic->count = n;
+
+	free(ki);
+}
+
+// Bitsliced pre-check of a nested authentication: copies the keys of dic which decrypt the tag nonce
+// to one matching ar_enc and at_enc to out (in dictionary order). Parity and the data following the
+// authentication still need to be checked. Returns the number of candidates or -1 on error.
+int mfKeyDicFilterAuth(mfkeydic_t *dic, uint32_t uid, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc, uint32_t at_enc, mfkeydic_t *out) {
+	if (dic->count == 0)
+		return 0;
+
+	int res = -1;
+	uint32_t *nt = malloc(dic->count * sizeof(uint32_t));
+	uint32_t *expect = malloc(dic->count * sizeof(uint32_t));
+	uint64_t *alive = crypto1_bs_alive_create(dic->count);
+	crypto1_bs_t *bs = crypto1_bs_create(dic->keys, dic->count);
+	if (nt == NULL || expect == NULL || alive == NULL || bs == NULL)
+		goto out;
+
+	uint32_t in = uid ^ nt_enc;
+	crypto1_bs_word(bs, &in, true, 1, nt);
+	crypto1_bs_word(bs, &nr_enc, true, 1, NULL);
+
+	for (size_t i = 0; i < dic->count; i++) {
+		nt[i] ^= nt_enc;
+		expect[i] = prng_successor(nt[i], 64) ^ ar_enc;
+	}
+	if (crypto1_bs_word_cmp(bs, NULL, false, 0, expect, false, alive)) {
+		for (size_t i = 0; i < dic->count; i++)
+			expect[i] = prng_successor(nt[i], 96) ^ at_enc;
+		crypto1_bs_word_cmp(bs, NULL, false, 0, expect, false, alive);
+	}
+
+	res = 0;
+	for (size_t i = 0; i < dic->count; i++) {
+		if (crypto1_bs_alive(alive, i)) {
+			if (mfKeyDicAdd(out, dic->keys[i])) {
+				res = -1;
+				break;
+			}
+			res++;
+		}
+	}
+out:
+	crypto1_bs_destroy(bs);
+	free(alive);
+	free(expect);
+	free(nt);
+	return res;
+}
+
+typedef struct {
+	mfkeydic_t *dic;
+	mfkeycheck_t check;
+	void *data;
+	size_t next_block;
+	size_t found_idx;
+	pthread_mutex_t lock;
+} keysearch_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+keysearch_thread(void *arg) {
+	keysearch_t *ks = arg;
+
+	while (true) {
+		pthread_mutex_lock(&ks->lock);
+		size_t start = ks->next_block;
+		ks->next_block += KEYSEARCH_BLOCK_SIZE;
+		size_t found_idx = ks->found_idx;
+		pthread_mutex_unlock(&ks->lock);
+
+		// blocks are handed out in order, nothing earlier than found_idx is left
+		if (start >= ks->dic->count || start > found_idx)
+			break;
+
+		size_t end = MIN(start + KEYSEARCH_BLOCK_SIZE, ks->dic->count);
+		for (size_t i = start; i < end; i++) {
+			if (ks->check(ks->dic->keys[i], ks->data)) {
+				pthread_mutex_lock(&ks->lock);
+				if (i < ks->found_idx)
+					ks->found_idx = i;
+				pthread_mutex_unlock(&ks->lock);
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+// test all keys of dic, returns the first matching key (in dictionary order)
+bool mfKeySearch(mfkeydic_t *dic, mfkeycheck_t check, void *data, uint64_t *key) {
+	if (dic->count < KEYSEARCH_MIN_KEYS || NUM_KEYSEARCH_THREADS < 2) {
+		for (size_t i = 0; i < dic->count; i++) {
+			if (check(dic->keys[i], data)) {
+				*key = dic->keys[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	keysearch_t ks;
+	ks.dic = dic;
+	ks.check = check;
+	ks.data = data;
+	ks.next_block = 0;
+	ks.found_idx = SIZE_MAX;
+	pthread_mutex_init(&ks.lock, NULL);
+
+	int num_threads = NUM_KEYSEARCH_THREADS;
+	pthread_t thread_id[num_threads];
+	for (int i = 0; i < num_threads; i++)
+		pthread_create(&thread_id[i], NULL, keysearch_thread, &ks);
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(thread_id[i], NULL);
+
+	pthread_mutex_destroy(&ks.lock);
+
+	if (ks.found_idx == SIZE_MAX)
+		return false;
+
+	*key = dic->keys[ks.found_idx];
+	return true;
+}
@@ -0,0 +1,37 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Mifare Classic key dictionaries and multithreaded host side key search
+//-----------------------------------------------------------------------------
+
+#ifndef MFKEYSEARCH_H__
+#define MFKEYSEARCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MF_DEFAULT_KEYS_DIC		"default_keys.dic"
+
+typedef struct {
+	uint64_t *keys;
+	size_t count;
+	size_t allocated;
+} mfkeydic_t;
+
+// candidate test. Called concurrently from several threads, must not touch global state.
+typedef bool (*mfkeycheck_t)(uint64_t key, void *data);
+
+extern void mfKeyDicInit(mfkeydic_t *dic);
+extern void mfKeyDicFree(mfkeydic_t *dic);
+extern int mfKeyDicAdd(mfkeydic_t *dic, uint64_t key);
+extern int mfKeyDicAddDefaults(mfkeydic_t *dic);
+extern int mfKeyDicLoadFile(mfkeydic_t *dic, const char *filename);
+extern void mfKeyDicUnique(mfkeydic_t *dic);
+
+extern int mfKeyDicFilterAuth(mfkeydic_t *dic, uint32_t uid, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc, uint32_t at_enc, mfkeydic_t *out);
+extern bool mfKeySearch(mfkeydic_t *dic, mfkeycheck_t check, void *data, uint64_t *key);
+
+#endif
@@ -0,0 +1,677 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Mifare Classic key recovery from many saved traces at once
+//
+// Pass 1 collects every complete first (plain) authentication from all traces,
+// removes duplicates and recovers the keys with lfsr_recovery64(), spread over
+// all CPUs. Pass 2 walks each trace again, follows the encrypted sessions
+// and solves the nested authentications (known keys of the same card,
+// dictionary, weak PRNG nonce distance) while writing a decrypted transcript.
+//-----------------------------------------------------------------------------
+
+#include "mftracekeys.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+#include "protocols.h"
+#include "iso14443crc.h"
+#include "crapto1/crapto1.h"
+#include "mifarehost.h"
+#include "mifare4.h"
+#include "cmdhflist.h"
+#include "tracefile.h"
+#include "filelist.h"
+
+#define NUM_TRACEKEYS_THREADS	(num_CPUs())
+#define MAX_DECRYPT_LEN			64
+#define MAX_NESTED_CHECK_LEN	32			// NestedCheckKey() limit
+#define NESTED_NONCE_DISTANCE	16383
+#define TRACE_KEYS_FILE			"mfkeys.txt"
+
+typedef struct {
+	TAuthData ad;
+	uint64_t key;
+	bool solved;
+} firstauth_t;
+
+typedef struct {
+	firstauth_t *auths;
+	size_t count;
+	size_t allocated;
+} authlist_t;
+
+typedef struct {
+	filelist_t *files;
+	authlist_t *auths;
+	mftracekeys_t *keys;
+	mfkeydic_t *dic;
+	const char *outdir;
+	bool *samename;			// files[i] shares its name with another trace file
+	bool decrypt;
+	size_t nested_solved;
+	size_t nested_failed;
+} walkctx_t;
+
+static pthread_mutex_t tracekeys_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+// helpers
+
+typedef void (*parallel_fn)(size_t idx, void *data);
+
+typedef struct {
+	size_t count;
+	size_t next;
+	parallel_fn fn;
+	void *data;
+	pthread_mutex_t lock;
+} parallel_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+parallel_thread(void *arg) {
+	parallel_t *p = arg;
+
+	while (true) {
+		pthread_mutex_lock(&p->lock);
+		size_t idx = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		if (idx >= p->count)
+			break;
+		p->fn(idx, p->data);
+	}
+	return NULL;
+}
+
+// calls fn(0..count-1) from all CPUs
+static void run_parallel(size_t count, parallel_fn fn, void *data) {
+	parallel_t p = {count, 0, fn, data};
+	pthread_mutex_init(&p.lock, NULL);
+
+	int num_threads = MIN(NUM_TRACEKEYS_THREADS, (int)count);
+	if (num_threads < 1)
+		num_threads = 1;
+	pthread_t thread_id[num_threads];
+	for (int i = 0; i < num_threads; i++)
+		pthread_create(&thread_id[i], NULL, parallel_thread, &p);
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(thread_id[i], NULL);
+
+	pthread_mutex_destroy(&p.lock);
+}
+
+static void sprint_hex_r(char *buf, size_t size, const uint8_t *data, size_t len) {
+	buf[0] = 0;
+	for (size_t i = 0; i < len && 3 * i + 3 < size; i++)
+		sprintf(buf + 3 * i, "%02x ", data[i]);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//-----------------------------------------------------------------------------
+// file list
+
+static bool is_trace_file(const char *path, const char *name) {
+	size_t len = strlen(name);
+	return len > 4 && strcmp(name + len - 4, ".trc") == 0;
+}
+
+//-----------------------------------------------------------------------------
+// key table
+
+static void keys_add(mftracekeys_t *kt, uint32_t uid, uint8_t block, uint8_t keytype, uint64_t key) {
+	uint8_t sector = mfSectorNum(block);
+
+	pthread_mutex_lock(&tracekeys_lock);
+	for (size_t i = 0; i < kt->count; i++) {
+		if (kt->keys[i].uid == uid && kt->keys[i].sector == sector && kt->keys[i].keytype == keytype) {
+			pthread_mutex_unlock(&tracekeys_lock);
+			return;
+		}
+	}
+	if (kt->count == kt->allocated) {
+		size_t allocated = kt->allocated ? kt->allocated * 2 : 64;
+		mftracekey_t *p = realloc(kt->keys, allocated * sizeof(mftracekey_t));
+		if (p == NULL) {
+			pthread_mutex_unlock(&tracekeys_lock);
+			return;
+		}
+		kt->keys = p;
+		kt->allocated = allocated;
+	}
+	kt->keys[kt->count].uid = uid;
+	kt->keys[kt->count].sector = sector;
+	kt->keys[kt->count].keytype = keytype;
+	kt->keys[kt->count].key = key;
+	kt->count++;
+	pthread_mutex_unlock(&tracekeys_lock);
+}
+
+// all keys known for this card, the one for this sector/key type first
+static size_t keys_for_uid(mftracekeys_t *kt, uint32_t uid, uint8_t block, uint8_t keytype, uint64_t **keys) {
+	uint8_t sector = mfSectorNum(block);
+	size_t n = 0;
+
+	pthread_mutex_lock(&tracekeys_lock);
+	*keys = malloc((kt->count + 1) * sizeof(uint64_t));
+	if (*keys != NULL) {
+		for (size_t i = 0; i < kt->count; i++) {
+			if (kt->keys[i].uid != uid)
+				continue;
+			if (kt->keys[i].sector == sector && kt->keys[i].keytype == keytype && n > 0) {
+				(*keys)[n++] = (*keys)[0];
+				(*keys)[0] = kt->keys[i].key;
+			} else {
+				(*keys)[n++] = kt->keys[i].key;
+			}
+		}
+	}
+	pthread_mutex_unlock(&tracekeys_lock);
+
+	return n;
+}
+
+static int compare_tracekeys(const void *a, const void *b) {
+	const mftracekey_t *ka = a;
+	const mftracekey_t *kb = b;
+
+	if (ka->uid != kb->uid)
+		return ka->uid < kb->uid ? -1 : 1;
+	if (ka->sector != kb->sector)
+		return ka->sector - kb->sector;
+	return ka->keytype - kb->keytype;
+}
+
+void mfTraceKeysFree(mftracekeys_t *keys) {
+	free(keys->keys);
+	memset(keys, 0, sizeof(mftracekeys_t));
+}
+
+//-----------------------------------------------------------------------------
+// first authentications
+
+static int compare_auths(const void *a, const void *b) {
+	const TAuthData *aa = &((const firstauth_t *)a)->ad;
+	const TAuthData *ab = &((const firstauth_t *)b)->ad;
+
+	uint32_t va[] = {aa->uid, aa->nt, aa->nr_enc, aa->ar_enc, aa->at_enc};
+	uint32_t vb[] = {ab->uid, ab->nt, ab->nr_enc, ab->ar_enc, ab->at_enc};
+	for (int i = 0; i < 5; i++) {
+		if (va[i] != vb[i])
+			return va[i] < vb[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static void auths_add(authlist_t *al, TAuthData *ad) {
+	pthread_mutex_lock(&tracekeys_lock);
+	if (al->count == al->allocated) {
+		size_t allocated = al->allocated ? al->allocated * 2 : 64;
+		firstauth_t *p = realloc(al->auths, allocated * sizeof(firstauth_t));
+		if (p == NULL) {
+			pthread_mutex_unlock(&tracekeys_lock);
+			return;
+		}
+		al->auths = p;
+		al->allocated = allocated;
+	}
+	memset(&al->auths[al->count], 0, sizeof(firstauth_t));
+	al->auths[al->count].ad = *ad;
+	al->count++;
+	pthread_mutex_unlock(&tracekeys_lock);
+}
+
+static void auths_unique(authlist_t *al) {
+	if (al->count < 2)
+		return;
+
+	qsort(al->auths, al->count, sizeof(firstauth_t), compare_auths);
+	size_t n = 1;
+	for (size_t i = 1; i < al->count; i++) {
+		if (compare_auths(&al->auths[i], &al->auths[n - 1]) != 0)
+			al->auths[n++] = al->auths[i];
+	}
+	al->count = n;
+}
+
+static void solve_first_auth(size_t idx, void *data) {
+	firstauth_t *fa = &((authlist_t *)data)->auths[idx];
+
+	fa->ad.ks2 = fa->ad.ar_enc ^ prng_successor(fa->ad.nt, 64);
+	fa->ad.ks3 = fa->ad.at_enc ^ prng_successor(fa->ad.nt, 96);
+	fa->key = GetCrypto1ProbableKey(&fa->ad);
+
+	// verify, the reader response must match the recovered key
+	struct Crypto1State cs;
+	crypto1_init(&cs, fa->key);
+	crypto1_word(&cs, fa->ad.uid ^ fa->ad.nt, 0);
+	crypto1_word(&cs, fa->ad.nr_enc, 1);
+	fa->solved = (crypto1_word(&cs, 0, 0) ^ fa->ad.ar_enc) == prng_successor(fa->ad.nt, 64);
+}
+
+//-----------------------------------------------------------------------------
+// trace walker
+
+typedef enum {
+	wsNone,
+	wsNt,
+	wsNrAr,
+	wsAt,
+	wsFirstData,
+	wsData,
+} walkstate_t;
+
+static void start_auth(TAuthData *ad, uint8_t *cmd, bool first) {
+	ad->block = cmd[1];
+	ad->keytype = cmd[0] == MIFARE_AUTH_KEYB;
+	ad->first_auth = first;
+}
+
+// crypto state after a complete authentication with key
+static void session_state(struct Crypto1State *cs, TAuthData *ad, uint64_t key) {
+	crypto1_init(cs, key);
+	if (ad->first_auth)
+		crypto1_word(cs, ad->uid ^ ad->nt, 0);
+	else
+		crypto1_word(cs, ad->nt_enc ^ ad->uid, 1);
+	crypto1_word(cs, ad->nr_enc, 1);
+	crypto1_word(cs, 0, 0);
+	crypto1_word(cs, 0, 0);
+}
+
+static bool nested_distance_key(TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, uint64_t *key) {
+	uint8_t buf[MAX_DECRYPT_LEN];
+
+	if (!validate_prng_nonce(ad->nt))
+		return false;
+
+	uint32_t ntx = prng_successor(ad->nt, 90);
+	for (int i = 0; i < NESTED_NONCE_DISTANCE; i++) {
+		ntx = prng_successor(ntx, 1);
+		if (!NTParityChk(ad, ntx))
+			continue;
+
+		uint32_t ks2 = ad->ar_enc ^ prng_successor(ntx, 64);
+		uint32_t ks3 = ad->at_enc ^ prng_successor(ntx, 96);
+		struct Crypto1State *pcs = lfsr_recovery64(ks2, ks3);
+		memcpy(buf, cmd, cmdsize);
+		mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
+		crypto1_destroy(pcs);
+		if (CheckCrypto1Parity(cmd, cmdsize, buf, parity) && CheckCrc14443(CRC_14443_A, buf, cmdsize)) {
+			ad->nt = ntx;
+			ad->ks2 = ks2;
+			ad->ks3 = ks3;
+			*key = GetCrypto1ProbableKey(ad);
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool session_key(walkctx_t *ctx, TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, uint64_t *key) {
+	if (ad->first_auth) {
+		firstauth_t fa;
+		fa.ad = *ad;
+		firstauth_t *found = bsearch(&fa, ctx->auths->auths, ctx->auths->count, sizeof(firstauth_t), compare_auths);
+		if (found == NULL || !found->solved)
+			return false;
+		*key = found->key;
+		ad->nt = found->ad.nt;
+		return true;
+	}
+
+	if (cmdsize > MAX_NESTED_CHECK_LEN)
+		return false;
+
+	// keys of the same card
+	uint64_t *keys = NULL;
+	size_t n = keys_for_uid(ctx->keys, ad->uid, ad->block, ad->keytype, &keys);
+	for (size_t i = 0; i < n; i++) {
+		if (NestedCheckKey(keys[i], ad, cmd, cmdsize, parity)) {
+			*key = keys[i];
+			free(keys);
+			return true;
+		}
+	}
+	free(keys);
+
+	// dictionary, bitsliced pre-check of ar/at
+	if (ctx->dic) {
+		mfkeydic_t candidates;
+		mfKeyDicInit(&candidates);
+		mfkeydic_t *dic = ctx->dic;
+		if (mfKeyDicFilterAuth(ctx->dic, ad->uid, ad->nt_enc, ad->nr_enc, ad->ar_enc, ad->at_enc, &candidates) >= 0)
+			dic = &candidates;
+		for (size_t i = 0; i < dic->count; i++) {
+			if (NestedCheckKey(dic->keys[i], ad, cmd, cmdsize, parity)) {
+				*key = dic->keys[i];
+				mfKeyDicFree(&candidates);
+				return true;
+			}
+		}
+		mfKeyDicFree(&candidates);
+	}
+
+	return nested_distance_key(ad, cmd, cmdsize, parity, key);
+}
+
+static void annotate(char *exp, size_t size, uint8_t *cmd, size_t len) {
+	exp[0] = 0;
+	if (len < 2)
+		return;
+
+	switch (cmd[0]) {
+		case ISO14443A_CMD_READBLOCK:	snprintf(exp, size, "READBLOCK(%d)", cmd[1]); break;
+		case ISO14443A_CMD_WRITEBLOCK:	snprintf(exp, size, "WRITEBLOCK(%d)", cmd[1]); break;
+		case ISO14443A_CMD_HALT:		snprintf(exp, size, "HALT"); break;
+		case MIFARE_CMD_INC:			snprintf(exp, size, "INC(%d)", cmd[1]); break;
+		case MIFARE_CMD_DEC:			snprintf(exp, size, "DEC(%d)", cmd[1]); break;
+		case MIFARE_CMD_RESTORE:		snprintf(exp, size, "RESTORE(%d)", cmd[1]); break;
+		case MIFARE_CMD_TRANSFER:		snprintf(exp, size, "TRANSFER(%d)", cmd[1]); break;
+		case MIFARE_AUTH_KEYA:			snprintf(exp, size, "AUTH-A(%d)", cmd[1]); break;
+		case MIFARE_AUTH_KEYB:			snprintf(exp, size, "AUTH-B(%d)", cmd[1]); break;
+		default: break;
+	}
+}
+
+static void walk_trace(tracebuf_t *tb, walkctx_t *ctx, FILE *transcript) {
+	walkstate_t state = wsNone;
+	TAuthData ad;
+	struct Crypto1State cs;
+	bool have_cs = false;
+	char exp[40];
+	char raw[3 * MAX_DECRYPT_LEN + 1];
+	char dec[3 * MAX_DECRYPT_LEN + 1];
+	uint8_t plain[MAX_DECRYPT_LEN];
+
+	memset(&ad, 0, sizeof(ad));
+	uint32_t first_timestamp = tb->num_records ? TraceRecordTimestamp(tb, 0) : 0;
+
+	for (size_t i = 0; i < tb->num_records; i++) {
+		uint8_t *rec = tb->data + tb->offsets[i];
+		uint16_t data_len = rec[6] | (rec[7] << 8);
+		bool isResponse = data_len & TRACE_RESPONSE_FLAG;
+		data_len &= ~TRACE_RESPONSE_FLAG;
+		uint8_t *frame = rec + TRACE_RECORD_HEADER_LEN;
+		uint8_t *parity = frame + data_len;
+		size_t plain_len = 0;
+
+		exp[0] = 0;
+		dec[0] = 0;
+
+		if (!isResponse && data_len == 1 && (frame[0] == ISO14443A_CMD_REQA || frame[0] == ISO14443A_CMD_WUPA)) {
+			state = wsNone;
+			have_cs = false;
+		}
+
+		switch (state) {
+			case wsNone:
+				if (!isResponse && data_len == 9 && (frame[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT || frame[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT_2) && frame[1] == 0x70) {
+					ad.uid = bytes_to_num(&frame[2], 4);
+					ad.nt = 0;
+					snprintf(exp, sizeof(exp), "SELECT uid:%08x", ad.uid);
+				}
+				if (!isResponse && data_len == 4 && (frame[0] == MIFARE_AUTH_KEYA || frame[0] == MIFARE_AUTH_KEYB) && CheckCrc14443(CRC_14443_A, frame, 4)) {
+					start_auth(&ad, frame, true);
+					annotate(exp, sizeof(exp), frame, data_len);
+					state = wsNt;
+				}
+				break;
+			case wsNt:
+				if (isResponse && data_len == 4) {
+					if (ad.first_auth) {
+						ad.nt = bytes_to_num(frame, 4);
+					} else {
+						ad.nt_enc = bytes_to_num(frame, 4);
+						ad.nt_enc_par = parity[0];
+					}
+					snprintf(exp, sizeof(exp), "AUTH: nt%s", ad.first_auth ? "" : " (enc)");
+					state = wsNrAr;
+				} else {
+					state = wsNone;
+				}
+				break;
+			case wsNrAr:
+				if (!isResponse && data_len == 8) {
+					ad.nr_enc = bytes_to_num(frame, 4);
+					ad.ar_enc = bytes_to_num(&frame[4], 4);
+					ad.ar_enc_par = parity[0] << 4;
+					snprintf(exp, sizeof(exp), "AUTH: nr ar (enc)");
+					state = wsAt;
+				} else {
+					state = wsNone;
+				}
+				break;
+			case wsAt:
+				if (isResponse && data_len == 4) {
+					ad.at_enc = bytes_to_num(frame, 4);
+					ad.at_enc_par = parity[0];
+					snprintf(exp, sizeof(exp), "AUTH: at (enc)");
+					if (ad.first_auth && !ctx->decrypt)
+						auths_add(ctx->auths, &ad);
+					state = wsFirstData;
+				} else {
+					state = wsNone;
+				}
+				break;
+			case wsFirstData: {
+				uint64_t key;
+				have_cs = false;
+				if (ctx->decrypt) {
+					if (session_key(ctx, &ad, frame, data_len, parity, &key)) {
+						keys_add(ctx->keys, ad.uid, ad.block, ad.keytype, key);
+						session_state(&cs, &ad, key);
+						have_cs = true;
+						if (!ad.first_auth)
+							__sync_fetch_and_add(&ctx->nested_solved, 1);
+					} else if (!ad.first_auth) {
+						__sync_fetch_and_add(&ctx->nested_failed, 1);
+					}
+				}
+				state = wsData;
+				break;
+			}
+			case wsData:
+				break;
+		}
+
+		if (state == wsData && have_cs && data_len <= MAX_DECRYPT_LEN) {
+			memcpy(plain, frame, data_len);
+			mf_crypto1_decrypt(&cs, plain, data_len, 0);
+			plain_len = data_len;
+			if (!isResponse) {
+				annotate(exp, sizeof(exp), plain, plain_len);
+				if (plain_len == 4 && (plain[0] == MIFARE_AUTH_KEYA || plain[0] == MIFARE_AUTH_KEYB) && CheckCrc14443(CRC_14443_A, plain, 4)) {
+					start_auth(&ad, plain, false);
+					have_cs = false;
+					state = wsNt;
+				} else if (plain_len == 4 && plain[0] == ISO14443A_CMD_HALT) {
+					have_cs = false;
+					state = wsNone;
+				}
+			}
+		}
+
+		if (transcript) {
+			sprint_hex_r(raw, sizeof(raw), frame, MIN(data_len, MAX_DECRYPT_LEN));
+			if (plain_len)
+				sprint_hex_r(dec, sizeof(dec), plain, plain_len);
+			fprintf(transcript, "%10u | %s | %-48s | %-48s | %s\n",
+				get_u32(rec) - first_timestamp,
+				isResponse ? "Tag" : "Rdr",
+				raw,
+				dec,
+				exp);
+		}
+	}
+}
+
+static const char *trace_basename(const char *filename) {
+	const char *base = filename;
+	for (const char *p = filename; *p; p++) {
+		if (*p == '/' || *p == '\\')
+			base = p + 1;
+	}
+	return base;
+}
+
+static int compare_basenames(const void *a, const void *b) {
+	return strcmp(trace_basename(**(char ***)a), trace_basename(**(char ***)b));
+}
+
+// traces from different directories can have the same name, their transcripts get the file index
+static bool *find_same_names(filelist_t *files) {
+	bool *samename = calloc(files->count, sizeof(bool));
+	char ***sorted = malloc(files->count * sizeof(char **));
+	if (samename == NULL || sorted == NULL) {
+		free(samename);
+		free(sorted);
+		return NULL;
+	}
+	for (int i = 0; i < files->count; i++)
+		sorted[i] = &files->names[i];
+	qsort(sorted, files->count, sizeof(char **), compare_basenames);
+	for (int i = 1; i < files->count; i++) {
+		if (compare_basenames(&sorted[i - 1], &sorted[i]) == 0) {
+			samename[sorted[i - 1] - files->names] = true;
+			samename[sorted[i] - files->names] = true;
+		}
+	}
+	free(sorted);
+	return samename;
+}
+
+static void walk_file(size_t idx, void *data) {
+	walkctx_t *ctx = data;
+	const char *filename = ctx->files->names[idx];
+	tracebuf_t tb;
+	FILE *transcript = NULL;
+
+	if (TraceLoadFile(filename, &tb))
+		return;
+
+	if (ctx->decrypt && ctx->outdir) {
+		const char *base = trace_basename(filename);
+		char path[strlen(ctx->outdir) + strlen(base) + 32];
+		if (ctx->samename[idx])
+			sprintf(path, "%s/%s_%zu.txt", ctx->outdir, base, idx);
+		else
+			sprintf(path, "%s/%s.txt", ctx->outdir, base);
+		transcript = fopen(path, "w");
+		if (transcript == NULL) {
+			PrintAndLog("Could not create file %s", path);
+		} else {
+			fprintf(transcript, "# %s\n", filename);
+			fprintf(transcript, "#    Start | Src | Data                                             | Decrypted                                        | Annotation\n");
+		}
+	}
+
+	walk_trace(&tb, ctx, transcript);
+
+	if (transcript)
+		fclose(transcript);
+	TraceFree(&tb);
+}
+
+//-----------------------------------------------------------------------------
+
+static int write_keys(mftracekeys_t *kt, const char *outdir) {
+	char path[strlen(outdir) + strlen(TRACE_KEYS_FILE) + 2];
+	sprintf(path, "%s/%s", outdir, TRACE_KEYS_FILE);
+
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		PrintAndLog("Could not create file %s", path);
+		return 1;
+	}
+	fprintf(f, "# uid    sector key\n");
+	for (size_t i = 0; i < kt->count; i++)
+		fprintf(f, "%08x %3d %c %012" PRIx64 "\n", kt->keys[i].uid, kt->keys[i].sector, kt->keys[i].keytype ? 'B' : 'A', kt->keys[i].key);
+	fclose(f);
+
+	PrintAndLog("Keys written to %s", path);
+	return 0;
+}
+
+int mfTraceKeysRecover(char **traces, int tracescnt, mfkeydic_t *dic, const char *outdir, mftracekeys_t *result) {
+	filelist_t files = {0};
+	authlist_t auths = {0};
+	walkctx_t ctx = {0};
+
+	memset(result, 0, sizeof(mftracekeys_t));
+
+	int res = filelist_collect(traces, tracescnt, is_trace_file, &files);
+	if (res) {
+		filelist_free(&files);
+		return res;
+	}
+	if (files.count == 0) {
+		PrintAndLog("No trace files found");
+		filelist_free(&files);
+		return 1;
+	}
+
+	uint64_t start_time = msclock();
+	ctx.files = &files;
+	ctx.auths = &auths;
+	ctx.keys = result;
+	ctx.dic = dic;
+	ctx.outdir = outdir;
+
+	// pass 1: first authentications from all traces
+	ctx.decrypt = false;
+	run_parallel(files.count, walk_file, &ctx);
+	size_t total_auths = auths.count;
+	auths_unique(&auths);
+	PrintAndLog("%d trace files, %zu first authentications (%zu unique)", files.count, total_auths, auths.count);
+
+	run_parallel(auths.count, solve_first_auth, &auths);
+	size_t solved = 0;
+	for (size_t i = 0; i < auths.count; i++) {
+		if (auths.auths[i].solved) {
+			keys_add(result, auths.auths[i].ad.uid, auths.auths[i].ad.block, auths.auths[i].ad.keytype, auths.auths[i].key);
+			solved++;
+		}
+	}
+	PrintAndLog("Recovered keys of %zu first authentications", solved);
+
+	// pass 2: follow the sessions, nested authentications and transcripts
+	if (outdir) {
+		ctx.samename = find_same_names(&files);
+		if (ctx.samename == NULL) {
+			PrintAndLog("Cannot allocate memory");
+			free(auths.auths);
+			filelist_free(&files);
+			return 1;
+		}
+	}
+	ctx.decrypt = true;
+	run_parallel(files.count, walk_file, &ctx);
+	free(ctx.samename);
+	PrintAndLog("Nested authentications: %zu solved, %zu failed", ctx.nested_solved, ctx.nested_failed);
+
+	qsort(result->keys, result->count, sizeof(mftracekey_t), compare_tracekeys);
+	PrintAndLog("Time: %" PRIu64 " ms", msclock() - start_time);
+
+	if (outdir)
+		write_keys(result, outdir);
+
+	free(auths.auths);
+	filelist_free(&files);
+	return 0;
+}
@@ -0,0 +1,35 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Mifare Classic key recovery from many saved traces at once
+//-----------------------------------------------------------------------------
+
+#ifndef MFTRACEKEYS_H__
+#define MFTRACEKEYS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mfkeysearch.h"
+
+typedef struct {
+	uint32_t uid;
+	uint8_t sector;
+	uint8_t keytype;	// 0 = key A, 1 = key B
+	uint64_t key;
+} mftracekey_t;
+
+typedef struct {
+	mftracekey_t *keys;
+	size_t count;
+	size_t allocated;
+} mftracekeys_t;
+
+// traces: list of .trc files and/or directories (all *.trc files in them are used).
+// outdir: if not NULL, decrypted transcripts (<trace>.txt, <trace>_<file index>.txt if
+// traces in different directories have the same name) and mfkeys.txt are written there.
+extern int mfTraceKeysRecover(char **traces, int tracescnt, mfkeydic_t *dic, const char *outdir, mftracekeys_t *result);
+extern void mfTraceKeysFree(mftracekeys_t *keys);
+
+#endif
@@ -22,9 +22,12 @@
 #include "ui.h"
 #include "parity.h"
 #include "util.h"
+#include "util_posix.h"
 #include "iso14443crc.h"
+#include "crc16.h"
 
 #include "mifare.h"
+#include "mifare4.h"
 
 // mifare tracer flags used in mfTraceDecode()
 #define TRACE_IDLE		 				0x00
@@ -113,14 +116,142 @@ static uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, u
 }
 
 
+// remove the members of the sorted list2 from the sorted list1. Lists are terminated by -1. Result will be in list1. Number of elements is returned.
+static uint32_t difference(uint64_t *list1, uint64_t *list2, uint32_t count2)
+{
+	uint64_t *p1, *p3;
+	uint32_t i2 = 0;
+	p1 = p3 = list1;
+
+	while (*p1 != -1) {
+		while (i2 < count2 && list2[i2] < *p1) i2++;
+		if (i2 < count2 && list2[i2] == *p1) {
+			p1++;
+		} else {
+			*p3++ = *p1++;
+		}
+	}
+	*p3 = -1;
+	return p3 - list1;
+}
+
+
+typedef struct {
+	uint32_t uid, nt, nr, ar;
+	uint64_t par_list, ks_list;
+	uint64_t *keylist;
+	uint32_t keycount;
+} darkside_round_t;
+
+
+// solves one round while the device already collects the next one
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+darkside_solve_thread(void *arg)
+{
+	darkside_round_t *r = arg;
+
+	r->keycount = nonce2key(r->uid, r->nt, r->nr, r->ar, r->par_list, r->ks_list, &r->keylist);
+	if (r->keycount > 0) {
+		qsort(r->keylist, r->keycount, sizeof(*r->keylist), compare_uint64);
+	}
+	return NULL;
+}
+
+
+static int darkside_collect(UsbCommand *c, darkside_round_t *r)
+{
+	clearCommandBuffer();
+	SendCommand(c);
+
+	//flush queue
+	while (ukbhit()) {
+		int c = getchar(); (void) c;
+	}
+
+	// wait cycle
+	while (true) {
+		printf(".");
+		fflush(stdout);
+		if (ukbhit()) {
+			return -5;
+		}
+
+		UsbCommand resp;
+		if (WaitForResponseTimeout(CMD_ACK, &resp, 1000)) {
+			int16_t isOK = resp.arg[0];
+			if (isOK < 0) {
+				return isOK;
+			}
+			memset(r, 0, sizeof(darkside_round_t));
+			r->uid = (uint32_t)bytes_to_num(resp.d.asBytes +  0, 4);
+			r->nt =  (uint32_t)bytes_to_num(resp.d.asBytes +  4, 4);
+			r->par_list = bytes_to_num(resp.d.asBytes +  8, 8);
+			r->ks_list = bytes_to_num(resp.d.asBytes +  16, 8);
+			r->nr = (uint32_t)bytes_to_num(resp.d.asBytes + 24, 4);
+			r->ar = (uint32_t)bytes_to_num(resp.d.asBytes + 28, 4);
+			break;
+		}
+	}
+
+	if (r->par_list == 0 && c->arg[0] == true) {
+		PrintAndLog("Parity is all zero. Most likely this card sends NACK on every failed authentication.");
+	}
+	c->arg[0] = false;
+
+	return 0;
+}
+
+
+static int darkside_check_keys(uint64_t *keylist, uint32_t keycount, uint64_t **tested, uint32_t *testedcount, uint64_t *key)
+{
+	if (keycount > 1) {
+		PrintAndLog("Found %u possible keys. Trying to authenticate with each of them ...\n", keycount);
+	} else {
+		PrintAndLog("Found a possible key. Trying to authenticate...\n");
+	}
+
+	// remember the keys which failed, a later round may come up with them again
+	uint64_t *p = realloc(*tested, (*testedcount + keycount) * sizeof(uint64_t));
+	if (p != NULL) {
+		memcpy(p + *testedcount, keylist, keycount * sizeof(uint64_t));
+		*tested = p;
+		*testedcount += keycount;
+		qsort(*tested, *testedcount, sizeof(uint64_t), compare_uint64);
+	}
+
+	*key = -1;
+	uint8_t keyBlock[USB_CMD_DATA_SIZE];
+	int max_keys = USB_CMD_DATA_SIZE/6;
+	for (int i = 0; i < keycount; i += max_keys) {
+		int size = keycount - i > max_keys ? max_keys : keycount - i;
+		for (int j = 0; j < size; j++) {
+			num_to_bytes(keylist[i + j], 6, keyBlock+(j*6));
+		}
+		if (!mfCheckKeys(0, 0, false, size, keyBlock, key)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+// Nonce sets are collected by the device and solved by the client in parallel. Key candidates of the
+// "no parity" variant are intersected over all rounds, keys which failed on the card are never tried again.
 int mfDarkside(uint64_t *key)
 {
-	uint32_t uid = 0;
-	uint32_t nt = 0, nr = 0, ar = 0;
-	uint64_t par_list = 0, ks_list = 0;
-	uint64_t *keylist = NULL, *last_keylist = NULL;
-	uint32_t keycount = 0;
-	int16_t isOK = 0;
+	darkside_round_t rounds[2];
+	int cur = 0;
+	uint64_t *candidates = NULL;
+	uint64_t *tested = NULL;
+	uint32_t testedcount = 0;
+	pthread_t solver;
+	int res;
 
 	UsbCommand c = {CMD_READER_MIFARE, {true, 0, 0}};
 
@@ -130,99 +261,66 @@ int mfDarkside(uint64_t *key)
 	printf("Press button on the proxmark3 device to abort both proxmark3 and client.\n");
 	printf("-------------------------------------------------------------------------\n");
 
+	res = darkside_collect(&c, &rounds[cur]);
 
-	while (true) {
-		clearCommandBuffer();
-		SendCommand(&c);
-
-		//flush queue
-		while (ukbhit()) {
-			int c = getchar(); (void) c;
-		}
+	while (res == 0) {
+		darkside_round_t *r = &rounds[cur];
 
-		// wait cycle
-		while (true) {
-			printf(".");
-			fflush(stdout);
-			if (ukbhit()) {
-				return -5;
-				break;
-			}
+		pthread_create(&solver, NULL, darkside_solve_thread, r);
+		res = darkside_collect(&c, &rounds[cur ^ 1]);
+		pthread_join(solver, NULL);
+		cur ^= 1;
 
-			UsbCommand resp;
-			if (WaitForResponseTimeout(CMD_ACK, &resp, 1000)) {
-				isOK  = resp.arg[0];
-				if (isOK < 0) {
-					return isOK;
-				}
-				uid = (uint32_t)bytes_to_num(resp.d.asBytes +  0, 4);
-				nt =  (uint32_t)bytes_to_num(resp.d.asBytes +  4, 4);
-				par_list = bytes_to_num(resp.d.asBytes +  8, 8);
-				ks_list = bytes_to_num(resp.d.asBytes +  16, 8);
-				nr = (uint32_t)bytes_to_num(resp.d.asBytes + 24, 4);
-				ar = (uint32_t)bytes_to_num(resp.d.asBytes + 28, 4);
-				break;
-			}
+		if (res != 0) {
+			free(r->keylist);
+			break;
 		}
 
-		if (par_list == 0 && c.arg[0] == true) {
-			PrintAndLog("Parity is all zero. Most likely this card sends NACK on every failed authentication.");
+		if (r->keycount == 0) {
+			PrintAndLog("Key not found (lfsr_common_prefix list is null). Nt=%08x", r->nt);
+			PrintAndLog("This is expected to happen in 25%% of all cases. Trying again with a different reader nonce...");
+			continue;
 		}
-		c.arg[0] = false;
 
-		keycount = nonce2key(uid, nt, nr, ar, par_list, ks_list, &keylist);
-
-		if (keycount == 0) {
-			PrintAndLog("Key not found (lfsr_common_prefix list is null). Nt=%08x", nt);
-			PrintAndLog("This is expected to happen in 25%% of all cases. Trying again with a different reader nonce...");
+		r->keycount = difference(r->keylist, tested, testedcount);
+		if (r->keycount == 0) {
+			PrintAndLog("All possible keys have been tested before. Trying again...");
+			free(r->keylist);
 			continue;
 		}
 
-		if (par_list == 0) {
-			qsort(keylist, keycount, sizeof(*keylist), compare_uint64);
-			keycount = intersection(last_keylist, keylist);
+		uint64_t *keylist = r->keylist;
+		uint32_t keycount = r->keycount;
+		if (r->par_list == 0) {
+			keycount = intersection(candidates, r->keylist);
 			if (keycount == 0) {
-				free(last_keylist);
-				last_keylist = keylist;
+				free(candidates);
+				candidates = r->keylist;
 				continue;
 			}
+			keylist = candidates;
 		}
 
-		if (keycount > 1) {
-			PrintAndLog("Found %u possible keys. Trying to authenticate with each of them ...\n", keycount);
-		} else {
-			PrintAndLog("Found a possible key. Trying to authenticate...\n");
-		}
-
-		*key = -1;
-		uint8_t keyBlock[USB_CMD_DATA_SIZE];
-		int max_keys = USB_CMD_DATA_SIZE/6;
-		for (int i = 0; i < keycount; i += max_keys) {
-			int size = keycount - i > max_keys ? max_keys : keycount - i;
-			for (int j = 0; j < size; j++) {
-				if (par_list == 0) {
-					num_to_bytes(last_keylist[i*max_keys + j], 6, keyBlock+(j*6));
-				} else {
-					num_to_bytes(keylist[i*max_keys + j], 6, keyBlock+(j*6));
-				}
-			}
-			if (!mfCheckKeys(0, 0, false, size, keyBlock, key)) {
-				break;
-			}
+		if (darkside_check_keys(keylist, keycount, &tested, &testedcount, key) == 0) {
+			free(r->keylist);
+			break;
 		}
 
-		if (*key != -1) {
-			free(last_keylist);
-			free(keylist);
-			break;
+		PrintAndLog("Authentication failed. Trying again...");
+		if (r->par_list == 0) {
+			// next round is intersected with this one
+			free(candidates);
+			candidates = r->keylist;
+			difference(candidates, tested, testedcount);
 		} else {
-			PrintAndLog("Authentication failed. Trying again...");
-			free(last_keylist);
-			last_keylist = keylist;
+			free(r->keylist);
 		}
 	}
 
-	return 0;
+	free(candidates);
+	free(tested);
+
+	return res;
 }
 
 
@@ -270,6 +368,216 @@ int mfCheckKeysSec(uint8_t sectorCnt, uint8_t keyType, uint8_t timeout14a, bool
 	return foundAKey ? 0 : 3;
 }
 
+static int mfCheckKeysDictUpload(uint32_t keycnt, uint8_t *keyBlock) {
+
+	uint32_t max_keys = USB_CMD_DATA_SIZE / 6;
+
+	for (uint32_t i = 0; i < keycnt; i += max_keys) {
+		uint32_t size = MIN(max_keys, keycnt - i);
+		UsbCommand c = {CMD_MIFARE_CHKKEYS_DICT, {i, keycnt, size}};
+		memcpy(c.d.asBytes, keyBlock + 6 * i, 6 * size);
+		clearCommandBuffer();
+		SendCommand(&c);
+
+		UsbCommand resp;
+		if (!WaitForResponseTimeout(CMD_ACK, &resp, 3000)) return 1;
+		if (!resp.arg[0]) return 2;
+	}
+	return 0;
+}
+
+// Check all sectors with the whole dictionary in one command. The dictionary stays
+// on the device and is only uploaded if it isn't there (anymore).
+// Returns 0 = keys found, 1 = timeout of the dictionary upload (firmware without the command),
+// 2 = failed, 3 = no keys found, 4 = dictionary too big, 5 = timeout while checking
+int mfCheckKeysFast(uint8_t sectorCnt, uint8_t keyType, uint8_t timeout14a, bool clear_trace, uint32_t keycnt, uint8_t *keyBlock, sector_t *e_sector) {
+
+	if (e_sector == NULL)
+		return -1;
+	if (keycnt == 0 || keycnt > MF_CHKKEYS_DICT_MAX)
+		return 4;
+
+	static uint32_t dict_keycnt = 0;
+	static uint16_t dict_crc = 0;
+	uint16_t crc = crc16_ccitt(keyBlock, keycnt * 6);
+	bool foundAKey = false;
+
+	// a device without this command doesn't answer the upload
+	if (keycnt != dict_keycnt || crc != dict_crc) {
+		dict_keycnt = 0;
+		if (mfCheckKeysDictUpload(keycnt, keyBlock)) return 1;
+		dict_keycnt = keycnt;
+		dict_crc = crc;
+	}
+
+	// between two reports the whole dictionary is tried on one sector and a found key on
+	// all remaining sectors, 13 ms per failed authentication
+	uint32_t timeout = MAX(3000, 1000 + 13 * (keycnt + 2 * sectorCnt));
+
+	for (int upload = 0; upload < 2; upload++) {
+		UsbCommand c = {CMD_MIFARE_CHKKEYS_FAST, {((sectorCnt & 0xff) | ((keyType & 0xff) << 8)), clear_trace | ((timeout14a & 0xff) << 8), keycnt | (crc << 16)}};
+		clearCommandBuffer();
+		SendCommand(&c);
+
+		UsbCommand resp;
+		bool late = false;
+		while (true) {
+			if (!WaitForResponseTimeoutW(CMD_ACK, &resp, timeout, false)) {
+				// The device may still be checking keys. Its late reports must not be taken
+				// for the answers of the next command, wait once more for them.
+				if (late) {
+					clearCommandBuffer();
+					return 5;
+				}
+				late = true;
+				printf("(waiting)");
+				fflush(stdout);
+				continue;
+			}
+			late = false;
+			if (resp.arg[0] != MF_CHKKEYS_SECTOR) break;
+
+			uint8_t sec = resp.arg[1] & 0xff;
+			uint8_t keyAB = (resp.arg[1] >> 8) & 0x01;
+			if ((resp.arg[1] >> 16) & 0x01 && sec < sectorCnt) {
+				e_sector[sec].foundKey[keyAB] = true;
+				e_sector[sec].Key[keyAB] = bytes_to_num(resp.d.asBytes, 6);
+				foundAKey = true;
+				printf("o");
+			} else {
+				printf(".");
+			}
+			fflush(stdout);
+		}
+
+		switch (resp.arg[0]) {
+			case MF_CHKKEYS_DONE:
+				return foundAKey ? 0 : 3;
+			case MF_CHKKEYS_NO_DICT:
+				if (upload || mfCheckKeysDictUpload(keycnt, keyBlock)) {
+					dict_keycnt = 0;
+					return 2;
+				}
+				break;
+			default:
+				return 2;
+		}
+	}
+	return 2;
+}
+
+bool mfSectorCommandsSupported(void) {
+	return GetDeviceCapabilities() & USB_CMD_CAP_MF_SECTOR;
+}
+
+// Sends all commands and collects the answers in the same order. The next
+// MF_SECTOR_PIPELINE - 1 commands wait on the device while one is executed.
+// Returns 0 = ok, 1 = timeout
+static int mfSectorCommands(UsbCommand *cmds, UsbCommand *resps, size_t count) {
+
+	uint32_t tags[MF_SECTOR_PIPELINE];
+	size_t sent = 0;
+
+	clearCommandBuffer();
+	for (size_t i = 0; i < count; i++) {
+		for ( ; sent < count && sent < i + MF_SECTOR_PIPELINE; sent++) {
+			tags[sent % MF_SECTOR_PIPELINE] = SendCommandTagged(&cmds[sent]);
+		}
+		// the answer may wait for all commands queued in front of it
+		if (!WaitForTaggedResponseTimeout(tags[i % MF_SECTOR_PIPELINE], CMD_ACK, &resps[i], MF_SECTOR_PIPELINE * 1500)) {
+			// don't take the answers of the commands still queued for the next call
+			msleep(MF_SECTOR_PIPELINE * 1500);
+			clearCommandBuffer();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Read the blocks of sectors 0..sectorCnt-1, one command per sector.
+// blocks[]: bit mask of the blocks to read per sector, the blocks read are cleared from it.
+// keyBblocks[]: the blocks to read with key B. data: 16 bytes per block of the card.
+// Returns 0 = all read, 1 = timeout, 2 = blocks left
+int mfReadSectorBlocks(uint8_t sectorCnt, uint8_t keyA[][6], uint8_t keyB[][6], uint16_t *blocks, uint16_t *keyBblocks, uint8_t *data) {
+
+	UsbCommand *cmds = calloc(sectorCnt, sizeof(UsbCommand));
+	UsbCommand *resps = calloc(sectorCnt, sizeof(UsbCommand));
+	uint8_t sectors[40];
+	size_t count = 0;
+
+	if (cmds == NULL || resps == NULL) {
+		free(cmds);
+		free(resps);
+		return 2;
+	}
+
+	for (uint8_t sectorNo = 0; sectorNo < sectorCnt && sectorNo < 40; sectorNo++) {
+		if (blocks[sectorNo] == 0) continue;
+		UsbCommand c = {CMD_MIFARE_READSC_BLOCKS, {sectorNo, blocks[sectorNo], keyBblocks[sectorNo]}};
+		memcpy(c.d.asBytes, keyA[sectorNo], 6);
+		memcpy(c.d.asBytes + 6, keyB[sectorNo], 6);
+		sectors[count] = sectorNo;
+		cmds[count++] = c;
+	}
+
+	int res = mfSectorCommands(cmds, resps, count);
+
+	for (size_t i = 0; res == 0 && i < count; i++) {
+		uint8_t sectorNo = sectors[i];
+		uint16_t blocksOK = resps[i].arg[1] & blocks[sectorNo];
+		for (uint8_t blockNo = 0; blockNo < 16; blockNo++) {
+			if (blocksOK & (1 << blockNo)) {
+				memcpy(data + 16 * (mfFirstBlockOfSector(sectorNo) + blockNo), resps[i].d.asBytes + 16 * blockNo, 16);
+			}
+		}
+		blocks[sectorNo] &= ~blocksOK;
+		if (blocks[sectorNo]) res = 2;
+	}
+
+	free(cmds);
+	free(resps);
+	return res;
+}
+
+// Write the blocks of sectors 0..sectorCnt-1 with keys[] of keyType, one command per sector.
+// blocks[]: bit mask of the blocks to write per sector, the blocks written are cleared from it.
+// data: 16 bytes per block of the card.
+// Returns 0 = all written, 1 = timeout, 2 = blocks left
+int mfWriteSectorBlocks(uint8_t sectorCnt, uint8_t keys[][6], uint8_t keyType, uint16_t *blocks, uint8_t *data) {
+
+	UsbCommand *cmds = calloc(sectorCnt, sizeof(UsbCommand));
+	UsbCommand *resps = calloc(sectorCnt, sizeof(UsbCommand));
+	uint8_t sectors[40];
+	size_t count = 0;
+
+	if (cmds == NULL || resps == NULL) {
+		free(cmds);
+		free(resps);
+		return 2;
+	}
+
+	for (uint8_t sectorNo = 0; sectorNo < sectorCnt && sectorNo < 40; sectorNo++) {
+		if (blocks[sectorNo] == 0) continue;
+		UsbCommand c = {CMD_MIFARE_WRITESC_BLOCKS, {sectorNo, blocks[sectorNo], keyType}};
+		memcpy(c.d.asBytes, keys[sectorNo], 6);
+		memcpy(c.d.asBytes + 10, data + 16 * mfFirstBlockOfSector(sectorNo), 16 * mfNumBlocksPerSector(sectorNo));
+		sectors[count] = sectorNo;
+		cmds[count++] = c;
+	}
+
+	int res = mfSectorCommands(cmds, resps, count);
+
+	for (size_t i = 0; res == 0 && i < count; i++) {
+		uint8_t sectorNo = sectors[i];
+		blocks[sectorNo] &= ~resps[i].arg[1];
+		if (blocks[sectorNo]) res = 2;
+	}
+
+	free(cmds);
+	free(resps);
+	return res;
+}
+
 // Compare 16 Bits out of cryptostate
 int Compare16Bits(const void * a, const void * b) {
 	if ((*(uint64_t*)b & 0x00ff000000ff0000) == (*(uint64_t*)a & 0x00ff000000ff0000)) return 0;
@@ -21,6 +21,9 @@
 // 5 == 500us
 #define MF_CHKKEYS_DEFTIMEOUT		5
 
+// sector commands queued on the device in mfReadSectorBlocks()/mfWriteSectorBlocks()
+#define MF_SECTOR_PIPELINE			2
+
 // mfCSetBlock work flags
 #define CSETBLOCK_UID 				0x01
 #define CSETBLOCK_WUPC				0x02
@@ -41,6 +44,11 @@ extern int mfDarkside(uint64_t *key);
 extern int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *ResultKeys, bool calibrate);
 extern int mfCheckKeys (uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keycnt, uint8_t *keyBlock, uint64_t *key);
 extern int mfCheckKeysSec(uint8_t sectorCnt, uint8_t keyType, uint8_t timeout14a, bool clear_trace, uint8_t keycnt, uint8_t * keyBlock, sector_t * e_sector);
+extern int mfCheckKeysFast(uint8_t sectorCnt, uint8_t keyType, uint8_t timeout14a, bool clear_trace, uint32_t keycnt, uint8_t *keyBlock, sector_t *e_sector);
+
+extern bool mfSectorCommandsSupported(void);
+extern int mfReadSectorBlocks(uint8_t sectorCnt, uint8_t keyA[][6], uint8_t keyB[][6], uint16_t *blocks, uint16_t *keyBblocks, uint8_t *data);
+extern int mfWriteSectorBlocks(uint8_t sectorCnt, uint8_t keys[][6], uint8_t keyType, uint16_t *blocks, uint8_t *data);
 
 extern int mfEmlGetMem(uint8_t *data, int blockNum, int blocksCount);
 extern int mfEmlSetMem(uint8_t *data, int blockNum, int blocksCount);
@@ -0,0 +1,341 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Server mode, client commands over a local UNIX socket
+//
+// One process owns the connection to the Proxmark and executes the commands
+// of all connected callers. Commands run one after the other in the main
+// thread, exactly as typed at the prompt. Whatever a command prints goes back
+// to the caller who sent it.
+//-----------------------------------------------------------------------------
+
+#define _POSIX_C_SOURCE 200112L		// need fileno(), sockets
+#include "pm3server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ui.h"
+
+#ifdef _WIN32
+
+int pm3server_run(const char *socket_path, bool usb_present)
+{
+	PrintAndLog("Server mode needs UNIX sockets, not available on this platform.");
+	return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "proxmark3.h"
+#include "cmdmain.h"
+#include "cmdhw.h"
+#include "comms.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0				// SIGPIPE is ignored anyway
+#endif
+
+typedef struct {
+	int fd;
+	char buf[PM3SERVER_MAX_LINE];
+	size_t len;
+} pm3server_client_t;
+
+static pm3server_client_t clients[PM3SERVER_MAX_CLIENTS];
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig)
+{
+	stop_requested = 1;
+}
+
+static void client_close(pm3server_client_t *client)
+{
+	close(client->fd);
+	client->fd = -1;
+	client->len = 0;
+}
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// a complete request line in the buffer? Copies it to line and removes it from the buffer.
+static bool client_get_line(pm3server_client_t *client, char *line)
+{
+	char *eol = memchr(client->buf, '\n', client->len);
+	if (eol == NULL)
+		return false;
+
+	size_t linelen = eol - client->buf;
+	memcpy(line, client->buf, linelen);
+	line[linelen] = '\0';
+	if (linelen > 0 && line[linelen - 1] == '\r')
+		line[linelen - 1] = '\0';
+	client->len -= linelen + 1;
+	memmove(client->buf, eol + 1, client->len);
+	return true;
+}
+
+// run one command with stdout and stderr redirected into a temporary file
+static int execute(char *cmd, FILE *out)
+{
+	int ret;
+	fflush(stdout);
+	fflush(stderr);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int saved_stderr = dup(STDERR_FILENO);
+	dup2(fileno(out), STDOUT_FILENO);
+	dup2(fileno(out), STDERR_FILENO);
+
+	if (!strcmp(cmd, "server stop")) {
+		stop_requested = 1;
+		ret = 0;
+	} else {
+		ret = CommandReceived(cmd);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(saved_stdout, STDOUT_FILENO);
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stdout);
+	close(saved_stderr);
+	return ret;
+}
+
+// Returns false if the connection is to be closed
+static bool handle_request(pm3server_client_t *client, char *line)
+{
+	char *id = line;
+	char *cmd = strchr(line, ' ');
+	if (cmd != NULL) {
+		*cmd++ = '\0';
+		while (*cmd == ' ') cmd++;
+	} else {
+		cmd = "";
+	}
+	size_t cmdlen = strlen(cmd);
+	while (cmdlen > 0 && cmd[cmdlen - 1] == ' ')
+		cmd[--cmdlen] = '\0';
+
+	FILE *out = tmpfile();
+	if (out == NULL) {
+		PrintAndLog("server: can't create a temporary file");
+		return false;
+	}
+
+	int ret = 0;
+	if (cmdlen > 0) {
+		printf("[%d] %s%s\n", client->fd, PROXPROMPT, cmd);
+		fflush(stdout);
+		ret = execute(cmd, out);
+	}
+
+	long outlen = ftell(out);
+	rewind(out);
+	char header[PM3SERVER_MAX_LINE + 32];
+	int headerlen = snprintf(header, sizeof(header), "%s %d %ld\n", id, ret, outlen);
+	bool ok = send_all(client->fd, header, headerlen);
+
+	char buf[4096];
+	size_t n;
+	while (ok && (n = fread(buf, 1, sizeof(buf), out)) > 0)
+		ok = send_all(client->fd, buf, n);
+	fclose(out);
+
+	return ok && ret != 99;		// quit/exit ends the connection only
+}
+
+// Removes the socket of a server that is gone. Anything else at the path is left
+// alone: files that aren't sockets and the sockets of running servers.
+static bool remove_stale_socket(const struct sockaddr_un *addr)
+{
+	struct stat st;
+	if (lstat(addr->sun_path, &st) < 0)
+		return errno == ENOENT;
+	if (!S_ISSOCK(st.st_mode)) {
+		PrintAndLog("server: %s exists and isn't a socket", addr->sun_path);
+		return false;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return false;
+	int res = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	int err = errno;
+	close(fd);
+	if (res < 0 && err == ECONNREFUSED)
+		return unlink(addr->sun_path) == 0;
+	PrintAndLog("server: %s is in use", addr->sun_path);
+	return false;
+}
+
+static int open_socket(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		PrintAndLog("server: socket path too long");
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		PrintAndLog("server: socket() failed: %s", strerror(errno));
+		return -1;
+	}
+	if (!remove_stale_socket(&addr)) {
+		close(fd);
+		return -1;
+	}
+	// only the user may drive the reader
+	mode_t old_umask = umask(077);
+	int res = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_umask);
+	if (res < 0 || chmod(socket_path, 0600) < 0 || listen(fd, PM3SERVER_MAX_CLIENTS) < 0) {
+		PrintAndLog("server: can't listen on %s: %s", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int pm3server_run(const char *socket_path, bool usb_present)
+{
+	if (usb_present) {
+		SetOffline(false);
+		// cache Version information now:
+		CmdVersion(NULL);
+	} else {
+		SetOffline(true);
+	}
+
+	int listen_fd = open_socket(socket_path);
+	if (listen_fd < 0)
+		return 1;
+
+	for (int i = 0; i < PM3SERVER_MAX_CLIENTS; i++) {
+		clients[i].fd = -1;
+		clients[i].len = 0;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	PrintAndLog("Listening on %s", socket_path);
+
+	char line[PM3SERVER_MAX_LINE];
+	int next = 0;		// round robin start
+
+	while (!stop_requested) {
+		struct pollfd fds[PM3SERVER_MAX_CLIENTS + 1];
+		int client_of_fds[PM3SERVER_MAX_CLIENTS + 1];
+		int nfds = 0;
+		bool pending = false;
+
+		fds[nfds].fd = listen_fd;
+		fds[nfds].events = POLLIN;
+		nfds++;
+		for (int i = 0; i < PM3SERVER_MAX_CLIENTS; i++) {
+			if (clients[i].fd < 0)
+				continue;
+			if (memchr(clients[i].buf, '\n', clients[i].len) != NULL)
+				pending = true;
+			fds[nfds].fd = clients[i].fd;
+			fds[nfds].events = POLLIN;
+			client_of_fds[nfds] = i;
+			nfds++;
+		}
+
+		// don't wait if there are requests queued already
+		if (poll(fds, nfds, pending ? 0 : -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			PrintAndLog("server: poll() failed: %s", strerror(errno));
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listen_fd, NULL, NULL);
+			if (fd >= 0) {
+				int i;
+				for (i = 0; i < PM3SERVER_MAX_CLIENTS && clients[i].fd >= 0; i++);
+				if (i < PM3SERVER_MAX_CLIENTS) {
+					clients[i].fd = fd;
+					clients[i].len = 0;
+				} else {
+					close(fd);
+				}
+			}
+		}
+
+		for (int j = 1; j < nfds; j++) {
+			pm3server_client_t *client = &clients[client_of_fds[j]];
+			if (!(fds[j].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (client->len == sizeof(client->buf)) {
+				// read on when the queued requests are done
+				if (memchr(client->buf, '\n', client->len) != NULL)
+					continue;
+				// line too long
+				client_close(client);
+				continue;
+			}
+			ssize_t n = recv(client->fd, client->buf + client->len, sizeof(client->buf) - client->len, 0);
+			if (n <= 0) {
+				// requests still in the buffer are dropped, nobody would read the answers
+				client_close(client);
+				continue;
+			}
+			client->len += n;
+		}
+
+		// one request per connection and round
+		for (int k = 0; k < PM3SERVER_MAX_CLIENTS && !stop_requested; k++) {
+			pm3server_client_t *client = &clients[(next + k) % PM3SERVER_MAX_CLIENTS];
+			if (client->fd < 0 || !client_get_line(client, line))
+				continue;
+			if (!handle_request(client, line))
+				client_close(client);
+		}
+		next = (next + 1) % PM3SERVER_MAX_CLIENTS;
+	}
+
+	for (int i = 0; i < PM3SERVER_MAX_CLIENTS; i++) {
+		if (clients[i].fd >= 0)
+			client_close(&clients[i]);
+	}
+	close(listen_fd);
+	unlink(socket_path);
+	PrintAndLog("Server stopped");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,24 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Server mode, client commands over a local UNIX socket
+//-----------------------------------------------------------------------------
+
+#ifndef PM3SERVER_H__
+#define PM3SERVER_H__
+
+#include <stdbool.h>
+
+// Request:  <id> <command>\n
+// Response: <id> <return code> <output length>\n<output>
+// The id is chosen by the caller and must not contain spaces. Requests of one
+// connection are executed in order, the connections take turns.
+#define PM3SERVER_MAX_CLIENTS	32
+#define PM3SERVER_MAX_LINE		1024
+
+// runs until a "server stop" request. Returns 0 on a clean stop.
+int pm3server_run(const char *socket_path, bool usb_present);
+
+#endif
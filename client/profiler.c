@@ -0,0 +1,588 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Opt-in latency profiler of the client
+//-----------------------------------------------------------------------------
+
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include "usb_cmd.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+
+bool g_profiling = false;
+
+// everything below, the answers are stored by the communication thread
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t profile_start_ns;			// origin of the trace events
+static uint64_t profile_on_ns;				// recorded time of the finished on periods
+static uint64_t profile_on_since_ns;		// start of the current on period
+
+// Log-linear buckets like HdrHistogram: exact values below 128, above that 64
+// buckets per power of two, i.e. values are reported within 1/64.
+#define HIST_SUB_BITS		6
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint32_t *counts;			// HIST_BUCKETS, allocated with the first value
+} profile_hist_t;
+
+typedef struct {
+	uint32_t cmd;
+	profile_hist_t round_trip;	// request sent until its first answer is stored
+	profile_hist_t wait;		// time spent in WaitForResponse..() for it
+	profile_hist_t pickup;		// first answer stored until the command takes it
+} profile_request_stats_t;
+
+typedef struct {
+	char *name;					// command path, e.g. "hf mf chk"
+	profile_hist_t wall;
+	profile_hist_t cpu;
+	uint64_t wait_ns;			// waiting for the Proxmark, all runs
+	uint64_t requests;
+} profile_command_stats_t;
+
+static profile_request_stats_t *request_stats = NULL;
+static size_t request_stats_count = 0;
+static profile_command_stats_t *command_stats = NULL;
+static size_t command_stats_count = 0;
+
+typedef struct {
+	uint64_t sent_ns;			// 0 = none
+	uint64_t stored_ns;			// first answer, 0 = none yet
+	uint32_t cmd;
+	uint32_t tag;
+	uint32_t id;				// of the trace events
+	bool taken;
+} profile_pending_t;
+
+// tagged requests by tag, there are never more than CMD_BUFFER_SIZE on the way
+#define PROFILE_PENDING		64
+static profile_pending_t pending[PROFILE_PENDING];
+static profile_pending_t pending_untagged;
+static uint32_t next_request_id = 0;
+
+// CLI commands being executed
+typedef struct {
+	char path[64];
+	char *line;
+	uint64_t start_ns;
+	uint64_t start_cpu_ns;
+	uint64_t wait_ns;
+	uint32_t requests;
+} profile_frame_t;
+
+#define PROFILE_MAX_DEPTH	8
+static profile_frame_t frames[PROFILE_MAX_DEPTH];
+static int frame_depth = 0;		// deeper frames are counted, not recorded
+
+enum {
+	EV_COMMAND,
+	EV_WAIT,
+	EV_REQUEST,
+	EV_ANSWER,
+	EV_RESPONSE
+};
+
+typedef struct {
+	uint8_t type;
+	uint32_t cmd;
+	uint32_t id;				// request, or number of requests of a command
+	uint64_t ts_ns;
+	uint64_t dur_ns;
+	uint64_t cpu_ns;			// EV_COMMAND only
+	uint64_t wait_ns;			// EV_COMMAND only
+	char *line;					// EV_COMMAND only
+} profile_event_t;
+
+#define PROFILE_MAX_EVENTS	(1 << 18)
+static profile_event_t *events = NULL;
+static size_t events_count = 0;
+static size_t events_size = 0;
+static uint64_t events_dropped = 0;
+
+
+static int HistBucket(uint64_t v) {
+	if (v < 2 * HIST_SUB_BUCKETS)
+		return v;
+	int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+	return HIST_SUB_BUCKETS * shift + (v >> shift);
+}
+
+// highest value in the bucket
+static uint64_t HistBucketHigh(int bucket) {
+	if (bucket < 2 * HIST_SUB_BUCKETS)
+		return bucket;
+	int shift = bucket / HIST_SUB_BUCKETS - 1;
+	uint64_t low = (uint64_t)(bucket - HIST_SUB_BUCKETS * shift) << shift;
+	return low + ((uint64_t)1 << shift) - 1;
+}
+
+static void HistAdd(profile_hist_t *h, uint64_t v) {
+	if (!h->counts) {
+		h->counts = calloc(HIST_BUCKETS, sizeof(uint32_t));
+		if (!h->counts)
+			return;
+	}
+	h->counts[HistBucket(v)]++;
+	if (!h->count || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->sum += v;
+}
+
+static void HistFree(profile_hist_t *h) {
+	free(h->counts);
+	memset(h, 0, sizeof(*h));
+}
+
+// value at percentile p of a histogram with values, total gets the number of values up to it
+static uint64_t HistPercentile(const profile_hist_t *h, double p, uint64_t *total) {
+	uint64_t target = ceil(p / 100 * h->count);
+	if (target < 1)
+		target = 1;
+	if (target > h->count)
+		target = h->count;
+
+	uint64_t n = 0;
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		n += h->counts[i];
+		if (n >= target) {
+			if (total)
+				*total = n;
+			uint64_t v = HistBucketHigh(i);
+			return v < h->min ? h->min : v > h->max ? h->max : v;
+		}
+	}
+	if (total)
+		*total = h->count;
+	return h->max;
+}
+
+static profile_request_stats_t *RequestStats(uint32_t cmd) {
+	for (size_t i = 0; i < request_stats_count; i++)
+		if (request_stats[i].cmd == cmd)
+			return &request_stats[i];
+
+	profile_request_stats_t *p = realloc(request_stats, (request_stats_count + 1) * sizeof(*p));
+	if (!p)
+		return NULL;
+	request_stats = p;
+	p = &request_stats[request_stats_count++];
+	memset(p, 0, sizeof(*p));
+	p->cmd = cmd;
+	return p;
+}
+
+static profile_command_stats_t *CommandStats(const char *name) {
+	for (size_t i = 0; i < command_stats_count; i++)
+		if (!strcmp(command_stats[i].name, name))
+			return &command_stats[i];
+
+	profile_command_stats_t *p = realloc(command_stats, (command_stats_count + 1) * sizeof(*p));
+	if (!p)
+		return NULL;
+	command_stats = p;
+	p = &command_stats[command_stats_count];
+	memset(p, 0, sizeof(*p));
+	p->name = strmcopy((char *)name);
+	if (!p->name)
+		return NULL;
+	command_stats_count++;
+	return p;
+}
+
+static profile_event_t *AddEvent(int type, uint32_t cmd, uint32_t id, uint64_t ts_ns, uint64_t dur_ns) {
+	if (events_count == events_size) {
+		size_t size = events_size ? 2 * events_size : 1024;
+		profile_event_t *p = NULL;
+		if (size <= PROFILE_MAX_EVENTS)
+			p = realloc(events, size * sizeof(*p));
+		if (!p) {
+			events_dropped++;
+			return NULL;
+		}
+		events = p;
+		events_size = size;
+	}
+	profile_event_t *ev = &events[events_count++];
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	ev->cmd = cmd;
+	ev->id = id;
+	ev->ts_ns = ts_ns;
+	ev->dur_ns = dur_ns;
+	return ev;
+}
+
+static profile_pending_t *PendingRequest(uint32_t tag) {
+	profile_pending_t *req = tag ? &pending[tag % PROFILE_PENDING] : &pending_untagged;
+	return req->sent_ns && req->tag == tag ? req : NULL;
+}
+
+static void ClearData(void) {
+	for (size_t i = 0; i < request_stats_count; i++) {
+		HistFree(&request_stats[i].round_trip);
+		HistFree(&request_stats[i].wait);
+		HistFree(&request_stats[i].pickup);
+	}
+	free(request_stats);
+	request_stats = NULL;
+	request_stats_count = 0;
+
+	for (size_t i = 0; i < command_stats_count; i++) {
+		free(command_stats[i].name);
+		HistFree(&command_stats[i].wall);
+		HistFree(&command_stats[i].cpu);
+	}
+	free(command_stats);
+	command_stats = NULL;
+	command_stats_count = 0;
+
+	for (size_t i = 0; i < events_count; i++)
+		free(events[i].line);
+	free(events);
+	events = NULL;
+	events_count = events_size = 0;
+	events_dropped = 0;
+
+	memset(pending, 0, sizeof(pending));
+	memset(&pending_untagged, 0, sizeof(pending_untagged));
+	profile_start_ns = nsclock();
+	profile_on_ns = 0;
+	profile_on_since_ns = profile_start_ns;
+}
+
+void ProfilerReset(void) {
+	pthread_mutex_lock(&profile_lock);
+	ClearData();
+	pthread_mutex_unlock(&profile_lock);
+}
+
+// the data is kept when the profiler is switched off and on again
+void ProfilerEnable(bool enable) {
+	pthread_mutex_lock(&profile_lock);
+	uint64_t now = nsclock();
+	if (enable && !profile_start_ns)
+		profile_start_ns = now;
+	if (enable && !g_profiling)
+		profile_on_since_ns = now;
+	if (!enable && g_profiling)
+		profile_on_ns += now - profile_on_since_ns;
+	g_profiling = enable;
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileRequestSent(uint64_t cmd) {
+	uint64_t now = nsclock();
+	uint32_t tag = cmd >> USB_CMD_TAG_SHIFT;
+
+	pthread_mutex_lock(&profile_lock);
+	profile_pending_t *req = tag ? &pending[tag % PROFILE_PENDING] : &pending_untagged;
+	req->sent_ns = now;
+	req->stored_ns = 0;
+	req->cmd = cmd & USB_CMD_CMD_MASK;
+	req->tag = tag;
+	req->id = ++next_request_id;
+	req->taken = false;
+	for (int i = 0; i < frame_depth && i < PROFILE_MAX_DEPTH; i++)
+		frames[i].requests++;
+	AddEvent(EV_REQUEST, req->cmd, req->id, now, 0);
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileResponseStored(uint64_t cmd) {
+	uint64_t now = nsclock();
+
+	pthread_mutex_lock(&profile_lock);
+	AddEvent(EV_RESPONSE, cmd & USB_CMD_CMD_MASK, 0, now, 0);
+	profile_pending_t *req = PendingRequest(cmd >> USB_CMD_TAG_SHIFT);
+	if (req && !req->stored_ns) {
+		req->stored_ns = now;
+		profile_request_stats_t *stats = RequestStats(req->cmd);
+		if (stats)
+			HistAdd(&stats->round_trip, now - req->sent_ns);
+		AddEvent(EV_ANSWER, req->cmd, req->id, now, 0);
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileResponseTaken(uint64_t cmd) {
+	uint64_t now = nsclock();
+
+	pthread_mutex_lock(&profile_lock);
+	profile_pending_t *req = PendingRequest(cmd >> USB_CMD_TAG_SHIFT);
+	if (req && req->stored_ns && !req->taken) {
+		req->taken = true;
+		profile_request_stats_t *stats = RequestStats(req->cmd);
+		if (stats)
+			HistAdd(&stats->pickup, now - req->stored_ns);
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileWaitDone(int64_t tag, uint64_t start_ns) {
+	uint64_t now = nsclock();
+
+	pthread_mutex_lock(&profile_lock);
+	profile_pending_t *req = tag >= 0 ? PendingRequest(tag) : NULL;
+	if (req) {
+		profile_request_stats_t *stats = RequestStats(req->cmd);
+		if (stats)
+			HistAdd(&stats->wait, now - start_ns);
+	}
+	for (int i = 0; i < frame_depth && i < PROFILE_MAX_DEPTH; i++)
+		frames[i].wait_ns += now - start_ns;
+	AddEvent(EV_WAIT, req ? req->cmd : 0, req ? req->id : 0, start_ns, now - start_ns);
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileCommandBegin(const char *line) {
+	pthread_mutex_lock(&profile_lock);
+	if (frame_depth < PROFILE_MAX_DEPTH) {
+		profile_frame_t *f = &frames[frame_depth];
+		memset(f, 0, sizeof(*f));
+		f->line = strmcopy((char *)line);
+		f->start_ns = nsclock();
+		f->start_cpu_ns = cpuclock();
+	}
+	frame_depth++;
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileCommandName(const char *name) {
+	pthread_mutex_lock(&profile_lock);
+	if (frame_depth > 0 && frame_depth <= PROFILE_MAX_DEPTH) {
+		char *path = frames[frame_depth - 1].path;
+		size_t len = strlen(path);
+		snprintf(path + len, sizeof(frames[0].path) - len, "%s%s", len ? " " : "", name);
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+void ProfileCommandEnd(void) {
+	if (!frame_depth)
+		return;
+
+	uint64_t now = nsclock();
+	uint64_t cpu = cpuclock();
+
+	pthread_mutex_lock(&profile_lock);
+	frame_depth--;
+	if (frame_depth < PROFILE_MAX_DEPTH && !g_profiling) {
+		// turned off while the command ran ('hw profile --off' itself), nothing is recorded
+		free(frames[frame_depth].line);
+		frames[frame_depth].line = NULL;
+	} else if (frame_depth < PROFILE_MAX_DEPTH) {
+		profile_frame_t *f = &frames[frame_depth];
+		profile_command_stats_t *stats = CommandStats(f->path[0] ? f->path : "(unknown)");
+		if (stats) {
+			HistAdd(&stats->wall, now - f->start_ns);
+			HistAdd(&stats->cpu, cpu - f->start_cpu_ns);
+			stats->wait_ns += f->wait_ns;
+			stats->requests += f->requests;
+		}
+		profile_event_t *ev = AddEvent(EV_COMMAND, 0, f->requests, f->start_ns, now - f->start_ns);
+		if (ev && f->line) {
+			ev->cpu_ns = cpu - f->start_cpu_ns;
+			ev->wait_ns = f->wait_ns;
+			ev->line = f->line;
+		} else {
+			free(f->line);
+		}
+		f->line = NULL;
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+
+// HdrHistogram's outputPercentileDistribution(): 5 steps per halving of the distance to 100%
+static void PrintDistribution(const profile_hist_t *h, double unit) {
+	PrintAndLog("%16s %12s %12s %12s %18s", "", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+	double p = 0;
+	for (int i = 0; i < 200; i++) {
+		uint64_t total;
+		uint64_t v = HistPercentile(h, p, &total);
+		if (total == h->count) {
+			PrintAndLog("%16s %12.3f %12.6f %12" PRIu64, "", v / unit, 1.0, total);
+			break;
+		}
+		PrintAndLog("%16s %12.3f %12.6f %12" PRIu64 " %18.2f", "", v / unit, p / 100, total, 1 / (1 - p / 100));
+		double half_distance = pow(2, floor(log2(100 / (100 - p))) + 1);
+		p += 100 / (half_distance * 5);
+	}
+	PrintAndLog("%16s #[Mean = %.3f, Max = %.3f, Total count = %" PRIu64 "]", "",
+		(double)h->sum / h->count / unit, h->max / unit, h->count);
+}
+
+static void PrintHist(const char *name, const char *what, const profile_hist_t *h, double unit, bool distribution) {
+	if (!h->count)
+		return;
+	PrintAndLog("%-24s %-10s %8" PRIu64 " %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f", name, what, h->count,
+		h->min / unit, HistPercentile(h, 50, NULL) / unit, HistPercentile(h, 90, NULL) / unit,
+		HistPercentile(h, 99, NULL) / unit, HistPercentile(h, 99.9, NULL) / unit, h->max / unit,
+		(double)h->sum / h->count / unit);
+	if (distribution)
+		PrintDistribution(h, unit);
+}
+
+static int CompareRequestStats(const void *a, const void *b) {
+	uint32_t ca = ((const profile_request_stats_t *)a)->cmd;
+	uint32_t cb = ((const profile_request_stats_t *)b)->cmd;
+	return ca < cb ? -1 : ca > cb;
+}
+
+void ProfilerPrint(bool distributions) {
+	pthread_mutex_lock(&profile_lock);
+	const char *columns = "   count        min        p50        p90        p99      p99.9        max       mean";
+
+	// only the time while profiling was on
+	uint64_t recorded_ns = profile_on_ns + (g_profiling ? nsclock() - profile_on_since_ns : 0);
+	PrintAndLog("Profiling is %s, %.3f s recorded", g_profiling ? "on" : "off", recorded_ns / 1e9);
+	PrintAndLog("");
+	PrintAndLog("%-24s %-10s %s", "request (us)", "", columns);
+	qsort(request_stats, request_stats_count, sizeof(*request_stats), CompareRequestStats);
+	for (size_t i = 0; i < request_stats_count; i++) {
+		profile_request_stats_t *s = &request_stats[i];
+		char name[16];
+		snprintf(name, sizeof(name), "0x%04x", s->cmd);
+		PrintHist(name, "round trip", &s->round_trip, 1e3, distributions);
+		PrintHist(name, "wait", &s->wait, 1e3, distributions);
+		PrintHist(name, "pickup", &s->pickup, 1e3, distributions);
+	}
+
+	PrintAndLog("");
+	PrintAndLog("%-24s %-10s %s", "command (ms)", "", columns);
+	for (size_t i = 0; i < command_stats_count; i++) {
+		profile_command_stats_t *s = &command_stats[i];
+		PrintHist(s->name, "wall", &s->wall, 1e6, distributions);
+		PrintHist(s->name, "cpu", &s->cpu, 1e6, distributions);
+		if (s->wall.sum && s->requests)
+			PrintAndLog("%-24s %-10s %.3f ms waiting for the Proxmark (%.1f%% of wall time), %" PRIu64 " requests",
+				s->name, "device", s->wait_ns / 1e6, 100.0 * s->wait_ns / s->wall.sum, s->requests);
+	}
+	if (events_dropped)
+		PrintAndLog("\n%" PRIu64 " trace events dropped, the trace is limited to %d events", events_dropped, PROFILE_MAX_EVENTS);
+	pthread_mutex_unlock(&profile_lock);
+}
+
+
+static void WriteJsonString(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+int ProfilerSaveChromeTrace(const char *name) {
+	FILE *f = fopen(name, "w");
+	if (!f) {
+		PrintAndLog("Can't create %s", name);
+		return 1;
+	}
+
+	pthread_mutex_lock(&profile_lock);
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"proxmark3\"}},\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"commands\"}},\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"USB\"}}");
+	for (size_t i = 0; i < events_count; i++) {
+		const profile_event_t *ev = &events[i];
+		double ts = (int64_t)(ev->ts_ns - profile_start_ns) / 1e3;
+		fprintf(f, ",\n{");
+		switch (ev->type) {
+			case EV_COMMAND:
+				fprintf(f, "\"name\":");
+				WriteJsonString(f, ev->line ? ev->line : "");
+				fprintf(f, ",\"cat\":\"command\",\"ph\":\"X\",\"tid\":1,\"dur\":%.3f,"
+					"\"args\":{\"cpu_ms\":%.3f,\"wait_ms\":%.3f,\"requests\":%u}",
+					ev->dur_ns / 1e3, ev->cpu_ns / 1e6, ev->wait_ns / 1e6, ev->id);
+				break;
+			case EV_WAIT:
+				if (ev->id)
+					fprintf(f, "\"name\":\"wait 0x%04x\",", ev->cmd);
+				else
+					fprintf(f, "\"name\":\"wait\",");
+				fprintf(f, "\"cat\":\"wait\",\"ph\":\"X\",\"tid\":1,\"dur\":%.3f", ev->dur_ns / 1e3);
+				break;
+			case EV_REQUEST:
+			case EV_ANSWER:
+				fprintf(f, "\"name\":\"0x%04x\",\"cat\":\"request\",\"ph\":\"%c\",\"id\":%u,\"tid\":2",
+					ev->cmd, ev->type == EV_REQUEST ? 'b' : 'e', ev->id);
+				break;
+			case EV_RESPONSE:
+				fprintf(f, "\"name\":\"rx 0x%04x\",\"cat\":\"response\",\"ph\":\"i\",\"s\":\"t\",\"tid\":2", ev->cmd);
+				break;
+		}
+		fprintf(f, ",\"pid\":1,\"ts\":%.3f}", ts);
+	}
+	fprintf(f, "\n]}\n");
+	size_t count = events_count;
+	pthread_mutex_unlock(&profile_lock);
+
+	bool failed = ferror(f);
+	if (fclose(f) || failed) {
+		PrintAndLog("Can't write %s", name);
+		return 1;
+	}
+	PrintAndLog("Saved %zu events to %s", count, name);
+	return 0;
+}
+
+
+// checks the histogram buckets and percentiles
+int ProfilerSelftest(void) {
+	int errors = 0;
+
+	for (int shift = 0; shift < 64; shift++) {
+		uint64_t v[3] = {(uint64_t)1 << shift, ((uint64_t)1 << shift) - 1, ((uint64_t)1 << shift) + ((uint64_t)1 << shift >> 1)};
+		for (int i = 0; i < (shift < 63 ? 3 : 2); i++) {
+			int bucket = HistBucket(v[i]);
+			uint64_t high = HistBucketHigh(bucket);
+			if (bucket >= HIST_BUCKETS || high < v[i] || high - v[i] > v[i] / HIST_SUB_BUCKETS || (bucket && HistBucketHigh(bucket - 1) >= v[i])) {
+				PrintAndLog("Bucket %d of %" PRIu64 " wrong", bucket, v[i]);
+				errors++;
+			}
+		}
+	}
+
+	profile_hist_t h = {0};
+	for (uint64_t v = 1; v <= 10000; v++)
+		HistAdd(&h, v);
+	double percentiles[] = {0, 50, 90, 99, 99.9, 100};
+	for (int i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		uint64_t expected = percentiles[i] ? ceil(percentiles[i] * 100) : 1;
+		uint64_t value = HistPercentile(&h, percentiles[i], NULL);
+		if (value < expected || value > expected + expected / HIST_SUB_BUCKETS) {
+			PrintAndLog("Percentile %.1f is %" PRIu64 ", expected %" PRIu64, percentiles[i], value, expected);
+			errors++;
+		}
+	}
+	HistFree(&h);
+
+	PrintAndLog("Profiler histogram selftest %s", errors ? "FAILED" : "passed");
+	return errors ? 1 : 0;
+}
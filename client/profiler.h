@@ -0,0 +1,43 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Opt-in latency profiler of the client (hw profile): request round trips and
+// waits by command ID, wall and CPU time by CLI command
+//-----------------------------------------------------------------------------
+
+#ifndef PROFILER_H__
+#define PROFILER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The hooks must only be called while this is set, except ProfileCommandEnd() of a
+// frame begun while it was set.
+extern bool g_profiling;
+
+extern void ProfilerEnable(bool enable);
+extern void ProfilerReset(void);
+
+// comms.c, cmd includes the request tag
+extern void ProfileRequestSent(uint64_t cmd);
+extern void ProfileResponseStored(uint64_t cmd);
+extern void ProfileResponseTaken(uint64_t cmd);
+// waited since start_ns for the answer to the request with this tag (0 = the last
+// untagged one), -1 if the wait doesn't belong to a request
+extern void ProfileWaitDone(int64_t tag, uint64_t start_ns);
+
+// cmdmain.c and cmdparser.c. Commands may nest (scripts).
+extern void ProfileCommandBegin(const char *line);
+extern void ProfileCommandName(const char *name);
+extern void ProfileCommandEnd(void);
+
+// percentiles of all histograms, with distributions the full HdrHistogram style
+// percentile distributions
+extern void ProfilerPrint(bool distributions);
+// Chrome trace event format, for chrome://tracing or Perfetto
+extern int ProfilerSaveChromeTrace(const char *name);
+extern int ProfilerSelftest(void);
+
+#endif
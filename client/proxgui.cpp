@@ -11,6 +11,7 @@
 #include "proxgui.h"
 #include "proxguiqt.h"
 #include "proxmark3.h"
+#include "graphlod.h"
 
 static ProxGuiQT *gui = NULL;
 static WorkerThread *main_loop_thread = NULL;
@@ -45,6 +46,9 @@ extern "C" void HideGraphWindow(void)
 
 extern "C" void RepaintGraphWindow(void)
 {
+  // callers repaint after changing the samples, the plot rebuilds its level of detail data
+  GraphLodDataChanged();
+
   if (!gui)
     return;
 
@@ -285,6 +285,57 @@ int Plot::valueOf_yCoord(int y, QRect r, int maxVal)
 	int z = (r.bottom() - r.top())/2;
 	return (y-z) * maxVal / z;
 }
+
+// first sample index (up to len) at or right of the right edge
+int Plot::visibleEnd(int len, QRect r)
+{
+	int end = GraphStart + (int)((r.right() - r.left()) / GraphPixelsPerPoint);
+	if (end > len) end = len;
+	if (end < GraphStart) end = GraphStart;
+	while (end > GraphStart && xCoordOf(end - 1, r) >= r.right()) end--;
+	while (end < len && xCoordOf(end, r) < r.right()) end++;
+	return end;
+}
+
+// first sample drawn in pixel column px of the plot (xCoordOf() rounds down)
+int Plot::columnStart(int px)
+{
+	return GraphStart + (int)ceil(px / GraphPixelsPerPoint);
+}
+
+/**
+ * Collects a path with at most three vertices per pixel column: where it enters
+ * the column, the other extreme and where it leaves.
+ */
+class ColumnPath
+{
+	QPainterPath &path;
+	bool open;
+	int cx, cyFirst, cyMin, cyMax, cyLast;
+public:
+	ColumnPath(QPainterPath &p) : path(p), open(false), cx(0), cyFirst(0), cyMin(0), cyMax(0), cyLast(0) {}
+	void add(int x, int y) {
+		if (open && x == cx) {
+			if (y < cyMin) cyMin = y;
+			if (y > cyMax) cyMax = y;
+			cyLast = y;
+			return;
+		}
+		flush();
+		open = true;
+		cx = x;
+		cyFirst = cyMin = cyMax = cyLast = y;
+	}
+	void flush() {
+		if (!open) return;
+		path.lineTo(cx, cyFirst);
+		if (cyMin != cyMax) {
+			path.lineTo(cx, (cyFirst == cyMin) ? cyMax : cyMin);
+			path.lineTo(cx, cyLast);
+		}
+		open = false;
+	}
+};
 static const QColor GREEN = QColor(100,255,100);
 static const QColor RED   = QColor(255,100,100);
 static const QColor BLUE  = QColor(100,100,255);
@@ -300,7 +351,7 @@ QColor Plot::getColor(int graphNum)
 	}
 }
 
-void Plot::setMaxAndStart(int *buffer, int len, QRect plotRect)
+void Plot::setMaxAndStart(int *buffer, int len, QRect plotRect, graph_lod_t *lod)
 {
 	if (len == 0) return;
 	startMax = (len - (int)((plotRect.right() - plotRect.left() - 40) / GraphPixelsPerPoint));
@@ -311,14 +362,9 @@ void Plot::setMaxAndStart(int *buffer, int len, QRect plotRect)
 		GraphStart = startMax;
 	}
 	if (GraphStart > len) return;
-	int vMin = INT_MAX, vMax = INT_MIN, v = 0;
-	int sample_index = GraphStart ;
-	for( ; sample_index < len && xCoordOf(sample_index,plotRect) < plotRect.right() ; sample_index++) {
-
-		v = buffer[sample_index];
-		if(v < vMin) vMin = v;
-		if(v > vMax) vMax = v;
-	}
+	int vMin, vMax;
+	GraphLodUpdate(lod, buffer, len);
+	GraphLodMinMax(lod, GraphStart, visibleEnd(len, plotRect), &vMin, &vMax);
 
 	g_absVMax = 0;
 	if(fabs( (double) vMin) > g_absVMax) g_absVMax = (int)fabs( (double) vMin);
@@ -355,61 +401,105 @@ void Plot::PlotDemod(uint8_t *buffer, size_t len, QRect plotRect, QRect annotati
 	penPath.moveTo(x, y);
 	delta_x = 0;
 	int clk = first_delta_x;
-	for(int i = BitStart; i < (int)len && xCoordOf(delta_x+DemodStart, plotRect) < plotRect.right(); i++) {
-		for (int ii = 0; ii < (clk) && i < (int)len && xCoordOf(DemodStart+delta_x+ii, plotRect) < plotRect.right() ; ii++ ) {
-			x = xCoordOf(DemodStart+delta_x+ii, plotRect);
-			v = buffer[i]*200-100;
+	if (GraphPixelsPerPoint > 10) {
+		for(int i = BitStart; i < (int)len && xCoordOf(delta_x+DemodStart, plotRect) < plotRect.right(); i++) {
+			for (int ii = 0; ii < (clk) && i < (int)len && xCoordOf(DemodStart+delta_x+ii, plotRect) < plotRect.right() ; ii++ ) {
+				x = xCoordOf(DemodStart+delta_x+ii, plotRect);
+				v = buffer[i]*200-100;
 
-			y = yCoordOf( v, plotRect, absVMax);
+				y = yCoordOf( v, plotRect, absVMax);
 
-			penPath.lineTo(x, y);
+				penPath.lineTo(x, y);
 
-			if(GraphPixelsPerPoint > 10) {
 				QRect f(QPoint(x - 3, y - 3),QPoint(x + 3, y + 3));
 				painter->fillRect(f, QColor(100, 255, 100));
+				if (ii == (int)clk/2) {
+					//print label
+					sprintf(str, "%u",buffer[i]);
+					painter->drawText(x-8, y + ((buffer[i] > 0) ? 18 : -6), str);
+				}
 			}
-			if (ii == (int)clk/2) {
+			delta_x += clk;
+			clk = grid_delta_x;
+		}
+	} else {
+		// a bit is a horizontal line, only its ends are needed. Bits narrower than a
+		// pixel collapse into their column, labels are left out once they'd overlap.
+		ColumnPath column(penPath);
+		bool labels = grid_delta_x * GraphPixelsPerPoint >= 10;
+		int last = visibleEnd(INT_MAX, plotRect) - 1;
+		for(int i = BitStart; i < (int)len && DemodStart+delta_x <= last; i++) {
+			int first = DemodStart+delta_x;
+			int end = first + clk - 1;
+			if (end > last) end = last;
+			v = buffer[i]*200-100;
+			y = yCoordOf( v, plotRect, absVMax);
+
+			column.add(xCoordOf(first, plotRect), y);
+			column.add(xCoordOf(end, plotRect), y);
+
+			if (labels && first + clk/2 <= end) {
 				//print label
 				sprintf(str, "%u",buffer[i]);
-				painter->drawText(x-8, y + ((buffer[i] > 0) ? 18 : -6), str);
+				painter->drawText(xCoordOf(first + clk/2, plotRect)-8, y + ((buffer[i] > 0) ? 18 : -6), str);
 			}
+			delta_x += clk;
+			clk = grid_delta_x;
 		}
-		delta_x += clk;
-		clk = grid_delta_x;
+		column.flush();
 	}
 
 	//Graph annotations
 	painter->drawPath(penPath);
 }
 
-void Plot::PlotGraph(int *buffer, int len, QRect plotRect, QRect annotationRect, QPainter *painter, int graphNum)
+void Plot::PlotGraph(int *buffer, int len, QRect plotRect, QRect annotationRect, QPainter *painter, int graphNum, graph_lod_t *lod)
 {
 	if (len == 0) return;
 	//clock_t begin = clock();
 	QPainterPath penPath;
-	int vMin = INT_MAX, vMax = INT_MIN, vMean = 0, v = 0, i = 0;
+	int vMin, vMax, vMean = 0, v = 0;
+	int i = visibleEnd(len, plotRect);
+
+	//catch stats
+	GraphLodUpdate(lod, buffer, len);
+	GraphLodMinMax(lod, GraphStart, i, &vMin, &vMax);
+	if (i > GraphStart)
+		vMean = (int)(GraphLodSum(lod, GraphStart, i) / (i - GraphStart));
+
 	int x = xCoordOf(GraphStart, plotRect);
 	int y = yCoordOf(buffer[GraphStart],plotRect,g_absVMax);
 	penPath.moveTo(x, y);
-	for(i = GraphStart; i < len && xCoordOf(i, plotRect) < plotRect.right(); i++) {
+	if (GraphPixelsPerPoint < 1) {
+		// several samples per pixel column, draw their range as a vertical line. The
+		// last sample of the previous column is included to connect the lines.
+		int first = GraphStart;
+		for (int px = 0; first < i; px++) {
+			int last = columnStart(px + 1);
+			if (last > i) last = i;
+			int cMin, cMax;
+			GraphLodMinMax(lod, (first > GraphStart) ? first - 1 : first, last, &cMin, &cMax);
+			x = plotRect.left() + px;
+			penPath.lineTo(x, yCoordOf(cMax, plotRect, g_absVMax));
+			penPath.lineTo(x, yCoordOf(cMin, plotRect, g_absVMax));
+			first = last;
+		}
+	} else {
+		for(int j = GraphStart; j < i; j++) {
 
-		x = xCoordOf(i, plotRect);
-		v = buffer[i];
+			x = xCoordOf(j, plotRect);
+			v = buffer[j];
 
-		y = yCoordOf( v, plotRect, g_absVMax);
+			y = yCoordOf( v, plotRect, g_absVMax);
 
-		penPath.lineTo(x, y);
+			penPath.lineTo(x, y);
 
-		if(GraphPixelsPerPoint > 10) {
-			QRect f(QPoint(x - 3, y - 3),QPoint(x + 3, y + 3));
-			painter->fillRect(f, QColor(100, 255, 100));
+			if(GraphPixelsPerPoint > 10) {
+				QRect f(QPoint(x - 3, y - 3),QPoint(x + 3, y + 3));
+				painter->fillRect(f, QColor(100, 255, 100));
+			}
 		}
-		//catch stats
-		if(v < vMin) vMin = v;
-		if(v > vMax) vMax = v;
-		vMean += v;
 	}
-	vMean /= (i - GraphStart);
 
 	painter->setPen(getColor(graphNum));
 
@@ -518,7 +608,7 @@ void Plot::paintEvent(QPaintEvent *event)
 	painter.fillRect(plotRect, QColor(0, 0, 0));
 
 	//init graph variables
-	setMaxAndStart(GraphBuffer,GraphTraceLen,plotRect);
+	setMaxAndStart(GraphBuffer,GraphTraceLen,plotRect,&graphLod[0]);
 
 	// center line
 	int zeroHeight = plotRect.top() + (plotRect.bottom() - plotRect.top()) / 2;
@@ -528,14 +618,14 @@ void Plot::paintEvent(QPaintEvent *event)
 	plotGridLines(&painter, plotRect);
 
 	//Start painting graph
-	PlotGraph(GraphBuffer, GraphTraceLen,plotRect,infoRect,&painter,0);
+	PlotGraph(GraphBuffer, GraphTraceLen,plotRect,infoRect,&painter,0,&graphLod[0]);
 	if (showDemod && DemodBufferLen	> 8) {
 		PlotDemod(DemodBuffer, DemodBufferLen,plotRect,infoRect,&painter,2,g_DemodStartIdx);
 	}
 	if (g_useOverlays) {
 		//init graph variables
-		setMaxAndStart(s_Buff,GraphTraceLen,plotRect);
-		PlotGraph(s_Buff, GraphTraceLen,plotRect,infoRect,&painter,1);
+		setMaxAndStart(s_Buff,GraphTraceLen,plotRect,&graphLod[1]);
+		PlotGraph(s_Buff, GraphTraceLen,plotRect,infoRect,&painter,1,&graphLod[1]);
 	}
 	// End graph drawing
 
@@ -585,12 +675,19 @@ Plot::Plot(QWidget *parent) : QWidget(parent), GraphStart(0), GraphPixelsPerPoin
 	setAutoFillBackground(true);
 	CursorAPos = 0;
 	CursorBPos = 0;
+	memset(graphLod, 0, sizeof(graphLod));
 
 	setWindowTitle(tr("Sliders"));
 
 	master = parent;
 }
 
+Plot::~Plot(void)
+{
+	GraphLodFree(&graphLod[0]);
+	GraphLodFree(&graphLod[1]);
+}
+
 void Plot::closeEvent(QCloseEvent *event)
 {
 	event->ignore();
@@ -22,6 +22,7 @@
 #include <QtGui>
 
 #include "ui/ui_overlays.h"
+#include "graphlod.h"
 /**
  * @brief The actual plot, black area were we paint the graph
  */
@@ -33,16 +34,20 @@ private:
 	double GraphPixelsPerPoint;
 	int CursorAPos;
 	int CursorBPos;
-	void PlotGraph(int *buffer, int len, QRect r,QRect r2, QPainter* painter, int graphNum);
+	graph_lod_t graphLod[2];	// GraphBuffer, s_Buff
+	void PlotGraph(int *buffer, int len, QRect r,QRect r2, QPainter* painter, int graphNum, graph_lod_t *lod);
 	void PlotDemod(uint8_t *buffer, size_t len, QRect r,QRect r2, QPainter* painter, int graphNum, int plotOffset);
 	void plotGridLines(QPainter* painter,QRect r);
 	int xCoordOf(int i, QRect r );
 	int yCoordOf(int v, QRect r, int maxVal);
 	int valueOf_yCoord(int y, QRect r, int maxVal);
-	void setMaxAndStart(int *buffer, int len, QRect plotRect);
+	int visibleEnd(int len, QRect r);
+	int columnStart(int px);
+	void setMaxAndStart(int *buffer, int len, QRect plotRect, graph_lod_t *lod);
 	QColor getColor(int graphNum);
 public:
 	Plot(QWidget *parent = 0);
+	~Plot(void);
 
 protected:
 	void paintEvent(QPaintEvent *event);
@@ -28,6 +28,7 @@
 #include "cmdhw.h"
 #include "whereami.h"
 #include "comms.h"
+#include "pm3server.h"
 
 void
 #ifdef __has_attribute
@@ -177,7 +178,7 @@ static void set_my_executable_path(void)
 }
 
 static void show_help(bool showFullHelp, char *command_line){
-	printf("syntax: %s <port> [-h|-help|-m|-f|-flush|-w|-wait|-c|-command|-l|-lua] [cmd_script_file_name] [command][lua_script_name]\n", command_line);
+	printf("syntax: %s <port> [-h|-help|-m|-f|-flush|-w|-wait|-c|-command|-l|-lua|-s|-server] [cmd_script_file_name] [command][lua_script_name][socket]\n", command_line);
 	printf("\texample: %s "SERIAL_PORT_H"\n\n", command_line);
 
 	if (showFullHelp){
@@ -195,6 +196,9 @@ static void show_help(bool showFullHelp, char *command_line){
 		printf("\t%s "SERIAL_PORT_H" -command \"hf mf nested 1 *\"\n\n", command_line);
 		printf("lua: <-l|-lua> Execute lua script.\n");
 		printf("\t%s "SERIAL_PORT_H" -l hf_read\n\n", command_line);
+		printf("server: <-s|-server> Execute the commands of other processes sent to a UNIX socket.\n");
+		printf("\tRequest: <id> <command>\\n, response: <id> <return code> <output length>\\n<output>\n");
+		printf("\t%s "SERIAL_PORT_H" -s /tmp/proxmark3.sock\n\n", command_line);
 	}
 }
 
@@ -207,6 +211,7 @@ int main(int argc, char* argv[]) {
 	bool addLuaExec = false;
 	char *script_cmds_file = NULL;
 	char *script_cmd = NULL;
+	char *server_socket = NULL;
 
 	if (argc < 2) {
 		show_help(true, argv[0]);
@@ -242,10 +247,18 @@ int main(int argc, char* argv[]) {
 			executeCommand = true;
 			addLuaExec = true;
 		}
+
+		if(strcmp(argv[i],"-s") == 0 || strcmp(argv[i],"-server") == 0){
+			if (i + 1 >= argc) {
+				printf("ERROR: server: socket name missing.\n");
+				return 2;
+			}
+			server_socket = argv[++i];
+		}
 	}
 
 	// If the user passed the filename of the 'script' to execute, get it from last parameter
-	if (argc > 2 && argv[argc - 1] && argv[argc - 1][0] != '-') {
+	if (argc > 2 && argv[argc - 1] && argv[argc - 1][0] != '-' && argv[argc - 1] != server_socket) {
 		if (executeCommand){
 			script_cmd = argv[argc - 1];
 			
@@ -286,6 +299,14 @@ int main(int argc, char* argv[]) {
 	// try to open USB connection to Proxmark
 	usb_present = OpenProxmark(argv[1], waitCOMPort, 20, false);
 
+	if (server_socket) {
+		int ret = pm3server_run(server_socket, usb_present);
+		if (usb_present) {
+			CloseProxmark();
+		}
+		exit(ret);
+	}
+
 #ifdef HAVE_GUI
 #ifdef _WIN32
 	InitGraphics(argc, argv, script_cmds_file, script_cmd, usb_present);
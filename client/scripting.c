@@ -11,6 +11,8 @@
 #include "scripting.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
@@ -19,7 +21,13 @@
 #include "usb_cmd.h"
 #include "cmdmain.h"
 #include "util.h"
+#include "util_posix.h"
 #include "mifarehost.h"
+#include "cmddata.h"
+#include "graph.h"
+#include "graphlod.h"
+#include "lfdemod.h"
+#include "crapto1/crapto1.h"
 #include "../common/iso15693tools.h"
 #include "iso14443crc.h"
 #include "../common/crc16.h"
@@ -49,8 +57,14 @@ static int l_SendCommand(lua_State *L){
 	  } d;
 	} PACKED UsbCommand;
 
-	==> A 544 byte buffer will do.
+	==> A 544 byte buffer will do. Or a UsbCommand object, see l_newCommand().
 	**/
+	UsbCommand *c = luaL_testudata(L, 1, "pm3.UsbCommand");
+	if (c) {
+		SendCommand(c);
+		return 0;
+	}
+
 	//Pop cmd
 	size_t size;
 	const char *data = luaL_checklstring(L, 1, &size);
@@ -392,6 +406,807 @@ static int l_sha1(lua_State *L)
 	return 1;
 }
 
+/*
+ Native objects. A UsbCommand lives in a userdata and is passed to SendCommand()
+ as is, buffer views read and write GraphBuffer, DemodBuffer and the command
+ data in place. Indices of views are 0-based, like in the C code.
+*/
+#define LUA_USBCOMMAND	"pm3.UsbCommand"
+#define LUA_VIEW	"pm3.View"
+
+typedef struct {
+	uint8_t *u8;		// one of u8 / i32 is set
+	int *i32;
+	size_t capacity;
+	int *int_len;		// current length, capacity if both are NULL
+	size_t *size_len;
+} lua_view_t;
+
+static size_t view_len(const lua_view_t *v)
+{
+	if (v->int_len) return *v->int_len;
+	if (v->size_len) return *v->size_len;
+	return v->capacity;
+}
+
+// pushes a new view, the value at index owner (if not 0) is kept alive as long as the view
+static lua_view_t *push_view(lua_State *L, int owner)
+{
+	if (owner < 0) owner = lua_gettop(L) + owner + 1;
+	lua_view_t *v = lua_newuserdata(L, sizeof(lua_view_t));
+	memset(v, 0, sizeof(*v));
+	luaL_setmetatable(L, LUA_VIEW);
+	if (owner) {
+		lua_pushvalue(L, owner);
+		lua_setuservalue(L, -2);
+	}
+	return v;
+}
+
+// views with i32 are on GraphBuffer, the plot rebuilds its level of detail data after writes
+static void view_changed(const lua_view_t *v)
+{
+	if (v->i32)
+		GraphLodDataChanged();
+}
+
+static size_t check_index(lua_State *L, const lua_view_t *v, int arg, size_t limit)
+{
+	lua_Number n = luaL_checknumber(L, arg);
+	luaL_argcheck(L, n >= 0 && n < limit && n == (size_t)n, arg, "index out of range");
+	return (size_t)n;
+}
+
+static int l_view_index(lua_State *L)
+{
+	lua_view_t *v = luaL_checkudata(L, 1, LUA_VIEW);
+	if (lua_type(L, 2) != LUA_TNUMBER) {
+		// methods
+		luaL_getmetatable(L, LUA_VIEW);
+		lua_pushvalue(L, 2);
+		lua_rawget(L, -2);
+		return 1;
+	}
+	lua_Number n = lua_tonumber(L, 2);
+	if (n < 0 || n >= view_len(v) || n != (size_t)n) {
+		lua_pushnil(L);
+		return 1;
+	}
+	if (v->u8)
+		lua_pushinteger(L, v->u8[(size_t)n]);
+	else
+		lua_pushinteger(L, v->i32[(size_t)n]);
+	return 1;
+}
+
+static int l_view_newindex(lua_State *L)
+{
+	lua_view_t *v = luaL_checkudata(L, 1, LUA_VIEW);
+	size_t i = check_index(L, v, 2, view_len(v));
+	lua_Integer x = luaL_checkinteger(L, 3);
+	if (v->u8) {
+		luaL_argcheck(L, x >= 0 && x <= 0xff, 3, "byte expected");
+		v->u8[i] = x;
+	} else {
+		v->i32[i] = x;
+	}
+	view_changed(v);
+	return 0;
+}
+
+static int l_view_len(lua_State *L)
+{
+	lua_view_t *v = luaL_checkudata(L, 1, LUA_VIEW);
+	lua_pushinteger(L, view_len(v));
+	return 1;
+}
+
+/**
+ * @brief view:sub([i [, j]]) returns elements i..j (inclusive, default all) as a
+ * byte string. Samples of the graph are clipped to -128..127 (as by getFromGraphBuf).
+ */
+static int l_view_sub(lua_State *L)
+{
+	lua_view_t *v = luaL_checkudata(L, 1, LUA_VIEW);
+	size_t len = view_len(v);
+	lua_Number first = luaL_optnumber(L, 2, 0);
+	lua_Number last = luaL_optnumber(L, 3, (lua_Number)len - 1);
+	if (first < 0) first = 0;
+	if (last > (lua_Number)len - 1) last = (lua_Number)len - 1;
+	if (last < first) {
+		lua_pushliteral(L, "");
+		return 1;
+	}
+	size_t i = first, n = (size_t)last - i + 1;
+	if (v->u8) {
+		lua_pushlstring(L, (const char *)v->u8 + i, n);
+		return 1;
+	}
+	luaL_Buffer b;
+	char *p = luaL_buffinitsize(L, &b, n);
+	for (size_t k = 0; k < n; k++) {
+		int x = v->i32[i + k];
+		p[k] = (char)(x > 127 ? 127 : x < -128 ? -128 : x);
+	}
+	luaL_pushresultsize(&b, n);
+	return 1;
+}
+
+/**
+ * @brief view:set(i, s) copies the bytes of string s to the elements from i on.
+ * Graph samples are set to the signed byte values.
+ */
+static int l_view_set(lua_State *L)
+{
+	lua_view_t *v = luaL_checkudata(L, 1, LUA_VIEW);
+	size_t i = check_index(L, v, 2, v->capacity + 1);
+	size_t n;
+	const char *s = luaL_checklstring(L, 3, &n);
+	luaL_argcheck(L, n <= v->capacity - i, 3, "string too long");
+	if (v->u8)
+		memcpy(v->u8 + i, s, n);
+	else
+		for (size_t k = 0; k < n; k++)
+			v->i32[i + k] = (int8_t)s[k];
+	view_changed(v);
+	return 0;
+}
+
+/**
+ * @brief view:resize(n) sets the length of GraphBuffer or DemodBuffer. New elements are 0.
+ */
+static int l_view_resize(lua_State *L)
+{
+	lua_view_t *v = luaL_checkudata(L, 1, LUA_VIEW);
+	luaL_argcheck(L, v->int_len || v->size_len, 1, "view has a fixed size");
+	size_t n = check_index(L, v, 2, v->capacity + 1);
+	size_t len = view_len(v);
+	if (n > len) {
+		if (v->u8)
+			memset(v->u8 + len, 0, n - len);
+		else
+			memset(v->i32 + len, 0, (n - len) * sizeof(int));
+	}
+	if (v->int_len)
+		*v->int_len = n;
+	else
+		*v->size_len = n;
+	view_changed(v);
+	return 0;
+}
+
+static int l_GraphBuffer(lua_State *L)
+{
+	lua_view_t *v = push_view(L, 0);
+	v->i32 = GraphBuffer;
+	v->capacity = MAX_GRAPH_TRACE_LEN;
+	v->int_len = &GraphTraceLen;
+	return 1;
+}
+
+static int l_DemodBuffer(lua_State *L)
+{
+	lua_view_t *v = push_view(L, 0);
+	v->u8 = DemodBuffer;
+	v->capacity = MAX_DEMOD_BUF_LEN;
+	v->size_len = &DemodBufferLen;
+	return 1;
+}
+
+static uint64_t check_arg64(lua_State *L, int arg)
+{
+	lua_Number n = luaL_checknumber(L, arg);
+	luaL_argcheck(L, n >= 0 && n < 18446744073709551616.0, arg, "unsigned 64 bit value expected");
+	return (uint64_t)n;
+}
+
+// sets the command fields from the table at index t
+static void command_from_table(lua_State *L, UsbCommand *c, int t)
+{
+	static const char *args[] = {"arg1", "arg2", "arg3"};
+	lua_getfield(L, t, "cmd");
+	if (!lua_isnil(L, -1)) c->cmd = (c->cmd & ~USB_CMD_CMD_MASK) | luaL_checkunsigned(L, -1);
+	lua_pop(L, 1);
+	lua_getfield(L, t, "tag");
+	if (!lua_isnil(L, -1)) c->cmd = (c->cmd & USB_CMD_CMD_MASK) | ((uint64_t)luaL_checkunsigned(L, -1) << USB_CMD_TAG_SHIFT);
+	lua_pop(L, 1);
+	for (int i = 0; i < 3; i++) {
+		lua_getfield(L, t, args[i]);
+		if (!lua_isnil(L, -1)) c->arg[i] = check_arg64(L, -1);
+		lua_pop(L, 1);
+	}
+	lua_getfield(L, t, "data");
+	if (!lua_isnil(L, -1)) {
+		size_t n;
+		const char *s = luaL_checklstring(L, -1, &n);
+		luaL_argcheck(L, n <= USB_CMD_DATA_SIZE, t, "data too long");
+		memcpy(c->d.asBytes, s, n);
+	}
+	lua_pop(L, 1);
+}
+
+/**
+ * @brief core.newCommand([t]) returns a new zeroed UsbCommand. t may be a table
+ * {cmd=, tag=, arg1=, arg2=, arg3=, data=<binary string>} or a 544 byte string as built
+ * by Command:getBytes(). cmd and tag are the low and high 32 bits of the command
+ * word, a Lua number can't hold both.
+ */
+static int l_newCommand(lua_State *L)
+{
+	UsbCommand *c = lua_newuserdata(L, sizeof(UsbCommand));
+	memset(c, 0, sizeof(*c));
+	luaL_setmetatable(L, LUA_USBCOMMAND);
+	if (lua_istable(L, 1)) {
+		command_from_table(L, c, 1);
+	} else if (!lua_isnoneornil(L, 1)) {
+		size_t n;
+		const char *s = luaL_checklstring(L, 1, &n);
+		luaL_argcheck(L, n == sizeof(UsbCommand), 1, "544 byte string expected");
+		memcpy(c, s, n);
+	}
+	return 1;
+}
+
+static int l_command_index(lua_State *L)
+{
+	UsbCommand *c = luaL_checkudata(L, 1, LUA_USBCOMMAND);
+	const char *k = luaL_checkstring(L, 2);
+	if (!strcmp(k, "cmd")) {
+		lua_pushunsigned(L, c->cmd & USB_CMD_CMD_MASK);
+	} else if (!strcmp(k, "tag")) {
+		lua_pushunsigned(L, c->cmd >> USB_CMD_TAG_SHIFT);
+	} else if (!strncmp(k, "arg", 3) && k[3] >= '1' && k[3] <= '3' && !k[4]) {
+		lua_pushnumber(L, c->arg[k[3] - '1']);
+	} else if (!strcmp(k, "data")) {
+		lua_view_t *v = push_view(L, 1);
+		v->u8 = c->d.asBytes;
+		v->capacity = USB_CMD_DATA_SIZE;
+	} else if (!strcmp(k, "bytes")) {
+		lua_pushlstring(L, (const char *)c, sizeof(UsbCommand));
+	} else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+static int l_command_newindex(lua_State *L)
+{
+	UsbCommand *c = luaL_checkudata(L, 1, LUA_USBCOMMAND);
+	const char *k = luaL_checkstring(L, 2);
+	if (!strcmp(k, "cmd")) {
+		c->cmd = (c->cmd & ~USB_CMD_CMD_MASK) | luaL_checkunsigned(L, 3);
+	} else if (!strcmp(k, "tag")) {
+		c->cmd = (c->cmd & USB_CMD_CMD_MASK) | ((uint64_t)luaL_checkunsigned(L, 3) << USB_CMD_TAG_SHIFT);
+	} else if (!strncmp(k, "arg", 3) && k[3] >= '1' && k[3] <= '3' && !k[4]) {
+		c->arg[k[3] - '1'] = check_arg64(L, 3);
+	} else if (!strcmp(k, "data")) {
+		size_t n;
+		const char *s = luaL_checklstring(L, 3, &n);
+		luaL_argcheck(L, n <= USB_CMD_DATA_SIZE, 3, "data too long");
+		memset(c->d.asBytes, 0, USB_CMD_DATA_SIZE);
+		memcpy(c->d.asBytes, s, n);
+	} else {
+		return luaL_error(L, "UsbCommand has no field '%s'", k);
+	}
+	return 0;
+}
+
+static int l_command_tostring(lua_State *L)
+{
+	UsbCommand *c = luaL_checkudata(L, 1, LUA_USBCOMMAND);
+	char buf[100];
+	snprintf(buf, sizeof(buf), "UsbCommand 0x%04" PRIx64 " tag %" PRIu64 " (0x%" PRIx64 ", 0x%" PRIx64 ", 0x%" PRIx64 ")",
+		(uint64_t)(c->cmd & USB_CMD_CMD_MASK), c->cmd >> USB_CMD_TAG_SHIFT, c->arg[0], c->arg[1], c->arg[2]);
+	lua_pushstring(L, buf);
+	return 1;
+}
+
+/**
+ * @brief core.WaitForResponse(cmd [, ms_timeout]) like WaitForResponseTimeout, but
+ * returns the response as UsbCommand object. Returns nil on timeout.
+ */
+static int l_WaitForResponse(lua_State *L)
+{
+	uint32_t cmd = luaL_checkunsigned(L, 1);
+	size_t ms_timeout = luaL_optunsigned(L, 2, -1);
+
+	UsbCommand *response = lua_newuserdata(L, sizeof(UsbCommand));
+	luaL_setmetatable(L, LUA_USBCOMMAND);
+	if (!WaitForResponseTimeout(cmd, response, ms_timeout)) {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+/**
+ * @brief core.mfnested(blockNo, keyType, key, trgBlockNo, trgKeyType [, calibrate])
+ * with keys as 6 byte strings. Returns the target key or nil, error code.
+ */
+static int l_mfnested(lua_State *L)
+{
+	uint8_t blockNo = luaL_checkunsigned(L, 1);
+	uint8_t keyType = luaL_checkunsigned(L, 2);
+	size_t keylen;
+	const char *key = luaL_checklstring(L, 3, &keylen);
+	luaL_argcheck(L, keylen == 6, 3, "6 byte key expected");
+	uint8_t trgBlockNo = luaL_checkunsigned(L, 4);
+	uint8_t trgKeyType = luaL_checkunsigned(L, 5);
+	bool calibrate = lua_isnone(L, 6) ? true : lua_toboolean(L, 6);
+
+	uint8_t keycopy[6], result[6 * 4];
+	memcpy(keycopy, key, 6);
+	int res = mfnested(blockNo, keyType, keycopy, trgBlockNo, trgKeyType, result, calibrate);
+	if (res) {
+		lua_pushnil(L);
+		lua_pushinteger(L, res);
+		return 2;
+	}
+	lua_pushlstring(L, (const char *)result, 6);
+	return 1;
+}
+
+/**
+ * @brief core.mfCheckKeys(blockNo, keyType, clear_trace, keys) tests the keys (a
+ * string of 6 byte keys, at most 85) and returns the valid one or nil, error code.
+ */
+static int l_mfCheckKeys(lua_State *L)
+{
+	uint8_t blockNo = luaL_checkunsigned(L, 1);
+	uint8_t keyType = luaL_checkunsigned(L, 2);
+	bool clear_trace = lua_toboolean(L, 3);
+	size_t len;
+	const char *keys = luaL_checklstring(L, 4, &len);
+	luaL_argcheck(L, len > 0 && len % 6 == 0 && len / 6 <= USB_CMD_DATA_SIZE / 6, 4, "1..85 6 byte keys expected");
+
+	uint8_t keyBlock[USB_CMD_DATA_SIZE];
+	uint64_t key;
+	memcpy(keyBlock, keys, len);
+	int res = mfCheckKeys(blockNo, keyType, clear_trace, len / 6, keyBlock, &key);
+	if (res) {
+		lua_pushnil(L);
+		lua_pushinteger(L, res);
+		return 2;
+	}
+	uint8_t dest_key[6];
+	num_to_bytes(key, sizeof(dest_key), dest_key);
+	lua_pushlstring(L, (const char *)dest_key, sizeof(dest_key));
+	return 1;
+}
+
+/**
+ * @brief core.lfsr_recovery32(ks2, in) returns a table with all crypto1 states
+ * (48 bit LFSR values) producing keystream ks2 with input in.
+ */
+static int l_lfsr_recovery32(lua_State *L)
+{
+	uint32_t ks2 = luaL_checkunsigned(L, 1);
+	uint32_t in = luaL_optunsigned(L, 2, 0);
+
+	struct Crypto1State *states = lfsr_recovery32(ks2, in);
+	if (!states)
+		return returnToLuaWithError(L, "Out of memory");
+
+	lua_newtable(L);
+	int i = 0;
+	for (struct Crypto1State *s = states; s->odd || s->even; s++) {
+		uint64_t lfsr;
+		crypto1_get_lfsr(s, &lfsr);
+		lua_pushnumber(L, lfsr);
+		lua_rawseti(L, -2, ++i);
+	}
+	free(states);
+	return 1;
+}
+
+/**
+ * @brief core.lfsr_rollback_word(lfsr, in [, fb]) rolls the state back by 32 bits.
+ * Returns the new 48 bit state and the rolled back keystream word.
+ */
+static int l_lfsr_rollback_word(lua_State *L)
+{
+	uint64_t lfsr = check_arg64(L, 1);
+	uint32_t in = luaL_checkunsigned(L, 2);
+	int fb = lua_toboolean(L, 3);
+
+	struct Crypto1State *s = crypto1_create(lfsr);
+	if (!s)
+		return returnToLuaWithError(L, "Out of memory");
+	uint32_t ks = lfsr_rollback_word(s, in, fb);
+	crypto1_get_lfsr(s, &lfsr);
+	crypto1_destroy(s);
+	lua_pushnumber(L, lfsr);
+	lua_pushunsigned(L, ks);
+	return 2;
+}
+
+static int l_prng_successor(lua_State *L)
+{
+	uint32_t x = luaL_checkunsigned(L, 1);
+	uint32_t n = luaL_checkunsigned(L, 2);
+	lua_pushunsigned(L, prng_successor(x, n));
+	return 1;
+}
+
+/*
+ Raw demodulators, GraphBuffer to DemodBuffer, as 'data rawdemod' but with the
+ parameters and results as numbers. 0 (or nil) parameters are autodetected.
+ Return the number of bits or nil, error message.
+*/
+static uint8_t *demod_samples(lua_State *L, size_t *len)
+{
+	uint8_t *bits = malloc(MAX_GRAPH_TRACE_LEN);
+	if (!bits)
+		luaL_error(L, "Out of memory");	// doesn't return
+	*len = getFromGraphBuf(bits);
+	return bits;
+}
+
+static int demod_result(lua_State *L, uint8_t *bits, size_t len, int errCnt, int maxErr, int clk, int startIdx)
+{
+	if (errCnt < 0 || errCnt > maxErr || len < 16) {
+		free(bits);
+		return returnToLuaWithError(L, "No data found, clk: %d, errors: %d", clk, errCnt);
+	}
+	setDemodBuf(bits, len, 0);
+	setClockGrid(clk, startIdx);
+	free(bits);
+	lua_pushinteger(L, len);
+	return 1;
+}
+
+/**
+ * @brief core.askdemod([clk [, invert [, maxErr [, amp [, askType]]]]]), askType 1 = manchester,
+ * 0 = raw. Returns bits, clk, invert, errors.
+ */
+static int l_askdemod(lua_State *L)
+{
+	int clk = luaL_optinteger(L, 1, 0);
+	int invert = lua_toboolean(L, 2);
+	int maxErr = luaL_optinteger(L, 3, 100);
+	uint8_t amp = lua_toboolean(L, 4);
+	uint8_t askType = luaL_optinteger(L, 5, 1);
+
+	size_t len;
+	uint8_t *bits = demod_samples(L, &len);
+	int startIdx = 0;
+	int errCnt = len ? askdemod_ext(bits, &len, &clk, &invert, maxErr, amp, askType, &startIdx) : -1;
+	if (demod_result(L, bits, len, errCnt, maxErr, clk, startIdx) != 1)
+		return 2;
+	lua_pushinteger(L, clk);
+	lua_pushboolean(L, invert);
+	lua_pushinteger(L, errCnt);
+	return 4;
+}
+
+/**
+ * @brief core.fskdemod([clk [, invert [, fchigh [, fclow]]]]). Returns bits, clk, fchigh, fclow.
+ */
+static int l_fskdemod(lua_State *L)
+{
+	uint8_t rfLen = luaL_optinteger(L, 1, 0);
+	uint8_t invert = lua_toboolean(L, 2);
+	uint8_t fchigh = luaL_optinteger(L, 3, 0);
+	uint8_t fclow = luaL_optinteger(L, 4, 0);
+
+	size_t len;
+	uint8_t *bits = demod_samples(L, &len);
+	int startIdx = 0;
+	int size = -1;
+	if (len) {
+		if (!fchigh || !fclow) {
+			uint16_t fcs = countFC(bits, len, 1);
+			fchigh = fcs ? fcs >> 8 : 10;
+			fclow = fcs ? fcs & 0xff : 8;
+		}
+		if (!rfLen) {
+			int firstClockEdge = 0;
+			rfLen = detectFSKClk(bits, len, fchigh, fclow, &firstClockEdge);
+			if (!rfLen) rfLen = 50;
+		}
+		size = fskdemod(bits, len, rfLen, invert, fchigh, fclow, &startIdx);
+	}
+	if (demod_result(L, bits, size > 0 ? size : 0, size > 0 ? 0 : -1, 0, rfLen, startIdx) != 1)
+		return 2;
+	lua_pushinteger(L, rfLen);
+	lua_pushinteger(L, fchigh);
+	lua_pushinteger(L, fclow);
+	return 4;
+}
+
+/**
+ * @brief core.pskdemod([clk [, invert [, maxErr]]]) demodulates PSK1. Returns bits, clk, invert, errors.
+ */
+static int l_pskdemod(lua_State *L)
+{
+	int clk = luaL_optinteger(L, 1, 0);
+	int invert = lua_toboolean(L, 2);
+	int maxErr = luaL_optinteger(L, 3, 100);
+
+	size_t len;
+	uint8_t *bits = demod_samples(L, &len);
+	int startIdx = 0;
+	int errCnt = len ? pskRawDemod_ext(bits, &len, &clk, &invert, &startIdx) : -1;
+	if (demod_result(L, bits, len, errCnt, maxErr, clk, startIdx) != 1)
+		return 2;
+	lua_pushinteger(L, clk);
+	lua_pushboolean(L, invert);
+	lua_pushinteger(L, errCnt);
+	return 4;
+}
+
+/**
+ * @brief core.nrzdemod([clk [, invert [, maxErr]]]). Returns bits, clk, invert, errors.
+ */
+static int l_nrzdemod(lua_State *L)
+{
+	int clk = luaL_optinteger(L, 1, 0);
+	int invert = lua_toboolean(L, 2);
+	int maxErr = luaL_optinteger(L, 3, 100);
+
+	size_t len;
+	uint8_t *bits = demod_samples(L, &len);
+	int startIdx = 0;
+	int errCnt = len ? nrzRawDemod(bits, &len, &clk, &invert, &startIdx) : -1;
+	if (demod_result(L, bits, len, errCnt, maxErr, clk, startIdx) != 1)
+		return 2;
+	lua_pushinteger(L, clk);
+	lua_pushboolean(L, invert);
+	lua_pushinteger(L, errCnt);
+	return 4;
+}
+
+/*
+ Cooperative tasks. core.spawn() starts a function as coroutine, core.run() resumes
+ the tasks until all have finished. Inside a task core.await() and core.sleep() yield
+ until the answer arrives or the time is up, the other tasks go on meanwhile. Outside
+ of a task they block. Requests sent with core.submit() are tagged, so the answers of
+ several outstanding requests can be told apart (untagged with old firmware: then
+ answers with the same command go to the tasks in the order they await them).
+*/
+typedef enum {
+	TASK_READY,
+	TASK_AWAIT,
+	TASK_SLEEP,
+} lua_task_state_t;
+
+typedef struct {
+	lua_State *co;
+	int ref;			// keeps the coroutine alive
+	int nargs;			// for the first resume
+	lua_task_state_t state;
+	uint32_t tag;
+	uint32_t cmd;
+	uint64_t deadline;
+} lua_task_t;
+
+static lua_task_t *tasks = NULL;
+static size_t task_count = 0;
+static size_t task_space = 0;
+
+static lua_task_t *current_task(lua_State *L)
+{
+	for (size_t i = 0; i < task_count; i++)
+		if (tasks[i].co == L)
+			return &tasks[i];
+	return NULL;
+}
+
+static void tasks_clear(lua_State *L)
+{
+	for (size_t i = 0; i < task_count; i++)
+		luaL_unref(L, LUA_REGISTRYINDEX, tasks[i].ref);
+	task_count = 0;
+}
+
+/**
+ * @brief core.submit(command) sends a UsbCommand object or 544 byte string without waiting.
+ * Returns the request tag for core.poll() / core.await().
+ */
+static int l_submit(lua_State *L)
+{
+	UsbCommand *c = luaL_testudata(L, 1, LUA_USBCOMMAND);
+	if (!c) {
+		size_t size;
+		c = (UsbCommand *)luaL_checklstring(L, 1, &size);
+		luaL_argcheck(L, size == sizeof(UsbCommand), 1, "UsbCommand or 544 byte string expected");
+	}
+	lua_pushunsigned(L, SendCommandTagged(c));
+	return 1;
+}
+
+// like PollTaggedResponse(), but the answer keeps the tag for its tag field
+static bool poll_response(uint32_t tag, uint32_t cmd, UsbCommand *response)
+{
+	if (!PollTaggedResponse(tag, cmd, response))
+		return false;
+	response->cmd |= (uint64_t)tag << USB_CMD_TAG_SHIFT;
+	return true;
+}
+
+/**
+ * @brief core.poll(tag [, cmd]) returns the answer to the request (as UsbCommand object)
+ * if it has arrived, nil otherwise.
+ */
+static int l_poll(lua_State *L)
+{
+	uint32_t tag = luaL_checkunsigned(L, 1);
+	uint32_t cmd = luaL_optunsigned(L, 2, CMD_UNKNOWN);
+
+	UsbCommand *response = lua_newuserdata(L, sizeof(UsbCommand));
+	luaL_setmetatable(L, LUA_USBCOMMAND);
+	if (!poll_response(tag, cmd, response))
+		lua_pushnil(L);
+	return 1;
+}
+
+/**
+ * @brief core.await(tag [, cmd [, ms_timeout]]) waits for the answer to the request.
+ * Returns it as UsbCommand object, nil on timeout.
+ */
+static int l_await(lua_State *L)
+{
+	uint32_t tag = luaL_checkunsigned(L, 1);
+	uint32_t cmd = luaL_optunsigned(L, 2, CMD_UNKNOWN);
+	size_t ms_timeout = luaL_optunsigned(L, 3, -1);
+
+	UsbCommand *response = lua_newuserdata(L, sizeof(UsbCommand));
+	luaL_setmetatable(L, LUA_USBCOMMAND);
+
+	uint64_t start_time = msclock();
+	lua_task_t *t = current_task(L);
+	if (t) {
+		if (poll_response(tag, cmd, response))
+			return 1;
+		t->state = TASK_AWAIT;
+		t->tag = tag;
+		t->cmd = cmd;
+		t->deadline = start_time + ms_timeout;
+		return lua_yield(L, 0);
+	}
+
+	while (true) {
+		uint32_t received = ResponsesReceived();
+		if (poll_response(tag, cmd, response))
+			return 1;
+		uint64_t elapsed = msclock() - start_time;
+		if (elapsed >= ms_timeout)
+			break;
+		WaitForResponses(received, ms_timeout - elapsed);
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+/**
+ * @brief core.sleep(ms)
+ */
+static int l_sleep(lua_State *L)
+{
+	size_t ms = luaL_checkunsigned(L, 1);
+
+	lua_task_t *t = current_task(L);
+	if (t) {
+		t->state = TASK_SLEEP;
+		t->deadline = msclock() + ms;
+		return lua_yield(L, 0);
+	}
+	msleep(ms);
+	return 0;
+}
+
+/**
+ * @brief core.msclock() returns a millisecond clock for measuring durations
+ */
+static int l_msclock(lua_State *L)
+{
+	lua_pushnumber(L, msclock());
+	return 1;
+}
+
+/**
+ * @brief core.spawn(f, ...) adds a task calling f(...). It starts with the next core.run().
+ */
+static int l_spawn(lua_State *L)
+{
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	int n = lua_gettop(L);
+
+	if (task_count == task_space) {
+		size_t space = task_space ? 2 * task_space : 16;
+		lua_task_t *p = realloc(tasks, space * sizeof(lua_task_t));
+		if (!p)
+			return luaL_error(L, "Out of memory");
+		tasks = p;
+		task_space = space;
+	}
+
+	lua_State *co = lua_newthread(L);
+	lua_insert(L, 1);
+	lua_xmove(L, co, n);
+	lua_task_t *t = &tasks[task_count++];
+	t->co = co;
+	t->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	t->nargs = n - 1;
+	t->state = TASK_READY;
+	return 0;
+}
+
+/**
+ * @brief core.run() resumes the tasks until all have finished. An error in a task ends all
+ * tasks and is raised here. A keypress aborts.
+ */
+static int l_run(lua_State *L)
+{
+	if (current_task(L))
+		return luaL_error(L, "core.run() called from a task");
+
+	while (task_count) {
+		if (ukbhit() > 0) {
+			tasks_clear(L);
+			return luaL_error(L, "aborted by keypress");
+		}
+
+		uint32_t received = ResponsesReceived();
+		uint64_t now = msclock();
+		uint64_t wakeup = now + 100;		// check the keyboard now and then
+		bool progress = false;
+
+		for (size_t i = 0; i < task_count; ) {
+			lua_task_t *t = &tasks[i];
+			lua_State *co = t->co;
+			int nargs = 0;
+
+			if (t->state == TASK_AWAIT) {
+				UsbCommand *response = lua_newuserdata(co, sizeof(UsbCommand));
+				luaL_setmetatable(co, LUA_USBCOMMAND);
+				if (!poll_response(t->tag, t->cmd, response)) {
+					lua_pop(co, 1);
+					if (now < t->deadline) {
+						wakeup = MIN(wakeup, t->deadline);
+						i++;
+						continue;
+					}
+					lua_pushnil(co);
+				}
+				nargs = 1;
+			} else if (t->state == TASK_SLEEP) {
+				if (now < t->deadline) {
+					wakeup = MIN(wakeup, t->deadline);
+					i++;
+					continue;
+				}
+			} else {
+				nargs = t->nargs;
+				t->nargs = 0;
+			}
+
+			// a task may spawn tasks and move the array, don't use t after resuming
+			t->state = TASK_READY;
+			progress = true;
+			int status = lua_resume(co, L, nargs);
+			if (status == LUA_YIELD) {
+				lua_settop(co, 0);
+				i++;
+			} else if (status == LUA_OK) {
+				luaL_unref(L, LUA_REGISTRYINDEX, tasks[i].ref);
+				memmove(&tasks[i], &tasks[i + 1], (task_count - i - 1) * sizeof(lua_task_t));
+				task_count--;
+			} else {
+				lua_xmove(co, L, 1);
+				tasks_clear(L);
+				return lua_error(L);
+			}
+		}
+
+		if (!progress) {
+			now = msclock();
+			if (wakeup > now)
+				WaitForResponses(received, wakeup - now);
+		}
+	}
+	return 0;
+}
+
 /**
  * @brief Sets the lua path to include "./lualibs/?.lua", in order for a script to be
  * able to do "require('foobar')" if foobar.lua is within lualibs folder.
@@ -438,9 +1253,55 @@ int set_pm3_libraries(lua_State *L)
 		{"crc16",                       l_crc16},
 		{"crc64",                       l_crc64},
 		{"sha1",                        l_sha1},
+		{"newCommand",                  l_newCommand},
+		{"WaitForResponse",             l_WaitForResponse},
+		{"GraphBuffer",                 l_GraphBuffer},
+		{"DemodBuffer",                 l_DemodBuffer},
+		{"mfnested",                    l_mfnested},
+		{"mfCheckKeys",                 l_mfCheckKeys},
+		{"lfsr_recovery32",             l_lfsr_recovery32},
+		{"lfsr_rollback_word",          l_lfsr_rollback_word},
+		{"prng_successor",              l_prng_successor},
+		{"askdemod",                    l_askdemod},
+		{"fskdemod",                    l_fskdemod},
+		{"pskdemod",                    l_pskdemod},
+		{"nrzdemod",                    l_nrzdemod},
+		{"submit",                      l_submit},
+		{"poll",                        l_poll},
+		{"await",                       l_await},
+		{"sleep",                       l_sleep},
+		{"spawn",                       l_spawn},
+		{"run",                         l_run},
+		{"msclock",                     l_msclock},
 		{NULL, NULL}
 	};
 
+	static const luaL_Reg command_meta[] = {
+		{"__index",                     l_command_index},
+		{"__newindex",                  l_command_newindex},
+		{"__tostring",                  l_command_tostring},
+		{NULL, NULL}
+	};
+
+	static const luaL_Reg view_meta[] = {
+		{"__index",                     l_view_index},
+		{"__newindex",                  l_view_newindex},
+		{"__len",                       l_view_len},
+		{"sub",                         l_view_sub},
+		{"set",                         l_view_set},
+		{"resize",                      l_view_resize},
+		{NULL, NULL}
+	};
+
+	// tasks of the previous script are gone with its lua_State
+	task_count = 0;
+
+	luaL_newmetatable(L, LUA_USBCOMMAND);
+	luaL_setfuncs(L, command_meta, 0);
+	luaL_newmetatable(L, LUA_VIEW);
+	luaL_setfuncs(L, view_meta, 0);
+	lua_pop(L, 2);
+
 	lua_pushglobaltable(L);
 	// Core library is in this table. Contains '
 	//this is 'pm3' table
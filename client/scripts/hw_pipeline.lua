@@ -0,0 +1,70 @@
+local cmds = require('commands')
+local getopt = require('getopt')
+
+example = [[
+	1. script run hw_pipeline
+	2. script run hw_pipeline -n 500 -p 8
+]]
+author = "pm3 devs"
+usage = "script run hw_pipeline [-n <count>] [-p <tasks>]"
+desc = [[
+This script measures the USB round trip with CMD_PING, first one request at a
+time, then with several tasks each keeping a request in flight (core.spawn,
+core.submit, core.await). It is also an example of the asynchronous API.
+
+Arguments:
+	-h             : this help
+	-n <count>     : number of pings per run (default 200)
+	-p <tasks>     : number of parallel tasks (default 4)
+]]
+
+local TIMEOUT = 2000
+
+local function help()
+	print(desc)
+	print("Example usage")
+	print(example)
+end
+
+local function ping()
+	local tag = core.submit(core.newCommand{cmd = cmds.CMD_PING})
+	return core.await(tag, cmds.CMD_ACK, TIMEOUT) ~= nil
+end
+
+-- runs count pings in the given number of tasks, returns the time in ms or nil on timeout
+local function measure(count, tasks)
+	local left, ok = count, true
+	local function worker()
+		while left > 0 and ok do
+			left = left - 1
+			ok = ping()
+		end
+	end
+	local start = core.msclock()
+	for i = 1, tasks do
+		core.spawn(worker)
+	end
+	core.run()
+	if not ok then return nil end
+	return core.msclock() - start
+end
+
+local function main(args)
+	local count, tasks = 200, 4
+	for o, a in getopt.getopt(args, 'hn:p:') do
+		if o == "h" then return help() end
+		if o == "n" then count = tonumber(a) end
+		if o == "p" then tasks = tonumber(a) end
+	end
+
+	for _, n in ipairs{1, tasks} do
+		local ms = measure(count, n)
+		if not ms then
+			print("Timeout while waiting for the proxmark")
+			return
+		end
+		print(("%d task(s): %d pings in %d ms, %.2f ms per ping"):format(n, count, ms, ms / count))
+	end
+end
+
+main(args)
@@ -0,0 +1,267 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Indexed access to recorded HF traces (trace buffer or .trc files)
+//
+// Trace files are mapped into memory instead of being read in chunks and a
+// record offset index is built in one pass over the record headers. Records
+// can then be selected by index, which allows to seek by timestamp and to
+// filter before the (expensive) annotation is done.
+//-----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L		// need mmap()
+#endif
+
+#include "tracefile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ui.h"
+#include "parity.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define TRACE_CHUNK_SIZE (1<<16)
+
+static uint16_t get_u16(uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t record_len(uint16_t data_len) {
+	data_len &= ~TRACE_RESPONSE_FLAG;
+	uint16_t parity_len = (data_len - 1) / 8 + 1;
+	return TRACE_RECORD_HEADER_LEN + data_len + parity_len;
+}
+
+static int build_index(tracebuf_t *tb) {
+	size_t pos = 0;
+	size_t allocated = 1024;
+
+	tb->num_records = 0;
+	tb->offsets = malloc(allocated * sizeof(size_t));
+	if (tb->offsets == NULL)
+		return 2;
+
+	while (pos + TRACE_RECORD_HEADER_LEN <= tb->len) {
+		size_t len = record_len(get_u16(tb->data + pos + 6));
+		if (pos + len > tb->len)
+			break;
+
+		if (tb->num_records == allocated) {
+			allocated *= 2;
+			size_t *p = realloc(tb->offsets, allocated * sizeof(size_t));
+			if (p == NULL) {
+				free(tb->offsets);
+				tb->offsets = NULL;
+				return 2;
+			}
+			tb->offsets = p;
+		}
+		tb->offsets[tb->num_records++] = pos;
+		pos += len;
+	}
+
+	return 0;
+}
+
+#if defined(_WIN32)
+static int read_file(FILE *f, tracebuf_t *tb) {
+	size_t bytes_read;
+
+	tb->data = malloc(TRACE_CHUNK_SIZE);
+	if (tb->data == NULL)
+		return 2;
+
+	while (!feof(f)) {
+		bytes_read = fread(tb->data + tb->len, 1, TRACE_CHUNK_SIZE, f);
+		tb->len += bytes_read;
+		if (!feof(f)) {
+			uint8_t *p = realloc(tb->data, tb->len + TRACE_CHUNK_SIZE);
+			if (p == NULL) {
+				free(tb->data);
+				tb->data = NULL;
+				return 2;
+			}
+			tb->data = p;
+		}
+	}
+	return 0;
+}
+#endif
+
+int TraceLoadFile(const char *filename, tracebuf_t *tb) {
+	memset(tb, 0, sizeof(tracebuf_t));
+
+#if defined(_WIN32)
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL) {
+		PrintAndLog("Could not open file %s", filename);
+		return 1;
+	}
+	int res = read_file(f, tb);
+	fclose(f);
+	if (res) {
+		PrintAndLog("Cannot allocate memory for trace");
+		return res;
+	}
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		PrintAndLog("Could not open file %s", filename);
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		PrintAndLog("Could not stat file %s", filename);
+		close(fd);
+		return 1;
+	}
+
+	tb->len = st.st_size;
+	if (tb->len > 0) {
+		void *p = mmap(NULL, tb->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			PrintAndLog("Could not map file %s", filename);
+			close(fd);
+			return 1;
+		}
+		tb->data = p;
+		tb->mapped = true;
+	}
+	close(fd);
+#endif
+
+	if (build_index(tb)) {
+		PrintAndLog("Cannot allocate memory for trace index");
+		TraceFree(tb);
+		return 2;
+	}
+
+	return 0;
+}
+
+// takes ownership of data (must have been malloc'ed)
+int TraceLoadBuffer(uint8_t *data, size_t len, tracebuf_t *tb) {
+	memset(tb, 0, sizeof(tracebuf_t));
+	tb->data = data;
+	tb->len = len;
+
+	if (build_index(tb)) {
+		PrintAndLog("Cannot allocate memory for trace index");
+		TraceFree(tb);
+		return 2;
+	}
+
+	return 0;
+}
+
+void TraceFree(tracebuf_t *tb) {
+#if !defined(_WIN32)
+	if (tb->mapped) {
+		munmap(tb->data, tb->len);
+	} else
+#endif
+	{
+		free(tb->data);
+	}
+	free(tb->offsets);
+	memset(tb, 0, sizeof(tracebuf_t));
+}
+
+void TraceFilterInit(tracefilter_t *filter) {
+	memset(filter, 0, sizeof(tracefilter_t));
+	filter->direction = -1;
+	filter->time_to = UINT32_MAX;
+}
+
+bool TraceFilterActive(tracefilter_t *filter) {
+	return filter->by_time || filter->by_cmd || filter->direction >= 0;
+}
+
+uint32_t TraceRecordTimestamp(tracebuf_t *tb, size_t idx) {
+	return get_u32(tb->data + tb->offsets[idx]);
+}
+
+bool TraceRecordIsResponse(tracebuf_t *tb, size_t idx) {
+	return get_u16(tb->data + tb->offsets[idx] + 6) & TRACE_RESPONSE_FLAG;
+}
+
+// index of the first record starting at or after reltime (relative to the first record)
+size_t TraceFindTime(tracebuf_t *tb, uint32_t reltime) {
+	if (tb->num_records == 0)
+		return 0;
+
+	uint32_t first_timestamp = TraceRecordTimestamp(tb, 0);
+	size_t lo = 0;
+	size_t hi = tb->num_records;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (TraceRecordTimestamp(tb, mid) - first_timestamp < reltime)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+bool TraceRecordMatches(tracebuf_t *tb, size_t idx, tracefilter_t *filter) {
+	uint8_t *rec = tb->data + tb->offsets[idx];
+
+	if (filter->by_time) {
+		uint32_t reltime = get_u32(rec) - TraceRecordTimestamp(tb, 0);
+		if (reltime < filter->time_from || reltime > filter->time_to)
+			return false;
+	}
+
+	uint16_t data_len = get_u16(rec + 6);
+	if (filter->direction >= 0 && (bool)(data_len & TRACE_RESPONSE_FLAG) != (filter->direction == 1))
+		return false;
+
+	if (filter->by_cmd) {
+		data_len &= ~TRACE_RESPONSE_FLAG;
+		if (data_len == 0 || rec[TRACE_RECORD_HEADER_LEN] != filter->cmd)
+			return false;
+	}
+
+	return true;
+}
+
+bool TraceWriteRecord(FILE *f, uint32_t timestamp, uint32_t duration, const uint8_t *data, uint16_t data_len, bool response) {
+	uint8_t header[TRACE_RECORD_HEADER_LEN];
+	uint8_t parity[(0x7fff - 1) / 8 + 1];
+	uint16_t len = data_len | (response ? TRACE_RESPONSE_FLAG : 0);
+
+	if (data_len == 0 || data_len >= TRACE_RESPONSE_FLAG)
+		return false;
+	if (duration > 0xffff)
+		duration = 0xffff;
+	oddparitybuf(data, data_len, parity);
+	header[0] = timestamp;
+	header[1] = timestamp >> 8;
+	header[2] = timestamp >> 16;
+	header[3] = timestamp >> 24;
+	header[4] = duration;
+	header[5] = duration >> 8;
+	header[6] = len;
+	header[7] = len >> 8;
+	size_t parity_len = record_len(data_len) - TRACE_RECORD_HEADER_LEN - data_len;
+	return fwrite(header, 1, sizeof(header), f) == sizeof(header)
+	    && fwrite(data, 1, data_len, f) == data_len
+	    && fwrite(parity, 1, parity_len, f) == parity_len;
+}
@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Indexed access to recorded HF traces (trace buffer or .trc files)
+//-----------------------------------------------------------------------------
+
+#ifndef TRACEFILE_H__
+#define TRACEFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// every record starts with: timestamp(4), duration(2), data_len(2, bit 15 = response)
+#define TRACE_RECORD_HEADER_LEN		8
+#define TRACE_RESPONSE_FLAG			0x8000
+
+typedef struct {
+	uint8_t *data;			// raw trace, either mmap'ed or malloc'ed
+	size_t len;
+	bool mapped;
+	size_t *offsets;		// start of every complete record in data[]
+	size_t num_records;
+} tracebuf_t;
+
+typedef struct {
+	bool by_time;
+	uint32_t time_from;		// carrier periods, relative to the first record
+	uint32_t time_to;
+	int direction;			// -1 any, 0 reader only, 1 tag only
+	bool by_cmd;
+	uint8_t cmd;			// first byte of frame
+} tracefilter_t;
+
+extern int TraceLoadFile(const char *filename, tracebuf_t *tb);
+extern int TraceLoadBuffer(uint8_t *data, size_t len, tracebuf_t *tb);
+extern void TraceFree(tracebuf_t *tb);
+
+extern void TraceFilterInit(tracefilter_t *filter);
+extern bool TraceFilterActive(tracefilter_t *filter);
+extern uint32_t TraceRecordTimestamp(tracebuf_t *tb, size_t idx);
+extern bool TraceRecordIsResponse(tracebuf_t *tb, size_t idx);
+extern size_t TraceFindTime(tracebuf_t *tb, uint32_t reltime);
+extern bool TraceRecordMatches(tracebuf_t *tb, size_t idx, tracefilter_t *filter);
+
+// Appends a record in the format of the device trace buffer, with the odd parity
+// bits of the data. The format has 16 bits for the duration, longer durations are
+// stored as 0xffff.
+extern bool TraceWriteRecord(FILE *f, uint32_t timestamp, uint32_t duration, const uint8_t *data, uint16_t data_len, bool response);
+
+#endif
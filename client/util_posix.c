@@ -133,3 +133,35 @@ uint64_t msclock() {
 #endif
 }
 
+
+// a nanoseconds timer for latency measurement
+uint64_t nsclock() {
+#if defined(_WIN32)
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)((double)count.QuadPart * 1e9 / freq.QuadPart);
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+// CPU time of the process (all threads) in nanoseconds
+uint64_t cpuclock() {
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+		uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+		return (k + u) * 100;
+	}
+#elif defined(CLOCK_PROCESS_CPUTIME_ID) && !defined(__APPLE__)
+	struct timespec t;
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t) == 0) {
+		return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+	}
+#endif
+	return (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+}
@@ -22,5 +22,7 @@ extern void msleep(uint32_t n);		// sleep n milliseconds
 #endif // _WIN32
 
 extern uint64_t msclock(); 			// a milliseconds clock
+extern uint64_t nsclock(); 			// a nanoseconds clock
+extern uint64_t cpuclock(); 		// process CPU time in nanoseconds
 
 #endif
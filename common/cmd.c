@@ -49,6 +49,13 @@ bool cmd_receive(UsbCommand* cmd) {
   return true;
 }
 
+// tag of the command in execution, echoed in all answers
+static uint32_t cmd_tag = 0;
+
+void cmd_set_tag(uint32_t tag) {
+  cmd_tag = tag;
+}
+
 bool cmd_send(uint32_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* data, size_t len) {
   UsbCommand txcmd;
 
@@ -57,7 +64,7 @@ bool cmd_send(uint32_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* d
   }
   
   // Compose the outgoing command frame
-  txcmd.cmd = cmd;
+  txcmd.cmd = cmd | ((uint64_t)cmd_tag << USB_CMD_TAG_SHIFT);
   txcmd.arg[0] = arg0;
   txcmd.arg[1] = arg1;	
   txcmd.arg[2] = arg2;
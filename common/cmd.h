@@ -39,6 +39,7 @@
 
 bool cmd_receive(UsbCommand* cmd);
 bool cmd_send(uint32_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* data, size_t len);
+void cmd_set_tag(uint32_t tag);
 
 #endif // _PROXMARK_CMD_H_
 
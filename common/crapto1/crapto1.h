@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 struct Crypto1State {uint32_t odd, even;};
+void crypto1_init(struct Crypto1State *state, uint64_t key);
 #if defined(__arm__) && !defined(__linux__) && !defined(_WIN32) && !defined(__APPLE__)		// bare metal ARM Proxmark lacks malloc()/free()
 void crypto1_create(struct Crypto1State *s, uint64_t key);
 #else
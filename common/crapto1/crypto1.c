@@ -25,15 +25,22 @@
 #define SWAPENDIAN(x)\
 	(x = (x >> 8 & 0xff00ff) | (x & 0xff00ff) << 8, x = x >> 16 | x << 16)
 
-#if defined(__arm__) && !defined(__linux__) && !defined(_WIN32) && !defined(__APPLE__)		// bare metal ARM Proxmark lacks malloc()/free()
-void crypto1_create(struct Crypto1State *s, uint64_t key)
+void crypto1_init(struct Crypto1State *state, uint64_t key)
 {
 	int i;
 
-	for(i = 47;s && i > 0; i -= 2) {
-		s->odd  = s->odd  << 1 | BIT(key, (i - 1) ^ 7);
-		s->even = s->even << 1 | BIT(key, i ^ 7);
+	state->odd = 0;
+	state->even = 0;
+	for(i = 47; i > 0; i -= 2) {
+		state->odd  = state->odd  << 1 | BIT(key, (i - 1) ^ 7);
+		state->even = state->even << 1 | BIT(key, i ^ 7);
 	}
+}
+#if defined(__arm__) && !defined(__linux__) && !defined(_WIN32) && !defined(__APPLE__)		// bare metal ARM Proxmark lacks malloc()/free()
+void crypto1_create(struct Crypto1State *s, uint64_t key)
+{
+	if (s)
+		crypto1_init(s, key);
 	return;
 }
 void crypto1_destroy(struct Crypto1State *state)
@@ -45,12 +52,9 @@ void crypto1_destroy(struct Crypto1State *state)
 struct Crypto1State * crypto1_create(uint64_t key)
 {
 	struct Crypto1State *s = malloc(sizeof(*s));
-	int i;
 
-	for(i = 47;s && i > 0; i -= 2) {
-		s->odd  = s->odd  << 1 | BIT(key, (i - 1) ^ 7);
-		s->even = s->even << 1 | BIT(key, i ^ 7);
-	}
+	if (s)
+		crypto1_init(s, key);
 	return s;
 }
 void crypto1_destroy(struct Crypto1State *state)
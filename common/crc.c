@@ -6,6 +6,7 @@
 // Generic CRC calculation code.
 //-----------------------------------------------------------------------------
 #include "crc.h"
+#include "crctable.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -54,3 +55,12 @@ uint32_t CRC8Maxim(uint8_t *buff, size_t size)
 	}
 	return crc_finish(&crc);
 }
+
+// CRC-8/LEGIC: poly 0x63 LSB first, register preset 0x55, result bit reversed (check value 0xC6)
+uint8_t CRC8Legic(const uint8_t *buff, size_t size)
+{
+	uint8_t crc = crc8_legic_update(0x55, buff, size);
+	crc = (crc & 0xF0) >> 4 | (crc & 0x0F) << 4;
+	crc = (crc & 0xCC) >> 2 | (crc & 0x33) << 2;
+	return (crc & 0xAA) >> 1 | (crc & 0x55) << 1;
+}
@@ -39,6 +39,8 @@ extern uint32_t crc_finish(crc_t *crc);
 
 // Calculate CRC-8/Maxim checksum
 uint32_t CRC8Maxim(uint8_t *buff, size_t size  );
+// LEGIC Prime MCC (over the UID) and segment header CRC (over UID and header)
+uint8_t CRC8Legic(const uint8_t *buff, size_t size);
 /* Static initialization of a crc structure */
 #define CRC_INITIALIZER(_order, _polynom, _initial_value, _final_xor) { \
 	.state = ((_initial_value) & ((1L<<(_order))-1)), \
@@ -7,24 +7,21 @@
 //-----------------------------------------------------------------------------
 
 #include "crc16.h"
+#include "crctable.h"
 
 unsigned short update_crc16( unsigned short crc, unsigned char c )
 {
-	unsigned short i, v, tcrc = 0;
-
-	v = (crc ^ c) & 0xff;
-	for (i = 0; i < 8; i++) {
-		tcrc = ( (tcrc ^ v) & 1 ) ? ( tcrc >> 1 ) ^ 0x8408 : tcrc >> 1;
-		v >>= 1;
-	}
-
-	return ((crc >> 8) ^ tcrc)&0xffff;
+	return crc16_refl_update(crc, &c, 1);
 }
 
 uint16_t crc16(uint8_t const *message, int length, uint16_t remainder, uint16_t polynomial) {
 
 	if (length == 0) return (~remainder);
 
+	if (polynomial == 0x1021) {
+		return crc16_ccitt_update(remainder, message, length);
+	}
+
 	for (int byte = 0; byte < length; ++byte) {
 		remainder ^= (message[byte] << 8);
 		for (uint8_t bit = 8; bit > 0; --bit) {
@@ -0,0 +1,29 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Table driven CRCs for the polynomials used by the protocols
+//-----------------------------------------------------------------------------
+
+#ifndef __CRCTABLE_H
+#define __CRCTABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The update functions neither preset nor invert the CRC, callers do.
+
+// x^16 + x^12 + x^5 + 1, LSB first (0x8408). ISO14443A/B, ISO15693, iClass, Kermit
+uint16_t crc16_refl_update(uint16_t crc, const uint8_t *data, size_t len);
+
+// x^16 + x^12 + x^5 + 1, MSB first (0x1021). CCITT
+uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t *data, size_t len);
+
+// IEEE 802.3, LSB first (0xEDB88320). DESFire
+uint32_t crc32_refl_update(uint32_t crc, const uint8_t *data, size_t len);
+
+// x^8 + x^6 + x^5 + x + 1, LSB first (0xC6). LEGIC Prime MCC and segment headers
+uint8_t crc8_legic_update(uint8_t crc, const uint8_t *data, size_t len);
+
+#endif
@@ -10,6 +10,7 @@
 #include "proxmark3.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include "crctable.h"
 //#include "iso15693tools.h"
 #ifdef ON_DEVICE
 #include "printf.h"
@@ -27,22 +28,7 @@
 //	returns crc as 16bit value
 uint16_t Iso15693Crc(uint8_t *v, int n)
 {
-	uint32_t reg;
-	int i, j;
-
-	reg = 0xffff;
-	for(i = 0; i < n; i++) {
-		reg = reg ^ ((uint32_t)v[i]);
-		for (j = 0; j < 8; j++) {
-			if (reg & 0x0001) {
-				reg = (reg >> 1) ^ 0x8408;
-			} else {
-				reg = (reg >> 1);
-			}
-		}
-	}
-
-	return ~(uint16_t)(reg & 0xffff);
+	return ~crc16_refl_update(0xffff, v, n);
 }
 
 // adds a CRC to a dataframe
@@ -72,24 +58,13 @@ char* Iso15693sprintUID(char *target,uint8_t *uid) {
 
 uint16_t iclass_crc16(char *data_p, unsigned short length)
 {
-      unsigned char i;
       unsigned int data;
 	  uint16_t crc = 0xffff;
 
       if (length == 0)
             return (~crc);
 
-      do
-      {
-            for (i=0, data=(unsigned int)0xff & *data_p++;
-                 i < 8; 
-                 i++, data >>= 1)
-            {
-                  if ((crc & 0x0001) ^ (data & 0x0001))
-                        crc = (crc >> 1) ^ POLY;
-                  else  crc >>= 1;
-            }
-      } while (--length);
+      crc = crc16_refl_update(crc, (uint8_t *)data_p, length);
 
       crc = ~crc;
       data = crc;
@@ -97,4 +72,3 @@ uint16_t iclass_crc16(char *data_p, unsigned short length)
       crc = crc ^ 0xBC3;
       return (crc);
 }
-
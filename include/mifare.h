@@ -52,4 +52,17 @@ typedef struct {
 	uint32_t nr2;
 } nonces_t;
 
+//-----------------------------------------------------------------------------
+// MIFARE Classic key check with a dictionary kept in BigBuf
+//-----------------------------------------------------------------------------
+#define MF_CHKKEYS_DICT_MAX		2000	// keys
+
+// arg0 of the CMD_ACK replies to CMD_MIFARE_CHKKEYS_FAST
+typedef enum {
+	MF_CHKKEYS_FAILED = 0,		// can't select the card or cancelled
+	MF_CHKKEYS_DONE,			// last reply, arg1 = number of keys found
+	MF_CHKKEYS_SECTOR,			// arg1 = sector | keyType << 8 | found << 16, arg2 = key index, data = key
+	MF_CHKKEYS_NO_DICT			// dictionary not (or no longer) loaded
+} mf_chkkeys_reply_t;
+
 #endif // _MIFARE_H_
@@ -0,0 +1,73 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hot path counters of firmware built with WITH_PERF, read with CMD_PERF_STATS
+// (hw perf)
+//-----------------------------------------------------------------------------
+
+#ifndef _PERF_STATS_H_
+#define _PERF_STATS_H_
+
+#include <stdint.h>
+
+#define PERF_STATS_VERSION	1
+
+// The periodic interval timer runs free at MCK/16. The timer/counters can't be
+// used, all three of them count the SSP clock while sniffing or simulating HF.
+#define PERF_TICK_HZ		(48000000 / 16)
+
+// timed sections
+enum {
+	PERF_SEC_14A_SNIFF,				// hf 14a snoop, start to end
+	PERF_SEC_14A_READER_DECODE,		// MillerDecoding() of one sample while sniffing
+	PERF_SEC_14A_TAG_DECODE,		// ManchesterDecoding() of one sample while sniffing
+	PERF_SEC_ICLASS_SNIFF,			// hf iclass snoop, start to end
+	PERF_SEC_ICLASS_READER_DECODE,	// OutOfNDecoding() while sniffing
+	PERF_SEC_ICLASS_TAG_DECODE,		// ManchesterDecoding() while sniffing
+	PERF_SEC_LOG_TRACE,				// LogTrace()
+	PERF_SECTIONS
+};
+
+// event counters
+enum {
+	PERF_DMA_OVERRUNS,				// sniff DMA buffer overwritten before it was read, samples lost
+	PERF_DMA_ABORTS,				// sniff stopped because the DMA buffer was 90% full
+	PERF_TRACE_FULL,				// LogTrace() found the trace buffer full and stopped tracing
+	PERF_FRAMES_LOGGED,
+	PERF_14A_READER_DECODE_ERRORS,	// Miller sequence errors after the start of a frame
+	PERF_14A_TAG_COLLISIONS,		// frames with a collision
+	PERF_ICLASS_READER_DECODE_ERRORS,
+	PERF_ICLASS_TAG_DECODE_ERRORS,
+	PERF_COUNTERS
+};
+
+// high-water marks
+enum {
+	PERF_HW_DMA_BACKLOG,			// sniff samples received but not yet decoded, of dma_buffer_size
+	PERF_HW_TRACE_LEN,				// of trace_size
+	PERF_HW_BIGBUF_ALLOC,			// BigBuf_malloc()ed bytes
+	PERF_HIGH_WATER_MARKS
+};
+
+// the 64 bit fields are 8 byte aligned, the layout is the same on the ARM and the host
+typedef struct {
+	uint32_t calls;
+	uint32_t max_ticks;				// longest call
+	uint64_t ticks;
+} perf_section_t;
+
+typedef struct {
+	uint32_t version;
+	uint32_t tick_hz;
+	uint32_t elapsed_ticks;			// since the last reset
+	uint32_t dma_buffer_size;
+	perf_section_t section[PERF_SECTIONS];
+	uint32_t counter[PERF_COUNTERS];
+	uint32_t high_water[PERF_HIGH_WATER_MARKS];
+	uint32_t trace_size;
+	uint32_t bigbuf_size;
+} perf_stats_t;
+
+#endif // _PERF_STATS_H_
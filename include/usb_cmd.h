@@ -33,6 +33,15 @@ typedef struct {
     uint32_t asDwords[USB_CMD_DATA_SIZE/4];
   } d;
 } PACKED UsbCommand;
+
+// The upper 32 bits of UsbCommand.cmd carry an optional request tag. Firmware
+// which answers CMD_PING with USB_CMD_CAP_TAG in arg0 sends every packet with the
+// tag of the command it is executing, old firmware must only get untagged commands.
+#define USB_CMD_TAG_SHIFT	32
+#define USB_CMD_CMD_MASK	0xffffffffULL
+#define USB_CMD_CAP_TAG		0x01
+#define USB_CMD_CAP_MF_SECTOR	0x02	// CMD_MIFARE_READSC_BLOCKS, CMD_MIFARE_WRITESC_BLOCKS
+
 // A struct used to send sample-configs over USB
 typedef struct{
 	uint8_t decimation;
@@ -62,6 +71,7 @@ typedef struct{
 #define CMD_VERSION                                                       0x0107
 #define CMD_STATUS                                                        0x0108
 #define CMD_PING                                                          0x0109
+#define CMD_PERF_STATS                                                    0x010A
 
 // RDV40,  Smart card operations
 #define CMD_SMART_RAW                                                     0x0140
@@ -202,6 +212,10 @@ typedef struct{
 #define CMD_MIFAREU_WRITEBL_COMPAT                                        0x0723
 
 #define CMD_MIFARE_CHKKEYS                                                0x0623
+#define CMD_MIFARE_CHKKEYS_DICT                                           0x0624
+#define CMD_MIFARE_CHKKEYS_FAST                                           0x0625
+#define CMD_MIFARE_READSC_BLOCKS                                          0x0626
+#define CMD_MIFARE_WRITESC_BLOCKS                                         0x0627
 
 #define CMD_MIFARE_SNIFFER                                                0x0630
 //ultralightC
@@ -0,0 +1,777 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// bench - benchmarks of the client's crypto, cracking and decoding hot paths
+//
+// Every benchmark runs one operation of the unmodified client/common code on
+// fixed, checked-in data (tools/bench/data, traces/ and the loclass dump) and
+// checks its result, so a speedup that breaks the code doesn't go unnoticed.
+// Each benchmark is warmed up until one repeat takes the minimum time, then
+// timed for a number of repeats. The median is reported.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "crapto1/crapto1.h"
+#include "mfkey.h"
+#include "mifare.h"
+#include "crc.h"
+#include "crc16.h"
+#include "crc32.h"
+#include "crc64.h"
+#include "iso14443crc.h"
+#include "iso15693tools.h"
+#include "lfdemod.h"
+#include "loclass/cipher.h"
+#include "loclass/ikeys.h"
+#include "loclass/elite_crack.h"
+#include "emv/tlv.h"
+
+#define BENCH_VERSION		1
+#define DEFAULT_REPEATS		5
+#define DEFAULT_MIN_MS		200
+#define MAX_REPEATS			100
+#define MAX_RECORDS			16
+#define MAX_TRACE_LEN		(40000)
+#define CRC_BUF_LEN			1024
+
+typedef struct {
+	const char *name;
+	const char *desc;
+	size_t bytes;					// per operation, for MB/s. 0 if not applicable
+	bool (*setup)(void);			// loads the data, false if it isn't available
+	bool (*op)(void);				// one operation, false if its result is wrong
+} bench_t;
+
+typedef struct {
+	bool skipped;
+	bool ok;
+	uint64_t ops;					// per repeat
+	double ns_per_op;				// median of the repeats
+	double best_ns_per_op;
+} bench_result_t;
+
+static const char *root_dir = "../..";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static FILE *open_data(const char *name, const char *mode)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", root_dir, name);
+	FILE *f = fopen(path, mode);
+	if (f == NULL)
+		fprintf(stderr, "cannot open %s\n", path);
+	return f;
+}
+
+//-----------------------------------------------------------------------------
+// MIFARE Classic: crapto1 state recovery and the mfkey attacks
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	uint32_t uid, nt, nr, ar;
+	uint64_t par_info, ks_info;
+} darkside_t;
+
+static uint64_t mf_key;
+static nonces_t mf_mfkey32[MAX_RECORDS], mf_moebius[MAX_RECORDS], mf_mfkey64[MAX_RECORDS];
+static darkside_t mf_darkside[MAX_RECORDS];
+static int mf_mfkey32_count, mf_moebius_count, mf_mfkey64_count, mf_darkside_count;
+static int mf_next;
+
+static bool setup_mifare(void)
+{
+	static int loaded = 0;
+	if (loaded)
+		return loaded > 0;
+	loaded = -1;
+
+	FILE *f = open_data("tools/bench/data/mifare_nonces.txt", "r");
+	if (f == NULL)
+		return false;
+	char line[256], kind[16];
+	while (fgets(line, sizeof(line), f)) {
+		nonces_t n = {0};
+		darkside_t d;
+		if (line[0] == '#' || sscanf(line, "%15s", kind) != 1)
+			continue;
+		if (!strcmp(kind, "key")) {
+			sscanf(line, "%*s %" SCNx64, &mf_key);
+		} else if (!strcmp(kind, "mfkey32") && mf_mfkey32_count < MAX_RECORDS
+				&& sscanf(line, "%*s %x %x %x %x %x %x", &n.cuid, &n.nonce, &n.nr, &n.ar, &n.nr2, &n.ar2) == 6) {
+			mf_mfkey32[mf_mfkey32_count++] = n;
+		} else if (!strcmp(kind, "moebius") && mf_moebius_count < MAX_RECORDS
+				&& sscanf(line, "%*s %x %x %x %x %x %x %x", &n.cuid, &n.nonce, &n.nr, &n.ar, &n.nonce2, &n.nr2, &n.ar2) == 7) {
+			mf_moebius[mf_moebius_count++] = n;
+		} else if (!strcmp(kind, "mfkey64") && mf_mfkey64_count < MAX_RECORDS
+				&& sscanf(line, "%*s %x %x %x %x %x", &n.cuid, &n.nonce, &n.nr, &n.ar, &n.at) == 5) {
+			mf_mfkey64[mf_mfkey64_count++] = n;
+		} else if (!strcmp(kind, "darkside") && mf_darkside_count < MAX_RECORDS
+				&& sscanf(line, "%*s %x %x %x %x %" SCNx64 " %" SCNx64, &d.uid, &d.nt, &d.nr, &d.ar, &d.par_info, &d.ks_info) == 6) {
+			mf_darkside[mf_darkside_count++] = d;
+		}
+	}
+	fclose(f);
+
+	if (!mf_key || !mf_mfkey32_count || !mf_moebius_count || !mf_mfkey64_count || !mf_darkside_count) {
+		fprintf(stderr, "incomplete mifare_nonces.txt\n");
+		return false;
+	}
+	loaded = 1;
+	return true;
+}
+
+static bool bench_lfsr_recovery32(void)
+{
+	nonces_t *n = &mf_mfkey32[mf_next++ % mf_mfkey32_count];
+	struct Crypto1State *s = lfsr_recovery32(n->ar ^ prng_successor(n->nonce, 64), 0);
+	bool ok = s != NULL && (s->odd | s->even);
+	crypto1_destroy(s);
+	return ok;
+}
+
+static bool bench_lfsr_recovery64(void)
+{
+	nonces_t *n = &mf_mfkey64[mf_next++ % mf_mfkey64_count];
+	uint64_t key;
+	struct Crypto1State *s = lfsr_recovery64(n->ar ^ prng_successor(n->nonce, 64), n->at ^ prng_successor(n->nonce, 96));
+	lfsr_rollback_word(s, 0, 0);
+	lfsr_rollback_word(s, 0, 0);
+	lfsr_rollback_word(s, n->nr, 1);
+	lfsr_rollback_word(s, n->cuid ^ n->nonce, 0);
+	crypto1_get_lfsr(s, &key);
+	crypto1_destroy(s);
+	return key == mf_key;
+}
+
+// the hot path of nonce2key() in mifarehost.c (hf mf mifare)
+static bool bench_lfsr_common_prefix(void)
+{
+	darkside_t *d = &mf_darkside[mf_next++ % mf_darkside_count];
+	uint8_t ks3x[8], par[8][8];
+
+	for (int pos = 0; pos < 8; pos++) {
+		ks3x[7 - pos] = (d->ks_info >> (pos * 8)) & 0x0f;
+		uint8_t bt = (d->par_info >> (pos * 8)) & 0xff;
+		for (int i = 0; i < 8; i++)
+			par[7 - pos][i] = (bt >> i) & 0x01;
+	}
+
+	struct Crypto1State *states = lfsr_common_prefix(d->nr & 0xffffff1f, d->ar, ks3x, par, d->par_info == 0);
+	if (states == NULL)
+		return false;
+	bool found = false;
+	for (struct Crypto1State *s = states; s->odd | s->even; s++) {
+		uint64_t key;
+		lfsr_rollback_word(s, d->uid ^ d->nt, 0);
+		crypto1_get_lfsr(s, &key);
+		found |= key == mf_key;
+	}
+	free(states);
+	return found;
+}
+
+static bool bench_mfkey32(void)
+{
+	uint64_t key;
+	return mfkey32(mf_mfkey32[mf_next++ % mf_mfkey32_count], &key) && key == mf_key;
+}
+
+static bool bench_mfkey32_moebius(void)
+{
+	uint64_t key;
+	return mfkey32_moebius(mf_moebius[mf_next++ % mf_moebius_count], &key) && key == mf_key;
+}
+
+static bool bench_mfkey64(void)
+{
+	uint64_t key;
+	mfkey64(mf_mfkey64[mf_next++ % mf_mfkey64_count], &key);
+	return key == mf_key;
+}
+
+// 64 words of keystream after the authentication
+static bool bench_crypto1_word(void)
+{
+	nonces_t *n = &mf_mfkey64[0];
+	struct Crypto1State s;
+	uint32_t ks = 0;
+	crypto1_init(&s, mf_key);
+	crypto1_word(&s, n->cuid ^ n->nonce, 0);
+	for (int i = 0; i < 64; i++)
+		ks ^= crypto1_word(&s, 0, 0);
+	return ks == 0xa92e315c;
+}
+
+//-----------------------------------------------------------------------------
+// iClass: loclass key table recovery
+//-----------------------------------------------------------------------------
+
+#define ICLASS_MAX_ITEMS	256
+
+// custom key the loclass dump was made with and the start of its hash2() key table,
+// see _testBruteforce()
+static uint8_t iclass_kcus[8] = {0x5b, 0x7c, 0x62, 0xc4, 0x91, 0xc1, 0x1b, 0x39};
+static const uint8_t iclass_keytable_head[16] = {
+	0xf1, 0x35, 0x59, 0xa1, 0x0d, 0x5a, 0x26, 0x7f, 0x18, 0x60, 0x0b, 0x96, 0x8a, 0xc0, 0x25, 0xc1
+};
+static uint8_t iclass_keytable[128];
+static dumpdata iclass_items[ICLASS_MAX_ITEMS];
+static uint8_t iclass_div_keys[ICLASS_MAX_ITEMS][8];
+static int iclass_count;
+static int iclass_next;
+
+static void iclass_div_key(const dumpdata *item, uint8_t div_key[8])
+{
+	uint8_t key_index[8], key_sel[8], key_sel_p[8];
+	hash1((uint8_t *)item->csn, key_index);
+	for (int i = 0; i < 8; i++)
+		key_sel[i] = iclass_keytable[key_index[i]];
+	permutekey_rev(key_sel, key_sel_p);
+	diversifyKey((uint8_t *)item->csn, key_sel_p, div_key);
+}
+
+static bool setup_iclass(void)
+{
+	static int loaded = 0;
+	if (loaded)
+		return loaded > 0;
+	loaded = -1;
+
+	hash2(iclass_kcus, iclass_keytable);
+	if (memcmp(iclass_keytable, iclass_keytable_head, sizeof(iclass_keytable_head))) {
+		fprintf(stderr, "hash2() of the loclass custom key is wrong\n");
+		return false;
+	}
+
+	FILE *f = open_data("client/loclass/iclass_dump.bin", "rb");
+	if (f == NULL)
+		return false;
+	iclass_count = fread(iclass_items, sizeof(dumpdata), ICLASS_MAX_ITEMS, f);
+	fclose(f);
+	if (iclass_count == 0)
+		return false;
+
+	for (int i = 0; i < iclass_count; i++) {
+		uint8_t mac[4];
+		iclass_div_key(&iclass_items[i], iclass_div_keys[i]);
+		doMAC(iclass_items[i].cc_nr, iclass_div_keys[i], mac);
+		if (memcmp(mac, iclass_items[i].mac, 4)) {
+			fprintf(stderr, "loclass dump item %d doesn't match the custom key\n", i);
+			return false;
+		}
+	}
+	loaded = 1;
+	return true;
+}
+
+static bool bench_hash2(void)
+{
+	uint8_t keytable[128];
+	hash2(iclass_kcus, keytable);
+	return !memcmp(keytable, iclass_keytable, sizeof(keytable));
+}
+
+static bool bench_diversifyKey(void)
+{
+	dumpdata *item = &iclass_items[iclass_next % iclass_count];
+	uint8_t key_index[8], key_sel[8], key_sel_p[8], div_key[8];
+	hash1(item->csn, key_index);
+	for (int i = 0; i < 8; i++)
+		key_sel[i] = iclass_keytable[key_index[i]];
+	permutekey_rev(key_sel, key_sel_p);
+	diversifyKey(item->csn, key_sel_p, div_key);
+	return !memcmp(div_key, iclass_div_keys[iclass_next++ % iclass_count], 8);
+}
+
+static bool bench_doMAC(void)
+{
+	int i = iclass_next++ % iclass_count;
+	uint8_t mac[4];
+	doMAC(iclass_items[i].cc_nr, iclass_div_keys[i], mac);
+	return !memcmp(mac, iclass_items[i].mac, 4);
+}
+
+// one byte of the key table missing, as in the first rounds of a loclass attack
+static bool bench_bruteforceItem(void)
+{
+	dumpdata *item = &iclass_items[iclass_next++ % iclass_count];
+	uint16_t keytable[128];
+	uint8_t key_index[8];
+
+	for (int i = 0; i < 128; i++)
+		keytable[i] = iclass_keytable[i] | CRACKED;
+	hash1(item->csn, key_index);
+	keytable[key_index[0]] = 0;
+
+	return bruteforceItem(*item, keytable) == 0
+		&& keytable[key_index[0]] == (iclass_keytable[key_index[0]] | CRACKED);
+}
+
+//-----------------------------------------------------------------------------
+// CRCs over a pseudo random block
+//-----------------------------------------------------------------------------
+
+static uint8_t crc_buf[CRC_BUF_LEN];
+
+static bool setup_crc(void)
+{
+	uint32_t x = 0x2545f491;
+	for (int i = 0; i < CRC_BUF_LEN; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		crc_buf[i] = x;
+	}
+	return true;
+}
+
+static bool bench_crc14443a(void)
+{
+	uint8_t b1, b2;
+	ComputeCrc14443(CRC_14443_A, crc_buf, CRC_BUF_LEN, &b1, &b2);
+	return (b1 | b2 << 8) == 0x573e;
+}
+
+static bool bench_crc15693(void)
+{
+	return Iso15693Crc(crc_buf, CRC_BUF_LEN) == 0x2954;
+}
+
+static bool bench_crc16_ccitt(void)
+{
+	return crc16_ccitt(crc_buf, CRC_BUF_LEN) == 0xf3f5;
+}
+
+static bool bench_crc32(void)
+{
+	uint8_t crc[4];
+	crc32(crc_buf, CRC_BUF_LEN, crc);
+	return (crc[0] | crc[1] << 8 | crc[2] << 16 | (uint32_t)crc[3] << 24) == 0x613ebedc;
+}
+
+static bool bench_crc64(void)
+{
+	uint64_t crc = 0;
+	crc64(crc_buf, CRC_BUF_LEN, &crc);
+	return crc == 0x73832ba03fbef120ULL;
+}
+
+static bool bench_crc8_legic(void)
+{
+	return CRC8Legic(crc_buf, CRC_BUF_LEN) == 0x20;
+}
+
+//-----------------------------------------------------------------------------
+// LF demodulators on the traces in traces/
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	const char *file;
+	uint8_t *samples;
+	size_t len;
+} lf_trace_t;
+
+static lf_trace_t lf_traces[] = {
+	{"traces/EM4102-1.pm3"},
+	{"traces/HID-weak-fob-11647.pm3"},
+	{"traces/AWID-15-259.pm3"},
+	{"traces/ioprox-XSF-01-3B-44725.pm3"},
+	{"traces/indala-504278295.pm3"},
+	{"traces/modulation-nrz.pm3"},
+};
+enum { LF_EM410X, LF_HID, LF_AWID, LF_IOPROX, LF_INDALA, LF_NRZ, LF_TRACES };
+
+static uint8_t lf_buf[MAX_TRACE_LEN];
+
+// as 'data load' followed by getFromGraphBuf()
+static bool setup_lf(void)
+{
+	static int loaded = 0;
+	if (loaded)
+		return loaded > 0;
+	loaded = -1;
+
+	for (int i = 0; i < LF_TRACES; i++) {
+		lf_trace_t *t = &lf_traces[i];
+		FILE *f = open_data(t->file, "r");
+		if (f == NULL)
+			return false;
+		t->samples = malloc(MAX_TRACE_LEN);
+		char line[80];
+		while (t->len < MAX_TRACE_LEN && fgets(line, sizeof(line), f)) {
+			int v = atoi(line);
+			if (v > 127) v = 127;
+			if (v < -127) v = -127;
+			t->samples[t->len++] = v + 128;
+		}
+		fclose(f);
+	}
+	loaded = 1;
+	return true;
+}
+
+static size_t lf_load(int trace)
+{
+	memcpy(lf_buf, lf_traces[trace].samples, lf_traces[trace].len);
+	return lf_traces[trace].len;
+}
+
+// data rawdemod am + lf em 410x_demod
+static bool bench_em410x(void)
+{
+	size_t size = lf_load(LF_EM410X), idx = 0;
+	int clk = 0, invert = 0, startIdx = 0;
+	uint32_t hi = 0;
+	uint64_t lo = 0;
+	int errCnt = askdemod_ext(lf_buf, &size, &clk, &invert, 100, 0, 1, &startIdx);
+	if (errCnt < 0 || size < 16)
+		return false;
+	return Em410xDecode(lf_buf, &size, &idx, &hi, &lo) && lo == 0x010872e77cULL;
+}
+
+static bool bench_hid(void)
+{
+	size_t size = lf_load(LF_HID);
+	uint32_t hi2 = 0, hi = 0, lo = 0;
+	int waveIdx = 0;
+	return HIDdemodFSK(lf_buf, &size, &hi2, &hi, &lo, &waveIdx) >= 0 && ((lo >> 1) & 0xffff) == 11647;
+}
+
+static bool bench_awid(void)
+{
+	size_t size = lf_load(LF_AWID);
+	int waveIdx = 0;
+	int idx = AWIDdemodFSK(lf_buf, &size, &waveIdx);
+	if (idx <= 0 || removeParity(lf_buf, idx + 8, 4, 1, 88) != 66)
+		return false;
+	// 26 bit format, FC 15, card 259
+	return bytebits_to_byte(lf_buf, 8) == 26 && bytebits_to_byte(lf_buf + 9, 8) == 15
+		&& bytebits_to_byte(lf_buf + 17, 16) == 259;
+}
+
+static bool bench_ioprox(void)
+{
+	size_t size = lf_load(LF_IOPROX);
+	int waveIdx = 0;
+	int idx = IOdemodFSK(lf_buf, size, &waveIdx);
+	// XSF(01)3B:44725
+	return idx > 0 && bytebits_to_byte(lf_buf + idx + 18, 8) == 0x3b
+		&& (bytebits_to_byte(lf_buf + idx + 36, 8) << 8 | bytebits_to_byte(lf_buf + idx + 45, 8)) == 44725;
+}
+
+// data rawdemod p1 32 + lf indala demod
+static bool bench_indala(void)
+{
+	size_t size = lf_load(LF_INDALA);
+	int clk = 32, invert = 0, startIdx = 0;
+	uint8_t inv = 0;
+	int errCnt = pskRawDemod_ext(lf_buf, &size, &clk, &invert, &startIdx);
+	if (errCnt < 0 || size < 16)
+		return false;
+	int idx = indala64decode(lf_buf, &size, &inv);
+	return idx >= 0 && size == 64 && bytebits_to_byte(lf_buf + idx + 32, 32) == 0xa084f052;
+}
+
+static bool bench_nrz(void)
+{
+	size_t size = lf_load(LF_NRZ);
+	int clk = 0, invert = 0, startIdx = 0;
+	int errCnt = nrzRawDemod(lf_buf, &size, &clk, &invert, &startIdx);
+	return errCnt == 0 && clk == 64 && size == 374;
+}
+
+//-----------------------------------------------------------------------------
+// EMV TLV parsing
+//-----------------------------------------------------------------------------
+
+#define EMV_MAX_RESPONSES	8
+
+static uint8_t emv_resp[EMV_MAX_RESPONSES][512];
+static size_t emv_resp_len[EMV_MAX_RESPONSES];
+static int emv_count;
+
+static bool setup_emv(void)
+{
+	static int loaded = 0;
+	if (loaded)
+		return loaded > 0;
+	loaded = -1;
+
+	FILE *f = open_data("tools/bench/data/emv_responses.txt", "r");
+	if (f == NULL)
+		return false;
+	char line[1200];
+	while (emv_count < EMV_MAX_RESPONSES && fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		size_t n = 0;
+		unsigned int b;
+		for (char *p = line; n < sizeof(emv_resp[0]) && sscanf(p, "%2x", &b) == 1; p += 2)
+			emv_resp[emv_count][n++] = b;
+		if (n)
+			emv_resp_len[emv_count++] = n;
+	}
+	fclose(f);
+	loaded = emv_count ? 1 : -1;
+	return emv_count > 0;
+}
+
+// 'emv exec' style: parse every response and look up the tags the client needs
+static bool bench_tlv(void)
+{
+	static const tlv_tag_t tags[] = {0x4f, 0x9f38, 0x94, 0x57, 0x5a, 0x8c, 0x9f46, 0x9f49};
+	struct tlvdb *root = NULL;
+	for (int i = 0; i < emv_count; i++) {
+		struct tlvdb *t = tlvdb_parse_multi(emv_resp[i], emv_resp_len[i]);
+		if (t == NULL) {
+			tlvdb_free(root);
+			return false;
+		}
+		if (root)
+			tlvdb_add(root, t);
+		else
+			root = t;
+	}
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(tags) / sizeof(tags[0]); i++)
+		ok &= tlvdb_get(root, tags[i], NULL) != NULL;
+	tlvdb_free(root);
+	return ok;
+}
+
+//-----------------------------------------------------------------------------
+
+static const bench_t benchmarks[] = {
+	{"crapto1/lfsr_recovery32",		"32 bit keystream to LFSR states",			0, setup_mifare, bench_lfsr_recovery32},
+	{"crapto1/lfsr_recovery64",		"64 bit keystream to LFSR state",			0, setup_mifare, bench_lfsr_recovery64},
+	{"crapto1/lfsr_common_prefix",	"darkside nonce2key",						0, setup_mifare, bench_lfsr_common_prefix},
+	{"crapto1/crypto1_word",		"64 keystream words",						0, setup_mifare, bench_crypto1_word},
+	{"mfkey/mfkey32",				"key from 2 auths, same nonce",				0, setup_mifare, bench_mfkey32},
+	{"mfkey/mfkey32_moebius",		"key from 2 auths, different nonces",		0, setup_mifare, bench_mfkey32_moebius},
+	{"mfkey/mfkey64",				"key from reader and tag response",			0, setup_mifare, bench_mfkey64},
+	{"loclass/hash2",				"key table from custom key",				0, setup_iclass, bench_hash2},
+	{"loclass/diversifyKey",		"hash1, permutation and DES",				0, setup_iclass, bench_diversifyKey},
+	{"loclass/doMAC",				"MAC of CC and NR",							0, setup_iclass, bench_doMAC},
+	{"loclass/bruteforceItem",		"one key table byte",						0, setup_iclass, bench_bruteforceItem},
+	{"crc/iso14443a",				"ComputeCrc14443()",				CRC_BUF_LEN, setup_crc, bench_crc14443a},
+	{"crc/iso15693",				"Iso15693Crc()",					CRC_BUF_LEN, setup_crc, bench_crc15693},
+	{"crc/crc16_ccitt",				"crc16_ccitt()",					CRC_BUF_LEN, setup_crc, bench_crc16_ccitt},
+	{"crc/crc32",					"crc32()",							CRC_BUF_LEN, setup_crc, bench_crc32},
+	{"crc/crc64",					"crc64()",							CRC_BUF_LEN, setup_crc, bench_crc64},
+	{"crc/legic",					"CRC8Legic()",						CRC_BUF_LEN, setup_crc, bench_crc8_legic},
+	{"lfdemod/em410x",				"ASK/Manchester + EM410x",					0, setup_lf, bench_em410x},
+	{"lfdemod/hid",					"FSK2a + HID Prox",							0, setup_lf, bench_hid},
+	{"lfdemod/awid",				"FSK2 + AWID",								0, setup_lf, bench_awid},
+	{"lfdemod/ioprox",				"FSK2a + ioProx",							0, setup_lf, bench_ioprox},
+	{"lfdemod/indala",				"PSK1 + Indala 64",							0, setup_lf, bench_indala},
+	{"lfdemod/nrz",					"NRZ raw demod",							0, setup_lf, bench_nrz},
+	{"emv/tlv",						"parse 4 card responses, find 8 tags",		0, setup_emv, bench_tlv},
+	{NULL}
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void run_bench(const bench_t *b, int repeats, uint64_t min_ns, bench_result_t *r)
+{
+	memset(r, 0, sizeof(*r));
+	if (!b->setup()) {
+		r->skipped = true;
+		return;
+	}
+	r->ok = true;
+
+	// warm-up, which also finds the number of operations for one repeat
+	uint64_t ops = 1;
+	for (;;) {
+		uint64_t t = now_ns();
+		for (uint64_t i = 0; i < ops; i++)
+			r->ok &= b->op();
+		t = now_ns() - t;
+		if (t >= min_ns)
+			break;
+		uint64_t next = t ? ops * min_ns / t + 1 : ops * 100;
+		ops = next > ops * 100 ? ops * 100 : next;
+	}
+
+	double ns[MAX_REPEATS];
+	for (int k = 0; k < repeats; k++) {
+		uint64_t t = now_ns();
+		for (uint64_t i = 0; i < ops; i++)
+			r->ok &= b->op();
+		ns[k] = (double)(now_ns() - t) / ops;
+	}
+	qsort(ns, repeats, sizeof(ns[0]), cmp_double);
+	r->ops = ops;
+	r->ns_per_op = ns[repeats / 2];
+	r->best_ns_per_op = ns[0];
+}
+
+static bool selected(const char *name, int nfilters, char **filters)
+{
+	if (nfilters == 0)
+		return true;
+	for (int i = 0; i < nfilters; i++) {
+		if (strstr(name, filters[i]))
+			return true;
+	}
+	return false;
+}
+
+static void cpu_name(char *name, size_t size)
+{
+	snprintf(name, size, "unknown");
+	FILE *f = fopen("/proc/cpuinfo", "r");
+	if (f == NULL)
+		return;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		char *p = strchr(line, ':');
+		if (p && !strncmp(line, "model name", 10)) {
+			p += strspn(p, ": \t");
+			p[strcspn(p, "\r\n\"\\")] = '\0';
+			snprintf(name, size, "%s", p);
+			break;
+		}
+	}
+	fclose(f);
+}
+
+static bool write_json(const char *filename, int repeats, uint64_t min_ns, bench_result_t *results)
+{
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		fprintf(stderr, "cannot create %s\n", filename);
+		return false;
+	}
+	char cpu[128], date[32];
+	time_t now = time(NULL);
+	cpu_name(cpu, sizeof(cpu));
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	fprintf(f, "{\n\t\"version\": %d,\n\t\"date\": \"%s\",\n\t\"cpu\": \"%s\",\n", BENCH_VERSION, date, cpu);
+	fprintf(f, "\t\"repeats\": %d,\n\t\"min_time_ms\": %" PRIu64 ",\n\t\"results\": [", repeats, min_ns / 1000000);
+	bool first = true;
+	for (int i = 0; benchmarks[i].name != NULL; i++) {
+		bench_result_t *r = &results[i];
+		if (r->ops == 0 && !r->skipped)
+			continue;
+		fprintf(f, "%s\n\t\t{\"name\": \"%s\", ", first ? "" : ",", benchmarks[i].name);
+		first = false;
+		if (r->skipped) {
+			fprintf(f, "\"skipped\": true}");
+			continue;
+		}
+		fprintf(f, "\"ops_per_sec\": %.3f, \"ns_per_op\": %.1f, \"best_ns_per_op\": %.1f, \"ops_per_repeat\": %" PRIu64 ", ",
+			1e9 / r->ns_per_op, r->ns_per_op, r->best_ns_per_op, r->ops);
+		if (benchmarks[i].bytes)
+			fprintf(f, "\"mb_per_sec\": %.2f, ", benchmarks[i].bytes * 1e3 / r->ns_per_op);
+		fprintf(f, "\"ok\": %s}", r->ok ? "true" : "false");
+	}
+	fprintf(f, "\n\t]\n}\n");
+	fclose(f);
+	return true;
+}
+
+static void usage(void)
+{
+	printf("usage: bench [-r <repeats>] [-t <ms>] [-j <report.json>] [-d <repo>] [-l] [<filter> ...]\n");
+	printf("  -r  timed repeats per benchmark, the median is reported (default %d)\n", DEFAULT_REPEATS);
+	printf("  -t  minimum time of one repeat in ms (default %d)\n", DEFAULT_MIN_MS);
+	printf("  -j  also write the results as JSON\n");
+	printf("  -d  proxmark3 source directory with the data files (default %s)\n", root_dir);
+	printf("  -l  list the benchmarks\n");
+	printf("  filters select the benchmarks whose name contains one of them, e.g. 'crapto1' 'crc/'\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int repeats = DEFAULT_REPEATS;
+	uint64_t min_ns = DEFAULT_MIN_MS * 1000000ULL;
+	const char *jsonname = NULL;
+	int argi;
+
+	for (argi = 1; argi < argc && argv[argi][0] == '-'; argi++) {
+		const char *opt = argv[argi];
+		if (!strcmp(opt, "-l")) {
+			for (int i = 0; benchmarks[i].name != NULL; i++)
+				printf("%-28s %s\n", benchmarks[i].name, benchmarks[i].desc);
+			return 0;
+		}
+		if (argi + 1 >= argc || strlen(opt) != 2 || !strchr("rtjd", opt[1])) {
+			usage();
+			return 1;
+		}
+		const char *val = argv[++argi];
+		switch (opt[1]) {
+			case 'r':
+				repeats = atoi(val);
+				if (repeats < 1 || repeats > MAX_REPEATS) {
+					fprintf(stderr, "repeats must be 1..%d\n", MAX_REPEATS);
+					return 1;
+				}
+				break;
+			case 't':
+				min_ns = strtoull(val, NULL, 10) * 1000000ULL;
+				break;
+			case 'j':
+				jsonname = val;
+				break;
+			case 'd':
+				root_dir = val;
+				break;
+		}
+	}
+
+	int count = 0;
+	while (benchmarks[count].name != NULL)
+		count++;
+	bench_result_t *results = calloc(count, sizeof(bench_result_t));
+	int failed = 0, skipped = 0;
+
+	printf("%-28s %14s %14s %10s  %s\n", "benchmark", "ops/s", "ns/op", "MB/s", "result");
+	for (int i = 0; i < count; i++) {
+		const bench_t *b = &benchmarks[i];
+		if (!selected(b->name, argc - argi, argv + argi))
+			continue;
+		bench_result_t *r = &results[i];
+		run_bench(b, repeats, min_ns, r);
+		if (r->skipped) {
+			printf("%-28s %14s %14s %10s  skipped, no data\n", b->name, "-", "-", "-");
+			skipped++;
+			continue;
+		}
+		char mbs[16] = "-";
+		if (b->bytes)
+			snprintf(mbs, sizeof(mbs), "%.1f", b->bytes * 1e3 / r->ns_per_op);
+		printf("%-28s %14.1f %14.1f %10s  %s\n", b->name, 1e9 / r->ns_per_op, r->ns_per_op, mbs, r->ok ? "ok" : "WRONG RESULT");
+		fflush(stdout);
+		if (!r->ok)
+			failed++;
+	}
+
+	if (jsonname != NULL && !write_json(jsonname, repeats, min_ns, results))
+		failed++;
+	free(results);
+
+	if (failed || skipped)
+		printf("%d failed, %d skipped\n", failed, skipped);
+	return failed || skipped ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Client symbols the benchmarked sources need, without the client's UI
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include "ui.h"
+
+uint8_t g_debugMode = 0;
+
+// the benchmarks must not measure terminal output
+void PrintAndLog(char *fmt, ...)
+{
+	(void)fmt;
+}
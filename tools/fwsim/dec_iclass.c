@@ -0,0 +1,103 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// iClass OutOfNDecoding/ManchesterDecoding, fed like SnoopIClass() does
+//-----------------------------------------------------------------------------
+
+#include "iclass.c"
+
+#include "fwsim.h"
+
+#define ICLASS_BUFFER_SIZE 32
+
+static uint8_t readerToTagCmd[ICLASS_BUFFER_SIZE];
+static uint8_t tagToReaderResponse[ICLASS_BUFFER_SIZE];
+
+static struct {
+	int samples;
+	int div;
+	int decbyte;
+	int decbyter;
+	uint32_t time_start;
+	uint32_t time_stop;
+} snoop;
+
+static void snoopiclass_init(void)
+{
+	memset(&snoop, 0, sizeof(snoop));
+
+	memset(&Demod, 0, sizeof(Demod));
+	Demod.output = tagToReaderResponse;
+	Demod.state = DEMOD_UNSYNCD;
+
+	memset(&Uart, 0, sizeof(Uart));
+	Uart.output = readerToTagCmd;
+	Uart.byteCntMax = 32;
+	Uart.state = STATE_UNSYNCD;
+}
+
+// the body of the receive loop in SnoopIClass(), the SSP clock runs at 4 ticks per sample
+static void snoopiclass_feed(const uint8_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		int smpl = data[i];
+
+		snoop.samples++;
+		fwsim_ssp_clk = snoop.samples * 4;
+
+		if (smpl & 0xF) {
+			snoop.decbyte ^= (1 << (3 - snoop.div));
+		}
+
+		snoop.decbyter <<= 2;
+		snoop.decbyter ^= (smpl & 0x30);
+
+		snoop.div++;
+
+		if ((snoop.div + 1) % 2 == 0) {
+			smpl = snoop.decbyter;
+			if (OutOfNDecoding((smpl & 0xF0) >> 4)) {
+				rsamples = snoop.samples - Uart.samples;
+				snoop.time_stop = GetCountSspClk() << 4;
+				uint8_t parity[MAX_PARITY_SIZE];
+				GetParity(Uart.output, Uart.byteCnt, parity);
+				LogTrace(Uart.output, Uart.byteCnt, snoop.time_start, snoop.time_stop, parity, true);
+
+				Uart.state = STATE_UNSYNCD;
+				Demod.state = DEMOD_UNSYNCD;
+				Uart.byteCnt = 0;
+			} else {
+				snoop.time_start = GetCountSspClk() << 4;
+			}
+			snoop.decbyter = 0;
+		}
+
+		if (snoop.div > 3) {
+			smpl = snoop.decbyte;
+			if (ManchesterDecoding(smpl & 0x0F)) {
+				snoop.time_stop = GetCountSspClk() << 4;
+				rsamples = snoop.samples - Demod.samples;
+				uint8_t parity[MAX_PARITY_SIZE];
+				GetParity(Demod.output, Demod.len, parity);
+				LogTrace(Demod.output, Demod.len, snoop.time_start, snoop.time_stop, parity, false);
+
+				memset(&Demod, 0, sizeof(Demod));
+				Demod.output = tagToReaderResponse;
+				Demod.state = DEMOD_UNSYNCD;
+			} else {
+				snoop.time_start = GetCountSspClk() << 4;
+			}
+
+			snoop.div = 0;
+			snoop.decbyte = 0x00;
+		}
+	}
+}
+
+const fwsim_decoder_t fwsim_iclass[] = {
+	{"iclass", "iclass", 1, "iClass sniffer (OutOfNDecoding/ManchesterDecoding)",
+		snoopiclass_init, snoopiclass_feed, NULL},
+	{NULL}
+};
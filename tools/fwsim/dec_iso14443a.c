@@ -0,0 +1,144 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// ISO14443A Miller/Manchester decoders, fed like SnoopIso14443a() does
+//-----------------------------------------------------------------------------
+
+#include "iso14443a.c"
+
+#include "fwsim.h"
+
+static uint8_t receivedCmd[MAX_FRAME_SIZE];
+static uint8_t receivedCmdPar[MAX_PARITY_SIZE];
+static uint8_t receivedResponse[MAX_FRAME_SIZE];
+static uint8_t receivedResponsePar[MAX_PARITY_SIZE];
+
+static struct {
+	uint32_t rsamples;
+	uint8_t previous_data;
+	bool TagIsActive;
+	bool ReaderIsActive;
+} snoop;
+
+static void snoop14a_init(void)
+{
+	memset(&snoop, 0, sizeof(snoop));
+	DemodInit(receivedResponse, receivedResponsePar);
+	UartInit(receivedCmd, receivedCmdPar);
+}
+
+// the body of the receive loop in SnoopIso14443a(), untriggered
+static void snoop14a_feed(const uint8_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (snoop.rsamples & 0x01) {
+			if (!snoop.TagIsActive) {
+				uint8_t readerdata = (snoop.previous_data & 0xF0) | (data[i] >> 4);
+				if (MillerDecoding(readerdata, (snoop.rsamples-1)*4)) {
+					LogTrace(receivedCmd,
+							Uart.len,
+							Uart.startTime*16 - DELAY_READER_AIR2ARM_AS_SNIFFER,
+							Uart.endTime*16 - DELAY_READER_AIR2ARM_AS_SNIFFER,
+							Uart.parity,
+							true);
+					UartReset();
+					DemodReset();
+				}
+				snoop.ReaderIsActive = (Uart.state != STATE_UNSYNCD);
+			}
+
+			if (!snoop.ReaderIsActive) {
+				uint8_t tagdata = (snoop.previous_data << 4) | (data[i] & 0x0F);
+				if (ManchesterDecoding(tagdata, 0, (snoop.rsamples-1)*4)) {
+					LogTrace(receivedResponse,
+							Demod.len,
+							Demod.startTime*16 - DELAY_TAG_AIR2ARM_AS_SNIFFER,
+							Demod.endTime*16 - DELAY_TAG_AIR2ARM_AS_SNIFFER,
+							Demod.parity,
+							false);
+					DemodReset();
+					UartInit(receivedCmd, receivedCmdPar);
+				}
+				snoop.TagIsActive = (Demod.state != DEMOD_UNSYNCD);
+			}
+		}
+
+		snoop.previous_data = data[i];
+		snoop.rsamples++;
+	}
+}
+
+// Sniffer samples carry 4 ticks each: the reader signal in the high nibble
+// (0 = pause) and the tag load modulation in the low nibble (1 = modulated).
+// frame == NULL gives some idle samples.
+static size_t snoop14a_gen(uint8_t *out, size_t maxlen, const uint8_t *frame, uint16_t bits, bool reader)
+{
+	uint8_t par[MAX_PARITY_SIZE];
+	size_t n = 0;
+	int first;
+
+	if (frame == NULL) {
+		for ( ; n < 64 && n < maxlen; n++)
+			out[n] = 0xF0;
+		return n;
+	}
+
+	GetParity(frame, nbytes(bits), par);
+	if (reader) {
+		CodeIso14443aBitsAsReaderPar(frame, bits, (bits % 8) ? NULL : par);
+		first = 0;
+	} else {
+		CodeIso14443aAsTagPar(frame, bits / 8, par);
+		first = 1;				// skip the correction bit, it compensates a delay of the real FPGA
+	}
+
+	for (int i = first; i < ToSendMax && n + 2 <= maxlen; i++) {
+		if (reader) {
+			uint8_t b = ~ToSend[i];
+			out[n++] = (b & 0xF0) | 0x00;
+			out[n++] = (b << 4) | 0x00;
+		} else {
+			out[n++] = 0xF0 | (ToSend[i] >> 4);
+			out[n++] = 0xF0 | (ToSend[i] & 0x0F);
+		}
+	}
+	return n;
+}
+
+// 'fwsim test', same as fwsim_ref14a_step() in ref_iso14443a.c
+void fwsim_14a_init(void)
+{
+	memset(receivedCmd, 0, sizeof(receivedCmd));
+	memset(receivedCmdPar, 0, sizeof(receivedCmdPar));
+	memset(receivedResponse, 0, sizeof(receivedResponse));
+	memset(receivedResponsePar, 0, sizeof(receivedResponsePar));
+	UartInit(receivedCmd, receivedCmdPar);
+	DemodInit(receivedResponse, receivedResponsePar);
+}
+
+void fwsim_14a_step(uint8_t readerdata, uint8_t tagdata, uint16_t offset, uint32_t time, fwsim_14a_state_t *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->reader_frame = MillerDecoding(readerdata, time);
+	st->tag_frame = ManchesterDecoding(tagdata, offset, time);
+	memcpy(st->uart, &Uart, sizeof(Uart));
+	memcpy(st->demod, &Demod, sizeof(Demod));
+	((tUart *)st->uart)->output = ((tUart *)st->uart)->parity = NULL;
+	((tDemod *)st->demod)->output = ((tDemod *)st->demod)->parity = NULL;
+	memcpy(st->reader, receivedCmd, MAX_FRAME_SIZE);
+	memcpy(st->reader_par, receivedCmdPar, MAX_PARITY_SIZE);
+	memcpy(st->tag, receivedResponse, MAX_FRAME_SIZE);
+	memcpy(st->tag_par, receivedResponsePar, MAX_PARITY_SIZE);
+	if (st->reader_frame)
+		UartReset();
+	if (st->tag_frame)
+		DemodReset();
+}
+
+const fwsim_decoder_t fwsim_iso14443a[] = {
+	{"14a", "14a", 1, "ISO14443A sniffer (MillerDecoding/ManchesterDecoding)",
+		snoop14a_init, snoop14a_feed, snoop14a_gen},
+	{NULL}
+};
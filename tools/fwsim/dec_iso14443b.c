@@ -0,0 +1,117 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// ISO14443B Uart/Demod decoders, fed like the firmware receive loops do
+//-----------------------------------------------------------------------------
+
+#include "iso14443b.c"
+
+#include "fwsim.h"
+
+static uint8_t receivedCmd[MAX_FRAME_SIZE];
+static uint8_t receivedResponse[MAX_FRAME_SIZE];
+
+static struct {
+	int samples;
+	bool TagIsActive;
+	bool ReaderIsActive;
+	bool triggered;
+} snoop;
+
+static void snoop14b_init(void)
+{
+	memset(&snoop, 0, sizeof(snoop));
+	DemodInit(receivedResponse);
+	UartInit(receivedCmd);
+}
+
+// SSC samples are 16 bit words, I in the high and Q in the low byte
+static void sample_iq(const uint8_t *data, int8_t *ci, int8_t *cq)
+{
+	uint16_t w;
+	memcpy(&w, data, sizeof(w));
+	*ci = w >> 8;
+	*cq = w;
+}
+
+// the body of the receive loop in SnoopIso14443b()
+static void snoop14b_feed(const uint8_t *data, size_t count)
+{
+	uint8_t parity[MAX_PARITY_SIZE] = {0};
+
+	for (size_t i = 0; i < count; i++) {
+		int8_t ci, cq;
+		sample_iq(data + 2*i, &ci, &cq);
+
+		snoop.samples++;
+
+		if (!snoop.TagIsActive) {
+			if (Handle14443bUartBit(ci & 0x01)) {
+				snoop.triggered = true;
+				LogTrace(Uart.output, Uart.byteCnt, snoop.samples, snoop.samples, parity, true);
+				UartReset();
+				DemodReset();
+			}
+			if (Handle14443bUartBit(cq & 0x01)) {
+				snoop.triggered = true;
+				LogTrace(Uart.output, Uart.byteCnt, snoop.samples, snoop.samples, parity, true);
+				UartReset();
+				DemodReset();
+			}
+			snoop.ReaderIsActive = (Uart.state > STATE_GOT_FALLING_EDGE_OF_SOF);
+		}
+
+		if (!snoop.ReaderIsActive && snoop.triggered) {
+			if (Handle14443bSamplesDemod(ci/2, cq/2)) {
+				LogTrace(Demod.output, Demod.len, snoop.samples, snoop.samples, parity, false);
+				DemodReset();
+			}
+			snoop.TagIsActive = (Demod.state > DEMOD_GOT_FALLING_EDGE_OF_SOF);
+		}
+	}
+}
+
+// GetIso14443bCommandFromReader(), simulated tag: one bit per SSC bit, MSB first
+static void reader14b_feed(const uint8_t *data, size_t count)
+{
+	uint8_t parity[MAX_PARITY_SIZE] = {0};
+
+	for (size_t i = 0; i < count; i++) {
+		snoop.samples++;
+		for (uint8_t mask = 0x80; mask != 0x00; mask >>= 1) {
+			if (Handle14443bUartBit(data[i] & mask)) {
+				LogTrace(Uart.output, Uart.byteCnt, snoop.samples, snoop.samples, parity, true);
+				UartReset();
+			}
+		}
+	}
+}
+
+// GetSamplesFor14443bDemod(), reader receiving the tag answer
+static void tag14b_feed(const uint8_t *data, size_t count)
+{
+	uint8_t parity[MAX_PARITY_SIZE] = {0};
+
+	for (size_t i = 0; i < count; i++) {
+		int8_t ci, cq;
+		sample_iq(data + 2*i, &ci, &cq);
+
+		snoop.samples++;
+		if (Handle14443bSamplesDemod(ci, cq)) {
+			LogTrace(Demod.output, Demod.len, snoop.samples, snoop.samples, parity, false);
+			DemodReset();
+		}
+	}
+}
+
+const fwsim_decoder_t fwsim_iso14443b[] = {
+	{"14b", "14b", 2, "ISO14443B sniffer (Handle14443bUartBit/Handle14443bSamplesDemod)",
+		snoop14b_init, snoop14b_feed, NULL},
+	{"14b-reader", "14b", 1, "ISO14443B commands received as tag (Handle14443bUartBit)",
+		snoop14b_init, reader14b_feed, NULL},
+	{"14b-tag", "14b", 2, "ISO14443B answers received as reader (Handle14443bSamplesDemod)",
+		snoop14b_init, tag14b_feed, NULL},
+	{NULL}
+};
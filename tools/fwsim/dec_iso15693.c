@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// ISO15693 tag and reader decoders, fed like the firmware receive loops do
+//-----------------------------------------------------------------------------
+
+#include "iso15693.c"
+
+#include "fwsim.h"
+
+static uint8_t received[ISO15693_MAX_COMMAND_LENGTH];
+static uint8_t response[ISO15693_MAX_RESPONSE_LENGTH];
+
+static DecodeTag_t DecodeTag;
+static DecodeReader_t DecodeReader;
+static int samples;
+
+static void tag15_init(void)
+{
+	samples = 0;
+	memset(&DecodeTag, 0, sizeof(DecodeTag));
+	DecodeTagInit(&DecodeTag, response);
+}
+
+// GetIso15693AnswerFromTag(): 16 bit SSC words, I in the high and Q in the low byte
+static void tag15_feed(const uint8_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		uint16_t w;
+		memcpy(&w, data + 2*i, sizeof(w));
+		int8_t ci = (int8_t)(w >> 8);
+		int8_t cq = (int8_t)(w & 0xff);
+
+		samples++;
+		if (Handle15693SamplesFromTag(ci, cq, &DecodeTag)) {
+			LogTrace(DecodeTag.output, DecodeTag.len, samples, samples, NULL, false);
+			DecodeTagInit(&DecodeTag, response);
+		}
+	}
+}
+
+static void reader15_init(void)
+{
+	samples = 0;
+	memset(&DecodeReader, 0, sizeof(DecodeReader));
+	DecodeReaderInit(received, sizeof(received), &DecodeReader);
+}
+
+// GetIso15693CommandFromReader(): one bit per SSC bit, MSB first
+static void reader15_feed(const uint8_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		for (int j = 7; j >= 0; j--) {
+			if (Handle15693SampleFromReader((data[i] >> j) & 0x01, &DecodeReader)) {
+				LogTrace(DecodeReader.output, DecodeReader.byteCount, samples, samples, NULL, true);
+				DecodeReaderInit(received, sizeof(received), &DecodeReader);
+			}
+			samples++;
+		}
+	}
+}
+
+const fwsim_decoder_t fwsim_iso15693[] = {
+	{"15-tag", "15", 2, "ISO15693 answers received as reader (Handle15693SamplesFromTag)",
+		tag15_init, tag15_feed, NULL},
+	{"15-reader", "15", 1, "ISO15693 commands received as tag (Handle15693SampleFromReader)",
+		reader15_init, reader15_feed, NULL},
+	{NULL}
+};
@@ -0,0 +1,434 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// fwsim - run the firmware HF protocol decoders on the host
+//
+// Replays recorded FPGA sample streams through the unmodified decoders in
+// armsrc/ and writes the decoded frames as a trace file for 'hf list', or
+// measures the time the decoders need per sample.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+#include "fwsim.h"
+#include "BigBuf.h"
+
+#define FEED_CHUNK		1024		// samples per call, trace buffer is emptied in between
+#define BENCH_DEFAULT	(4*1024*1024)
+#define BENCH_MIN_NS	1000000000ULL
+
+static const fwsim_decoder_t *all_decoders[] = {
+	fwsim_iso14443a,
+	fwsim_iclass,
+	fwsim_iso14443b,
+	fwsim_iso15693,
+	NULL
+};
+
+static const fwsim_decoder_t *find_decoder(const char *name)
+{
+	for (int i = 0; all_decoders[i] != NULL; i++) {
+		for (const fwsim_decoder_t *d = all_decoders[i]; d->name != NULL; d++) {
+			if (!strcmp(d->name, name))
+				return d;
+		}
+	}
+	fprintf(stderr, "unknown decoder '%s', see 'fwsim list'\n", name);
+	return NULL;
+}
+
+static uint8_t *load_file(const char *filename, size_t *len)
+{
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "cannot open %s\n", filename);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *buf = malloc(size > 0 ? size : 1);
+	if (buf == NULL || fread(buf, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "cannot read %s\n", filename);
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	*len = size;
+	return buf;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void reset_decoder(const fwsim_decoder_t *d)
+{
+	fwsim_ssp_clk = 0;
+	BigBuf_free();
+	clear_trace();
+	set_tracing(true);
+	d->init();
+}
+
+// feed all samples, collect the trace. Returns the number of frames.
+static size_t run_decoder(const fwsim_decoder_t *d, const uint8_t *samples, size_t count, uint8_t **trace, size_t *tracelen)
+{
+	size_t frames = 0;
+
+	for (size_t i = 0; i < count; i += FEED_CHUNK) {
+		size_t n = count - i < FEED_CHUNK ? count - i : FEED_CHUNK;
+		d->feed(samples + i * d->sample_size, n);
+
+		uint16_t len = BigBuf_get_traceLen();
+		if (len == 0)
+			continue;
+		uint8_t *tb = BigBuf_get_addr();
+		for (size_t pos = 0; pos + 8 <= len; frames++) {
+			uint16_t flen = (tb[pos+6] | (tb[pos+7] << 8)) & 0x7fff;
+			pos += 8 + flen + (flen - 1) / 8 + 1;
+		}
+		if (trace != NULL) {
+			*trace = realloc(*trace, *tracelen + len);
+			memcpy(*trace + *tracelen, tb, len);
+			*tracelen += len;
+		}
+		clear_trace();
+		set_tracing(true);
+	}
+	return frames;
+}
+
+static void print_trace(const uint8_t *trace, size_t len)
+{
+	printf("      Start |        End | Src | Data\n");
+	printf("------------|------------|-----|------------------------------------\n");
+	for (size_t pos = 0; pos + 8 <= len; ) {
+		const uint8_t *r = trace + pos;
+		uint32_t start = r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24);
+		uint16_t duration = r[4] | (r[5] << 8);
+		uint16_t flen = r[6] | (r[7] << 8);
+		bool response = flen & 0x8000;
+		flen &= 0x7fff;
+		printf(" %10u | %10u | %s |", start, start + duration, response ? "Tag" : "Rdr");
+		for (int i = 0; i < flen; i++)
+			printf(" %02x", r[8 + i]);
+		printf("\n");
+		pos += 8 + flen + (flen - 1) / 8 + 1;
+	}
+}
+
+static int cmd_list(void)
+{
+	printf("%-12s %-6s %-7s %s\n", "decoder", "hf list", "sample", "description");
+	for (int i = 0; all_decoders[i] != NULL; i++) {
+		for (const fwsim_decoder_t *d = all_decoders[i]; d->name != NULL; d++) {
+			printf("%-12s %-6s %zu byte  %s%s\n", d->name, d->list_proto, d->sample_size, d->desc,
+			       d->gen != NULL ? " [gen]" : "");
+		}
+	}
+	return 0;
+}
+
+static int cmd_replay(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: fwsim replay <decoder> <samples> [<trace.trc>]\n");
+		return 1;
+	}
+	const fwsim_decoder_t *d = find_decoder(argv[0]);
+	if (d == NULL)
+		return 1;
+
+	size_t len;
+	uint8_t *samples = load_file(argv[1], &len);
+	if (samples == NULL)
+		return 1;
+
+	uint8_t *trace = NULL;
+	size_t tracelen = 0;
+	reset_decoder(d);
+	size_t frames = run_decoder(d, samples, len / d->sample_size, &trace, &tracelen);
+
+	print_trace(trace, tracelen);
+	printf("%zu samples, %zu frames\n", len / d->sample_size, frames);
+
+	int res = 0;
+	if (argc > 2) {
+		FILE *f = fopen(argv[2], "wb");
+		if (f == NULL || fwrite(trace, 1, tracelen, f) != tracelen) {
+			fprintf(stderr, "cannot write %s\n", argv[2]);
+			res = 1;
+		} else {
+			printf("trace saved to %s, view with 'hf list %s l %s'\n", argv[2], d->list_proto, argv[2]);
+		}
+		if (f != NULL)
+			fclose(f);
+	}
+	free(trace);
+	free(samples);
+	return res;
+}
+
+static int cmd_bench(int argc, char *argv[])
+{
+	if (argc < 1) {
+		fprintf(stderr, "usage: fwsim bench <decoder|all> [<samples>]\n");
+		return 1;
+	}
+
+	uint8_t *samples = NULL;
+	size_t len = BENCH_DEFAULT * 2;
+	if (argc > 1) {
+		samples = load_file(argv[1], &len);
+		if (samples == NULL)
+			return 1;
+	} else {
+		// noise, the decoders mostly search for a start of frame
+		samples = malloc(len);
+		uint32_t x = 0x12345678;
+		for (size_t i = 0; i < len; i++) {
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			samples[i] = x;
+		}
+	}
+
+	printf("%-12s %12s %10s %12s %8s\n", "decoder", "samples", "ns/sample", "cycles/sample", "frames");
+	for (int i = 0; all_decoders[i] != NULL; i++) {
+		for (const fwsim_decoder_t *d = all_decoders[i]; d->name != NULL; d++) {
+			if (strcmp(argv[0], "all") && strcmp(argv[0], d->name))
+				continue;
+
+			size_t count = len / d->sample_size;
+			if (count == 0)
+				continue;
+			uint64_t total = 0, ns = 0, cycles = 0;
+			size_t frames = 0;
+			do {
+				reset_decoder(d);
+				uint64_t t0 = now_ns();
+#ifdef HAVE_RDTSC
+				uint64_t c0 = __rdtsc();
+#endif
+				frames = run_decoder(d, samples, count, NULL, NULL);
+#ifdef HAVE_RDTSC
+				cycles += __rdtsc() - c0;
+#endif
+				ns += now_ns() - t0;
+				total += count;
+			} while (ns < BENCH_MIN_NS);
+
+			printf("%-12s %12zu %10.2f %12.2f %8zu\n", d->name, count, (double)ns / total,
+			       (double)cycles / total, frames);
+		}
+	}
+	free(samples);
+	return 0;
+}
+
+static int parse_hex(const char *s, uint8_t *out, size_t maxlen)
+{
+	size_t n = 0;
+	while (s[0] && s[1] && n < maxlen) {
+		unsigned int b;
+		if (sscanf(s, "%2x", &b) != 1)
+			return -1;
+		out[n++] = b;
+		s += 2;
+	}
+	return *s ? -1 : (int)n;
+}
+
+// frames are given as r:<hex>[/<bits>] (reader) or t:<hex> (tag)
+static int cmd_gen(int argc, char *argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: fwsim gen <decoder> <samples> r:<hex>[/<bits>]|t:<hex> ...\n");
+		return 1;
+	}
+	const fwsim_decoder_t *d = find_decoder(argv[0]);
+	if (d == NULL)
+		return 1;
+	if (d->gen == NULL) {
+		fprintf(stderr, "decoder %s can't generate samples\n", d->name);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "wb");
+	if (f == NULL) {
+		fprintf(stderr, "cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	uint8_t buf[32 * MAX_FRAME_SIZE];
+	size_t total = d->gen(buf, sizeof(buf), NULL, 0, true);		// start with silence
+	fwrite(buf, 1, total, f);
+	for (int i = 2; i < argc; i++) {
+		uint8_t frame[MAX_FRAME_SIZE];
+		bool reader = (argv[i][0] == 'r');
+		char hex[2 * MAX_FRAME_SIZE + 1];
+		int bits = 0;
+		if ((argv[i][0] != 'r' && argv[i][0] != 't') || argv[i][1] != ':'
+		    || sscanf(argv[i] + 2, "%512[0-9a-fA-F]/%d", hex, &bits) < 1) {
+			fprintf(stderr, "invalid frame '%s'\n", argv[i]);
+			fclose(f);
+			return 1;
+		}
+		int flen = parse_hex(hex, frame, sizeof(frame));
+		if (flen <= 0) {
+			fprintf(stderr, "invalid frame '%s'\n", argv[i]);
+			fclose(f);
+			return 1;
+		}
+		if (bits == 0 || bits > flen * 8)
+			bits = flen * 8;
+
+		size_t n = d->gen(buf, sizeof(buf), frame, bits, reader);
+		fwrite(buf, 1, n, f);
+		total += n;
+		// some silence between the frames
+		n = d->gen(buf, sizeof(buf), NULL, 0, reader);
+		fwrite(buf, 1, n, f);
+		total += n;
+	}
+	fclose(f);
+	printf("%zu samples written to %s\n", total / d->sample_size, argv[1]);
+	return 0;
+}
+
+// Compare the ISO14443A decoders with the copy of the old ones in ref_iso14443a.c,
+// sample by sample: return values, decoder state and the frame buffers. The input
+// are random reader and tag frames with some bit errors, followed by noise, in
+// both sample alignments of the sniffer.
+#define TEST_FRAMES		300
+static uint32_t test_rnd_state = 1;
+
+static uint32_t test_rnd(void)
+{
+	uint32_t x = test_rnd_state;
+	x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+	return test_rnd_state = x;
+}
+
+// a random byte, each bit set with a probability of p1 percent
+static uint8_t test_biased(int p1)
+{
+	uint8_t b = 0;
+	for (int i = 0; i < 8; i++)
+		if ((int)(test_rnd() % 100) < p1)
+			b |= 1 << i;
+	return b;
+}
+
+static int cmd_test(void)
+{
+	const fwsim_decoder_t *d = &fwsim_iso14443a[0];
+	size_t maxlen = TEST_FRAMES * 32 * 20, len;
+	uint8_t *samples = malloc(maxlen);
+	if (samples == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	len = d->gen(samples, maxlen, NULL, 0, true);
+	for (int i = 0; i < TEST_FRAMES; i++) {
+		uint8_t frame[18];
+		bool reader = test_rnd() & 1;
+		int bytes = 1 + test_rnd() % sizeof(frame);
+		uint16_t bits = bytes * 8;
+		for (int j = 0; j < bytes; j++)
+			frame[j] = test_rnd();
+		if (reader && bytes == 1)
+			bits = 7;			// short frame, REQA/WUPA
+		len += d->gen(samples + len, maxlen - len, frame, bits, reader);
+		len += d->gen(samples + len, maxlen - len, NULL, 0, reader);
+	}
+
+	static const int flip_rates[] = {0, 1, 10, 100};	// bit flips per mille
+	fwsim_14a_state_t *ref = malloc(sizeof(*ref)), *cur = malloc(sizeof(*cur));
+	int res = 0;
+	for (int r = 0; r < sizeof(flip_rates) / sizeof(flip_rates[0]) && res == 0; r++) {
+		long frames[2] = {0, 0};
+		uint8_t prev = 0;
+		fwsim_ref14a_init();
+		fwsim_14a_init();
+		for (int pass = 0; pass < 4 && res == 0; pass++) {
+			for (size_t i = 0; i < len; i++) {
+				uint8_t c = samples[i];
+				if (pass >= 2)
+					c = (test_biased(92) & 0xF0) | (test_biased(8) & 0x0F);
+				for (int b = 0; b < 8; b++)
+					if ((int)(test_rnd() % 1000) < flip_rates[r])
+						c ^= 1 << b;
+				// as the sniffer loop: the reader decoder gets the last two reader nibbles,
+				// the tag decoder the last two tag nibbles
+				uint8_t readerdata = (prev & 0xF0) | (c >> 4);
+				uint8_t tagdata = (prev << 4) | (c & 0x0F);
+				prev = c;
+				if ((i & 1) != (pass & 1))
+					continue;
+				uint16_t offset = test_rnd() % 8;
+				fwsim_ref14a_step(readerdata, tagdata, offset, i * 4 + 1, ref);
+				fwsim_14a_step(readerdata, tagdata, offset, i * 4 + 1, cur);
+				if (memcmp(ref, cur, sizeof(*ref))) {
+					printf("14a: mismatch at %d per mille bit errors, pass %d, sample %zu\n", flip_rates[r], pass, i);
+					res = 1;
+					break;
+				}
+				frames[0] += ref->reader_frame;
+				frames[1] += ref->tag_frame != 0;
+			}
+		}
+		if (res == 0)
+			printf("14a: %3d per mille bit errors: identical, %ld reader / %ld tag frames\n", flip_rates[r], frames[0], frames[1]);
+	}
+	free(cur);
+	free(ref);
+	free(samples);
+	return res;
+}
+
+static void usage(void)
+{
+	printf("fwsim - run the firmware HF decoders on recorded samples\n\n");
+	printf("  fwsim list                                   list the decoders\n");
+	printf("  fwsim replay <decoder> <samples> [<trc>]     decode samples, optionally save a trace\n");
+	printf("  fwsim bench <decoder|all> [<samples>]        time per sample (noise if no samples given)\n");
+	printf("  fwsim gen <decoder> <samples> <frame> ...    encode frames, r:<hex>[/<bits>] or t:<hex>\n");
+	printf("  fwsim test                                   compare the 14a decoders with the old ones\n");
+	printf("\nSamples are the raw DMA buffer contents the firmware receive loop reads.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "list"))
+		return cmd_list();
+	if (!strcmp(argv[1], "replay"))
+		return cmd_replay(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "bench"))
+		return cmd_bench(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "gen"))
+		return cmd_gen(argc - 2, argv + 2);
+	if (!strcmp(argv[1], "test"))
+		return cmd_test();
+
+	usage();
+	return 1;
+}
@@ -0,0 +1,57 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Host side simulation of the firmware protocol decoders
+//-----------------------------------------------------------------------------
+
+#ifndef FWSIM_H__
+#define FWSIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// One replay mode. feed() runs the decoder(s) over raw samples exactly as the
+// firmware receive loop does with the DMA buffer and logs every decoded frame
+// with LogTrace(). The decoder state persists between calls.
+typedef struct {
+	const char *name;
+	const char *list_proto;		// for 'hf list <proto> l <file>'
+	size_t sample_size;			// bytes per DMA sample
+	const char *desc;
+	void (*init)(void);
+	void (*feed)(const uint8_t *samples, size_t count);
+	// optional: sample stream for the given frames, NULL if not supported
+	size_t (*gen)(uint8_t *out, size_t maxlen, const uint8_t *frame, uint16_t bits, bool reader);
+} fwsim_decoder_t;
+
+extern const fwsim_decoder_t fwsim_iso14443a[];
+extern const fwsim_decoder_t fwsim_iclass[];
+extern const fwsim_decoder_t fwsim_iso14443b[];
+extern const fwsim_decoder_t fwsim_iso15693[];
+
+// the simulated SSP clock returned by GetCountSspClk()
+extern uint32_t fwsim_ssp_clk;
+
+// 'fwsim test': ISO14443A decoder state after one sniffer sample, the decoder
+// structs with their buffer pointers cleared and the contents of the buffers
+typedef struct {
+	bool reader_frame;
+	int tag_frame;
+	uint8_t uart[64];
+	uint8_t demod[64];
+	uint8_t reader[256];
+	uint8_t reader_par[32];
+	uint8_t tag[256];
+	uint8_t tag_par[32];
+} fwsim_14a_state_t;
+
+// the firmware decoders (dec_iso14443a.c) and the reference copy (ref_iso14443a.c)
+extern void fwsim_14a_init(void);
+extern void fwsim_14a_step(uint8_t readerdata, uint8_t tagdata, uint16_t offset, uint32_t time, fwsim_14a_state_t *st);
+extern void fwsim_ref14a_init(void);
+extern void fwsim_ref14a_step(uint8_t readerdata, uint8_t tagdata, uint16_t offset, uint32_t time, fwsim_14a_state_t *st);
+
+#endif
@@ -0,0 +1,155 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Host replacements for the firmware functions the protocol decoders link
+// against. Everything that talks to the hardware is a no-op, time comes from
+// the simulated SSP clock.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "proxmark3.h"
+#include "apps.h"
+#include "util.h"
+#include "cmd.h"
+#include "fpgaloader.h"
+#include "mifareutil.h"
+#include "mifaresniff.h"
+#include "usb_cdc.h"
+#include "fwsim.h"
+
+uint32_t fwsim_ssp_clk = 0;
+
+int MF_DBGLEVEL = MF_DBG_NONE;
+
+//-----------------------------------------------------------------------------
+// ToSend buffer, same as in appmain.c
+//-----------------------------------------------------------------------------
+#define TOSEND_BUFFER_SIZE (9*MAX_FRAME_SIZE + 1 + 1 + 2)
+uint8_t ToSend[TOSEND_BUFFER_SIZE];
+int ToSendMax;
+static int ToSendBit;
+
+void ToSendReset(void)
+{
+	ToSendMax = -1;
+	ToSendBit = 8;
+}
+
+void ToSendStuffBit(int b)
+{
+	if(ToSendBit >= 8) {
+		ToSendMax++;
+		ToSend[ToSendMax] = 0;
+		ToSendBit = 0;
+	}
+
+	if(b) {
+		ToSend[ToSendMax] |= (1 << (7 - ToSendBit));
+	}
+
+	ToSendBit++;
+
+	if(ToSendMax >= sizeof(ToSend)) {
+		ToSendBit = 0;
+		DbpString("ToSendStuffBit overflowed!");
+	}
+}
+
+//-----------------------------------------------------------------------------
+// debug output goes to stderr
+//-----------------------------------------------------------------------------
+void DbpString(char *str)
+{
+	fprintf(stderr, "fw: %s\n", str);
+}
+
+void Dbprintf(const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "fw: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+}
+
+void Dbhexdump(int len, uint8_t *d, bool bAsci)
+{
+	fprintf(stderr, "fw:");
+	for (int i = 0; i < len; i++)
+		fprintf(stderr, " %02x", d[i]);
+	fprintf(stderr, "\n");
+}
+
+//-----------------------------------------------------------------------------
+// util.c
+//-----------------------------------------------------------------------------
+size_t nbytes(size_t nbits) {
+	return (nbits >> 3)+((nbits % 8) > 0);
+}
+
+uint32_t SwapBits(uint32_t value, int nrbits) {
+	int i;
+	uint32_t newvalue = 0;
+	for(i = 0; i < nrbits; i++) {
+		newvalue ^= ((value >> i) & 1) << (nrbits - 1 - i);
+	}
+	return newvalue;
+}
+
+void num_to_bytes(uint64_t n, size_t len, uint8_t* dest)
+{
+	while (len--) {
+		dest[len] = (uint8_t) n;
+		n >>= 8;
+	}
+}
+
+uint64_t bytes_to_num(uint8_t* src, size_t len)
+{
+	uint64_t num = 0;
+	while (len--)
+	{
+		num = (num << 8) | (*src);
+		src++;
+	}
+	return num;
+}
+
+void LEDsoff() {}
+void SpinDelay(int ms) {}
+void StartCountSspClk() { fwsim_ssp_clk = 0; }
+uint32_t RAMFUNC GetCountSspClk() { return fwsim_ssp_clk; }
+uint32_t RAMFUNC GetTickCount() { return fwsim_ssp_clk / 847; }		// SSP clock is 847.5kHz in most HF modes
+
+//-----------------------------------------------------------------------------
+// hardware
+//-----------------------------------------------------------------------------
+void FpgaDownloadAndGo(int bitstream_version) {}
+void FpgaWriteConfWord(uint8_t v) {}
+void FpgaSetupSsc(uint8_t mode) {}
+bool FpgaSetupSscDma(uint8_t *buf, uint16_t sample_count) { return true; }
+void SetAdcMuxFor(uint32_t whichGpio) {}
+bool usb_poll_validate_length() { return false; }
+void OnError(uint8_t reason) {}
+
+bool cmd_send(uint32_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* data, size_t len)
+{
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Mifare, only reached from the reader and sniffer main loops
+//-----------------------------------------------------------------------------
+int mifare_sendcmd_short(struct Crypto1State *pcs, uint8_t crypted, uint8_t cmd, uint8_t data, uint8_t* answer, uint8_t *answer_parity, uint32_t *timing)
+{
+	return 0;
+}
+
+bool MfSniffInit(void) { return false; }
+bool MfSniffEnd(void) { return false; }
+bool RAMFUNC MfSniffLogic(const uint8_t *data, uint16_t len, uint8_t *parity, uint16_t bitCnt, bool reader) { return false; }
+bool RAMFUNC MfSniffSend(uint16_t maxTimeoutMs) { return false; }
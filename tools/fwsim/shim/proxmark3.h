@@ -0,0 +1,27 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Host build of the firmware: the real proxmark3.h, minus the register
+// accesses which the protocol decoders do inline (LEDs, watchdog, button).
+//-----------------------------------------------------------------------------
+
+#ifndef FWSIM_PROXMARK3_H__
+#define FWSIM_PROXMARK3_H__
+
+#include_next "proxmark3.h"
+
+#undef WDT_HIT
+#undef LOW
+#undef HIGH
+#undef GETBIT
+#undef BUTTON_PRESS
+
+#define WDT_HIT()			((void)0)
+#define LOW(x)				((void)(x))
+#define HIGH(x)				((void)(x))
+#define GETBIT(x)			0
+#define BUTTON_PRESS()		false
+
+#endif